@@ -77,6 +77,8 @@ function(lcms2_add_plugins)
         "${PROJECT_SOURCE_DIR}/plugins/threaded/src/threaded_core.c"
         "${PROJECT_SOURCE_DIR}/plugins/threaded/src/threaded_main.c"
         "${PROJECT_SOURCE_DIR}/plugins/threaded/src/threaded_scheduler.c"
+        "${PROJECT_SOURCE_DIR}/plugins/threaded/src/threaded_async.c"
+        "${PROJECT_SOURCE_DIR}/plugins/threaded/src/threaded_pool.c"
         "${PROJECT_SOURCE_DIR}/plugins/threaded/src/threaded_internal.h"
       INCLUDE_DIRS
         "${PROJECT_SOURCE_DIR}/plugins/threaded/include"
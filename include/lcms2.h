@@ -65,6 +65,9 @@
 // Uncomment to get rid of pthreads/windows dependency
 // #define CMS_NO_PTHREADS  1
 
+// Uncomment to read files into memory instead of mapping them on cmsOpenProfileFromMappedFile
+// #define CMS_NO_MMAP  1
+
 // Uncomment this for special windows mutex initialization (see lcms2_internal.h)
 // #define CMS_RELY_ON_WINDOWS_STATIC_MUTEX_INIT
 
@@ -1115,6 +1118,29 @@ CMSAPI void             CMSEXPORT cmsDeleteContext(cmsContext ContextID);
 CMSAPI cmsContext       CMSEXPORT cmsDupContext(cmsContext ContextID, void* NewUserData);
 CMSAPI void*            CMSEXPORT cmsGetContextUserData(cmsContext ContextID);
 
+// Memory accounting  ----------------------------------------------------------------------------------------------------
+
+// Kinds of objects memory is broken down into. Tags are counted as the objects they decode to
+#define cmsMEMORY_OTHER      0
+#define cmsMEMORY_CLUT       1
+#define cmsMEMORY_CURVE      2
+#define cmsMEMORY_PIPELINE   3
+#define cmsMEMORY_PROFILE    4
+#define cmsMEMORY_TRANSFORM  5
+#define cmsMEMORY_KINDS      6
+
+typedef struct {
+
+    size_t CurrentBytes;
+    size_t PeakBytes;
+    size_t Allocations;                 // Blocks allocated since accounting started
+    size_t Bytes[cmsMEMORY_KINDS];      // Current bytes, by kind of object
+
+} cmsMemoryStats;
+
+CMSAPI cmsBool          CMSEXPORT cmsEnableMemoryStats(cmsContext ContextID);
+CMSAPI cmsBool          CMSEXPORT cmsGetMemoryStats(cmsContext ContextID, cmsMemoryStats* Stats);
+
 // Plug-In registering  --------------------------------------------------------------------------------------------------
 
 CMSAPI cmsBool           CMSEXPORT cmsPlugin(void* Plugin);
@@ -1292,6 +1318,10 @@ CMSAPI cmsStage*         CMSEXPORT cmsPipelineGetPtrToLastStage(const cmsPipelin
 
 CMSAPI void              CMSEXPORT cmsPipelineEval16(const cmsUInt16Number In[], cmsUInt16Number Out[], const cmsPipeline* lut);
 CMSAPI void              CMSEXPORT cmsPipelineEvalFloat(const cmsFloat32Number In[], cmsFloat32Number Out[], const cmsPipeline* lut);
+
+// Evaluate nPixels at once. In and Out are arrays of interleaved pixels of InputChannels and OutputChannels each
+CMSAPI void              CMSEXPORT cmsPipelineEval16Batch(const cmsUInt16Number In[], cmsUInt16Number Out[], cmsUInt32Number nPixels, const cmsPipeline* lut);
+CMSAPI void              CMSEXPORT cmsPipelineEvalFloatBatch(const cmsFloat32Number In[], cmsFloat32Number Out[], cmsUInt32Number nPixels, const cmsPipeline* lut);
 CMSAPI cmsBool           CMSEXPORT cmsPipelineEvalReverseFloat(cmsFloat32Number Target[], cmsFloat32Number Result[], cmsFloat32Number Hint[], const cmsPipeline* lut);
 CMSAPI cmsBool           CMSEXPORT cmsPipelineCat(cmsPipeline* l1, const cmsPipeline* l2);
 CMSAPI cmsBool           CMSEXPORT cmsPipelineSetSaveAs8bitsFlag(cmsPipeline* lut, cmsBool On);
@@ -1343,6 +1373,10 @@ typedef cmsInt32Number (* cmsSAMPLERFLOAT)(CMSREGISTER const cmsFloat32Number In
 // Use this flag to prevent changes being written to destination
 #define SAMPLER_INSPECT     0x01000000
 
+// The sampler is reentrant and nodes are independent, so they may be sampled concurrently through
+// the parallelization plug-in. Results are the same as sampling them in order.
+#define SAMPLER_PARALLEL    0x02000000
+
 // For CLUT only
 CMSAPI cmsBool           CMSEXPORT cmsStageSampleCLut16bit(cmsStage* mpe, cmsSAMPLER16 Sampler, void* Cargo, cmsUInt32Number dwFlags);
 CMSAPI cmsBool           CMSEXPORT cmsStageSampleCLutFloat(cmsStage* mpe, cmsSAMPLERFLOAT Sampler, void* Cargo, cmsUInt32Number dwFlags);
@@ -1532,6 +1566,7 @@ CMSAPI void*             CMSEXPORT cmsReadTag(cmsHPROFILE hProfile, cmsTagSignat
 CMSAPI cmsBool           CMSEXPORT cmsWriteTag(cmsHPROFILE hProfile, cmsTagSignature sig, const void* data);
 CMSAPI cmsBool           CMSEXPORT cmsLinkTag(cmsHPROFILE hProfile, cmsTagSignature sig, cmsTagSignature dest);
 CMSAPI cmsTagSignature   CMSEXPORT cmsTagLinkedTo(cmsHPROFILE hProfile, cmsTagSignature sig);
+CMSAPI cmsBool           CMSEXPORT cmsReadAllTags(cmsHPROFILE hProfile);
 
 // Read and write raw data
 CMSAPI cmsUInt32Number   CMSEXPORT cmsReadRawTag(cmsHPROFILE hProfile, cmsTagSignature sig, void* Buffer, cmsUInt32Number BufferSize);
@@ -1627,6 +1662,8 @@ typedef struct _cms_io_handler cmsIOHANDLER;
 CMSAPI cmsIOHANDLER*     CMSEXPORT cmsOpenIOhandlerFromFile(cmsContext ContextID, const char* FileName, const char* AccessMode);
 CMSAPI cmsIOHANDLER*     CMSEXPORT cmsOpenIOhandlerFromStream(cmsContext ContextID, FILE* Stream);
 CMSAPI cmsIOHANDLER*     CMSEXPORT cmsOpenIOhandlerFromMem(cmsContext ContextID, void *Buffer, cmsUInt32Number size, const char* AccessMode);
+CMSAPI cmsIOHANDLER*     CMSEXPORT cmsOpenIOhandlerFromBorrowedMem(cmsContext ContextID, const void *Buffer, cmsUInt32Number size);
+CMSAPI cmsIOHANDLER*     CMSEXPORT cmsOpenIOhandlerFromMappedFile(cmsContext ContextID, const char* FileName);
 CMSAPI cmsIOHANDLER*     CMSEXPORT cmsOpenIOhandlerFromNULL(cmsContext ContextID);
 CMSAPI cmsIOHANDLER*     CMSEXPORT cmsGetProfileIOhandler(cmsHPROFILE hProfile);
 CMSAPI cmsBool           CMSEXPORT cmsCloseIOhandler(cmsIOHANDLER* io);
@@ -1643,6 +1680,12 @@ CMSAPI cmsHPROFILE      CMSEXPORT cmsOpenProfileFromStream(FILE* ICCProfile, con
 CMSAPI cmsHPROFILE      CMSEXPORT cmsOpenProfileFromStreamTHR(cmsContext ContextID, FILE* ICCProfile, const char* sAccess);
 CMSAPI cmsHPROFILE      CMSEXPORT cmsOpenProfileFromMem(const void * MemPtr, cmsUInt32Number dwSize);
 CMSAPI cmsHPROFILE      CMSEXPORT cmsOpenProfileFromMemTHR(cmsContext ContextID, const void * MemPtr, cmsUInt32Number dwSize);
+CMSAPI cmsHPROFILE      CMSEXPORT cmsOpenProfileFromBorrowedMem(const void * MemPtr, cmsUInt32Number dwSize);
+CMSAPI cmsHPROFILE      CMSEXPORT cmsOpenProfileFromBorrowedMemTHR(cmsContext ContextID, const void * MemPtr, cmsUInt32Number dwSize);
+CMSAPI cmsHPROFILE      CMSEXPORT cmsOpenProfileFromMappedFile(const char *ICCProfile);
+CMSAPI cmsHPROFILE      CMSEXPORT cmsOpenProfileFromMappedFileTHR(cmsContext ContextID, const char *ICCProfile);
+CMSAPI cmsHPROFILE      CMSEXPORT cmsOpenSharedProfileFromMem(const void * MemPtr, cmsUInt32Number dwSize);
+CMSAPI cmsHPROFILE      CMSEXPORT cmsOpenSharedProfileFromFile(const char *ICCProfile);
 CMSAPI cmsHPROFILE      CMSEXPORT cmsOpenProfileFromIOhandlerTHR(cmsContext ContextID, cmsIOHANDLER* io);
 CMSAPI cmsHPROFILE      CMSEXPORT cmsOpenProfileFromIOhandler2THR(cmsContext ContextID, cmsIOHANDLER* io, cmsBool write);
 CMSAPI cmsBool          CMSEXPORT cmsCloseProfile(cmsHPROFILE hProfile);
@@ -1747,6 +1790,8 @@ CMSAPI cmsUInt32Number  CMSEXPORT cmsGetSupportedIntentsTHR(cmsContext ContextID
 #define cmsFLAGS_NOCACHE                  0x0040    // Inhibit 1-pixel cache
 #define cmsFLAGS_NOOPTIMIZE               0x0100    // Inhibit optimizations
 #define cmsFLAGS_NULLTRANSFORM            0x0200    // Don't transform anyway
+#define cmsFLAGS_MULTICACHE               0x08000000 // Use a hashed multi-entry cache instead of the 1-pixel cache
+#define cmsFLAGS_ARENA                    0x20000000 // Allocate everything owned by the transform in one arena (no device links)
 
 // Proofing flags
 #define cmsFLAGS_GAMUTCHECK               0x1000    // Out of Gamut alarm
@@ -1757,6 +1802,7 @@ CMSAPI cmsUInt32Number  CMSEXPORT cmsGetSupportedIntentsTHR(cmsContext ContextID
 #define cmsFLAGS_NOWHITEONWHITEFIXUP      0x0004    // Don't fix scum dot
 #define cmsFLAGS_HIGHRESPRECALC           0x0400    // Use more memory to give better accuracy
 #define cmsFLAGS_LOWRESPRECALC            0x0800    // Use less memory to minimize resources
+#define cmsFLAGS_LAZYPRECALC              0x10000000 // Fill precalculated CLUT cells on first use
 
 // For devicelink creation
 #define cmsFLAGS_8BITS_DEVICELINK         0x0008   // Create 8 bits devicelinks
@@ -1767,6 +1813,7 @@ CMSAPI cmsUInt32Number  CMSEXPORT cmsGetSupportedIntentsTHR(cmsContext ContextID
 #define cmsFLAGS_FORCE_CLUT               0x0002    // Force CLUT optimization
 #define cmsFLAGS_CLUT_POST_LINEARIZATION  0x0001    // create postlinearization tables if possible
 #define cmsFLAGS_CLUT_PRE_LINEARIZATION   0x0010    // create prelinearization tables if possible
+#define cmsFLAGS_MATSHAPER16              0x40000000 // 16 bits matrix-shaper in floating point instead of a resampled CLUT
 
 // Specific to unbounded mode
 #define cmsFLAGS_NONEGATIVES              0x8000    // Prevent negative numbers in floating point transforms
@@ -1879,6 +1926,20 @@ CMSAPI void             CMSEXPORT cmsGetAlarmCodesTHR(cmsContext ContextID,
 
 
 
+// CPU features used to select vectorized kernels
+#define cmsCPU_SSE2                       0x0001
+#define cmsCPU_SSE41                      0x0002
+#define cmsCPU_AVX2                       0x0004
+#define cmsCPU_FMA                        0x0008
+#define cmsCPU_AVX512                     0x0010
+#define cmsCPU_NEON                       0x0100
+
+// Features detected on this CPU, restricted by the context mask and the LCMS2_CPU_FEATURES environment
+// variable ("none", "sse2", "sse4.1", "avx2", "avx512", "neon" or a number), which is read once per process.
+// Set mask returns the previous mask.
+CMSAPI cmsUInt32Number  CMSEXPORT cmsGetCPUFeatures(cmsContext ContextID);
+CMSAPI cmsUInt32Number  CMSEXPORT cmsSetCPUFeaturesMask(cmsContext ContextID, cmsUInt32Number Mask);
+
 // Adaptation state for absolute colorimetric intent
 CMSAPI cmsFloat64Number CMSEXPORT cmsSetAdaptationState(cmsFloat64Number d);
 CMSAPI cmsFloat64Number CMSEXPORT cmsSetAdaptationStateTHR(cmsContext ContextID, cmsFloat64Number d);
@@ -1899,6 +1960,29 @@ CMSAPI cmsPipeline*    CMSEXPORT cmsGetTransformGamutCheckPipeline(cmsHTRANSFORM
 CMSAPI cmsNAMEDCOLORLIST* CMSEXPORT cmsGetTransformInputColorants(cmsHTRANSFORM hTransform);
 CMSAPI cmsNAMEDCOLORLIST* CMSEXPORT cmsGetTransformOutputColorants(cmsHTRANSFORM hTransform);
 
+// Hit/miss counters of the multi-entry cache. Returns FALSE if the transform was not created with cmsFLAGS_MULTICACHE
+CMSAPI cmsBool          CMSEXPORT cmsGetTransformCacheStats(cmsHTRANSFORM hTransform, cmsUInt32Number* Hits, cmsUInt32Number* Misses);
+CMSAPI void             CMSEXPORT cmsResetTransformCacheStats(cmsHTRANSFORM hTransform);
+
+// Attaches caller-owned scratch memory to a transform, so cmsDoTransform* does not need to allocate
+// nor to build big buffers on the stack. The multi-entry cache is kept there between calls. The buffer
+// must outlive the transform or be detached by passing NULL, and calls on the transform must not overlap.
+CMSAPI cmsBool          CMSEXPORT cmsSetTransformScratch(cmsHTRANSFORM hTransform, void* Buffer, cmsUInt32Number BufferSize);
+CMSAPI cmsUInt32Number  CMSEXPORT cmsGetTransformScratchSize(cmsHTRANSFORM hTransform);
+
+// Per-context cache of transforms, disabled by default. Creating a transform that matches a cached one,
+// by profile IDs, intents, BPC, adaptation states, formats and flags, returns the same shared handle.
+// Profiles without an ID (see cmsMD5computeID) are never cached. cmsDeleteTransform releases each handle.
+CMSAPI cmsUInt32Number  CMSEXPORT cmsSetTransformCacheSize(cmsContext ContextID, cmsUInt32Number MaxEntries);
+CMSAPI void             CMSEXPORT cmsFlushTransformCache(cmsContext ContextID);
+
+// Saves an optimized 16 bits transform to a memory blob, and rebuilds it without reading profiles nor
+// optimizing again. Blobs are only valid for the same library version. If MemPtr is NULL, the needed
+// size is returned in BytesNeeded. Transforms from plug-ins or with gamut check cannot be saved.
+CMSAPI cmsBool          CMSEXPORT cmsSaveTransformToMem(cmsHTRANSFORM hTransform, void* MemPtr, cmsUInt32Number* BytesNeeded);
+CMSAPI cmsHTRANSFORM    CMSEXPORT cmsLoadTransformFromMemTHR(cmsContext ContextID, const void* MemPtr, cmsUInt32Number dwSize);
+CMSAPI cmsHTRANSFORM    CMSEXPORT cmsLoadTransformFromMem(const void* MemPtr, cmsUInt32Number dwSize);
+
 // For backwards compatibility
 CMSAPI cmsBool          CMSEXPORT cmsChangeBuffersFormat(cmsHTRANSFORM hTransform,
                                                          cmsUInt32Number InputFormat,
@@ -202,6 +202,7 @@ typedef void*    (* _cmsDupUserDataFn)(cmsContext ContextID, const void* Data);
 #define cmsPluginInterpolationSig            0x696E7048     // 'inpH'
 #define cmsPluginParametricCurveSig          0x70617248     // 'parH'
 #define cmsPluginFormattersSig               0x66726D48     // 'frmH
+#define cmsPluginFormattersRowSig            0x66727748     // 'frwH'
 #define cmsPluginTagTypeSig                  0x74797048     // 'typH'
 #define cmsPluginTagSig                      0x74616748     // 'tagH'
 #define cmsPluginRenderingIntentSig          0x696E7448     // 'intH'
@@ -281,6 +282,22 @@ typedef union {
     _cmsInterpFnFloat    LerpFloat;         // Forward interpolation in floating point
 } cmsInterpFunction;
 
+// Same as above, on nPixels at once. Input and Output are interleaved pixels of nInputs and nOutputs channels
+typedef void (* _cmsInterpFn16Batch)(const cmsUInt16Number Input[],
+                                     cmsUInt16Number Output[],
+                                     cmsUInt32Number nPixels,
+                                     const struct _cms_interp_struc* p);
+
+typedef void (* _cmsInterpFnFloatBatch)(const cmsFloat32Number Input[],
+                                        cmsFloat32Number Output[],
+                                        cmsUInt32Number nPixels,
+                                        const struct _cms_interp_struc* p);
+
+typedef union {
+    _cmsInterpFn16Batch    Lerp16Batch;
+    _cmsInterpFnFloatBatch LerpFloatBatch;
+} cmsInterpBatchFunction;
+
 // Flags for interpolator selection
 #define CMS_LERP_FLAGS_16BITS             0x0000        // The default
 #define CMS_LERP_FLAGS_FLOAT              0x0001        // Requires different implementation
@@ -307,6 +324,8 @@ typedef struct _cms_interp_struc {  // Used on all interpolations. Supplied by l
     const void *Table;                // Points to the actual interpolation table
     cmsInterpFunction Interpolation;  // Points to the function to do the interpolation
 
+    cmsInterpBatchFunction BatchInterpolation;  // Several pixels per call. Set by lcms2, vectorized when possible
+
  } cmsInterpParams;
 
 // Interpolators factory
@@ -321,6 +340,12 @@ typedef struct {
 
 } cmsPluginInterpolation;
 
+// Simplex (Kuhn triangulation) interpolators for 5 to 15 inputs, touching only N+1 nodes per sample.
+// Suitable as the factory of an interpolation plug-in. Other cases are left to the default.
+CMSAPI cmsInterpFunction CMSEXPORT _cmsSimplexInterpolatorsFactory(cmsUInt32Number nInputChannels,
+                                                                   cmsUInt32Number nOutputChannels,
+                                                                   cmsUInt32Number dwFlags);
+
 //----------------------------------------------------------------------------------------------------------
 
 // Parametric curves. A negative type means same function but analytically inverted. Max. number of params is 10
@@ -367,6 +392,28 @@ typedef union {
 #define CMS_PACK_FLAGS_16BITS       0x0000
 #define CMS_PACK_FLAGS_FLOAT        0x0001
 
+// Row formatters convert a run of nPixels in one call. Values are kept in planes, one per channel, and PlaneStride
+// values apart. Stride is the same as on the per-pixel formatters, and the buffer advanced past the run is returned
+typedef cmsUInt8Number* (* cmsFormatterRow16)(struct _cmstransform_struct* CMMcargo,
+                                              cmsUInt16Number Planes[],
+                                              cmsUInt32Number PlaneStride,
+                                              cmsUInt8Number* Buffer,
+                                              cmsUInt32Number nPixels,
+                                              cmsUInt32Number Stride);
+
+typedef cmsUInt8Number* (* cmsFormatterRowFloat)(struct _cmstransform_struct* CMMcargo,
+                                                 cmsFloat32Number Planes[],
+                                                 cmsUInt32Number  PlaneStride,
+                                                 cmsUInt8Number*  Buffer,
+                                                 cmsUInt32Number  nPixels,
+                                                 cmsUInt32Number  Stride);
+
+typedef union {
+    cmsFormatterRow16    Row16;
+    cmsFormatterRowFloat RowFloat;
+
+} cmsFormatterRow;
+
 typedef enum { cmsFormatterInput=0, cmsFormatterOutput=1 } cmsFormatterDirection;
 
 typedef cmsFormatter (* cmsFormatterFactory)(cmsUInt32Number Type,           // Specific type, i.e. TYPE_RGB_8
@@ -380,6 +427,18 @@ typedef struct {
 
 } cmsPluginFormatters;
 
+// Row formatters. Those are used on top of the formatters above whenever the transform can go by runs of pixels,
+// and are preferred to any built-in handler of the same format. The per-pixel formatter is still needed as fallback.
+typedef cmsFormatterRow (* cmsFormatterRowFactory)(cmsUInt32Number Type,        // Specific type, i.e. TYPE_RGB_8
+                                                   cmsFormatterDirection Dir,
+                                                   cmsUInt32Number dwFlags);   // precision
+
+typedef struct {
+    cmsPluginBase          base;
+    cmsFormatterRowFactory FormattersRowFactory;
+
+} cmsPluginFormattersRow;
+
 //----------------------------------------------------------------------------------------------------------
 
 // Tag type handler. Each type is free to return anything it wants, and it is up to the caller to
@@ -677,15 +736,36 @@ CMSAPI _cmsTransform2Fn CMSEXPORT _cmsGetTransformWorker(struct _cmstransform_st
 CMSAPI cmsInt32Number   CMSEXPORT _cmsGetTransformMaxWorkers(struct _cmstransform_struct* CMMcargo);
 CMSAPI cmsUInt32Number  CMSEXPORT _cmsGetTransformWorkerFlags(struct _cmstransform_struct* CMMcargo);
 
+// Scratch memory attached by the caller, or NULL. Schedulers may use it for their bookkeeping, the
+// built-in routines leave it alone when running as workers.
+CMSAPI void*            CMSEXPORT _cmsGetTransformScratch(struct _cmstransform_struct* CMMcargo, cmsUInt32Number* Size);
+
 // Let's plug-in to guess the best number of workers
 #define CMS_GUESS_MAX_WORKERS -1
 
+// Called when the plug-in is unregistered from a context, including on cmsDeleteContext(). 
+// Gives the scheduler a chance to release any per-context resource, like worker threads.
+typedef void     (* _cmsSchedulerShutdownFn)(cmsContext ContextID);
+
+// Work other than transforms, as sampling CLUT nodes, is handed to the plug-in as a number of
+// independent tasks. The runner calls Fn(Cargo, 0) ... Fn(Cargo, nTasks-1) in any order, maybe
+// concurrently, and returns once all of them are done.
+typedef void     (* _cmsTaskFn)(void* Cargo, cmsUInt32Number Task);
+typedef void     (* _cmsRunTasksFn)(cmsContext ContextID, cmsInt32Number MaxWorkers, _cmsTaskFn Fn, void* Cargo, cmsUInt32Number nTasks);
+
+// Bytes of scratch memory the scheduler may need for its bookkeeping on a given transform. It is
+// added to what cmsGetTransformScratchSize() reports.
+typedef cmsUInt32Number (* _cmsSchedulerScratchFn)(struct _cmstransform_struct* CMMcargo);
+
 typedef struct {
     cmsPluginBase       base;
 
     cmsInt32Number      MaxWorkers;       // Number of starts to do as maximum
     cmsUInt32Number     WorkerFlags;      // Reserved
     _cmsTransform2Fn    SchedulerFn;      // callback to setup functions     
+    _cmsSchedulerShutdownFn ShutdownFn;   // Optional, only read if ExpectedVersion >= 2190
+    _cmsRunTasksFn      RunTasksFn;       // Optional, only read if ExpectedVersion >= 2190
+    _cmsSchedulerScratchFn ScratchSizeFn; // Optional, only read if ExpectedVersion >= 2190
 
 }  cmsPluginParalellization;
 
@@ -38,9 +38,13 @@ extern "C" {
 
 // Configuration toggles
 
+// Split the work in many small tiles, kept on per-worker deques. Idle workers steal tiles 
+// from busy ones, which balances the load on heterogeneous cores or uneven images.
+#define CMS_THREADED_WORK_STEALING      0x0001
+
 // The one and only plug-in entry point. To install this plugin in your code you need to place this in 
 // some initialization place. If you want to combine this plug-in with fastfloat, make sure to call 
-// the threaded entry point comes last in chain. flags is a reserved field for future use
+// the threaded entry point comes last in chain. flags is a combination of the toggles above
 //
 //  cmsPlugin(cmsThreadedExtensions(CMS_THREADED_GUESS_MAX_THREADS, 0));
 // 
@@ -49,6 +53,39 @@ extern "C" {
 
 CMSAPI void* CMSEXPORT cmsThreadedExtensions(cmsInt32Number max_threads, cmsUInt32Number flags);
 
+// Asynchronous transforms. The call returns as soon as the work is queued on the worker pool 
+// of the transform context, so the caller can decode or encode other data meanwhile. Many 
+// transforms may be queued at once, they are served in order. Buffers should be kept alive 
+// and untouched until the transform is done. The optional callback is called from a worker 
+// thread once the transform is done. Each returned handle has to be released by 
+// cmsWaitTransformAsync(), which also waits for completion and callback. Make sure all handles
+// are released before deleting the transform or its context. If the transform context has 
+// not this plug-in installed, the transform is done on the calling thread before returning.
+
+typedef void (* cmsTransformDoneFn)(cmsHTRANSFORM Transform, void* UserData);
+
+CMSAPI cmsHANDLE CMSEXPORT cmsDoTransformAsync(cmsHTRANSFORM Transform,
+                                               const void* InputBuffer,
+                                               void* OutputBuffer,
+                                               cmsUInt32Number Size,
+                                               cmsTransformDoneFn DoneFn,
+                                               void* UserData);
+
+CMSAPI cmsHANDLE CMSEXPORT cmsDoTransformLineStrideAsync(cmsHTRANSFORM Transform,
+                                               const void* InputBuffer,
+                                               void* OutputBuffer,
+                                               cmsUInt32Number PixelsPerLine,
+                                               cmsUInt32Number LineCount,
+                                               cmsUInt32Number BytesPerLineIn,
+                                               cmsUInt32Number BytesPerLineOut,
+                                               cmsUInt32Number BytesPerPlaneIn,
+                                               cmsUInt32Number BytesPerPlaneOut,
+                                               cmsTransformDoneFn DoneFn,
+                                               void* UserData);
+
+CMSAPI cmsBool   CMSEXPORT cmsIsTransformAsyncDone(cmsHANDLE hAsync);
+CMSAPI void      CMSEXPORT cmsWaitTransformAsync(cmsHANDLE hAsync);
+
 #ifndef CMS_USE_CPP_API
 #   ifdef __cplusplus
     }
@@ -0,0 +1,182 @@
+//---------------------------------------------------------------------------------
+//
+//  Little Color Management System, multithreaded extensions
+//  Copyright (c) 1998-2026 Marti Maria Saguer, all rights reserved
+//
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//---------------------------------------------------------------------------------
+
+#include "threaded_internal.h"
+
+// An asynchronous transform is a job of a single slice, which is the whole transform call. 
+// The worker picking it calls the scheduler, so the transform is further split across the 
+// pool as a regular call would be.
+typedef struct {
+
+    _cmsThrJob         Job;          // Should be first
+    _cmsWorkSlice      Slice;
+    cmsStride          Stride;
+
+    _cmsThrPool*       Pool;         // NULL if done on the calling thread
+
+    cmsTransformDoneFn DoneFn;
+    void*              UserData;
+
+} _cmsThrAsync;
+
+
+// Called by the thread finishing the transform
+static
+void AsyncDone(_cmsThrJob* job)
+{
+    _cmsThrAsync* a = (_cmsThrAsync*)job;
+
+    if (a->DoneFn != NULL)
+        a->DoneFn((cmsHTRANSFORM)a->Slice.CMMcargo, a->UserData);
+}
+
+// Queues the transform on the context pool, or does it right now if not possible
+static
+cmsHANDLE SubmitAsync(cmsHTRANSFORM Transform,
+                      const void* InputBuffer,
+                      void* OutputBuffer,
+                      cmsUInt32Number PixelsPerLine,
+                      cmsUInt32Number LineCount,
+                      const cmsStride* Stride,
+                      cmsTransformDoneFn DoneFn,
+                      void* UserData)
+{
+    struct _cmstransform_struct* CMMcargo = (struct _cmstransform_struct*)Transform;
+    cmsContext ContextID = cmsGetTransformContextID(Transform);
+    cmsInt32Number MaxWorkers = _cmsGetTransformMaxWorkers(CMMcargo);
+    _cmsThrAsync* a;
+
+    a = (_cmsThrAsync*)_cmsMallocZero(ContextID, sizeof(_cmsThrAsync));
+    if (a == NULL) return NULL;
+
+    a->Stride = *Stride;
+
+    a->Slice.CMMcargo = CMMcargo;
+    a->Slice.InputBuffer = InputBuffer;
+    a->Slice.OutputBuffer = OutputBuffer;
+    a->Slice.PixelsPerLine = PixelsPerLine;
+    a->Slice.LineCount = LineCount;
+    a->Slice.Stride = &a->Stride;
+
+    a->DoneFn = DoneFn;
+    a->UserData = UserData;
+
+    a->Job.Worker = _cmsThrScheduler;
+    a->Job.Slices = &a->Slice;
+    a->Job.nSlices = 1;
+    a->Job.Deques = NULL;
+    a->Job.TaskFn = NULL;
+    a->Job.TaskCargo = NULL;
+    a->Job.DoneFn = AsyncDone;
+
+    // Only transforms handled by this plug-in can use the pool, otherwise nobody would shut it down.
+    // At least one worker is needed, as the caller does not help on asynchronous jobs.
+    if (_cmsGetTransformWorker(CMMcargo) != NULL) {
+
+        if (MaxWorkers == CMS_THREADED_GUESS_MAX_THREADS)
+            MaxWorkers = _cmsThrIdealThreadCount();
+
+        a->Pool = _cmsThrGetPool(ContextID, MaxWorkers > 1 ? MaxWorkers - 1 : 1);
+        if (a->Pool != NULL && a->Pool->nThreads == 0)
+            a->Pool = NULL;
+    }
+
+    if (a->Pool != NULL) {
+
+        _cmsThrSubmitJob(a->Pool, &a->Job);
+    }
+    else {
+
+        cmsDoTransformLineStride(Transform, InputBuffer, OutputBuffer, PixelsPerLine, LineCount,
+                                 Stride->BytesPerLineIn, Stride->BytesPerLineOut,
+                                 Stride->BytesPerPlaneIn, Stride->BytesPerPlaneOut);
+        AsyncDone(&a->Job);
+        a->Job.Finished = TRUE;
+    }
+
+    return (cmsHANDLE)a;
+}
+
+
+// Same as cmsDoTransform(), but asynchronous
+cmsHANDLE CMSEXPORT cmsDoTransformAsync(cmsHTRANSFORM Transform,
+                                        const void* InputBuffer,
+                                        void* OutputBuffer,
+                                        cmsUInt32Number Size,
+                                        cmsTransformDoneFn DoneFn,
+                                        void* UserData)
+{
+    cmsStride Stride;
+
+    Stride.BytesPerLineIn = 0;  // Not used
+    Stride.BytesPerLineOut = 0;
+    Stride.BytesPerPlaneIn = Size * _cmsThrPixelSpacing(cmsGetTransformInputFormat(Transform));
+    Stride.BytesPerPlaneOut = Size * _cmsThrPixelSpacing(cmsGetTransformOutputFormat(Transform));
+
+    return SubmitAsync(Transform, InputBuffer, OutputBuffer, Size, 1, &Stride, DoneFn, UserData);
+}
+
+// Same as cmsDoTransformLineStride(), but asynchronous
+cmsHANDLE CMSEXPORT cmsDoTransformLineStrideAsync(cmsHTRANSFORM Transform,
+                                                  const void* InputBuffer,
+                                                  void* OutputBuffer,
+                                                  cmsUInt32Number PixelsPerLine,
+                                                  cmsUInt32Number LineCount,
+                                                  cmsUInt32Number BytesPerLineIn,
+                                                  cmsUInt32Number BytesPerLineOut,
+                                                  cmsUInt32Number BytesPerPlaneIn,
+                                                  cmsUInt32Number BytesPerPlaneOut,
+                                                  cmsTransformDoneFn DoneFn,
+                                                  void* UserData)
+{
+    cmsStride Stride;
+
+    Stride.BytesPerLineIn = BytesPerLineIn;
+    Stride.BytesPerLineOut = BytesPerLineOut;
+    Stride.BytesPerPlaneIn = BytesPerPlaneIn;
+    Stride.BytesPerPlaneOut = BytesPerPlaneOut;
+
+    return SubmitAsync(Transform, InputBuffer, OutputBuffer, PixelsPerLine, LineCount, &Stride, DoneFn, UserData);
+}
+
+// Returns TRUE if the transform is done and callback has been called. Handle is still valid.
+cmsBool CMSEXPORT cmsIsTransformAsyncDone(cmsHANDLE hAsync)
+{
+    _cmsThrAsync* a = (_cmsThrAsync*)hAsync;
+
+    if (a == NULL) return TRUE;
+    if (a->Pool == NULL) return a->Job.Finished;
+
+    return _cmsThrIsJobFinished(a->Pool, &a->Job);
+}
+
+// Waits for the transform and releases the handle
+void CMSEXPORT cmsWaitTransformAsync(cmsHANDLE hAsync)
+{
+    _cmsThrAsync* a = (_cmsThrAsync*)hAsync;
+
+    if (a == NULL) return;
+
+    if (a->Pool != NULL)
+        _cmsThrWaitJob(a->Pool, &a->Job);
+
+    _cmsFree(cmsGetTransformContextID((cmsHTRANSFORM)a->Slice.CMMcargo), a);
+}
@@ -25,14 +25,11 @@
 // windows does not support pthreads. 
 #ifdef CMS_IS_WINDOWS_
 
-#define WIN32_LEAN_AND_MEAN 1
-#include <windows.h>
-
 // To pass parameter to the thread
 typedef struct
 {
-    _cmsTransform2Fn worker;
-    _cmsWorkSlice* param;
+    _cmsThrEntryFn fn;
+    void* param;
 
 } thread_adaptor_param;
 
@@ -42,17 +39,15 @@ static
 DWORD WINAPI thread_adaptor(LPVOID p)
 {
     thread_adaptor_param* ap = (thread_adaptor_param*)p;
-    _cmsWorkSlice* s = ap->param;
 
-    ap->worker(s->CMMcargo, s->InputBuffer, s->OutputBuffer, 
-               s->PixelsPerLine, s->LineCount, s->Stride);
+    ap->fn(ap->param);
     _cmsFree(0, p);
     return 0;
 }
 
-// This function creates a thread and executes it. The thread calls the worker function
-// with the given parameters.
-cmsHANDLE _cmsThrCreateWorker(cmsContext ContextID, _cmsTransform2Fn worker, _cmsWorkSlice* param)
+// This function creates a thread and executes it. The thread calls the entry function
+// with the given parameter.
+cmsHANDLE _cmsThrCreateThread(cmsContext ContextID, _cmsThrEntryFn fn, void* param)
 {
     DWORD ThreadID;
     thread_adaptor_param* p;
@@ -61,12 +56,13 @@ cmsHANDLE _cmsThrCreateWorker(cmsContext ContextID, _cmsTransform2Fn worker, _cm
     p = (thread_adaptor_param*)_cmsMalloc(0, sizeof(thread_adaptor_param));
     if (p == NULL) return NULL;
 
-    p->worker = worker;
+    p->fn = fn;
     p->param = param;
 
     handle  = CreateThread(NULL, 0, thread_adaptor, (LPVOID) p, 0, &ThreadID);
     if (handle == NULL)
     {
+        _cmsFree(0, p);
         cmsSignalError(ContextID, cmsERROR_UNDEFINED, "Cannot create thread");
     }
 
@@ -74,12 +70,14 @@ cmsHANDLE _cmsThrCreateWorker(cmsContext ContextID, _cmsTransform2Fn worker, _cm
 }
 
 // Waits until given thread is ended
-void _cmsThrJoinWorker(cmsContext ContextID, cmsHANDLE hWorker)
+void _cmsThrJoinThread(cmsContext ContextID, cmsHANDLE hThread)
 {
-    if (WaitForSingleObject((HANDLE)hWorker, INFINITE) != WAIT_OBJECT_0)
+    if (WaitForSingleObject((HANDLE)hThread, INFINITE) != WAIT_OBJECT_0)
     {
         cmsSignalError(ContextID, cmsERROR_UNDEFINED, "Cannot join thread");
     }
+
+    CloseHandle((HANDLE)hThread);
 }
 
 // Returns the ideal number of threads the system can run
@@ -91,17 +89,59 @@ cmsInt32Number _cmsThrIdealThreadCount(void)
     return sysinfo.dwNumberOfProcessors; //Returns the number of processors in the system.
 }
 
+// Slim reader/writer locks need no cleanup
+cmsBool _cmsThrMutexInit(_cmsThrMutex* mtx)
+{
+    InitializeSRWLock(mtx);
+    return TRUE;
+}
+
+void _cmsThrMutexDestroy(_cmsThrMutex* mtx)
+{
+    UNUSED_PARAMETER(mtx);
+}
+
+void _cmsThrMutexLock(_cmsThrMutex* mtx)
+{
+    AcquireSRWLockExclusive(mtx);
+}
+
+void _cmsThrMutexUnlock(_cmsThrMutex* mtx)
+{
+    ReleaseSRWLockExclusive(mtx);
+}
+
+cmsBool _cmsThrCondInit(_cmsThrCond* cond)
+{
+    InitializeConditionVariable(cond);
+    return TRUE;
+}
+
+void _cmsThrCondDestroy(_cmsThrCond* cond)
+{
+    UNUSED_PARAMETER(cond);
+}
+
+void _cmsThrCondWait(_cmsThrCond* cond, _cmsThrMutex* mtx)
+{
+    SleepConditionVariableSRW(cond, mtx, INFINITE, 0);
+}
+
+void _cmsThrCondBroadcast(_cmsThrCond* cond)
+{
+    WakeAllConditionVariable(cond);
+}
+
 #else
 
 // Rest of the wide world
-#include <pthread.h>
 #include <unistd.h>
 
 // To pass parameter to the thread
 typedef struct
 {
-    _cmsTransform2Fn worker;
-    _cmsWorkSlice* param;
+    _cmsThrEntryFn fn;
+    void* param;
 
 } thread_adaptor_param;
 
@@ -111,18 +151,16 @@ static
 void* thread_adaptor(void* p)
 {
     thread_adaptor_param* ap = (thread_adaptor_param*)p;
-    _cmsWorkSlice* s = ap->param;
 
-    ap->worker(s->CMMcargo, s->InputBuffer, s->OutputBuffer,
-               s->PixelsPerLine, s->LineCount, s->Stride);
+    ap->fn(ap->param);
     _cmsFree(0, p);
 
     return NULL;
 }
 
-// This function creates a thread and executes it. The thread calls the worker function
-// with the given parameters.
-cmsHANDLE _cmsThrCreateWorker(cmsContext ContextID, _cmsTransform2Fn worker, _cmsWorkSlice* param)
+// This function creates a thread and executes it. The thread calls the entry function
+// with the given parameter.
+cmsHANDLE _cmsThrCreateThread(cmsContext ContextID, _cmsThrEntryFn fn, void* param)
 {
     pthread_t threadId;
     thread_adaptor_param* p;
@@ -130,12 +168,13 @@ cmsHANDLE _cmsThrCreateWorker(cmsContext ContextID, _cmsTransform2Fn worker, _cm
     p = (thread_adaptor_param*)_cmsMalloc(0, sizeof(thread_adaptor_param));
     if (p == NULL) return NULL;
 
-    p->worker = worker;
+    p->fn = fn;
     p->param = param;
 
     int err = pthread_create(&threadId, NULL, thread_adaptor, p);
     if (err != 0)
     {
+        _cmsFree(0, p);
         cmsSignalError(ContextID, cmsERROR_UNDEFINED, "Cannot create thread [pthread error %d]", err);
         return NULL;
     }
@@ -144,9 +183,9 @@ cmsHANDLE _cmsThrCreateWorker(cmsContext ContextID, _cmsTransform2Fn worker, _cm
 }
 
 // Waits until given thread is ended
-void _cmsThrJoinWorker(cmsContext ContextID, cmsHANDLE hWorker)
+void _cmsThrJoinThread(cmsContext ContextID, cmsHANDLE hThread)
 {
-    int err = pthread_join((pthread_t)hWorker, NULL);
+    int err = pthread_join((pthread_t)hThread, NULL);
     if (err != 0)
     {
         cmsSignalError(ContextID, cmsERROR_UNDEFINED, "Cannot join thread [pthread error %d]", err); 
@@ -162,4 +201,44 @@ cmsInt32Number _cmsThrIdealThreadCount(void)
         return (cmsInt32Number)cores;
 }
 
+cmsBool _cmsThrMutexInit(_cmsThrMutex* mtx)
+{
+    return pthread_mutex_init(mtx, NULL) == 0;
+}
+
+void _cmsThrMutexDestroy(_cmsThrMutex* mtx)
+{
+    pthread_mutex_destroy(mtx);
+}
+
+void _cmsThrMutexLock(_cmsThrMutex* mtx)
+{
+    pthread_mutex_lock(mtx);
+}
+
+void _cmsThrMutexUnlock(_cmsThrMutex* mtx)
+{
+    pthread_mutex_unlock(mtx);
+}
+
+cmsBool _cmsThrCondInit(_cmsThrCond* cond)
+{
+    return pthread_cond_init(cond, NULL) == 0;
+}
+
+void _cmsThrCondDestroy(_cmsThrCond* cond)
+{
+    pthread_cond_destroy(cond);
+}
+
+void _cmsThrCondWait(_cmsThrCond* cond, _cmsThrMutex* mtx)
+{
+    pthread_cond_wait(cond, mtx);
+}
+
+void _cmsThrCondBroadcast(_cmsThrCond* cond)
+{
+    pthread_cond_broadcast(cond);
+}
+
 #endif
@@ -23,8 +23,8 @@
 
 #include "lcms2_threaded.h"
 
-// This plugin requires lcms 2.14 or greater
-#define REQUIRED_LCMS_VERSION 2140
+// This plugin requires lcms 2.19 or greater
+#define REQUIRED_LCMS_VERSION 2190
 
 // Unused parameter warning suppression
 #define UNUSED_PARAMETER(x) ((void)x) 
@@ -62,11 +62,108 @@ cmsUInt32Number _cmsThrCountSlices(struct _cmstransform_struct* CMMcargo, cmsInt
 // Split work following several expert rules
 cmsBool		    _cmsThrSplitWork(const _cmsWorkSlice* master, cmsInt32Number nslices, _cmsWorkSlice slices[]);
 
+// Native synchronization objects. Both can be statically initialized.
+#ifdef CMS_IS_WINDOWS_
+#   define WIN32_LEAN_AND_MEAN 1
+#   include <windows.h>
+typedef SRWLOCK            _cmsThrMutex;
+typedef CONDITION_VARIABLE _cmsThrCond;
+#   define CMS_THR_MUTEX_INITIALIZER SRWLOCK_INIT
+#else
+#   include <pthread.h>
+typedef pthread_mutex_t    _cmsThrMutex;
+typedef pthread_cond_t     _cmsThrCond;
+#   define CMS_THR_MUTEX_INITIALIZER PTHREAD_MUTEX_INITIALIZER
+#endif
+
+// Thread entry point
+typedef void (* _cmsThrEntryFn)(void* param);
+
 // Thread primitives
-cmsHANDLE       _cmsThrCreateWorker(cmsContext ContextID, _cmsTransform2Fn worker, _cmsWorkSlice* param);
-void            _cmsThrJoinWorker(cmsContext ContextID, cmsHANDLE hWorker);
+cmsHANDLE       _cmsThrCreateThread(cmsContext ContextID, _cmsThrEntryFn fn, void* param);
+void            _cmsThrJoinThread(cmsContext ContextID, cmsHANDLE hThread);
 cmsInt32Number  _cmsThrIdealThreadCount(void);
 
+cmsBool         _cmsThrMutexInit(_cmsThrMutex* mtx);
+void            _cmsThrMutexDestroy(_cmsThrMutex* mtx);
+void            _cmsThrMutexLock(_cmsThrMutex* mtx);
+void            _cmsThrMutexUnlock(_cmsThrMutex* mtx);
+
+cmsBool         _cmsThrCondInit(_cmsThrCond* cond);
+void            _cmsThrCondDestroy(_cmsThrCond* cond);
+void            _cmsThrCondWait(_cmsThrCond* cond, _cmsThrMutex* mtx);
+void            _cmsThrCondBroadcast(_cmsThrCond* cond);
+
+// A range of tiles owned by a participant in work-stealing mode. Owner pops from the 
+// top, thieves take the bottom half.
+typedef struct {
+
+    _cmsThrMutex      Lock;
+    cmsUInt32Number   Top;
+    cmsUInt32Number   Bottom;        // One past the last tile
+
+} _cmsThrDeque;
+
+// A job is a set of slices sharing the same worker function. Workers pick slices from the
+// queue in order, the submitter helps on its own job and waits for all slices to be done.
+// In work-stealing mode, Slices holds the tiles and the dispatched units are the deques, 
+// so nSlices is the number of participants instead.
+typedef struct _cmsThrJob_st {
+
+    _cmsTransform2Fn  Worker;
+    _cmsWorkSlice*    Slices;
+    cmsUInt32Number   nSlices;
+
+    _cmsThrDeque*     Deques;        // NULL if static slicing
+
+    // Generic tasks from lcms, used instead of worker and slices if not NULL
+    _cmsTaskFn        TaskFn;
+    void*             TaskCargo;
+    
+    cmsUInt32Number   NextSlice;     // Next slice to be dispatched
+    cmsUInt32Number   Pending;       // Slices not yet finished
+    cmsBool           Finished;      // All slices done and completion callback called
+
+    // Optional, called by the thread finishing the last slice
+    void  (* DoneFn)(struct _cmsThrJob_st* job);
+
+    struct _cmsThrJob_st* Next;
+
+} _cmsThrJob;
+
+// The persistent pool of workers. There is one per context, created on first use and 
+// destroyed when the plug-in is unregistered, which includes cmsDeleteContext()
+typedef struct _cmsThrPool_st {
+
+    cmsContext       ContextID;
+
+    cmsInt32Number   nThreads;
+    cmsHANDLE*       Threads;
+
+    _cmsThrMutex     Lock;
+    _cmsThrCond      WorkReady;      // Signaled when a job is queued or on shutdown
+    _cmsThrCond      WorkDone;       // Signaled when a job has all its slices done
+
+    _cmsThrJob*      Head;           // Queue of jobs having slices to dispatch
+    _cmsThrJob*      Tail;
+
+    cmsBool          Shutdown;
+
+    struct _cmsThrPool_st* Next;
+
+} _cmsThrPool;
+
+// Pool management
+_cmsThrPool*    _cmsThrGetPool(cmsContext ContextID, cmsInt32Number nThreads);
+void            _cmsThrShutdownPool(cmsContext ContextID);
+void            _cmsThrRunJob(_cmsThrPool* pool, _cmsThrJob* job);
+void            _cmsThrSubmitJob(_cmsThrPool* pool, _cmsThrJob* job);
+void            _cmsThrWaitJob(_cmsThrPool* pool, _cmsThrJob* job);
+cmsBool         _cmsThrIsJobFinished(_cmsThrPool* pool, _cmsThrJob* job);
+
+// Bytes from one pixel to the next. Planar formats take just one component
+cmsUInt32Number _cmsThrPixelSpacing(cmsUInt32Number format);
+
 // The scheduler
 void  _cmsThrScheduler(struct _cmstransform_struct* CMMcargo,
 				       const void* InputBuffer,
@@ -74,6 +171,12 @@ void  _cmsThrScheduler(struct _cmstransform_struct* CMMcargo,
 				       cmsUInt32Number PixelsPerLine,
 				       cmsUInt32Number LineCount,
 				       const cmsStride* Stride);
+
+// Scratch memory the scheduler can use on a transform
+cmsUInt32Number _cmsThrScratchSize(struct _cmstransform_struct* CMMcargo);
+
+// Runs tasks other than transforms
+void  _cmsThrRunTasks(cmsContext ContextID, cmsInt32Number MaxWorkers, _cmsTaskFn Fn, void* Cargo, cmsUInt32Number nTasks);
 #endif
 
 
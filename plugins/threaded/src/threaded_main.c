@@ -29,7 +29,10 @@ static cmsPluginParalellization Plugin = {
 
   CMS_THREADED_GUESS_MAX_THREADS,
   0,
-  _cmsThrScheduler  
+  _cmsThrScheduler,
+  _cmsThrShutdownPool,
+  _cmsThrRunTasks,
+  _cmsThrScratchSize
 };
 
 // This is the main plug-in installer. 
@@ -0,0 +1,420 @@
+//---------------------------------------------------------------------------------
+//
+//  Little Color Management System, multithreaded extensions
+//  Copyright (c) 1998-2026 Marti Maria Saguer, all rights reserved
+//
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//---------------------------------------------------------------------------------
+
+#include "threaded_internal.h"
+
+// Creating and joining threads on each transform is expensive when the transformed
+// blocks are small. Instead, each context owns a pool of workers that sleep until
+// some job is queued. Pools are created on first use and live until the plug-in is
+// unregistered from the context, which includes cmsDeleteContext().
+
+// All pools are kept in a list, one per context. 
+static _cmsThrMutex PoolListLock = CMS_THR_MUTEX_INITIALIZER;
+static _cmsThrPool* PoolList = NULL;
+
+
+// Removes a job from the queue. Pool should be locked.
+static
+void Dequeue(_cmsThrPool* pool, _cmsThrJob* job)
+{
+    _cmsThrJob* prev = NULL;
+    _cmsThrJob* ptr;
+
+    for (ptr = pool->Head; ptr != NULL; prev = ptr, ptr = ptr->Next) {
+
+        if (ptr == job) {
+
+            if (prev == NULL)
+                pool->Head = job->Next;
+            else
+                prev->Next = job->Next;
+
+            if (pool->Tail == job)
+                pool->Tail = prev;
+
+            job->Next = NULL;
+            return;
+        }
+    }
+}
+
+// Takes next slice from the given job, and removes the job from the queue
+// once all its slices are dispatched. Pool should be locked.
+static
+cmsUInt32Number TakeSlice(_cmsThrPool* pool, _cmsThrJob* job)
+{
+    cmsUInt32Number n = job->NextSlice++;
+
+    if (job->NextSlice >= job->nSlices)
+        Dequeue(pool, job);
+
+    return n;
+}
+
+// Computes one slice or tile
+static
+void RunTile(_cmsThrJob* job, cmsUInt32Number n)
+{
+    _cmsWorkSlice* s;
+
+    if (job->TaskFn != NULL) {
+
+        job->TaskFn(job->TaskCargo, n);
+        return;
+    }
+
+    s = &job->Slices[n];
+    job->Worker(s->CMMcargo, s->InputBuffer, s->OutputBuffer,
+                s->PixelsPerLine, s->LineCount, s->Stride);
+}
+
+// Takes the first tile of own deque
+static
+cmsBool PopTop(_cmsThrDeque* dq, cmsUInt32Number* tile)
+{
+    cmsBool ok = FALSE;
+
+    _cmsThrMutexLock(&dq->Lock);
+    if (dq->Top < dq->Bottom) {
+        *tile = dq->Top++;
+        ok = TRUE;
+    }
+    _cmsThrMutexUnlock(&dq->Lock);
+
+    return ok;
+}
+
+// Looks for a victim with pending tiles and moves the bottom half of its range to 
+// our own deque. Returns FALSE when all deques are empty.
+static
+cmsBool Steal(_cmsThrJob* job, cmsUInt32Number me)
+{
+    cmsUInt32Number i;
+
+    for (i = 1; i < job->nSlices; i++) {
+
+        _cmsThrDeque* victim = &job->Deques[(me + i) % job->nSlices];
+        cmsUInt32Number From, To;
+
+        _cmsThrMutexLock(&victim->Lock);
+
+        To = victim->Bottom;
+        From = victim->Top + (To - victim->Top) / 2;
+
+        if (From >= To) {
+            _cmsThrMutexUnlock(&victim->Lock);
+            continue;
+        }
+
+        victim->Bottom = From;
+        _cmsThrMutexUnlock(&victim->Lock);
+
+        _cmsThrMutexLock(&job->Deques[me].Lock);
+        job->Deques[me].Top = From;
+        job->Deques[me].Bottom = To;
+        _cmsThrMutexUnlock(&job->Deques[me].Lock);
+
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+// Computes one slice, or, in work-stealing mode, the tiles of one participant
+// and whatever it can steal from others. Pool should NOT be locked.
+static
+void RunSlice(_cmsThrJob* job, cmsUInt32Number n)
+{
+    cmsUInt32Number tile;
+
+    if (job->Deques == NULL) {
+
+        RunTile(job, n);
+        return;
+    }
+
+    do {
+
+        while (PopTop(&job->Deques[n], &tile)) {
+            RunTile(job, tile);
+        }
+
+    } while (Steal(job, n));
+}
+
+// Accounts a finished slice. Pool should be locked. The completion callback, if any, is 
+// called without the lock. The job may vanish as soon as it is marked as finished and 
+// the lock is released, so it should not be touched afterwards.
+static
+void SliceDone(_cmsThrPool* pool, _cmsThrJob* job)
+{
+    if (--job->Pending > 0) return;
+
+    if (job->DoneFn != NULL) {
+
+        _cmsThrMutexUnlock(&pool->Lock);
+        job->DoneFn(job);
+        _cmsThrMutexLock(&pool->Lock);
+    }
+
+    job->Finished = TRUE;
+    _cmsThrCondBroadcast(&pool->WorkDone);
+}
+
+// The body of each worker thread. Sleeps until there is something to do
+static
+void WorkerLoop(void* param)
+{
+    _cmsThrPool* pool = (_cmsThrPool*)param;
+
+    _cmsThrMutexLock(&pool->Lock);
+
+    for (;;) {
+
+        _cmsThrJob* job = pool->Head;
+        cmsUInt32Number n;
+
+        if (job == NULL) {
+
+            if (pool->Shutdown) break;
+
+            _cmsThrCondWait(&pool->WorkReady, &pool->Lock);
+            continue;
+        }
+
+        n = TakeSlice(pool, job);
+
+        _cmsThrMutexUnlock(&pool->Lock);
+        RunSlice(job, n);
+        _cmsThrMutexLock(&pool->Lock);
+
+        SliceDone(pool, job);
+    }
+
+    _cmsThrMutexUnlock(&pool->Lock);
+}
+
+// Frees a pool once all threads are joined
+static
+void FreePool(_cmsThrPool* pool)
+{
+    if (pool->Threads != NULL) _cmsFree(0, pool->Threads);
+
+    _cmsThrCondDestroy(&pool->WorkDone);
+    _cmsThrCondDestroy(&pool->WorkReady);
+    _cmsThrMutexDestroy(&pool->Lock);
+
+    _cmsFree(0, pool);
+}
+
+// Creates a new pool with nThreads workers. It may end with less if the system refuses 
+// to create them. A pool with zero threads is still valid, as submitter does all work.
+static
+_cmsThrPool* CreatePool(cmsContext ContextID, cmsInt32Number nThreads)
+{
+    _cmsThrPool* pool;
+    cmsInt32Number i;
+
+    pool = (_cmsThrPool*)_cmsMallocZero(0, sizeof(_cmsThrPool));
+    if (pool == NULL) return NULL;
+
+    if (!_cmsThrMutexInit(&pool->Lock)) {
+        _cmsFree(0, pool);
+        return NULL;
+    }
+
+    if (!_cmsThrCondInit(&pool->WorkReady)) {
+        _cmsThrMutexDestroy(&pool->Lock);
+        _cmsFree(0, pool);
+        return NULL;
+    }
+
+    if (!_cmsThrCondInit(&pool->WorkDone)) {
+        _cmsThrCondDestroy(&pool->WorkReady);
+        _cmsThrMutexDestroy(&pool->Lock);
+        _cmsFree(0, pool);
+        return NULL;
+    }
+
+    pool->ContextID = ContextID;
+
+    if (nThreads > 0) {
+
+        pool->Threads = (cmsHANDLE*)_cmsCalloc(0, (cmsUInt32Number) nThreads, sizeof(cmsHANDLE));
+        if (pool->Threads == NULL) {
+            FreePool(pool);
+            return NULL;
+        }
+
+        for (i = 0; i < nThreads; i++) {
+
+            cmsHANDLE h = _cmsThrCreateThread(ContextID, WorkerLoop, pool);
+            if (h == NULL) break;
+
+            pool->Threads[pool->nThreads++] = h;
+        }
+    }
+
+    return pool;
+}
+
+// Returns the pool for the given context, creating it if needed
+_cmsThrPool* _cmsThrGetPool(cmsContext ContextID, cmsInt32Number nThreads)
+{
+    _cmsThrPool* pool;
+
+    _cmsThrMutexLock(&PoolListLock);
+
+    for (pool = PoolList; pool != NULL; pool = pool->Next) {
+
+        if (pool->ContextID == ContextID) {
+
+            _cmsThrMutexUnlock(&PoolListLock);
+            return pool;
+        }
+    }
+
+    pool = CreatePool(ContextID, nThreads);
+    if (pool != NULL) {
+
+        pool->Next = PoolList;
+        PoolList = pool;
+    }
+
+    _cmsThrMutexUnlock(&PoolListLock);
+    return pool;
+}
+
+// Stops all workers of the context pool, if any, and releases it. Called by lcms
+// when the plug-in is unregistered. Any job on the fly is completed before returning.
+void _cmsThrShutdownPool(cmsContext ContextID)
+{
+    _cmsThrPool* pool;
+    _cmsThrPool* prev = NULL;
+    cmsInt32Number i;
+
+    _cmsThrMutexLock(&PoolListLock);
+
+    for (pool = PoolList; pool != NULL; prev = pool, pool = pool->Next) {
+
+        if (pool->ContextID == ContextID) {
+
+            if (prev == NULL)
+                PoolList = pool->Next;
+            else
+                prev->Next = pool->Next;
+            break;
+        }
+    }
+
+    _cmsThrMutexUnlock(&PoolListLock);
+
+    if (pool == NULL) return;
+
+    _cmsThrMutexLock(&pool->Lock);
+    pool->Shutdown = TRUE;
+    _cmsThrCondBroadcast(&pool->WorkReady);
+    _cmsThrMutexUnlock(&pool->Lock);
+
+    for (i = 0; i < pool->nThreads; i++) {
+        _cmsThrJoinThread(ContextID, pool->Threads[i]);
+    }
+
+    FreePool(pool);
+}
+
+// Puts the job at the end of the queue and wakes up workers. Pool should be locked.
+static
+void Enqueue(_cmsThrPool* pool, _cmsThrJob* job)
+{
+    job->NextSlice = 0;
+    job->Pending   = job->nSlices;
+    job->Finished  = FALSE;
+    job->Next      = NULL;
+
+    if (pool->Tail == NULL)
+        pool->Head = job;
+    else
+        pool->Tail->Next = job;
+    pool->Tail = job;
+
+    _cmsThrCondBroadcast(&pool->WorkReady);
+}
+
+// Queues a job and waits until it is done. Submitting thread helps on its own slices, 
+// so the job completes even if all workers are busy on other jobs.
+void _cmsThrRunJob(_cmsThrPool* pool, _cmsThrJob* job)
+{
+    if (job->nSlices == 0) return;
+
+    _cmsThrMutexLock(&pool->Lock);
+
+    Enqueue(pool, job);
+
+    while (job->NextSlice < job->nSlices) {
+
+        cmsUInt32Number n = TakeSlice(pool, job);
+
+        _cmsThrMutexUnlock(&pool->Lock);
+        RunSlice(job, n);
+        _cmsThrMutexLock(&pool->Lock);
+
+        SliceDone(pool, job);
+    }
+
+    while (!job->Finished) {
+        _cmsThrCondWait(&pool->WorkDone, &pool->Lock);
+    }
+
+    _cmsThrMutexUnlock(&pool->Lock);
+}
+
+// Queues a job and returns immediately. Job should be alive until finished.
+void _cmsThrSubmitJob(_cmsThrPool* pool, _cmsThrJob* job)
+{
+    _cmsThrMutexLock(&pool->Lock);
+    Enqueue(pool, job);
+    _cmsThrMutexUnlock(&pool->Lock);
+}
+
+// Waits until a submitted job is finished
+void _cmsThrWaitJob(_cmsThrPool* pool, _cmsThrJob* job)
+{
+    _cmsThrMutexLock(&pool->Lock);
+
+    while (!job->Finished) {
+        _cmsThrCondWait(&pool->WorkDone, &pool->Lock);
+    }
+
+    _cmsThrMutexUnlock(&pool->Lock);
+}
+
+// Polls a submitted job
+cmsBool _cmsThrIsJobFinished(_cmsThrPool* pool, _cmsThrJob* job)
+{
+    cmsBool Finished;
+
+    _cmsThrMutexLock(&pool->Lock);
+    Finished = job->Finished;
+    _cmsThrMutexUnlock(&pool->Lock);
+
+    return Finished;
+}
@@ -21,9 +21,19 @@
 
 #include "threaded_internal.h"
 
+// Slices up to this number are kept in the stack, so no allocation is needed for the usual case
+#define MAX_LOCAL_SLICES 256
+
+// Work-stealing mode splits the work in this number of tiles per worker
+#define TILES_PER_WORKER 8
+
+// Max number of participants in work-stealing mode
+#define MAX_DEQUES       64
+
 // The scheduler is responsible to split the work in several portions in a way that each
 // portion can be calculated by a different thread. All locking is already done by lcms 
-// mutexes, memory should not overlap.
+// mutexes, memory should not overlap. Portions are computed by the persistent pool of
+// workers of the context, plus the calling thread.
 void  _cmsThrScheduler(struct _cmstransform_struct* CMMcargo,
                        const void* InputBuffer,
                        void* OutputBuffer,
@@ -34,14 +44,18 @@ void  _cmsThrScheduler(struct _cmstransform_struct* CMMcargo,
     cmsContext ContextID = cmsGetTransformContextID(CMMcargo);
     _cmsTransform2Fn worker = _cmsGetTransformWorker(CMMcargo);
     cmsInt32Number   MaxWorkers = _cmsGetTransformMaxWorkers(CMMcargo);
-
-    // flags are not actually being used
-    // cmsUInt32Number  flags = _cmsGetTransformWorkerFlags(CMMcargo);
+    cmsUInt32Number  flags = _cmsGetTransformWorkerFlags(CMMcargo);
 
     _cmsWorkSlice master;
+    _cmsWorkSlice LocalSlices[MAX_LOCAL_SLICES];
     _cmsWorkSlice* slices;
+    _cmsThrDeque Deques[MAX_DEQUES];
     cmsStride FixedStride = *Stride;
-    cmsHANDLE* handles;
+    _cmsThrPool* pool;
+    _cmsThrJob job;
+    cmsUInt32Number nTiles, i;
+    void* Scratch;
+    cmsUInt32Number ScratchSize;
 
     //  Count the number of threads needed for this job. MaxWorkers is the upper limit or -1 to auto
     cmsUInt32Number nSlices = _cmsThrCountSlices(CMMcargo, MaxWorkers, PixelsPerLine, LineCount, &FixedStride);
@@ -53,6 +67,18 @@ void  _cmsThrScheduler(struct _cmstransform_struct* CMMcargo,
         return;
     }
 
+    // The pool is sized for the maximum number of workers. Calling thread counts as one.
+    if (MaxWorkers == CMS_THREADED_GUESS_MAX_THREADS)
+        MaxWorkers = _cmsThrIdealThreadCount();
+
+    pool = _cmsThrGetPool(ContextID, MaxWorkers - 1);
+    if (pool == NULL) {
+
+        // Out of memory, but we do the work anyway
+        worker(CMMcargo, InputBuffer, OutputBuffer, PixelsPerLine, LineCount, Stride);
+        return;
+    }
+
     // Setup master thread
     master.CMMcargo = CMMcargo;
     master.InputBuffer = InputBuffer;
@@ -61,39 +87,67 @@ void  _cmsThrScheduler(struct _cmstransform_struct* CMMcargo,
     master.LineCount = LineCount;
     master.Stride = &FixedStride;
 
-    // Create memory for the slices
-    slices  = (_cmsWorkSlice*)_cmsCalloc(ContextID, nSlices, sizeof(_cmsWorkSlice));
-    handles = (cmsHANDLE*) _cmsCalloc(ContextID, nSlices, sizeof(cmsHANDLE));
+    // In work-stealing mode, there are many more tiles than workers
+    nTiles = nSlices;
+    if (flags & CMS_THREADED_WORK_STEALING) {
 
-    if (slices == NULL || handles == NULL)
-    {
-        if (slices)  _cmsFree(ContextID, slices);
-        if (handles) _cmsFree(ContextID, handles);
+        cmsUInt32Number Units = (LineCount <= 1) ? PixelsPerLine : LineCount;
 
+        if (nSlices > MAX_DEQUES) nSlices = MAX_DEQUES;
+
+        nTiles = nSlices * TILES_PER_WORKER;
+        if (nTiles > Units) nTiles = Units;
+    }
+
+    // Memory for the slices. Scratch memory attached by the caller is used before going to the heap
+    Scratch = _cmsGetTransformScratch(CMMcargo, &ScratchSize);
+
+    if (nTiles <= MAX_LOCAL_SLICES)
+        slices = LocalSlices;
+    else
+    if (Scratch != NULL && ScratchSize >= nTiles * sizeof(_cmsWorkSlice))
+        slices = (_cmsWorkSlice*)Scratch;
+    else
+        slices = (_cmsWorkSlice*)_cmsCalloc(ContextID, nTiles, sizeof(_cmsWorkSlice));
+
+    if (slices == NULL)
+    {
         // Out of memory in this case only can come from a corruption, but we do the work anyway
         worker(CMMcargo, InputBuffer, OutputBuffer, PixelsPerLine, LineCount, Stride);
         return;
     }
 
     // All seems ok so far
-    if (_cmsThrSplitWork(&master, nSlices, slices))
+    if (_cmsThrSplitWork(&master, nTiles, slices))
     {
-        // Work is split. Create threads
-        cmsUInt32Number i;
-
-        for (i = 1; i < nSlices; i++)
-        {
-            handles[i] = _cmsThrCreateWorker(ContextID, worker, &slices[i]);
+        // Work is split. Hand it to the pool and wait for completion
+        job.Worker  = worker;
+        job.Slices  = slices;
+        job.nSlices = nSlices;
+        job.Deques  = NULL;
+        job.TaskFn  = NULL;
+        job.TaskCargo = NULL;
+        job.DoneFn  = NULL;
+
+        if (nTiles > nSlices) {
+
+            // Each participant starts with a contiguous range of tiles
+            for (i = 0; i < nSlices; i++) {
+
+                _cmsThrMutexInit(&Deques[i].Lock);
+                Deques[i].Top    = (i * nTiles) / nSlices;
+                Deques[i].Bottom = ((i + 1) * nTiles) / nSlices;
+            }
+
+            job.Deques = Deques;
         }
 
-        // Do our portion of work 
-        worker(CMMcargo, slices[0].InputBuffer, slices[0].OutputBuffer, 
-            slices[0].PixelsPerLine, slices[0].LineCount, slices[0].Stride);
+        _cmsThrRunJob(pool, &job);
+
+        if (job.Deques != NULL) {
 
-        // Wait until all threads are finished
-        for (i = 1; i < nSlices; i++)
-        {
-            _cmsThrJoinWorker(ContextID, handles[i]);
+            for (i = 0; i < nSlices; i++)
+                _cmsThrMutexDestroy(&Deques[i].Lock);
         }
     }
     else
@@ -102,7 +156,64 @@ void  _cmsThrScheduler(struct _cmstransform_struct* CMMcargo,
         worker(CMMcargo, InputBuffer, OutputBuffer, PixelsPerLine, LineCount, Stride);
     }
 
-    _cmsFree(ContextID, slices);
-    _cmsFree(ContextID, handles);
+    if (slices != LocalSlices && slices != Scratch)
+        _cmsFree(ContextID, slices);
 }
 
+// Room for the slices the scheduler may need on this transform, so callers attaching that much scratch
+// memory get no allocations at all. Zero if they always fit in the stack.
+cmsUInt32Number _cmsThrScratchSize(struct _cmstransform_struct* CMMcargo)
+{
+    cmsInt32Number  MaxWorkers = _cmsGetTransformMaxWorkers(CMMcargo);
+    cmsUInt32Number flags = _cmsGetTransformWorkerFlags(CMMcargo);
+    cmsUInt32Number nTiles;
+
+    if (MaxWorkers == CMS_THREADED_GUESS_MAX_THREADS)
+        MaxWorkers = _cmsThrIdealThreadCount();
+
+    if (MaxWorkers <= 1) return 0;
+
+    // Same bounds as the scheduler, the number of lines or pixels is not known here
+    nTiles = (cmsUInt32Number) MaxWorkers;
+    if (flags & CMS_THREADED_WORK_STEALING) {
+
+        if (nTiles > MAX_DEQUES) nTiles = MAX_DEQUES;
+        nTiles *= TILES_PER_WORKER;
+    }
+
+    if (nTiles <= MAX_LOCAL_SLICES) return 0;
+
+    return nTiles * (cmsUInt32Number) sizeof(_cmsWorkSlice);
+}
+
+// Tasks from lcms, as sampling CLUT nodes when optimizing a transform. Each task is a slice, so
+// idle workers keep taking them until all are done.
+void _cmsThrRunTasks(cmsContext ContextID, cmsInt32Number MaxWorkers, _cmsTaskFn Fn, void* Cargo, cmsUInt32Number nTasks)
+{
+    _cmsThrPool* pool = NULL;
+    _cmsThrJob job;
+    cmsUInt32Number i;
+
+    if (MaxWorkers == CMS_THREADED_GUESS_MAX_THREADS)
+        MaxWorkers = _cmsThrIdealThreadCount();
+
+    if (MaxWorkers > 1 && nTasks > 1)
+        pool = _cmsThrGetPool(ContextID, MaxWorkers - 1);
+
+    if (pool == NULL) {
+
+        for (i = 0; i < nTasks; i++)
+            Fn(Cargo, i);
+        return;
+    }
+
+    job.Worker    = NULL;
+    job.Slices    = NULL;
+    job.nSlices   = nTasks;
+    job.Deques    = NULL;
+    job.TaskFn    = Fn;
+    job.TaskCargo = Cargo;
+    job.DoneFn    = NULL;
+
+    _cmsThrRunJob(pool, &job);
+}
@@ -35,8 +35,8 @@ cmsINLINE cmsUInt32Number ComponentSize(cmsUInt32Number format)
     return BytesPerComponent;
 }
 
-// Returns bytes from one pixel to the next
-cmsINLINE cmsUInt32Number PixelSpacing(cmsUInt32Number format)
+// Returns bytes from one pixel to the next. Planar ones take just one component
+cmsUInt32Number _cmsThrPixelSpacing(cmsUInt32Number format)
 {
     if (T_PLANAR(format))
         return ComponentSize(format);
@@ -44,13 +44,6 @@ cmsINLINE cmsUInt32Number PixelSpacing(cmsUInt32Number format)
         return ComponentSize(format) * (T_CHANNELS(format) + T_EXTRA(format));
 }
 
-// macro is not portable
-cmsINLINE cmsUInt32Number minimum(cmsUInt32Number a, cmsUInt32Number b)
-{
-    return a < b ? a : b;
-}
-
-
 // Memory of block depends of planar or chunky. If lines is 1, then the stride does not contain
 // information and we have to calculate the size. If lines > 1, then we can take line size from stride.
 // if planar, total memory is number of planes per plane stride. If chunky memory is number of lines per
@@ -128,26 +121,25 @@ void SlicePerLines(const _cmsWorkSlice* master, cmsInt32Number nslices,
                             cmsInt32Number LinesPerSlice, _cmsWorkSlice slices[])
 {
     cmsInt32Number i;
-    cmsInt32Number TotalLines = master ->LineCount;
+    cmsInt32Number Extra = master->LineCount - nslices * LinesPerSlice;
+    cmsInt32Number Line = 0;
 
     for (i = 0; i < nslices; i++) {
 
         const cmsUInt8Number* PtrInput = master->InputBuffer;
         cmsUInt8Number* PtrOutput = master->OutputBuffer;
 
-        cmsInt32Number  lines = minimum(LinesPerSlice, TotalLines);
+        // Lines left because rounding are spread across first slices
+        cmsInt32Number  lines = LinesPerSlice + (i < Extra ? 1 : 0);
 
         memcpy(&slices[i], master, sizeof(_cmsWorkSlice));
 
-        slices[i].InputBuffer  = PtrInput + i * LinesPerSlice * master->Stride->BytesPerLineIn;
-        slices[i].OutputBuffer = PtrOutput + i * LinesPerSlice * master->Stride->BytesPerLineOut;
+        slices[i].InputBuffer  = PtrInput + Line * master->Stride->BytesPerLineIn;
+        slices[i].OutputBuffer = PtrOutput + Line * master->Stride->BytesPerLineOut;
 
         slices[i].LineCount = lines;
-        TotalLines -= lines;
+        Line += lines;
     }
-
-    // Add left lines because rounding
-    if (nslices > 0) slices[nslices - 1].LineCount += TotalLines;
 }
 
 // Per pixels on big blocks of one line
@@ -156,29 +148,28 @@ void SlicePerPixels(const _cmsWorkSlice* master, cmsInt32Number nslices,
                     cmsInt32Number PixelsPerSlice, _cmsWorkSlice slices[])
 {
     cmsInt32Number i;
-    cmsInt32Number TotalPixels = master->PixelsPerLine; // As this works on one line only
+    cmsInt32Number Extra = master->PixelsPerLine - nslices * PixelsPerSlice;  // As this works on one line only
+    cmsInt32Number Pixel = 0;
 
-    cmsUInt32Number PixelSpacingIn = PixelSpacing(cmsGetTransformInputFormat((cmsHTRANSFORM)master->CMMcargo));
-    cmsUInt32Number PixelSpacingOut = PixelSpacing(cmsGetTransformOutputFormat((cmsHTRANSFORM)master->CMMcargo));
+    cmsUInt32Number PixelSpacingIn = _cmsThrPixelSpacing(cmsGetTransformInputFormat((cmsHTRANSFORM)master->CMMcargo));
+    cmsUInt32Number PixelSpacingOut = _cmsThrPixelSpacing(cmsGetTransformOutputFormat((cmsHTRANSFORM)master->CMMcargo));
 
     for (i = 0; i < nslices; i++) {
 
         const cmsUInt8Number* PtrInput = master->InputBuffer;
         cmsUInt8Number* PtrOutput = master->OutputBuffer;
 
-        cmsInt32Number pixels = minimum(PixelsPerSlice, TotalPixels);
+        // Pixels left because rounding are spread across first slices
+        cmsInt32Number pixels = PixelsPerSlice + (i < Extra ? 1 : 0);
 
         memcpy(&slices[i], master, sizeof(_cmsWorkSlice));
 
-        slices[i].InputBuffer = PtrInput + i * PixelsPerSlice * PixelSpacingIn;
-        slices[i].OutputBuffer = PtrOutput + i * PixelsPerSlice * PixelSpacingOut;
+        slices[i].InputBuffer = PtrInput + Pixel * PixelSpacingIn;
+        slices[i].OutputBuffer = PtrOutput + Pixel * PixelSpacingOut;
         slices[i].PixelsPerLine = pixels;
 
-        TotalPixels -= pixels;
+        Pixel += pixels;
     }
-
-    // Add left pixels because rounding
-    if (nslices > 0) slices[nslices - 1].PixelsPerLine += TotalPixels;
 }
 
 
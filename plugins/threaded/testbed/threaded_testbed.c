@@ -351,6 +351,547 @@ void CheckAccuracy16Bits(void)
 }
 
 
+// Many small tiles on same context. Workers are kept alive across calls and released on cmsDeleteContext()
+static
+void TryManyTiles(cmsUInt32Number flags)
+{
+    cmsContext Raw = cmsCreateContext(NULL, NULL);
+    cmsContext Plugin = cmsCreateContext(cmsThreadedExtensions(CMS_THREADED_GUESS_MAX_THREADS, flags), NULL);
+    cmsHPROFILE hsRGB, hOut;
+    cmsHTRANSFORM xformRaw, xformPlugin;
+    Scanline_rgba8bits* bufferIn;
+    Scanline_rgba16bits* bufferRawOut;
+    Scanline_rgba16bits* bufferPluginOut;
+    cmsUInt32Number i, tile;
+    cmsUInt32Number npixels = 256 * 256;
+
+    hsRGB = cmsCreate_sRGBProfile();
+    hOut = cmsCreate_sRGBProfile();
+
+    xformRaw = cmsCreateTransformTHR(Raw, hsRGB, TYPE_RGBA_8, hOut, TYPE_RGBA_16, INTENT_PERCEPTUAL, FLAGS | cmsFLAGS_NOCACHE);
+    xformPlugin = cmsCreateTransformTHR(Plugin, hsRGB, TYPE_RGBA_8, hOut, TYPE_RGBA_16, INTENT_PERCEPTUAL, FLAGS | cmsFLAGS_NOCACHE);
+
+    cmsCloseProfile(hsRGB);
+    cmsCloseProfile(hOut);
+
+    if (xformRaw == NULL || xformPlugin == NULL) {
+
+        Fail("NULL transforms on pool reuse");
+    }
+
+    bufferIn = (Scanline_rgba8bits*)malloc(npixels * sizeof(Scanline_rgba8bits));
+    bufferRawOut = (Scanline_rgba16bits*)malloc(npixels * sizeof(Scanline_rgba16bits));
+    bufferPluginOut = (Scanline_rgba16bits*)malloc(npixels * sizeof(Scanline_rgba16bits));
+
+    for (tile = 0; tile < 64; tile++) {
+
+        for (i = 0; i < npixels; i++) {
+
+            bufferIn[i].r = (cmsUInt8Number)(i + tile);
+            bufferIn[i].g = (cmsUInt8Number)(i >> 8);
+            bufferIn[i].b = (cmsUInt8Number)(tile * 4);
+            bufferIn[i].a = 0;
+        }
+
+        cmsDoTransformLineStride(xformRaw, bufferIn, bufferRawOut, 256, 256, 256 * sizeof(Scanline_rgba8bits), 256 * sizeof(Scanline_rgba16bits), 0, 0);
+        cmsDoTransformLineStride(xformPlugin, bufferIn, bufferPluginOut, 256, 256, 256 * sizeof(Scanline_rgba8bits), 256 * sizeof(Scanline_rgba16bits), 0, 0);
+
+        if (memcmp(bufferRawOut, bufferPluginOut, npixels * sizeof(Scanline_rgba16bits)) != 0)
+            Fail("Tile %d differs", tile);
+    }
+
+    free(bufferIn); free(bufferRawOut);
+    free(bufferPluginOut);
+
+    cmsDeleteTransform(xformRaw);
+    cmsDeleteTransform(xformPlugin);
+
+    // This one should stop all workers
+    cmsDeleteContext(Plugin);
+    cmsDeleteContext(Raw);
+}
+
+static
+void CheckPoolReuse(void)
+{
+    trace("Checking worker pool reuse...");
+    TryManyTiles(0);
+    trace("Ok\n");
+}
+
+static
+void CheckWorkStealing(void)
+{
+    trace("Checking work-stealing scheduler...");
+    TryManyTiles(CMS_THREADED_WORK_STEALING);
+    trace("Ok\n");
+}
+
+
+// Callback for asynchronous transforms, each band has its own flag
+static
+void BandDone(cmsHTRANSFORM Transform, void* UserData)
+{
+    UNUSED_PARAMETER(Transform);
+    *(int*)UserData = 1;
+}
+
+// Queues several bands at once, as a decoder would do, and checks results against plain transforms
+static
+void CheckAsync(void)
+{
+    cmsContext Raw = cmsCreateContext(NULL, NULL);
+    cmsContext Plugin = cmsCreateContext(cmsThreadedExtensions(CMS_THREADED_GUESS_MAX_THREADS, 0), NULL);
+    cmsHPROFILE hIn, hOut;
+    cmsHTRANSFORM xformRaw, xformPlugin;
+    Scanline_rgba8bits* bufferIn;
+    Scanline_rgba16bits* bufferRawOut;
+    Scanline_rgba16bits* bufferPluginOut;
+    cmsHANDLE handles[16];
+    int done[16];
+    cmsUInt32Number i, band;
+    cmsUInt32Number npixels = 256 * 256 * 16;
+
+    trace("Checking asynchronous transforms...");
+
+    hIn = cmsOpenProfileFromFile(PROFILES_DIR "test5.icc", "r");
+    hOut = cmsOpenProfileFromFile(PROFILES_DIR "test3.icc", "r");
+
+    xformRaw = cmsCreateTransformTHR(Raw, hIn, TYPE_RGBA_8, hOut, TYPE_RGBA_16, INTENT_PERCEPTUAL, FLAGS | cmsFLAGS_NOCACHE);
+    xformPlugin = cmsCreateTransformTHR(Plugin, hIn, TYPE_RGBA_8, hOut, TYPE_RGBA_16, INTENT_PERCEPTUAL, FLAGS | cmsFLAGS_NOCACHE);
+
+    cmsCloseProfile(hIn);
+    cmsCloseProfile(hOut);
+
+    if (xformRaw == NULL || xformPlugin == NULL) {
+
+        Fail("NULL transforms on async check");
+    }
+
+    bufferIn = (Scanline_rgba8bits*)malloc(npixels * sizeof(Scanline_rgba8bits));
+    bufferRawOut = (Scanline_rgba16bits*)malloc(npixels * sizeof(Scanline_rgba16bits));
+    bufferPluginOut = (Scanline_rgba16bits*)malloc(npixels * sizeof(Scanline_rgba16bits));
+
+    for (i = 0; i < npixels; i++) {
+
+        bufferIn[i].r = (cmsUInt8Number)i;
+        bufferIn[i].g = (cmsUInt8Number)(i >> 8);
+        bufferIn[i].b = (cmsUInt8Number)(i >> 16);
+        bufferIn[i].a = 0;
+    }
+
+    cmsDoTransform(xformRaw, bufferIn, bufferRawOut, npixels);
+
+    // 16 bands of 256 lines
+    for (band = 0; band < 16; band++) {
+
+        done[band] = 0;
+        handles[band] = cmsDoTransformLineStrideAsync(xformPlugin, 
+                                 bufferIn + band * 256 * 256, bufferPluginOut + band * 256 * 256, 
+                                 256, 256, 256 * sizeof(Scanline_rgba8bits), 256 * sizeof(Scanline_rgba16bits), 0, 0, 
+                                 BandDone, &done[band]);
+        if (handles[band] == NULL)
+            Fail("Cannot queue band %d", band);
+    }
+
+    for (band = 0; band < 16; band++) {
+
+        cmsWaitTransformAsync(handles[band]);
+        if (!done[band])
+            Fail("Callback not called on band %d", band);
+    }
+
+    if (memcmp(bufferRawOut, bufferPluginOut, npixels * sizeof(Scanline_rgba16bits)) != 0)
+        Fail("Asynchronous transform differs");
+
+    free(bufferIn); free(bufferRawOut);
+    free(bufferPluginOut);
+
+    cmsDeleteTransform(xformRaw);
+    cmsDeleteTransform(xformPlugin);
+
+    cmsDeleteContext(Plugin);
+    cmsDeleteContext(Raw);
+
+    trace("Ok\n");
+}
+
+
+// Planar buffers submitted as a single run must use one component as plane stride
+static
+void CheckAsyncPlanar(void)
+{
+    cmsContext Raw = cmsCreateContext(NULL, NULL);
+    cmsContext Plugin = cmsCreateContext(cmsThreadedExtensions(CMS_THREADED_GUESS_MAX_THREADS, 0), NULL);
+    cmsHPROFILE hIn, hOut;
+    cmsHTRANSFORM xformRaw, xformPlugin;
+    cmsUInt8Number* bufferIn;
+    cmsUInt16Number* bufferRawOut;
+    cmsUInt16Number* bufferPluginOut;
+    cmsHANDLE handle;
+    int done = 0;
+    cmsUInt32Number i;
+    cmsUInt32Number npixels = 256 * 256;
+
+    trace("Checking asynchronous planar transforms...");
+
+    hIn = cmsOpenProfileFromFile(PROFILES_DIR "test5.icc", "r");
+    hOut = cmsOpenProfileFromFile(PROFILES_DIR "test3.icc", "r");
+
+    xformRaw = cmsCreateTransformTHR(Raw, hIn, TYPE_RGB_8_PLANAR, hOut, TYPE_RGB_16_PLANAR, INTENT_PERCEPTUAL, FLAGS | cmsFLAGS_NOCACHE);
+    xformPlugin = cmsCreateTransformTHR(Plugin, hIn, TYPE_RGB_8_PLANAR, hOut, TYPE_RGB_16_PLANAR, INTENT_PERCEPTUAL, FLAGS | cmsFLAGS_NOCACHE);
+
+    cmsCloseProfile(hIn);
+    cmsCloseProfile(hOut);
+
+    if (xformRaw == NULL || xformPlugin == NULL) {
+
+        Fail("NULL transforms on async planar check");
+    }
+
+    // Exactly three planes each, so any overrun is caught by memory checkers
+    bufferIn = (cmsUInt8Number*)malloc(npixels * 3 * sizeof(cmsUInt8Number));
+    bufferRawOut = (cmsUInt16Number*)malloc(npixels * 3 * sizeof(cmsUInt16Number));
+    bufferPluginOut = (cmsUInt16Number*)malloc(npixels * 3 * sizeof(cmsUInt16Number));
+
+    for (i = 0; i < npixels; i++) {
+
+        bufferIn[i] = (cmsUInt8Number)i;
+        bufferIn[i + npixels] = (cmsUInt8Number)(i >> 8);
+        bufferIn[i + 2 * npixels] = (cmsUInt8Number)(i * 3);
+    }
+
+    cmsDoTransform(xformRaw, bufferIn, bufferRawOut, npixels);
+
+    handle = cmsDoTransformAsync(xformPlugin, bufferIn, bufferPluginOut, npixels, BandDone, &done);
+    if (handle == NULL)
+        Fail("Cannot queue planar transform");
+
+    cmsWaitTransformAsync(handle);
+    if (!done)
+        Fail("Callback not called on planar transform");
+
+    if (memcmp(bufferRawOut, bufferPluginOut, npixels * 3 * sizeof(cmsUInt16Number)) != 0)
+        Fail("Asynchronous planar transform differs");
+
+    free(bufferIn); free(bufferRawOut);
+    free(bufferPluginOut);
+
+    cmsDeleteTransform(xformRaw);
+    cmsDeleteTransform(xformPlugin);
+
+    cmsDeleteContext(Plugin);
+    cmsDeleteContext(Raw);
+
+    trace("Ok\n");
+}
+
+
+// Transform creation samples the CLUT nodes on the pool. The result should be the same table.
+static
+void CheckParallelSampling(void)
+{
+    cmsContext Raw = cmsCreateContext(NULL, NULL);
+    cmsContext Plugin = cmsCreateContext(cmsThreadedExtensions(CMS_THREADED_GUESS_MAX_THREADS, 0), NULL);
+    cmsHPROFILE hIn, hOut;
+    cmsHTRANSFORM xformRaw, xformPlugin;
+    Scanline_cmyk16bits* bufferIn;
+    Scanline_cmyk16bits* bufferRawOut;
+    Scanline_cmyk16bits* bufferPluginOut;
+    cmsFloat64Number tRaw, tPlugin;
+    cmsUInt32Number i;
+    cmsUInt32Number npixels = 256 * 256;
+
+    trace("Checking parallel CLUT sampling...");
+
+    hIn = cmsOpenProfileFromFile(PROFILES_DIR "test1.icc", "r");
+    hOut = cmsOpenProfileFromFile(PROFILES_DIR "test2.icc", "r");
+
+    MeasureTimeStart();
+    xformRaw = cmsCreateTransformTHR(Raw, hIn, TYPE_CMYK_16, hOut, TYPE_CMYK_16, INTENT_PERCEPTUAL, cmsFLAGS_HIGHRESPRECALC | cmsFLAGS_NOCACHE);
+    tRaw = MeasureTimeStop();
+
+    MeasureTimeStart();
+    xformPlugin = cmsCreateTransformTHR(Plugin, hIn, TYPE_CMYK_16, hOut, TYPE_CMYK_16, INTENT_PERCEPTUAL, cmsFLAGS_HIGHRESPRECALC | cmsFLAGS_NOCACHE);
+    tPlugin = MeasureTimeStop();
+
+    cmsCloseProfile(hIn);
+    cmsCloseProfile(hOut);
+
+    if (xformRaw == NULL || xformPlugin == NULL) {
+
+        Fail("NULL transforms on parallel sampling check");
+    }
+
+    bufferIn = (Scanline_cmyk16bits*)malloc(npixels * sizeof(Scanline_cmyk16bits));
+    bufferRawOut = (Scanline_cmyk16bits*)malloc(npixels * sizeof(Scanline_cmyk16bits));
+    bufferPluginOut = (Scanline_cmyk16bits*)malloc(npixels * sizeof(Scanline_cmyk16bits));
+
+    for (i = 0; i < npixels; i++) {
+
+        bufferIn[i].c = (cmsUInt16Number)(i * 251);
+        bufferIn[i].m = (cmsUInt16Number)(i * 13);
+        bufferIn[i].y = (cmsUInt16Number)(i * 7919);
+        bufferIn[i].k = (cmsUInt16Number)(i >> 2);
+    }
+
+    cmsDoTransform(xformRaw, bufferIn, bufferRawOut, npixels);
+    cmsDoTransform(xformPlugin, bufferIn, bufferPluginOut, npixels);
+
+    if (memcmp(bufferRawOut, bufferPluginOut, npixels * sizeof(Scanline_cmyk16bits)) != 0)
+        Fail("Parallel sampling differs");
+
+    free(bufferIn); free(bufferRawOut);
+    free(bufferPluginOut);
+
+    cmsDeleteTransform(xformRaw);
+    cmsDeleteTransform(xformPlugin);
+
+    cmsDeleteContext(Plugin);
+    cmsDeleteContext(Raw);
+
+    trace("Ok (%.1f ms serial, %.1f ms on pool)\n", tRaw * 1000.0, tPlugin * 1000.0);
+}
+
+
+// Several threads on the same ARENA|MULTICACHE transform. The arena is sealed once the transform is built,
+// so calls do not race on it, and the memory of the context stays where it was.
+#define ARENA_THREADS   8
+
+typedef struct {
+
+    cmsHTRANSFORM xform;
+    const Scanline_rgb8bits* In;
+    Scanline_rgb8bits* Out;
+    cmsUInt32Number nPixels;
+
+} ArenaCargo;
+
+static
+void ArenaThread(void* param)
+{
+    ArenaCargo* Cargo = (ArenaCargo*) param;
+    cmsUInt32Number i;
+
+    for (i = 0; i < 50; i++)
+        cmsDoTransform(Cargo->xform, Cargo->In, Cargo->Out, Cargo->nPixels);
+}
+
+static
+void CheckArenaMultiCache(void)
+{
+    cmsContext ctx = cmsCreateContext(NULL, NULL);
+    cmsHPROFILE hIn, hOut;
+    cmsHTRANSFORM xformRef, xform;
+    cmsHANDLE Threads[ARENA_THREADS];
+    ArenaCargo Cargo[ARENA_THREADS];
+    Scanline_rgb8bits* In;
+    Scanline_rgb8bits* OutRef;
+    Scanline_rgb8bits* Out;
+    cmsMemoryStats Before, After;
+    cmsUInt32Number i, npixels = 256 * 64;
+
+    trace("Checking arena transforms on several threads...");
+
+    if (!cmsEnableMemoryStats(ctx)) Fail("Unable to account memory");
+
+    hIn  = cmsOpenProfileFromFileTHR(ctx, PROFILES_DIR "test5.icc", "r");
+    hOut = cmsOpenProfileFromFileTHR(ctx, PROFILES_DIR "test3.icc", "r");
+
+    xformRef = cmsCreateTransformTHR(ctx, hIn, TYPE_RGB_8, hOut, TYPE_RGB_8, INTENT_PERCEPTUAL, cmsFLAGS_NOCACHE);
+    xform    = cmsCreateTransformTHR(ctx, hIn, TYPE_RGB_8, hOut, TYPE_RGB_8, INTENT_PERCEPTUAL, cmsFLAGS_ARENA | cmsFLAGS_MULTICACHE);
+
+    cmsCloseProfile(hIn);
+    cmsCloseProfile(hOut);
+
+    if (xformRef == NULL || xform == NULL)
+        Fail("NULL transforms on arena check");
+
+    In     = (Scanline_rgb8bits*) malloc(npixels * sizeof(Scanline_rgb8bits));
+    OutRef = (Scanline_rgb8bits*) malloc(npixels * sizeof(Scanline_rgb8bits));
+    Out    = (Scanline_rgb8bits*) malloc(ARENA_THREADS * npixels * sizeof(Scanline_rgb8bits));
+
+    // A small palette, so the cache gets hits
+    for (i = 0; i < npixels; i++) {
+
+        In[i].r = (cmsUInt8Number) ((i * 7) & 0x3F);
+        In[i].g = (cmsUInt8Number) ((i * 3) & 0x3F);
+        In[i].b = (cmsUInt8Number) (i & 0x3F);
+    }
+
+    cmsDoTransform(xformRef, In, OutRef, npixels);
+    cmsGetMemoryStats(ctx, &Before);
+
+    for (i = 0; i < ARENA_THREADS; i++) {
+
+        Cargo[i].xform   = xform;
+        Cargo[i].In      = In;
+        Cargo[i].Out     = Out + i * npixels;
+        Cargo[i].nPixels = npixels;
+
+        Threads[i] = _cmsThrCreateThread(ctx, ArenaThread, &Cargo[i]);
+        if (Threads[i] == NULL) Fail("Unable to create threads");
+    }
+
+    for (i = 0; i < ARENA_THREADS; i++)
+        _cmsThrJoinThread(ctx, Threads[i]);
+
+    cmsGetMemoryStats(ctx, &After);
+
+    for (i = 0; i < ARENA_THREADS; i++) {
+
+        if (memcmp(OutRef, Out + i * npixels, npixels * sizeof(Scanline_rgb8bits)) != 0)
+            Fail("Arena transform differs on thread %u", i);
+    }
+
+    if (After.CurrentBytes != Before.CurrentBytes)
+        Fail("Memory in use went from %u to %u bytes", (cmsUInt32Number) Before.CurrentBytes, (cmsUInt32Number) After.CurrentBytes);
+
+    if (After.Allocations != Before.Allocations)
+        Fail("%u allocations on steady-state calls", (cmsUInt32Number) (After.Allocations - Before.Allocations));
+
+    free(In); free(OutRef); free(Out);
+
+    cmsDeleteTransform(xformRef);
+    cmsDeleteTransform(xform);
+    cmsDeleteContext(ctx);
+
+    trace("Ok\n");
+}
+
+// Many tiles do not fit in the stack of the scheduler. With the scratch memory the transform asks for,
+// calls should not allocate anything.
+static
+void CheckSchedulerScratch(void)
+{
+    cmsContext ctx = cmsCreateContext(cmsThreadedExtensions(48, CMS_THREADED_WORK_STEALING), NULL);
+    cmsHPROFILE hsRGB;
+    cmsHTRANSFORM xform;
+    Scanline_rgb8bits* In;
+    Scanline_rgb8bits* Out;
+    cmsMemoryStats Before, After;
+    cmsUInt32Number i, Size, npixels = 1024 * 1200;
+    void* Scratch;
+
+    trace("Checking scheduler on scratch memory...");
+
+    if (!cmsEnableMemoryStats(ctx)) Fail("Unable to account memory");
+
+    // More workers than processors is warned about, but it is what is wanted here
+    cmsSetLogErrorHandler(NULL);
+
+    hsRGB = cmsCreate_sRGBProfileTHR(ctx);
+    xform = cmsCreateTransformTHR(ctx, hsRGB, TYPE_RGB_8, hsRGB, TYPE_RGB_8, INTENT_PERCEPTUAL, cmsFLAGS_NOCACHE);
+    cmsCloseProfile(hsRGB);
+
+    if (xform == NULL)
+        Fail("NULL transform on scratch check");
+
+    Size = cmsGetTransformScratchSize(xform);
+    if (Size == 0)
+        Fail("No scratch memory asked for the slices");
+
+    In  = (Scanline_rgb8bits*) malloc(npixels * sizeof(Scanline_rgb8bits));
+    Out = (Scanline_rgb8bits*) malloc(npixels * sizeof(Scanline_rgb8bits));
+    Scratch = malloc(Size);
+
+    for (i = 0; i < npixels; i++) {
+
+        In[i].r = (cmsUInt8Number) i;
+        In[i].g = (cmsUInt8Number) (i >> 8);
+        In[i].b = (cmsUInt8Number) (i >> 16);
+    }
+
+    // The first call sets the workers up. Without scratch, the slices go to the heap
+    cmsDoTransformLineStride(xform, In, Out, 1024, 1200, 1024 * sizeof(Scanline_rgb8bits), 1024 * sizeof(Scanline_rgb8bits), 0, 0);
+
+    cmsGetMemoryStats(ctx, &Before);
+    cmsDoTransformLineStride(xform, In, Out, 1024, 1200, 1024 * sizeof(Scanline_rgb8bits), 1024 * sizeof(Scanline_rgb8bits), 0, 0);
+    cmsGetMemoryStats(ctx, &After);
+
+    if (After.Allocations == Before.Allocations)
+        Fail("Slices expected in the heap");
+
+    cmsSetTransformScratch(xform, Scratch, Size);
+
+    cmsGetMemoryStats(ctx, &Before);
+    for (i = 0; i < 4; i++)
+        cmsDoTransformLineStride(xform, In, Out, 1024, 1200, 1024 * sizeof(Scanline_rgb8bits), 1024 * sizeof(Scanline_rgb8bits), 0, 0);
+    cmsGetMemoryStats(ctx, &After);
+
+    cmsSetLogErrorHandler(FatalErrorQuit);
+
+    if (After.Allocations != Before.Allocations)
+        Fail("%u allocations with scratch memory", (cmsUInt32Number) (After.Allocations - Before.Allocations));
+
+    cmsDeleteTransform(xform);
+    cmsDeleteContext(ctx);
+    free(In); free(Out); free(Scratch);
+
+    trace("Ok\n");
+}
+
+// Workers fill the cells of a lazy CLUT concurrently. The result should be the same table.
+static
+void CheckLazyPrecalc(void)
+{
+    cmsContext Raw = cmsCreateContext(NULL, NULL);
+    cmsContext Plugin = cmsCreateContext(cmsThreadedExtensions(CMS_THREADED_GUESS_MAX_THREADS, 0), NULL);
+    cmsHPROFILE hIn, hOut;
+    cmsHTRANSFORM xformRaw, xformPlugin;
+    Scanline_cmyk16bits* bufferIn;
+    Scanline_cmyk16bits* bufferRawOut;
+    Scanline_cmyk16bits* bufferPluginOut;
+    cmsUInt32Number i;
+    cmsUInt32Number npixels = 256 * 256;
+
+    trace("Checking lazy CLUT on pool...");
+
+    hIn = cmsOpenProfileFromFile(PROFILES_DIR "test1.icc", "r");
+    hOut = cmsOpenProfileFromFile(PROFILES_DIR "test2.icc", "r");
+
+    xformRaw = cmsCreateTransformTHR(Raw, hIn, TYPE_CMYK_16, hOut, TYPE_CMYK_16, INTENT_PERCEPTUAL, cmsFLAGS_NOCACHE);
+    xformPlugin = cmsCreateTransformTHR(Plugin, hIn, TYPE_CMYK_16, hOut, TYPE_CMYK_16, INTENT_PERCEPTUAL, cmsFLAGS_NOCACHE | cmsFLAGS_LAZYPRECALC);
+
+    cmsCloseProfile(hIn);
+    cmsCloseProfile(hOut);
+
+    if (xformRaw == NULL || xformPlugin == NULL) {
+
+        Fail("NULL transforms on lazy CLUT check");
+    }
+
+    bufferIn = (Scanline_cmyk16bits*)malloc(npixels * sizeof(Scanline_cmyk16bits));
+    bufferRawOut = (Scanline_cmyk16bits*)malloc(npixels * sizeof(Scanline_cmyk16bits));
+    bufferPluginOut = (Scanline_cmyk16bits*)malloc(npixels * sizeof(Scanline_cmyk16bits));
+
+    for (i = 0; i < npixels; i++) {
+
+        bufferIn[i].c = (cmsUInt16Number)(i * 251);
+        bufferIn[i].m = (cmsUInt16Number)(i * 13);
+        bufferIn[i].y = (cmsUInt16Number)(i * 7919);
+        bufferIn[i].k = (cmsUInt16Number)(i >> 2);
+    }
+
+    cmsDoTransform(xformRaw, bufferIn, bufferRawOut, npixels);
+    cmsDoTransform(xformPlugin, bufferIn, bufferPluginOut, npixels);
+
+    if (memcmp(bufferRawOut, bufferPluginOut, npixels * sizeof(Scanline_cmyk16bits)) != 0)
+        Fail("Lazy CLUT differs");
+
+    free(bufferIn); free(bufferRawOut);
+    free(bufferPluginOut);
+
+    cmsDeleteTransform(xformRaw);
+    cmsDeleteTransform(xformPlugin);
+
+    cmsDeleteContext(Plugin);
+    cmsDeleteContext(Raw);
+
+    trace("Ok\n");
+}
+
+
 // --------------------------------------------------------------------------------------------------
 // P E R F O R M A N C E   C H E C K S
 // --------------------------------------------------------------------------------------------------
@@ -846,6 +1387,31 @@ void ComparativeLineStride8bits(void)
        cmsDeleteContext(NoPlugin);
 }
 
+static
+void ComparativeWorkStealing(void)
+{
+       cmsContext Static, Stealing;
+
+       trace("\n\n");
+       trace("C O M P A R A T I V E  static slicing vs. work-stealing tiles\n");
+       trace("                              values given in MegaPixels per second.\n");
+       trace("====================================================================\n");
+
+       fflush(stdout);
+
+       Static = cmsCreateContext(cmsThreadedExtensions(CMS_THREADED_GUESS_MAX_THREADS, 0), NULL);
+       Stealing = cmsCreateContext(cmsThreadedExtensions(CMS_THREADED_GUESS_MAX_THREADS, CMS_THREADED_WORK_STEALING), NULL);
+
+       ComparativeCt(Static, Stealing, "CLUT profiles  ", SpeedTest8bitLineStride, SpeedTest8bitLineStride, PROFILES_DIR "test5.icc", PROFILES_DIR "test3.icc");
+       ComparativeCt(Static, Stealing, "CLUT 16 bits   ", SpeedTest16bitsRGB,      SpeedTest16bitsRGB,      PROFILES_DIR "test5.icc", PROFILES_DIR "test3.icc");
+       ComparativeCt(Static, Stealing, "CMYK CLUT      ", SpeedTest16bitsCMYK,     SpeedTest16bitsCMYK,     PROFILES_DIR "test1.icc", PROFILES_DIR "test2.icc");
+       ComparativeCt(Static, Stealing, "Matrix-Shaper  ", SpeedTest8bitLineStride, SpeedTest8bitLineStride, PROFILES_DIR "test5.icc", PROFILES_DIR "test0.icc");
+       ComparativeCt(Static, Stealing, "curves         ", SpeedTest8bitLineStride, SpeedTest8bitLineStride, NULL, NULL);
+
+       cmsDeleteContext(Stealing);
+       cmsDeleteContext(Static);
+}
+
 
 
 // The harness test
@@ -872,11 +1438,20 @@ int main()
     // Accuracy
     CheckAccuracy8Bits();
     CheckAccuracy16Bits();
+    CheckPoolReuse();
+    CheckWorkStealing();
+    CheckAsync();
+    CheckAsyncPlanar();
+    CheckParallelSampling();
+    CheckLazyPrecalc();
+    CheckArenaMultiCache();
+    CheckSchedulerScratch();
 
     // Check speed
     SpeedTest8();
     SpeedTest16();
     ComparativeLineStride8bits();
+    ComparativeWorkStealing();
 
     cmsUnregisterPlugins();
 
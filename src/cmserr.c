@@ -127,6 +127,7 @@ long int CMSEXPORT cmsfilelength(FILE* f)
 // replace the optional mallocZero, calloc and dup as well.
 
 cmsBool   _cmsRegisterMemHandlerPlugin(cmsContext ContextID, cmsPluginBase* Plugin);
+static void UnshareMemoryChunk(_cmsMemPluginChunkType* ptr);
 
 // *********************************************************************************
 
@@ -223,7 +224,8 @@ void* _cmsDupDefaultFn(cmsContext ContextID, const void* Org, cmsUInt32Number si
 
 // Pointers to memory manager functions in Context0
 _cmsMemPluginChunkType _cmsMemPluginChunk = { _cmsMallocDefaultFn, _cmsMallocZeroDefaultFn, _cmsFreeDefaultFn, 
-                                              _cmsReallocDefaultFn, _cmsCallocDefaultFn,    _cmsDupDefaultFn
+                                              _cmsReallocDefaultFn, _cmsCallocDefaultFn,    _cmsDupDefaultFn,
+                                              NULL, NULL
                                             };
 
 
@@ -236,6 +238,10 @@ void _cmsAllocMemPluginChunk(struct _cmsContext_struct* ctx, const struct _cmsCo
 
         // Duplicate
         ctx ->chunks[MemPlugin] = _cmsSubAllocDup(ctx ->MemPool, src ->chunks[MemPlugin], sizeof(_cmsMemPluginChunkType));  
+
+        // Arenas and accounting are not inherited
+        if (ctx ->chunks[MemPlugin] != NULL)
+            UnshareMemoryChunk((_cmsMemPluginChunkType*) ctx ->chunks[MemPlugin]);
     }
     else {
 
@@ -261,6 +267,8 @@ void _cmsInstallAllocFunctions(cmsPluginMemHandler* Plugin, _cmsMemPluginChunkTy
         ptr ->MallocZeroPtr= _cmsMallocZeroDefaultFn;
         ptr ->CallocPtr    = _cmsCallocDefaultFn;
         ptr ->DupPtr       = _cmsDupDefaultFn;
+        ptr ->Arena        = NULL;
+        ptr ->Stats        = NULL;
       
         if (Plugin ->MallocZeroPtr != NULL) ptr ->MallocZeroPtr = Plugin -> MallocZeroPtr;
         if (Plugin ->CallocPtr != NULL)     ptr ->CallocPtr     = Plugin -> CallocPtr;
@@ -350,6 +358,565 @@ void* CMSEXPORT _cmsDupMem(cmsContext ContextID, const void* Org, cmsUInt32Numbe
 
 // ********************************************************************************************
 
+// Memory accounting. Once enabled on a context, its allocators are wrapped by ones that keep
+// track of every block in a hash table, keyed by address. Nothing changes in the blocks
+// themselves, so accounting may be turned on at any moment: blocks allocated before are just
+// not seen. Contexts without accounting run the allocators untouched. A few constructors tag
+// their main blocks with the kind of object, see _cmsSetMemoryKind().
+
+#define MEMSTATS_INITIAL_SLOTS   1024
+
+typedef struct {
+
+    const void*     Ptr;           // NULL if the slot is empty
+    cmsUInt32Number Size;
+    cmsUInt32Number Kind;
+
+} _cmsMemStatsEntry;
+
+typedef struct {
+
+    _cmsMemPluginChunkType Parent;  // The allocators in place before accounting
+    cmsContext       ContextID;     // The one accounted. The table and mutex belong to it
+    void*            Mutex;
+
+    cmsMemoryStats   Stats;
+
+    _cmsMemStatsEntry* Table;       // Open addressing, linear probing
+    cmsUInt32Number  nSlots;        // Power of two
+    cmsUInt32Number  nUsed;
+
+} _cmsMemStats;
+
+static
+_cmsMemStats* GetMemStats(cmsContext ContextID)
+{
+    _cmsMemPluginChunkType* ptr = (_cmsMemPluginChunkType*) _cmsContextGetClientChunk(ContextID, MemPlugin);
+    return (_cmsMemStats*) ptr ->Stats;
+}
+
+static
+cmsUInt32Number MemStatsSlot(const _cmsMemStats* s, const void* Ptr)
+{
+    return ((cmsUInt32Number) ((size_t) Ptr >> 4) * 0x9E3779B1U) & (s ->nSlots - 1);
+}
+
+// Returns the slot holding Ptr, or the empty one where it would go
+static
+cmsUInt32Number MemStatsFind(const _cmsMemStats* s, const void* Ptr)
+{
+    cmsUInt32Number i = MemStatsSlot(s, Ptr);
+
+    while (s ->Table[i].Ptr != NULL && s ->Table[i].Ptr != Ptr)
+        i = (i + 1) & (s ->nSlots - 1);
+
+    return i;
+}
+
+// Doubles the table. Must be called with the mutex locked
+static
+cmsBool MemStatsGrow(_cmsMemStats* s)
+{
+    _cmsMemStatsEntry* Old = s ->Table;
+    cmsUInt32Number nOld = s ->nSlots;
+    cmsUInt32Number i;
+
+    s ->Table = (_cmsMemStatsEntry*) s ->Parent.MallocPtr(s ->ContextID, 2 * nOld * sizeof(_cmsMemStatsEntry));
+    if (s ->Table == NULL) {
+        s ->Table = Old;
+        return FALSE;
+    }
+
+    memset(s ->Table, 0, 2 * nOld * sizeof(_cmsMemStatsEntry));
+    s ->nSlots = 2 * nOld;
+
+    for (i=0; i < nOld; i++) {
+
+        if (Old[i].Ptr != NULL)
+            s ->Table[MemStatsFind(s, Old[i].Ptr)] = Old[i];
+    }
+
+    s ->Parent.FreePtr(s ->ContextID, Old);
+    return TRUE;
+}
+
+// Counts as an allocation unless the block is just put back, as when a realloc fails
+static
+void TrackBlock(_cmsMemStats* s, const void* Ptr, cmsUInt32Number Size, cmsUInt32Number Kind, cmsBool NewBlock)
+{
+    cmsUInt32Number i;
+
+    if (!_cmsLockMutex(s ->ContextID, s ->Mutex)) return;
+
+    // Keep the load under 3/4. If the table cannot grow, the block goes unseen
+    if ((s ->nUsed + 1) * 4 <= s ->nSlots * 3 || MemStatsGrow(s)) {
+
+        i = MemStatsFind(s, Ptr);
+
+        s ->Table[i].Ptr  = Ptr;
+        s ->Table[i].Size = Size;
+        s ->Table[i].Kind = Kind;
+        s ->nUsed++;
+
+        if (NewBlock) s ->Stats.Allocations++;
+        s ->Stats.CurrentBytes += Size;
+        s ->Stats.Bytes[Kind]  += Size;
+
+        if (s ->Stats.CurrentBytes > s ->Stats.PeakBytes)
+            s ->Stats.PeakBytes = s ->Stats.CurrentBytes;
+    }
+
+    _cmsUnlockMutex(s ->ContextID, s ->Mutex);
+}
+
+// Forgets a block and returns its kind. Size, if given, gets the size of the block or zero if it was not tracked
+static
+cmsUInt32Number UntrackBlock(_cmsMemStats* s, const void* Ptr, cmsUInt32Number* Size)
+{
+    cmsUInt32Number i, j, k, Kind = cmsMEMORY_OTHER;
+
+    if (Size != NULL) *Size = 0;
+    if (!_cmsLockMutex(s ->ContextID, s ->Mutex)) return Kind;
+
+    i = MemStatsFind(s, Ptr);
+    if (s ->Table[i].Ptr != NULL) {
+
+        Kind = s ->Table[i].Kind;
+        if (Size != NULL) *Size = s ->Table[i].Size;
+
+        s ->Stats.CurrentBytes -= s ->Table[i].Size;
+        s ->Stats.Bytes[Kind]  -= s ->Table[i].Size;
+        s ->nUsed--;
+
+        // Backward shift, so no tombstones are needed
+        for (j = (i + 1) & (s ->nSlots - 1); s ->Table[j].Ptr != NULL; j = (j + 1) & (s ->nSlots - 1)) {
+
+            k = MemStatsSlot(s, s ->Table[j].Ptr);
+
+            if ((j > i && (k <= i || k > j)) || (j < i && (k <= i && k > j))) {
+                s ->Table[i] = s ->Table[j];
+                i = j;
+            }
+        }
+
+        s ->Table[i].Ptr = NULL;
+    }
+
+    _cmsUnlockMutex(s ->ContextID, s ->Mutex);
+    return Kind;
+}
+
+static
+void* _cmsMallocStatsFn(cmsContext ContextID, cmsUInt32Number size)
+{
+    _cmsMemStats* s = GetMemStats(ContextID);
+    void* Ptr = s ->Parent.MallocPtr(ContextID, size);
+
+    if (Ptr != NULL) TrackBlock(s, Ptr, size, cmsMEMORY_OTHER, TRUE);
+    return Ptr;
+}
+
+static
+void _cmsFreeStatsFn(cmsContext ContextID, void *Ptr)
+{
+    _cmsMemStats* s = GetMemStats(ContextID);
+
+    if (Ptr != NULL) UntrackBlock(s, Ptr, NULL);
+    s ->Parent.FreePtr(ContextID, Ptr);
+}
+
+// The old block is forgotten before the parent realloc, since another thread may get its address as soon as
+// it is released. It is put back if the realloc fails, as the block is still there then
+static
+void* _cmsReallocStatsFn(cmsContext ContextID, void* Ptr, cmsUInt32Number size)
+{
+    _cmsMemStats* s = GetMemStats(ContextID);
+    cmsUInt32Number Kind = cmsMEMORY_OTHER, OldSize = 0;
+    void* NewPtr;
+
+    if (Ptr != NULL)
+        Kind = UntrackBlock(s, Ptr, &OldSize);
+
+    NewPtr = s ->Parent.ReallocPtr(ContextID, Ptr, size);
+
+    if (NewPtr != NULL)
+        TrackBlock(s, NewPtr, size, Kind, TRUE);
+    else
+        if (OldSize != 0)
+            TrackBlock(s, Ptr, OldSize, Kind, FALSE);
+
+    return NewPtr;
+}
+
+// Tags a block as belonging to a given kind of object. Does nothing unless the context is accounted
+void _cmsSetMemoryKind(cmsContext ContextID, const void* Ptr, cmsUInt32Number Kind)
+{
+    _cmsMemStats* s = GetMemStats(ContextID);
+    cmsUInt32Number i;
+
+    if (s == NULL || Ptr == NULL || Kind >= cmsMEMORY_KINDS) return;
+    if (!_cmsLockMutex(s ->ContextID, s ->Mutex)) return;
+
+    i = MemStatsFind(s, Ptr);
+    if (s ->Table[i].Ptr != NULL) {
+
+        s ->Stats.Bytes[s ->Table[i].Kind] -= s ->Table[i].Size;
+        s ->Stats.Bytes[Kind] += s ->Table[i].Size;
+        s ->Table[i].Kind = Kind;
+    }
+
+    _cmsUnlockMutex(s ->ContextID, s ->Mutex);
+}
+
+// Drops a block from the accounting, for blocks that are going to be freed by other means
+void _cmsUnaccountMemory(cmsContext ContextID, const void* Ptr)
+{
+    _cmsMemStats* s = GetMemStats(ContextID);
+
+    if (s != NULL && Ptr != NULL)
+        UntrackBlock(s, Ptr, NULL);
+}
+
+// Starts accounting memory on a context. There is no way back, it lasts as long as the context.
+// Not for the global context, whose allocators are the template new contexts are built from
+cmsBool CMSEXPORT cmsEnableMemoryStats(cmsContext ContextID)
+{
+    _cmsMemPluginChunkType* ptr;
+    _cmsMemStats* s;
+
+    // Ids that are not contexts stand for the global one
+    if (_cmsGetContext(ContextID) == _cmsGetContext(NULL))
+        return FALSE;
+
+    ptr = (_cmsMemPluginChunkType*) _cmsContextGetClientChunk(ContextID, MemPlugin);
+    if (ptr ->Stats != NULL) return TRUE;
+    if (ptr ->Arena != NULL) return FALSE;
+
+    s = (_cmsMemStats*) ptr ->MallocPtr(ContextID, sizeof(_cmsMemStats));
+    if (s == NULL) return FALSE;
+
+    memset(s, 0, sizeof(_cmsMemStats));
+    memcpy(&s ->Parent, ptr, sizeof(_cmsMemPluginChunkType));
+    s ->ContextID = ContextID;
+
+    s ->Table = (_cmsMemStatsEntry*) ptr ->MallocPtr(ContextID, MEMSTATS_INITIAL_SLOTS * sizeof(_cmsMemStatsEntry));
+    s ->Mutex = _cmsCreateMutex(ContextID);
+
+    if (s ->Table == NULL || s ->Mutex == NULL) {
+
+        if (s ->Table != NULL) ptr ->FreePtr(ContextID, s ->Table);
+        if (s ->Mutex != NULL) _cmsDestroyMutex(ContextID, s ->Mutex);
+        ptr ->FreePtr(ContextID, s);
+        return FALSE;
+    }
+
+    memset(s ->Table, 0, MEMSTATS_INITIAL_SLOTS * sizeof(_cmsMemStatsEntry));
+    s ->nSlots = MEMSTATS_INITIAL_SLOTS;
+
+    // Other threads may be allocating on the context meanwhile. The stats go first, as the wrappers look
+    // for them, and the allocation entries go last, so no block is tracked before its free is.
+    // MallocZero, calloc and dup end up in malloc, so they are accounted there
+    ptr ->Stats         = s;
+    ptr ->FreePtr       = _cmsFreeStatsFn;
+    ptr ->ReallocPtr    = _cmsReallocStatsFn;
+    ptr ->MallocPtr     = _cmsMallocStatsFn;
+    ptr ->MallocZeroPtr = _cmsMallocZeroDefaultFn;
+    ptr ->CallocPtr     = _cmsCallocDefaultFn;
+    ptr ->DupPtr        = _cmsDupDefaultFn;
+
+    return TRUE;
+}
+
+// Snapshot of the counters. Returns FALSE, with all counters zero, if the context is not accounted
+cmsBool CMSEXPORT cmsGetMemoryStats(cmsContext ContextID, cmsMemoryStats* Stats)
+{
+    _cmsMemStats* s = GetMemStats(ContextID);
+
+    _cmsAssert(Stats != NULL);
+
+    memset(Stats, 0, sizeof(cmsMemoryStats));
+    if (s == NULL) return FALSE;
+
+    if (!_cmsLockMutex(s ->ContextID, s ->Mutex)) return FALSE;
+    memcpy(Stats, &s ->Stats, sizeof(cmsMemoryStats));
+    _cmsUnlockMutex(s ->ContextID, s ->Mutex);
+
+    return TRUE;
+}
+
+// On context deletion. Restores the allocators the context had before, blocks are still valid for them
+void _cmsFreeMemoryStats(cmsContext ContextID)
+{
+    _cmsMemPluginChunkType* ptr = (_cmsMemPluginChunkType*) _cmsContextGetClientChunk(ContextID, MemPlugin);
+    _cmsMemStats* s = (_cmsMemStats*) ptr ->Stats;
+
+    // Arena contexts share the stats of their owner
+    if (s == NULL || s ->ContextID != ContextID) return;
+
+    memcpy(ptr, &s ->Parent, sizeof(_cmsMemPluginChunkType));
+
+    _cmsDestroyMutex(ContextID, s ->Mutex);
+    ptr ->FreePtr(ContextID, s ->Table);
+    ptr ->FreePtr(ContextID, s);
+}
+
+// ********************************************************************************************
+
+// Arena allocation. A context may be turned into an arena: memory is carved sequentially from
+// big blocks, frees are ignored and everything goes away at once when the context is deleted.
+// Transforms created with cmsFLAGS_ARENA are built on a private arena context, so their
+// pipelines, curves and tables end up packed together and are released in a few calls.
+// There is no locking. Once the transform is built the arena is sealed: blocks are left as
+// they are, and whatever is allocated afterwards, maybe by several threads at once, comes
+// from the parent allocators and is freed back to them.
+
+#define ARENA_BLOCK_SIZE    (64*1024)
+
+// Same alignment malloc gives, some tables hold doubles
+#define _cmsALIGNARENA(x)   (((x) + 15) & ~(cmsUInt32Number) 15)
+
+typedef struct _cmsArenaBlock_st {
+
+    struct _cmsArenaBlock_st* Next;
+    cmsUInt32Number Size;          // Usable bytes, after the header
+    cmsUInt32Number Used;
+
+} _cmsArenaBlock;
+
+typedef struct {
+
+    _cmsMemPluginChunkType Parent;  // Where blocks come from, the allocators in place before the arena
+    _cmsArenaBlock* Head;           // Block being filled
+    cmsContext Owner;               // The context the arena works for
+    cmsBool Sealed;                 // No more items from the blocks
+
+} _cmsArena;
+
+// Each item is preceded by this
+typedef struct {
+
+    cmsUInt32Number Size;
+    cmsUInt32Number FromParent;     // Taken from the parent allocators, after sealing
+
+} _cmsArenaItem;
+
+#define ARENA_BLOCK_HEADER  _cmsALIGNARENA((cmsUInt32Number) sizeof(_cmsArenaBlock))
+#define ARENA_ITEM_HEADER   _cmsALIGNARENA((cmsUInt32Number) sizeof(_cmsArenaItem))
+
+static
+_cmsArena* GetArena(cmsContext ContextID)
+{
+    _cmsMemPluginChunkType* ptr = (_cmsMemPluginChunkType*) _cmsContextGetClientChunk(ContextID, MemPlugin);
+    return (_cmsArena*) ptr ->Arena;
+}
+
+static
+void* _cmsMallocArenaFn(cmsContext ContextID, cmsUInt32Number size)
+{
+    _cmsArena* Arena = GetArena(ContextID);
+    _cmsArenaBlock* b = Arena ->Head;
+    cmsUInt32Number Needed, BlockSize;
+    cmsUInt8Number* Item;
+
+    if (size == 0 || size > MAX_MEMORY_FOR_ALLOC) return NULL;
+
+    if (Arena ->Sealed) {
+
+        Item = (cmsUInt8Number*) Arena ->Parent.MallocPtr(ContextID, ARENA_ITEM_HEADER + size);
+        if (Item == NULL) return NULL;
+
+        ((_cmsArenaItem*) Item) ->Size = size;
+        ((_cmsArenaItem*) Item) ->FromParent = TRUE;
+        return Item + ARENA_ITEM_HEADER;
+    }
+
+    Needed = ARENA_ITEM_HEADER + _cmsALIGNARENA(size);
+
+    if (b == NULL || b ->Size - b ->Used < Needed) {
+
+        BlockSize = Needed > ARENA_BLOCK_SIZE ? Needed : ARENA_BLOCK_SIZE;
+
+        b = (_cmsArenaBlock*) Arena ->Parent.MallocPtr(ContextID, ARENA_BLOCK_HEADER + BlockSize);
+        if (b == NULL) return NULL;
+
+        b ->Size = BlockSize;
+        b ->Used = 0;
+
+        // Big items get a block of their own, and the one being filled keeps going
+        if (Needed > ARENA_BLOCK_SIZE / 4 && Arena ->Head != NULL) {
+
+            b ->Next = Arena ->Head ->Next;
+            Arena ->Head ->Next = b;
+        }
+        else {
+
+            b ->Next = Arena ->Head;
+            Arena ->Head = b;
+        }
+    }
+
+    Item = (cmsUInt8Number*) b + ARENA_BLOCK_HEADER + b ->Used;
+    b ->Used += Needed;
+
+    ((_cmsArenaItem*) Item) ->Size = size;
+    ((_cmsArenaItem*) Item) ->FromParent = FALSE;
+    return Item + ARENA_ITEM_HEADER;
+}
+
+// Items from the blocks are not released one by one. The only exception is the last one taken
+// before sealing, which is given back
+static
+void _cmsFreeArenaFn(cmsContext ContextID, void *Ptr)
+{
+    _cmsArena* Arena = GetArena(ContextID);
+    _cmsArenaBlock* b = Arena ->Head;
+    cmsUInt8Number* Item;
+
+    if (Ptr == NULL) return;
+
+    Item = (cmsUInt8Number*) Ptr - ARENA_ITEM_HEADER;
+
+    if (((_cmsArenaItem*) Item) ->FromParent) {
+
+        Arena ->Parent.FreePtr(ContextID, Item);
+        return;
+    }
+
+    if (Arena ->Sealed || b == NULL) return;
+
+    if (Item + ARENA_ITEM_HEADER + _cmsALIGNARENA(((_cmsArenaItem*) Item) ->Size) == (cmsUInt8Number*) b + ARENA_BLOCK_HEADER + b ->Used)
+        b ->Used = (cmsUInt32Number) (Item - ((cmsUInt8Number*) b + ARENA_BLOCK_HEADER));
+}
+
+static
+void* _cmsReallocArenaFn(cmsContext ContextID, void* Ptr, cmsUInt32Number size)
+{
+    cmsUInt32Number OldSize;
+    void* NewPtr;
+
+    if (Ptr == NULL) return _cmsMallocArenaFn(ContextID, size);
+
+    OldSize = ((_cmsArenaItem*) ((cmsUInt8Number*) Ptr - ARENA_ITEM_HEADER)) ->Size;
+    if (size <= OldSize) return Ptr;
+
+    NewPtr = _cmsMallocArenaFn(ContextID, size);
+    if (NewPtr == NULL) return NULL;
+
+    memmove(NewPtr, Ptr, OldSize);
+    _cmsFreeArenaFn(ContextID, Ptr);
+    return NewPtr;
+}
+
+// A copy of a context gets the allocators that were in place before any arena or accounting
+static
+void UnshareMemoryChunk(_cmsMemPluginChunkType* ptr)
+{
+    _cmsArena* Arena = (_cmsArena*) ptr ->Arena;
+    _cmsMemStats* Stats;
+
+    if (Arena != NULL)
+        memcpy(ptr, &Arena ->Parent, sizeof(_cmsMemPluginChunkType));
+
+    Stats = (_cmsMemStats*) ptr ->Stats;
+    if (Stats != NULL)
+        memcpy(ptr, &Stats ->Parent, sizeof(_cmsMemPluginChunkType));
+}
+
+// Turns a context into an arena. Not for the global context
+cmsBool _cmsInstallArena(cmsContext ContextID)
+{
+    _cmsMemPluginChunkType* ptr;
+    _cmsArena* Arena;
+
+    if (ContextID == NULL) return FALSE;
+
+    ptr = (_cmsMemPluginChunkType*) _cmsContextGetClientChunk(ContextID, MemPlugin);
+    if (ptr ->Arena != NULL) return TRUE;
+
+    Arena = (_cmsArena*) ptr ->MallocPtr(ContextID, sizeof(_cmsArena));
+    if (Arena == NULL) return FALSE;
+
+    memcpy(&Arena ->Parent, ptr, sizeof(_cmsMemPluginChunkType));
+    Arena ->Head = NULL;
+    Arena ->Owner = ContextID;
+    Arena ->Sealed = FALSE;
+
+    ptr ->MallocPtr     = _cmsMallocArenaFn;
+    ptr ->MallocZeroPtr = _cmsMallocZeroDefaultFn;
+    ptr ->FreePtr       = _cmsFreeArenaFn;
+    ptr ->ReallocPtr    = _cmsReallocArenaFn;
+    ptr ->CallocPtr     = _cmsCallocDefaultFn;
+    ptr ->DupPtr        = _cmsDupDefaultFn;
+    ptr ->Arena         = Arena;
+
+    return TRUE;
+}
+
+// Gives all blocks back and restores the allocators the context had before
+void _cmsFreeArena(cmsContext ContextID)
+{
+    _cmsMemPluginChunkType* ptr = (_cmsMemPluginChunkType*) _cmsContextGetClientChunk(ContextID, MemPlugin);
+    _cmsArena* Arena = (_cmsArena*) ptr ->Arena;
+    _cmsArenaBlock* b;
+    _cmsArenaBlock* Next;
+
+    if (Arena == NULL) return;
+
+    memcpy(ptr, &Arena ->Parent, sizeof(_cmsMemPluginChunkType));
+
+    for (b = Arena ->Head; b != NULL; b = Next) {
+
+        Next = b ->Next;
+        ptr ->FreePtr(ContextID, b);
+    }
+
+    ptr ->FreePtr(ContextID, Arena);
+}
+
+// A private context whose memory is an arena. Plug-ins and settings are those of ContextID
+cmsContext _cmsCreateArenaContext(cmsContext ContextID)
+{
+    cmsContext Arena;
+
+    // Ids that are not contexts stand for the global one
+    if (_cmsGetContext(ContextID) == _cmsGetContext(NULL))
+        ContextID = NULL;
+
+    Arena = cmsDupContext(ContextID, NULL);
+
+    if (Arena == NULL) return NULL;
+
+    // Whatever the transform takes still counts for the owner, if accounted
+    memcpy(_cmsContextGetClientChunk(Arena, MemPlugin), _cmsContextGetClientChunk(ContextID, MemPlugin), sizeof(_cmsMemPluginChunkType));
+
+    if (!_cmsInstallArena(Arena)) {
+        cmsDeleteContext(Arena);
+        return NULL;
+    }
+
+    GetArena(Arena) ->Owner = ContextID;
+    return Arena;
+}
+
+// From now on, the arena may be used by several threads. Items are taken from the parent allocators
+void _cmsSealArena(cmsContext ContextID)
+{
+    _cmsArena* Arena = GetArena(ContextID);
+
+    if (Arena != NULL) Arena ->Sealed = TRUE;
+}
+
+// The context an arena context was created for, or ContextID itself if it is not an arena
+cmsContext _cmsGetArenaOwner(cmsContext ContextID)
+{
+    _cmsMemPluginChunkType* ptr = (_cmsMemPluginChunkType*) _cmsContextGetClientChunk(ContextID, MemPlugin);
+
+    if (ptr ->Arena == NULL) return ContextID;
+    return ((_cmsArena*) ptr ->Arena) ->Owner;
+}
+
+// ********************************************************************************************
+
 // Sub allocation takes care of many pointers of small size. The memory allocated in
 // this way have be freed at once. Next function allocates a single chunk for linked list
 // I prefer this method over realloc due to the big impact on xput realloc may have if
@@ -731,21 +1298,244 @@ cmsBool _cmsRegisterParallelizationPlugin(cmsContext ContextID, cmsPluginBase* D
 
     if (Data == NULL) {
 
+        // Let the former scheduler release whatever it holds for this context
+        if (ctx->ShutdownFn != NULL)
+            ctx->ShutdownFn(ContextID);
+
         // No parallelization routines
         ctx->MaxWorkers = 0;
         ctx->WorkerFlags = 0;
         ctx->SchedulerFn = NULL;        
+        ctx->ShutdownFn = NULL;
+        ctx->RunTasksFn = NULL;
+        ctx->ScratchSizeFn = NULL;
         return TRUE;
     }
 
     // callback is required
     if (Plugin->SchedulerFn == NULL) return FALSE;
 
+    // Replacing a scheduler, the old one should be shut down first
+    if (ctx->ShutdownFn != NULL)
+        ctx->ShutdownFn(ContextID);
+
     ctx->MaxWorkers = Plugin->MaxWorkers;
     ctx->WorkerFlags = Plugin->WorkerFlags;
     ctx->SchedulerFn = Plugin->SchedulerFn;
+
+    // Older plug-ins do not have the shutdown, task nor scratch callbacks
+    ctx->ShutdownFn = (Plugin->base.ExpectedVersion >= 2190) ? Plugin->ShutdownFn : NULL;
+    ctx->RunTasksFn = (Plugin->base.ExpectedVersion >= 2190) ? Plugin->RunTasksFn : NULL;
+    ctx->ScratchSizeFn = (Plugin->base.ExpectedVersion >= 2190) ? Plugin->ScratchSizeFn : NULL;
     
     // All is ok
     return TRUE;
 }
 
+// Tasks should be independent, so running them in order gives the same result as any other way
+// Arena contexts are private to one transform, their tasks go to the owner so workers are not set up once per transform
+void _cmsRunTasks(cmsContext ContextID, _cmsTaskFn Fn, void* Cargo, cmsUInt32Number nTasks)
+{
+    _cmsParallelizationPluginChunkType* ctx;
+    cmsUInt32Number i;
+
+    ContextID = _cmsGetArenaOwner(ContextID);
+    ctx = (_cmsParallelizationPluginChunkType*)_cmsContextGetClientChunk(ContextID, ParallelizationPlugin);
+
+    if (nTasks > 1 && ctx->RunTasksFn != NULL) {
+
+        ctx->RunTasksFn(ContextID, ctx->MaxWorkers, Fn, Cargo, nTasks);
+        return;
+    }
+
+    for (i = 0; i < nTasks; i++)
+        Fn(Cargo, i);
+}
+
+
+// CPU features ---------------------------------------------------------------------------------------------
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#   define CMS_CPU_X86 1
+#   ifdef _MSC_VER
+#       include <intrin.h>
+#   else
+#       include <cpuid.h>
+#   endif
+#endif
+
+// The global Context0 storage for CPU features. All features are allowed by default
+_cmsCPUFeaturesChunkType _cmsCPUFeaturesChunk = { 0xFFFFFFFFU };
+
+// Allocate and init CPU features container.
+void _cmsAllocCPUFeaturesChunk(struct _cmsContext_struct* ctx,
+                               const struct _cmsContext_struct* src)
+{
+    static _cmsCPUFeaturesChunkType CPUFeaturesChunk = { 0xFFFFFFFFU };
+    void* from;
+
+    if (src != NULL) {
+        from = src ->chunks[CPUFeaturesContext];
+    }
+    else {
+        from = &CPUFeaturesChunk;
+    }
+
+    ctx ->chunks[CPUFeaturesContext] = _cmsSubAllocDup(ctx ->MemPool, from, sizeof(_cmsCPUFeaturesChunkType));
+}
+
+#ifdef CMS_CPU_X86
+
+static
+void CpuId(cmsUInt32Number Leaf, cmsUInt32Number Regs[4])
+{
+#ifdef _MSC_VER
+    int r[4];
+
+    __cpuidex(r, (int) Leaf, 0);
+    Regs[0] = (cmsUInt32Number) r[0]; Regs[1] = (cmsUInt32Number) r[1];
+    Regs[2] = (cmsUInt32Number) r[2]; Regs[3] = (cmsUInt32Number) r[3];
+#else
+    unsigned int eax, ebx, ecx, edx;
+
+    __cpuid_count(Leaf, 0, eax, ebx, ecx, edx);
+    Regs[0] = eax; Regs[1] = ebx; Regs[2] = ecx; Regs[3] = edx;
+#endif
+}
+
+// Register state the OS saves on context switch. AVX is useless if ymm/zmm are not preserved
+static
+cmsUInt32Number XCR0(void)
+{
+#ifdef _MSC_VER
+    return (cmsUInt32Number) _xgetbv(0);
+#else
+    unsigned int eax, edx;
+
+    __asm__ __volatile__ (".byte 0x0f, 0x01, 0xd0" : "=a" (eax), "=d" (edx) : "c" (0));
+    return eax;
+#endif
+}
+
+static
+cmsUInt32Number DetectCPUFeatures(void)
+{
+    cmsUInt32Number Regs[4];
+    cmsUInt32Number MaxLeaf, xcr0 = 0;
+    cmsUInt32Number Features = 0;
+
+    CpuId(0, Regs);
+    MaxLeaf = Regs[0];
+    if (MaxLeaf < 1) return 0;
+
+    CpuId(1, Regs);
+
+    if (Regs[3] & (1U << 26)) Features |= cmsCPU_SSE2;
+    if (Regs[2] & (1U << 19)) Features |= cmsCPU_SSE41;
+
+    // OSXSAVE and AVX
+    if ((Regs[2] & (1U << 27)) && (Regs[2] & (1U << 28))) {
+
+        xcr0 = XCR0();
+
+        if ((xcr0 & 0x06) == 0x06) {
+
+            if (Regs[2] & (1U << 12)) Features |= cmsCPU_FMA;
+
+            if (MaxLeaf >= 7) {
+
+                CpuId(7, Regs);
+
+                if (Regs[1] & (1U << 5)) Features |= cmsCPU_AVX2;
+
+                if ((Regs[1] & (1U << 16)) && (xcr0 & 0xE0) == 0xE0)
+                    Features |= cmsCPU_AVX512;
+            }
+        }
+    }
+
+    return Features;
+}
+
+#else
+
+static
+cmsUInt32Number DetectCPUFeatures(void)
+{
+#if defined(__aarch64__) || defined(_M_ARM64) || defined(__ARM_NEON)
+    return cmsCPU_NEON;
+#else
+    return 0;
+#endif
+}
+
+#endif
+
+// The LCMS2_CPU_FEATURES environment variable caps features for the whole process.
+// It takes either a level name or a number with cmsCPU_* flags.
+static
+cmsUInt32Number EnvironmentFeaturesMask(void)
+{
+    const char* Value = getenv("LCMS2_CPU_FEATURES");
+
+    if (Value == NULL || *Value == 0) return 0xFFFFFFFFU;
+
+    if (cmsstrcasecmp(Value, "none") == 0 || cmsstrcasecmp(Value, "scalar") == 0) return 0;
+    if (cmsstrcasecmp(Value, "sse2") == 0)   return cmsCPU_SSE2;
+    if (cmsstrcasecmp(Value, "sse4.1") == 0) return cmsCPU_SSE2|cmsCPU_SSE41;
+    if (cmsstrcasecmp(Value, "avx2") == 0)   return cmsCPU_SSE2|cmsCPU_SSE41|cmsCPU_AVX2|cmsCPU_FMA;
+    if (cmsstrcasecmp(Value, "avx512") == 0) return cmsCPU_SSE2|cmsCPU_SSE41|cmsCPU_AVX2|cmsCPU_FMA|cmsCPU_AVX512;
+    if (cmsstrcasecmp(Value, "neon") == 0)   return cmsCPU_NEON;
+
+    return (cmsUInt32Number) strtoul(Value, NULL, 0);
+}
+
+// Neither the CPU nor the environment variable change while running, so both are read just once per
+// process. Threads racing on the first call all store the same value.
+static cmsUInt32Number ProcessFeatures = 0;
+static cmsUInt8Number  ProcessFeaturesKnown = FALSE;
+
+static
+cmsUInt32Number GetProcessFeatures(void)
+{
+    if (!_cmsLoadAcquire8(&ProcessFeaturesKnown)) {
+
+        ProcessFeatures = DetectCPUFeatures() & EnvironmentFeaturesMask();
+        _cmsStoreRelease8(&ProcessFeaturesKnown, TRUE);
+    }
+
+    return ProcessFeatures;
+}
+
+// Features kernels may use on this context
+cmsUInt32Number CMSEXPORT cmsGetCPUFeatures(cmsContext ContextID)
+{
+    _cmsCPUFeaturesChunkType* ptr = (_cmsCPUFeaturesChunkType*) _cmsContextGetClientChunk(ContextID, CPUFeaturesContext);
+
+    return GetProcessFeatures() & ptr ->Mask;
+}
+
+// Restricts the features kernels may use on this context. Only affects objects created afterwards.
+cmsUInt32Number CMSEXPORT cmsSetCPUFeaturesMask(cmsContext ContextID, cmsUInt32Number Mask)
+{
+    _cmsCPUFeaturesChunkType* ptr = (_cmsCPUFeaturesChunkType*) _cmsContextGetClientChunk(ContextID, CPUFeaturesContext);
+    cmsUInt32Number Prev = ptr ->Mask;
+
+    ptr ->Mask = Mask;
+    return Prev;
+}
+
+// Picks the best kernel of a table
+_cmsKernelFn _cmsSelectKernel(cmsContext ContextID, const _cmsKernelEntry Table[], cmsUInt32Number nEntries)
+{
+    cmsUInt32Number Features = cmsGetCPUFeatures(ContextID);
+    cmsUInt32Number i;
+
+    for (i=0; i < nEntries; i++) {
+
+        if ((Table[i].Requires & Features) == Table[i].Requires)
+            return Table[i].Kernel;
+    }
+
+    return NULL;
+}
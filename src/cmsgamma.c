@@ -231,6 +231,7 @@ cmsToneCurve* AllocateToneCurveStruct(cmsContext ContextID, cmsUInt32Number nEnt
     // Allocate all required pointers, etc.
     p = (cmsToneCurve*) _cmsMallocZero(ContextID, sizeof(cmsToneCurve));
     if (!p) return NULL;
+    _cmsSetMemoryKind(ContextID, p, cmsMEMORY_CURVE);
 
     // In this case, there are no segments
     if (nSegments == 0) {
@@ -255,6 +256,7 @@ cmsToneCurve* AllocateToneCurveStruct(cmsContext ContextID, cmsUInt32Number nEnt
     else {
        p ->Table16 = (cmsUInt16Number*)  _cmsCalloc(ContextID, nEntries, sizeof(cmsUInt16Number));
        if (p ->Table16 == NULL) goto Error;
+       _cmsSetMemoryKind(ContextID, p ->Table16, cmsMEMORY_CURVE);
     }
 
     p -> nEntries  = nEntries;
@@ -283,8 +285,10 @@ cmsToneCurve* AllocateToneCurveStruct(cmsContext ContextID, cmsUInt32Number nEnt
 
             memmove(&p ->Segments[i], &Segments[i], sizeof(cmsCurveSegment));
 
-            if (Segments[i].Type == 0 && Segments[i].SampledPoints != NULL)
+            if (Segments[i].Type == 0 && Segments[i].SampledPoints != NULL) {
                 p ->Segments[i].SampledPoints = (cmsFloat32Number*) _cmsDupMem(ContextID, Segments[i].SampledPoints, sizeof(cmsFloat32Number) * Segments[i].nGridPoints);
+                _cmsSetMemoryKind(ContextID, p ->Segments[i].SampledPoints, cmsMEMORY_CURVE);
+            }
             else
                 p ->Segments[i].SampledPoints = NULL;
 
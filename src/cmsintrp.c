@@ -26,6 +26,20 @@
 
 #include "lcms2_internal.h"
 
+#ifdef CMS_USE_SSE2
+
+// SSE4.1 is not baseline. Kernels are built for it anyway, and only selected if the CPU has it
+#   if defined(_MSC_VER)
+#       define CMS_INTRP_USE_SSE41 1
+#       define CMS_TARGET_SSE41
+#       include <smmintrin.h>
+#   elif defined(__GNUC__) || defined(__clang__)
+#       define CMS_INTRP_USE_SSE41 1
+#       define CMS_TARGET_SSE41 __attribute__((target("sse4.1")))
+#       include <smmintrin.h>
+#   endif
+#endif
+
 // This module incorporates several interpolation routines, for 1 to 8 channels on input and
 // up to 65535 channels on output. The user may change those by using the interpolation plug-in
 
@@ -38,6 +52,7 @@
 
 // Interpolation routines by default
 static cmsInterpFunction DefaultInterpolatorsFactory(cmsUInt32Number nInputChannels, cmsUInt32Number nOutputChannels, cmsUInt32Number dwFlags);
+static cmsInterpBatchFunction DefaultBatchInterpolator(const cmsInterpParams* p);
 
 // This is the default factory
 _cmsInterpPluginChunkType _cmsInterpPluginChunk = { NULL };
@@ -102,6 +117,7 @@ cmsBool _cmsSetInterpolationRoutine(cmsContext ContextID, cmsInterpParams* p)
             return FALSE;
     }
 
+    p ->BatchInterpolation = DefaultBatchInterpolator(p);
     return TRUE;
 }
 
@@ -1173,6 +1189,630 @@ EVAL_FNS(13, 12)
 EVAL_FNS(14, 13)
 EVAL_FNS(15, 14)
 
+// Simplex interpolation -------------------------------------------------------------------------------------------
+
+// Kuhn triangulation of the N-dimensional hypercube. The sample lies in the simplex given by the
+// order of the fractional parts, whose N+1 vertices are reached by stepping the dimensions one by
+// one from largest to smallest fraction. Cost is linear in N, against 2^(N-3) tetrahedra of the
+// recursive evaluators above. It is not the same interpolant, so it is not used by default.
+
+static CMS_NO_SANITIZE
+void SimplexInterp16(CMSREGISTER const cmsUInt16Number Input[],
+                     CMSREGISTER cmsUInt16Number Output[],
+                     CMSREGISTER const cmsInterpParams* p16)
+{
+    const cmsUInt16Number* LutTable = (cmsUInt16Number*) p16 -> Table;
+    const cmsUInt32Number nIn = p16 -> nInputs;
+    cmsUInt32Number Rest[MAX_INPUT_DIMENSIONS], Step[MAX_INPUT_DIMENSIONS], Order[MAX_INPUT_DIMENSIONS];
+    cmsUInt32Number Node[MAX_INPUT_DIMENSIONS + 1], Weight[MAX_INPUT_DIMENSIONS + 1];
+    cmsUInt32Number i, j, k, t, OutChan, Sum;
+    cmsS15Fixed16Number fx;
+
+    // The factory never gives less than 5 inputs, this is just for the compiler to see both are set
+    Node[0] = Order[0] = Rest[0] = 0;
+
+    // Input[0] is the slowest-varying dimension
+    for (i=0; i < nIn; i++) {
+
+        fx = _cmsToFixedDomain((cmsS15Fixed16Number) Input[i] * p16 -> Domain[i]);
+
+        Rest[i] = (cmsUInt32Number) FIXED_REST_TO_INT(fx);
+        Step[i] = (Input[i] == 0xFFFFU ? 0 : p16 -> opta[nIn - 1 - i]);
+        Node[0] += p16 -> opta[nIn - 1 - i] * FIXED_TO_INT(fx);
+
+        // Keep the dimensions sorted by decreasing fraction, N is small
+        t = Order[i] = i;
+        for (j=i; j > 0 && Rest[Order[j-1]] < Rest[t]; j--)
+            Order[j] = Order[j-1];
+        Order[j] = t;
+    }
+
+    // Barycentric weights add up to 0x10000, so no term can overflow
+    Weight[0] = 0x10000U - Rest[Order[0]];
+    for (k=1; k <= nIn; k++) {
+
+        Node[k]   = Node[k-1] + Step[Order[k-1]];
+        Weight[k] = Rest[Order[k-1]] - (k < nIn ? Rest[Order[k]] : 0);
+    }
+
+    for (OutChan=0; OutChan < p16 -> nOutputs; OutChan++) {
+
+        Sum = 0x8000;
+        for (k=0; k <= nIn; k++)
+            Sum += Weight[k] * LutTable[Node[k] + OutChan];
+
+        Output[OutChan] = (cmsUInt16Number) (Sum >> 16);
+    }
+}
+
+static
+void SimplexInterpFloat(const cmsFloat32Number Input[],
+                        cmsFloat32Number Output[],
+                        const cmsInterpParams* p)
+{
+    const cmsFloat32Number* LutTable = (cmsFloat32Number*) p -> Table;
+    const cmsUInt32Number nIn = p -> nInputs;
+    cmsFloat32Number Rest[MAX_INPUT_DIMENSIONS], Weight[MAX_INPUT_DIMENSIONS + 1];
+    cmsUInt32Number Step[MAX_INPUT_DIMENSIONS], Order[MAX_INPUT_DIMENSIONS];
+    cmsUInt32Number Node[MAX_INPUT_DIMENSIONS + 1];
+    cmsUInt32Number i, j, k, t, OutChan;
+    cmsFloat32Number px, Sum;
+    int x0;
+
+    // Same as above, the compiler cannot see there are at least 5 inputs
+    Node[0] = Order[0] = 0;
+    Rest[0] = 0;
+
+    for (i=0; i < nIn; i++) {
+
+        px = fclamp(Input[i]) * p -> Domain[i];
+        x0 = _cmsQuickFloor(px);
+
+        Rest[i] = px - (cmsFloat32Number) x0;
+        Step[i] = (fclamp(Input[i]) >= 1.0 ? 0 : p -> opta[nIn - 1 - i]);
+        Node[0] += p -> opta[nIn - 1 - i] * x0;
+
+        // Keep the dimensions sorted by decreasing fraction
+        t = Order[i] = i;
+        for (j=i; j > 0 && Rest[Order[j-1]] < Rest[t]; j--)
+            Order[j] = Order[j-1];
+        Order[j] = t;
+    }
+
+    Weight[0] = 1.0F - Rest[Order[0]];
+    for (k=1; k <= nIn; k++) {
+
+        Node[k]   = Node[k-1] + Step[Order[k-1]];
+        Weight[k] = Rest[Order[k-1]] - (k < nIn ? Rest[Order[k]] : 0.0F);
+    }
+
+    for (OutChan=0; OutChan < p -> nOutputs; OutChan++) {
+
+        Sum = 0;
+        for (k=0; k <= nIn; k++)
+            Sum += Weight[k] * LutTable[Node[k] + OutChan];
+
+        Output[OutChan] = Sum;
+    }
+}
+
+// Factory for the simplex interpolators. Only 5 to 15 inputs are handled, for any other case the
+// returned function is NULL and the default is used instead. An interpolation plug-in may use
+// this function as its factory, or call it from its own.
+cmsInterpFunction CMSEXPORT _cmsSimplexInterpolatorsFactory(cmsUInt32Number nInputChannels,
+                                                            cmsUInt32Number nOutputChannels,
+                                                            cmsUInt32Number dwFlags)
+{
+    cmsInterpFunction Interpolation;
+
+    memset(&Interpolation, 0, sizeof(Interpolation));
+
+    if (nInputChannels < 5 || nInputChannels > MAX_INPUT_DIMENSIONS ||
+        nOutputChannels >= MAX_STAGE_CHANNELS)
+        return Interpolation;
+
+    if (dwFlags & CMS_LERP_FLAGS_FLOAT)
+        Interpolation.LerpFloat = SimplexInterpFloat;
+    else
+        Interpolation.Lerp16 = SimplexInterp16;
+
+    return Interpolation;
+}
+
+
+
+// Batch interpolation -----------------------------------------------------------------------------------------------
+
+// Generic batch, just calls the one-pixel interpolator
+static
+void Lerp16Loop(const cmsUInt16Number Input[],
+                cmsUInt16Number Output[],
+                cmsUInt32Number nPixels,
+                const cmsInterpParams* p)
+{
+    cmsUInt32Number i;
+
+    for (i=0; i < nPixels; i++) {
+
+        p ->Interpolation.Lerp16(Input, Output, p);
+        Input  += p ->nInputs;
+        Output += p ->nOutputs;
+    }
+}
+
+static
+void LerpFloatLoop(const cmsFloat32Number Input[],
+                   cmsFloat32Number Output[],
+                   cmsUInt32Number nPixels,
+                   const cmsInterpParams* p)
+{
+    cmsUInt32Number i;
+
+    for (i=0; i < nPixels; i++) {
+
+        p ->Interpolation.LerpFloat(Input, Output, p);
+        Input  += p ->nInputs;
+        Output += p ->nOutputs;
+    }
+}
+
+#ifdef CMS_USE_SSE2
+
+// Vectorized tetrahedral interpolation. Output channels are processed four at once, since they
+// are contiguous in the table. The 16 bits versions replicate the integer arithmetic of
+// TetrahedralInterp16 and Eval4Inputs, including the wrap-around of 32-bit products, so results
+// are identical. On ties, any of the tetrahedra sharing the face gives the same integer result.
+
+// Where a 3D cube is, and which tetrahedron holds the sample (16 bits)
+typedef struct {
+
+    cmsUInt32Number     X1, Y1, Z1;     // Offsets of the 2nd, 3rd and 4th nodes, relative to the base
+    cmsS15Fixed16Number rx, ry, rz;
+    int                 Tetra;
+
+} _cmsTetra16Setup;
+
+// Returns the offset of the base node. Domain and opta are in the order of the input channels
+cmsINLINE cmsUInt32Number Tetra16Setup(const cmsUInt16Number Input[],
+                                       const cmsUInt32Number Domain[],
+                                       const cmsUInt32Number optaX, const cmsUInt32Number optaY, const cmsUInt32Number optaZ,
+                                       _cmsTetra16Setup* s)
+{
+    cmsS15Fixed16Number fx, fy, fz;
+    cmsUInt32Number X1, Y1, Z1;
+
+    fx = _cmsToFixedDomain((int) Input[0] * Domain[0]);
+    fy = _cmsToFixedDomain((int) Input[1] * Domain[1]);
+    fz = _cmsToFixedDomain((int) Input[2] * Domain[2]);
+
+    s ->rx = FIXED_REST_TO_INT(fx);
+    s ->ry = FIXED_REST_TO_INT(fy);
+    s ->rz = FIXED_REST_TO_INT(fz);
+
+    X1 = (Input[0] == 0xFFFFU ? 0 : optaX);
+    Y1 = (Input[1] == 0xFFFFU ? 0 : optaY);
+    Z1 = (Input[2] == 0xFFFFU ? 0 : optaZ);
+
+    // Same selection as TetrahedralInterp16
+    if (s ->rx >= s ->ry) {
+        if (s ->ry >= s ->rz)      { Y1 += X1; Z1 += Y1; s ->Tetra = 0; }
+        else if (s ->rz >= s ->rx) { X1 += Z1; Y1 += X1; s ->Tetra = 1; }
+        else                       { Z1 += X1; Y1 += Z1; s ->Tetra = 2; }
+    } else {
+        if (s ->rx >= s ->rz)      { X1 += Y1; Z1 += X1; s ->Tetra = 3; }
+        else if (s ->ry >= s ->rz) { Z1 += Y1; X1 += Z1; s ->Tetra = 4; }
+        else                       { Y1 += Z1; X1 += Y1; s ->Tetra = 5; }
+    }
+
+    s ->X1 = X1; s ->Y1 = Y1; s ->Z1 = Z1;
+
+    return optaX * FIXED_TO_INT(fx) + optaY * FIXED_TO_INT(fy) + optaZ * FIXED_TO_INT(fz);
+}
+
+// Low 32 bits of a 32x32 product, SSE2 has no _mm_mullo_epi32
+cmsINLINE __m128i MulLo32(__m128i a, __m128i b)
+{
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd  = _mm_mul_epu32(_mm_srli_si128(a, 4), _mm_srli_si128(b, 4));
+
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                              _mm_shuffle_epi32(odd,  _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+// Loads up to four 16 bit entries as 32 bit integers. Never reads past n entries
+cmsINLINE __m128i Load16x4(const cmsUInt16Number* ptr, cmsUInt32Number n)
+{
+    if (n >= 4)
+        return _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*) ptr), _mm_setzero_si128());
+
+    return _mm_setr_epi32(ptr[0], n > 1 ? ptr[1] : 0, n > 2 ? ptr[2] : 0, 0);
+}
+
+cmsINLINE void Store16x4(cmsUInt16Number* ptr, __m128i v, cmsUInt32Number n)
+{
+    cmsUInt16Number tmp[8];
+
+    // Keep the low 16 bits of each lane, as the cast to cmsUInt16Number does
+    v = _mm_srai_epi32(_mm_slli_epi32(v, 16), 16);
+    v = _mm_packs_epi32(v, v);
+
+    if (n >= 4) {
+        _mm_storel_epi64((__m128i*) ptr, v);
+        return;
+    }
+
+    _mm_storeu_si128((__m128i*) tmp, v);
+    ptr[0] = tmp[0];
+    if (n > 1) ptr[1] = tmp[1];
+    if (n > 2) ptr[2] = tmp[2];
+}
+
+// The kernels are shared by the SSE2 and SSE4.1 versions, only the multiplication differs.
+// TETRA16_GROUP interpolates four output channels of the cube at LutTable, the result is
+// not yet truncated to 16 bits.
+#define TETRA16_KERNELS(SUFFIX, TARGET, MULLO) \
+ \
+static CMS_NO_SANITIZE TARGET \
+__m128i Tetra16Group##SUFFIX(const cmsUInt16Number* LutTable, cmsUInt32Number Left, \
+                             const _cmsTetra16Setup* s, __m128i vrx, __m128i vry, __m128i vrz) \
+{ \
+    __m128i c0 = Load16x4(LutTable, Left); \
+    __m128i c1 = Load16x4(LutTable + s ->X1, Left); \
+    __m128i c2 = Load16x4(LutTable + s ->Y1, Left); \
+    __m128i c3 = Load16x4(LutTable + s ->Z1, Left); \
+    __m128i Rest; \
+ \
+    switch (s ->Tetra) { \
+    case 0:  c3 = _mm_sub_epi32(c3, c2); c2 = _mm_sub_epi32(c2, c1); c1 = _mm_sub_epi32(c1, c0); break; \
+    case 1:  c2 = _mm_sub_epi32(c2, c1); c1 = _mm_sub_epi32(c1, c3); c3 = _mm_sub_epi32(c3, c0); break; \
+    case 2:  c2 = _mm_sub_epi32(c2, c3); c3 = _mm_sub_epi32(c3, c1); c1 = _mm_sub_epi32(c1, c0); break; \
+    case 3:  c3 = _mm_sub_epi32(c3, c1); c1 = _mm_sub_epi32(c1, c2); c2 = _mm_sub_epi32(c2, c0); break; \
+    case 4:  c1 = _mm_sub_epi32(c1, c3); c3 = _mm_sub_epi32(c3, c2); c2 = _mm_sub_epi32(c2, c0); break; \
+    default: c1 = _mm_sub_epi32(c1, c2); c2 = _mm_sub_epi32(c2, c3); c3 = _mm_sub_epi32(c3, c0); break; \
+    } \
+ \
+    Rest = _mm_add_epi32(_mm_add_epi32(MULLO(c1, vrx), MULLO(c2, vry)), \
+                         _mm_add_epi32(MULLO(c3, vrz), _mm_set1_epi32(0x8001))); \
+ \
+    Rest = _mm_srai_epi32(_mm_add_epi32(Rest, _mm_srai_epi32(Rest, 16)), 16); \
+ \
+    return _mm_add_epi32(c0, Rest); \
+} \
+ \
+static CMS_NO_SANITIZE TARGET \
+void TetrahedralInterp16Batch##SUFFIX(const cmsUInt16Number Input[], \
+                                      cmsUInt16Number Output[], \
+                                      cmsUInt32Number nPixels, \
+                                      const cmsInterpParams* p) \
+{ \
+    const cmsUInt16Number* Table = (cmsUInt16Number*) p -> Table; \
+    const cmsUInt32Number TotalOut = p -> nOutputs; \
+    cmsUInt32Number i, n, Base; \
+    _cmsTetra16Setup s; \
+    __m128i vrx, vry, vrz; \
+ \
+    for (i=0; i < nPixels; i++, Input += 3, Output += TotalOut) { \
+ \
+        Base = Tetra16Setup(Input, p ->Domain, p ->opta[2], p ->opta[1], p ->opta[0], &s); \
+ \
+        vrx = _mm_set1_epi32(s.rx); \
+        vry = _mm_set1_epi32(s.ry); \
+        vrz = _mm_set1_epi32(s.rz); \
+ \
+        for (n=0; n < TotalOut; n += 4) { \
+ \
+            Store16x4(Output + n, Tetra16Group##SUFFIX(Table + Base + n, TotalOut - n, &s, vrx, vry, vrz), TotalOut - n); \
+        } \
+    } \
+} \
+ \
+static CMS_NO_SANITIZE TARGET \
+void Eval4InputsBatch##SUFFIX(const cmsUInt16Number Input[], \
+                              cmsUInt16Number Output[], \
+                              cmsUInt32Number nPixels, \
+                              const cmsInterpParams* p16) \
+{ \
+    const cmsUInt16Number* Table = (cmsUInt16Number*) p16 -> Table; \
+    const cmsUInt32Number TotalOut = p16 -> nOutputs; \
+    const __m128i Mask16 = _mm_set1_epi32(0xFFFF); \
+    cmsUInt32Number i, n, Base; \
+    cmsS15Fixed16Number fk; \
+    cmsUInt32Number K0, K1; \
+    _cmsTetra16Setup s; \
+    __m128i vrx, vry, vrz, vrk; \
+ \
+    for (i=0; i < nPixels; i++, Input += 4, Output += TotalOut) { \
+ \
+        fk = _cmsToFixedDomain((int) Input[0] * p16 -> Domain[0]); \
+        K0 = p16 -> opta[3] * FIXED_TO_INT(fk); \
+        K1 = K0 + (Input[0] == 0xFFFFU ? 0 : p16->opta[3]); \
+ \
+        Base = Tetra16Setup(Input + 1, p16 ->Domain + 1, p16 ->opta[2], p16 ->opta[1], p16 ->opta[0], &s); \
+ \
+        vrk = _mm_set1_epi32(FIXED_REST_TO_INT(fk)); \
+        vrx = _mm_set1_epi32(s.rx); \
+        vry = _mm_set1_epi32(s.ry); \
+        vrz = _mm_set1_epi32(s.rz); \
+ \
+        for (n=0; n < TotalOut; n += 4) { \
+ \
+            __m128i Tmp1 = Tetra16Group##SUFFIX(Table + K0 + Base + n, TotalOut - n, &s, vrx, vry, vrz); \
+            __m128i Tmp2 = Tetra16Group##SUFFIX(Table + K1 + Base + n, TotalOut - n, &s, vrx, vry, vrz); \
+            __m128i dif; \
+ \
+            Tmp1 = _mm_and_si128(Tmp1, Mask16); \
+            Tmp2 = _mm_and_si128(Tmp2, Mask16); \
+ \
+            dif = MULLO(_mm_sub_epi32(Tmp2, Tmp1), vrk); \
+            dif = _mm_srli_epi32(_mm_add_epi32(dif, _mm_set1_epi32(0x8000)), 16); \
+ \
+            Store16x4(Output + n, _mm_add_epi32(dif, Tmp1), TotalOut - n); \
+        } \
+    } \
+}
+
+TETRA16_KERNELS(SSE2, , MulLo32)
+
+#ifdef CMS_INTRP_USE_SSE41
+TETRA16_KERNELS(SSE41, CMS_TARGET_SSE41, _mm_mullo_epi32)
+#endif
+
+
+// Where a 3D cube is, and which tetrahedron holds the sample (float). Each coefficient is the
+// difference of two nodes, so the whole thing reduces to six offsets from the base node.
+typedef struct {
+
+    cmsUInt32Number  a1, b1, a2, b2, a3, b3;
+    cmsFloat32Number rx, ry, rz;
+
+} _cmsTetraFloatSetup;
+
+// Returns the offset of the base node. Same selection and operations as TetrahedralInterpFloat
+cmsINLINE cmsUInt32Number TetraFloatSetup(const cmsFloat32Number Input[],
+                                          const cmsUInt32Number Domain[],
+                                          const cmsUInt32Number optaX, const cmsUInt32Number optaY, const cmsUInt32Number optaZ,
+                                          _cmsTetraFloatSetup* s)
+{
+    cmsFloat32Number px, py, pz;
+    cmsFloat32Number rx, ry, rz;
+    int x0, y0, z0;
+    cmsUInt32Number X1, Y1, Z1;
+
+    px = fclamp(Input[0]) * Domain[0];
+    py = fclamp(Input[1]) * Domain[1];
+    pz = fclamp(Input[2]) * Domain[2];
+
+    x0 = (int) floor(px); rx = (px - (cmsFloat32Number) x0);
+    y0 = (int) floor(py); ry = (py - (cmsFloat32Number) y0);
+    z0 = (int) floor(pz); rz = (pz - (cmsFloat32Number) z0);
+
+    X1 = (fclamp(Input[0]) >= 1.0 ? 0 : optaX);
+    Y1 = (fclamp(Input[1]) >= 1.0 ? 0 : optaY);
+    Z1 = (fclamp(Input[2]) >= 1.0 ? 0 : optaZ);
+
+    if (rx >= ry && ry >= rz) {
+        s ->a1 = X1;           s ->b1 = 0;
+        s ->a2 = X1 + Y1;      s ->b2 = X1;
+        s ->a3 = X1 + Y1 + Z1; s ->b3 = X1 + Y1;
+    }
+    else
+    if (rx >= rz && rz >= ry) {
+        s ->a1 = X1;           s ->b1 = 0;
+        s ->a2 = X1 + Y1 + Z1; s ->b2 = X1 + Z1;
+        s ->a3 = X1 + Z1;      s ->b3 = X1;
+    }
+    else
+    if (rz >= rx && rx >= ry) {
+        s ->a1 = X1 + Z1;      s ->b1 = Z1;
+        s ->a2 = X1 + Y1 + Z1; s ->b2 = X1 + Z1;
+        s ->a3 = Z1;           s ->b3 = 0;
+    }
+    else
+    if (ry >= rx && rx >= rz) {
+        s ->a1 = X1 + Y1;      s ->b1 = Y1;
+        s ->a2 = Y1;           s ->b2 = 0;
+        s ->a3 = X1 + Y1 + Z1; s ->b3 = X1 + Y1;
+    }
+    else
+    if (ry >= rz && rz >= rx) {
+        s ->a1 = X1 + Y1 + Z1; s ->b1 = Y1 + Z1;
+        s ->a2 = Y1;           s ->b2 = 0;
+        s ->a3 = Y1 + Z1;      s ->b3 = Y1;
+    }
+    else
+    if (rz >= ry && ry >= rx) {
+        s ->a1 = X1 + Y1 + Z1; s ->b1 = Y1 + Z1;
+        s ->a2 = Y1 + Z1;      s ->b2 = Z1;
+        s ->a3 = Z1;           s ->b3 = 0;
+    }
+    else {
+        s ->a1 = s ->b1 = s ->a2 = s ->b2 = s ->a3 = s ->b3 = 0;
+    }
+
+    s ->rx = rx; s ->ry = ry; s ->rz = rz;
+
+    return optaX * x0 + optaY * y0 + optaZ * z0;
+}
+
+// Loads up to four floats, never reads past n entries
+cmsINLINE __m128 LoadFloatx4(const cmsFloat32Number* ptr, cmsUInt32Number n)
+{
+    if (n >= 4)
+        return _mm_loadu_ps(ptr);
+
+    return _mm_setr_ps(ptr[0], n > 1 ? ptr[1] : 0, n > 2 ? ptr[2] : 0, 0);
+}
+
+cmsINLINE void StoreFloatx4(cmsFloat32Number* ptr, __m128 v, cmsUInt32Number n)
+{
+    cmsFloat32Number tmp[4];
+
+    if (n >= 4) {
+        _mm_storeu_ps(ptr, v);
+        return;
+    }
+
+    _mm_storeu_ps(tmp, v);
+    ptr[0] = tmp[0];
+    if (n > 1) ptr[1] = tmp[1];
+    if (n > 2) ptr[2] = tmp[2];
+}
+
+// Four output channels of the cube at Node
+cmsINLINE __m128 TetraFloatGroup(const cmsFloat32Number* Node, cmsUInt32Number Left,
+                                 const _cmsTetraFloatSetup* s, __m128 vrx, __m128 vry, __m128 vrz)
+{
+    __m128 c0 = LoadFloatx4(Node, Left);
+    __m128 c1 = _mm_sub_ps(LoadFloatx4(Node + s ->a1, Left), LoadFloatx4(Node + s ->b1, Left));
+    __m128 c2 = _mm_sub_ps(LoadFloatx4(Node + s ->a2, Left), LoadFloatx4(Node + s ->b2, Left));
+    __m128 c3 = _mm_sub_ps(LoadFloatx4(Node + s ->a3, Left), LoadFloatx4(Node + s ->b3, Left));
+    __m128 Out;
+
+    Out = _mm_add_ps(c0, _mm_mul_ps(c1, vrx));
+    Out = _mm_add_ps(Out, _mm_mul_ps(c2, vry));
+    Out = _mm_add_ps(Out, _mm_mul_ps(c3, vrz));
+
+    return Out;
+}
+
+static
+void TetrahedralInterpFloatBatchSSE2(const cmsFloat32Number Input[],
+                                     cmsFloat32Number Output[],
+                                     cmsUInt32Number nPixels,
+                                     const cmsInterpParams* p)
+{
+    const cmsFloat32Number* Table = (cmsFloat32Number*) p -> Table;
+    const cmsUInt32Number TotalOut = p -> nOutputs;
+    cmsUInt32Number i, n, Base;
+    _cmsTetraFloatSetup s;
+    __m128 vrx, vry, vrz;
+
+    for (i=0; i < nPixels; i++, Input += 3, Output += TotalOut) {
+
+        Base = TetraFloatSetup(Input, p ->Domain, p ->opta[2], p ->opta[1], p ->opta[0], &s);
+
+        vrx = _mm_set1_ps(s.rx);
+        vry = _mm_set1_ps(s.ry);
+        vrz = _mm_set1_ps(s.rz);
+
+        for (n=0; n < TotalOut; n += 4) {
+
+            StoreFloatx4(Output + n, TetraFloatGroup(Table + Base + n, TotalOut - n, &s, vrx, vry, vrz), TotalOut - n);
+        }
+    }
+}
+
+// Two tetrahedral interpolations on adjacent K planes, then a linear blend. As Eval4InputsFloat
+static
+void Eval4InputsFloatBatchSSE2(const cmsFloat32Number Input[],
+                               cmsFloat32Number Output[],
+                               cmsUInt32Number nPixels,
+                               const cmsInterpParams* p)
+{
+    const cmsFloat32Number* Table = (cmsFloat32Number*) p -> Table;
+    const cmsUInt32Number TotalOut = p -> nOutputs;
+    cmsUInt32Number i, n, Base;
+    cmsFloat32Number pk, rest;
+    int k0, K0, K1;
+    _cmsTetraFloatSetup s;
+    __m128 vrx, vry, vrz, vrest;
+
+    for (i=0; i < nPixels; i++, Input += 4, Output += TotalOut) {
+
+        pk = fclamp(Input[0]) * p->Domain[0];
+        k0 = _cmsQuickFloor(pk);
+        rest = pk - (cmsFloat32Number) k0;
+
+        K0 = p -> opta[3] * k0;
+        K1 = K0 + (fclamp(Input[0]) >= 1.0 ? 0 : p->opta[3]);
+
+        Base = TetraFloatSetup(Input + 1, p ->Domain + 1, p ->opta[2], p ->opta[1], p ->opta[0], &s);
+
+        vrx   = _mm_set1_ps(s.rx);
+        vry   = _mm_set1_ps(s.ry);
+        vrz   = _mm_set1_ps(s.rz);
+        vrest = _mm_set1_ps(rest);
+
+        for (n=0; n < TotalOut; n += 4) {
+
+            __m128 y0 = TetraFloatGroup(Table + K0 + Base + n, TotalOut - n, &s, vrx, vry, vrz);
+            __m128 y1 = TetraFloatGroup(Table + K1 + Base + n, TotalOut - n, &s, vrx, vry, vrz);
+
+            StoreFloatx4(Output + n, _mm_add_ps(y0, _mm_mul_ps(_mm_sub_ps(y1, y0), vrest)), TotalOut - n);
+        }
+    }
+}
+
+#endif
+
+// Implementations of the batch interpolators, best first
+static const _cmsKernelEntry Tetrahedral16Kernels[] = {
+#ifdef CMS_INTRP_USE_SSE41
+    { cmsCPU_SSE41, (_cmsKernelFn) TetrahedralInterp16BatchSSE41 },
+#endif
+#ifdef CMS_USE_SSE2
+    { cmsCPU_SSE2,  (_cmsKernelFn) TetrahedralInterp16BatchSSE2 },
+#endif
+    { 0,            (_cmsKernelFn) Lerp16Loop }
+};
+
+static const _cmsKernelEntry TetrahedralFloatKernels[] = {
+#ifdef CMS_USE_SSE2
+    { cmsCPU_SSE2,  (_cmsKernelFn) TetrahedralInterpFloatBatchSSE2 },
+#endif
+    { 0,            (_cmsKernelFn) LerpFloatLoop }
+};
+
+static const _cmsKernelEntry Eval4Inputs16Kernels[] = {
+#ifdef CMS_INTRP_USE_SSE41
+    { cmsCPU_SSE41, (_cmsKernelFn) Eval4InputsBatchSSE41 },
+#endif
+#ifdef CMS_USE_SSE2
+    { cmsCPU_SSE2,  (_cmsKernelFn) Eval4InputsBatchSSE2 },
+#endif
+    { 0,            (_cmsKernelFn) Lerp16Loop }
+};
+
+static const _cmsKernelEntry Eval4InputsFloatKernels[] = {
+#ifdef CMS_USE_SSE2
+    { cmsCPU_SSE2,  (_cmsKernelFn) Eval4InputsFloatBatchSSE2 },
+#endif
+    { 0,            (_cmsKernelFn) LerpFloatLoop }
+};
+
+#define NKERNELS(t) (sizeof(t) / sizeof(_cmsKernelEntry))
+
+// Picks the batch interpolator matching the one-pixel interpolator already selected
+static
+cmsInterpBatchFunction DefaultBatchInterpolator(const cmsInterpParams* p)
+{
+    cmsInterpBatchFunction Batch;
+    cmsBool IsFloat = (p ->dwFlags & CMS_LERP_FLAGS_FLOAT);
+
+    if (IsFloat) {
+
+        if (p ->Interpolation.LerpFloat == TetrahedralInterpFloat)
+            Batch.LerpFloatBatch = (_cmsInterpFnFloatBatch) _cmsSelectKernel(p ->ContextID, TetrahedralFloatKernels, NKERNELS(TetrahedralFloatKernels));
+        else
+        if (p ->Interpolation.LerpFloat == Eval4InputsFloat)
+            Batch.LerpFloatBatch = (_cmsInterpFnFloatBatch) _cmsSelectKernel(p ->ContextID, Eval4InputsFloatKernels, NKERNELS(Eval4InputsFloatKernels));
+        else
+            Batch.LerpFloatBatch = LerpFloatLoop;
+    }
+    else {
+
+        if (p ->Interpolation.Lerp16 == TetrahedralInterp16)
+            Batch.Lerp16Batch = (_cmsInterpFn16Batch) _cmsSelectKernel(p ->ContextID, Tetrahedral16Kernels, NKERNELS(Tetrahedral16Kernels));
+        else
+        if (p ->Interpolation.Lerp16 == Eval4Inputs)
+            Batch.Lerp16Batch = (_cmsInterpFn16Batch) _cmsSelectKernel(p ->ContextID, Eval4Inputs16Kernels, NKERNELS(Eval4Inputs16Kernels));
+        else
+            Batch.Lerp16Batch = Lerp16Loop;
+    }
+
+    return Batch;
+}
+
 
 // The default factory
 static
@@ -26,6 +26,24 @@
 
 #include "lcms2_internal.h"
 
+// Files are mapped on POSIX systems and Windows. Elsewhere, or with CMS_NO_MMAP, mapped files are read into memory
+#ifndef CMS_NO_MMAP
+#   if defined(CMS_IS_WINDOWS_)
+#       ifndef WIN32_LEAN_AND_MEAN
+#           define WIN32_LEAN_AND_MEAN 1
+#       endif
+#       include <windows.h>
+#       define CMS_MMAP_WINDOWS 1
+#   elif defined(__unix__) || defined(__unix) || (defined(__APPLE__) && defined(__MACH__))
+#       include <sys/types.h>
+#       include <sys/stat.h>
+#       include <sys/mman.h>
+#       include <fcntl.h>
+#       include <unistd.h>
+#       define CMS_MMAP_POSIX 1
+#   endif
+#endif
+
 // Generic I/O, tag dictionary management, profile struct
 
 // IOhandlers are abstractions used by littleCMS to read from whatever file, stream,
@@ -142,6 +160,7 @@ typedef struct {
     cmsUInt32Number Size;     // Size of allocated memory
     cmsUInt32Number Pointer;  // Points to current location
     int FreeBlockOnClose;     // As title
+    int UnmapBlockOnClose;    // The block is a mapped file
 
 } FILEMEM;
 
@@ -235,11 +254,32 @@ WriteError:
 }
 
 
+// Releases a block obtained by MapFile
+static
+void UnmapBlock(cmsUInt8Number* Block, cmsUInt32Number Size)
+{
+#if defined(CMS_MMAP_WINDOWS)
+    if (Block != NULL) UnmapViewOfFile(Block);
+    cmsUNUSED_PARAMETER(Size);
+#elif defined(CMS_MMAP_POSIX)
+    if (Block != NULL) munmap(Block, Size);
+#else
+    cmsUNUSED_PARAMETER(Block);
+    cmsUNUSED_PARAMETER(Size);
+#endif
+}
+
 static
 cmsBool  MemoryClose(struct _cms_io_handler* iohandler)
 {
     FILEMEM* ResData = (FILEMEM*) iohandler ->stream;
 
+    if (ResData ->UnmapBlockOnClose) {
+
+        UnmapBlock(ResData ->Block, ResData ->Size);
+        ResData ->Block = NULL;
+    }
+    else
     if (ResData ->FreeBlockOnClose) {
 
         if (ResData->Block) {
@@ -287,6 +327,7 @@ cmsIOHANDLER* CMSEXPORT cmsOpenIOhandlerFromMem(cmsContext ContextID, void *Buff
             return NULL;
         }
 
+        _cmsSetMemoryKind(ContextID, fm ->Block, cmsMEMORY_PROFILE);
 
         memmove(fm->Block, Buffer, size);
         fm ->FreeBlockOnClose = TRUE;
@@ -335,6 +376,238 @@ Error:
     return NULL;
 }
 
+// Read-only memory stream ----------------------------------------------------------
+
+// Those iohandlers read straight from a block that stays out of reach of lcms: either a memory block owned by the
+// caller or a mapped file. Nothing is copied when opening, and the pages of a mapped file are shared with
+// any other process mapping the same file.
+
+static
+cmsBool ReadOnlyMemoryWrite(struct _cms_io_handler* iohandler, cmsUInt32Number size, const void *Ptr)
+{
+    cmsSignalError(iohandler->ContextID, cmsERROR_WRITE, "Write to read-only memory");
+    return FALSE;
+
+    cmsUNUSED_PARAMETER(size);
+    cmsUNUSED_PARAMETER(Ptr);
+}
+
+static
+cmsIOHANDLER* OpenReadOnlyMem(cmsContext ContextID, cmsUInt8Number* Block, cmsUInt32Number size, cmsBool Mapped)
+{
+    cmsIOHANDLER* iohandler = NULL;
+    FILEMEM* fm = NULL;
+
+    iohandler = (cmsIOHANDLER*) _cmsMallocZero(ContextID, sizeof(cmsIOHANDLER));
+    if (iohandler == NULL) return NULL;
+
+    fm = (FILEMEM*) _cmsMallocZero(ContextID, sizeof(FILEMEM));
+    if (fm == NULL) {
+        _cmsFree(ContextID, iohandler);
+        return NULL;
+    }
+
+    fm ->Block   = Block;
+    fm ->Size    = size;
+    fm ->Pointer = 0;
+    fm ->FreeBlockOnClose  = FALSE;
+    fm ->UnmapBlockOnClose = Mapped;
+
+    iohandler ->ContextID = ContextID;
+    iohandler ->stream  = (void*) fm;
+    iohandler ->UsedSpace = 0;
+    iohandler ->ReportedSize = size;
+    iohandler ->PhysicalFile[0] = 0;
+
+    iohandler ->Read    = MemoryRead;
+    iohandler ->Seek    = MemorySeek;
+    iohandler ->Close   = MemoryClose;
+    iohandler ->Tell    = MemoryTell;
+    iohandler ->Write   = ReadOnlyMemoryWrite;
+
+    return iohandler;
+}
+
+// Create a iohandler reading from a memory block owned by the caller. No copy is made, so the block should be
+// kept untouched until the iohandler, or the profile using it, is closed.
+cmsIOHANDLER* CMSEXPORT cmsOpenIOhandlerFromBorrowedMem(cmsContext ContextID, const void *Buffer, cmsUInt32Number size)
+{
+    if (Buffer == NULL) {
+        cmsSignalError(ContextID, cmsERROR_READ, "Couldn't read profile from NULL pointer");
+        return NULL;
+    }
+
+    // The block is never written, read-only iohandlers don't allow it
+    return OpenReadOnlyMem(ContextID, (cmsUInt8Number*) Buffer, size, FALSE);
+}
+
+// Maps the whole file for reading. On systems without mapped files, the file is read into memory, and *Mapped
+// tells the block has to be freed instead.
+static
+cmsBool MapFile(cmsContext ContextID, const char* FileName, cmsUInt8Number** Block, cmsUInt32Number* Size, cmsBool* Mapped)
+{
+#if defined(CMS_MMAP_WINDOWS)
+
+    HANDLE hFile, hMap;
+    LARGE_INTEGER Length;
+
+    hFile = CreateFileA(FileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        cmsSignalError(ContextID, cmsERROR_FILE, "File '%s' not found", FileName);
+        return FALSE;
+    }
+
+    if (!GetFileSizeEx(hFile, &Length)) {
+        CloseHandle(hFile);
+        cmsSignalError(ContextID, cmsERROR_FILE, "Cannot get size of file '%s'", FileName);
+        return FALSE;
+    }
+
+    if (Length.QuadPart > (LONGLONG) 0xFFFFFFFF) {
+        CloseHandle(hFile);
+        cmsSignalError(ContextID, cmsERROR_FILE, "File '%s' is too large", FileName);
+        return FALSE;
+    }
+
+    *Block  = NULL;
+    *Size   = (cmsUInt32Number) Length.QuadPart;
+    *Mapped = TRUE;
+
+    // Empty files cannot be mapped, those are left to fail on reading
+    if (*Size > 0) {
+
+        hMap = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (hMap != NULL) {
+            *Block = (cmsUInt8Number*) MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(hMap);
+        }
+
+        if (*Block == NULL) {
+            CloseHandle(hFile);
+            cmsSignalError(ContextID, cmsERROR_FILE, "Cannot map file '%s'", FileName);
+            return FALSE;
+        }
+    }
+
+    CloseHandle(hFile);
+    return TRUE;
+
+#elif defined(CMS_MMAP_POSIX)
+
+    struct stat st;
+    void* Ptr;
+    int fd;
+
+    fd = open(FileName, O_RDONLY);
+    if (fd < 0) {
+        cmsSignalError(ContextID, cmsERROR_FILE, "File '%s' not found", FileName);
+        return FALSE;
+    }
+
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        cmsSignalError(ContextID, cmsERROR_FILE, "Cannot get size of file '%s'", FileName);
+        return FALSE;
+    }
+
+    if ((cmsUInt64Number) st.st_size > 0xFFFFFFFFU) {
+        close(fd);
+        cmsSignalError(ContextID, cmsERROR_FILE, "File '%s' is too large", FileName);
+        return FALSE;
+    }
+
+    *Block  = NULL;
+    *Size   = (cmsUInt32Number) st.st_size;
+    *Mapped = TRUE;
+
+    // Empty files cannot be mapped, those are left to fail on reading
+    if (*Size > 0) {
+
+        Ptr = mmap(NULL, *Size, PROT_READ, MAP_SHARED, fd, 0);
+        if (Ptr == MAP_FAILED) {
+            close(fd);
+            cmsSignalError(ContextID, cmsERROR_FILE, "Cannot map file '%s'", FileName);
+            return FALSE;
+        }
+
+        *Block = (cmsUInt8Number*) Ptr;
+    }
+
+    close(fd);
+    return TRUE;
+
+#else
+
+    FILE* fm;
+    long int fileLen;
+
+    fm = fopen(FileName, "rb");
+    if (fm == NULL) {
+        cmsSignalError(ContextID, cmsERROR_FILE, "File '%s' not found", FileName);
+        return FALSE;
+    }
+
+    fileLen = (long int) cmsfilelength(fm);
+    if (fileLen < 0) {
+        fclose(fm);
+        cmsSignalError(ContextID, cmsERROR_FILE, "Cannot get size of file '%s'", FileName);
+        return FALSE;
+    }
+
+    *Block  = NULL;
+    *Size   = (cmsUInt32Number) fileLen;
+    *Mapped = FALSE;
+
+    if (*Size > 0) {
+
+        *Block = (cmsUInt8Number*) _cmsMalloc(ContextID, *Size);
+        if (*Block == NULL || fread(*Block, 1, *Size, fm) != *Size) {
+
+            if (*Block != NULL) _cmsFree(ContextID, *Block);
+            fclose(fm);
+            cmsSignalError(ContextID, cmsERROR_FILE, "Read error on file '%s'", FileName);
+            return FALSE;
+        }
+    }
+
+    fclose(fm);
+    return TRUE;
+
+#endif
+}
+
+// Create a iohandler for a file mapped in memory. Only reading is supported.
+cmsIOHANDLER* CMSEXPORT cmsOpenIOhandlerFromMappedFile(cmsContext ContextID, const char* FileName)
+{
+    cmsIOHANDLER* iohandler;
+    cmsUInt8Number* Block;
+    cmsUInt32Number Size;
+    cmsBool Mapped;
+
+    _cmsAssert(FileName != NULL);
+
+    if (!MapFile(ContextID, FileName, &Block, &Size, &Mapped)) return NULL;
+
+    iohandler = OpenReadOnlyMem(ContextID, Block, Size, Mapped);
+    if (iohandler == NULL) {
+
+        if (Mapped)
+            UnmapBlock(Block, Size);
+        else
+            _cmsFree(ContextID, Block);
+        return NULL;
+    }
+
+    // The block read into memory is ours
+    ((FILEMEM*) iohandler ->stream) ->FreeBlockOnClose = !Mapped;
+
+    // Keep track of the original file
+    strncpy(iohandler -> PhysicalFile, FileName, sizeof(iohandler -> PhysicalFile)-1);
+    iohandler -> PhysicalFile[sizeof(iohandler -> PhysicalFile)-1] = 0;
+
+    return iohandler;
+}
+
 // File-based stream -------------------------------------------------------
 
 // Read count elements of size bytes each. Return number of elements read
@@ -591,6 +864,7 @@ cmsHPROFILE CMSEXPORT cmsCreateProfilePlaceholder(cmsContext ContextID)
 {
     _cmsICCPROFILE* Icc = (_cmsICCPROFILE*) _cmsMallocZero(ContextID, sizeof(_cmsICCPROFILE));
     if (Icc == NULL) return NULL;
+    _cmsSetMemoryKind(ContextID, Icc, cmsMEMORY_PROFILE);
 
     Icc ->ContextID = ContextID;
 
@@ -674,13 +948,46 @@ cmsBool CMSEXPORT cmsGetTagOffsetAndSize(cmsHPROFILE hProfile, cmsUInt32Number n
     return TRUE;
 }
 
+// The tag directory is indexed by an open addressing hash. Each tag position goes into the index once, when the
+// position is taken. Positions are never given to other signatures, so the index holds at most MAX_TABLE_TAG entries.
+// Deleted tags keep their entry, which no longer matches as the name is zeroed.
+cmsINLINE cmsUInt32Number TagHashSlot(cmsTagSignature sig)
+{
+    return (((cmsUInt32Number) sig * 0x9E3779B1U) >> 16) & (TAG_HASH_SIZE - 1);
+}
+
+static
+void IndexTag(_cmsICCPROFILE* Profile, cmsTagSignature sig, int n)
+{
+    cmsUInt32Number h = TagHashSlot(sig);
+
+    while (Profile ->TagHash[h] != 0)
+        h = (h + 1) & (TAG_HASH_SIZE - 1);
+
+    Profile ->TagHash[h] = (cmsUInt8Number) (n + 1);
+}
+
 static
 int SearchOneTag(_cmsICCPROFILE* Profile, cmsTagSignature sig)
 {
+    cmsUInt32Number h;
     int i;
 
-    for (i=0; i < (int) Profile -> TagCount; i++) {
+    // Zero marks deleted tags, those are not indexed
+    if (sig == (cmsTagSignature) 0) {
+
+        for (i=0; i < (int) Profile -> TagCount; i++) {
 
+            if (sig == Profile -> TagNames[i])
+                return i;
+        }
+
+        return -1;
+    }
+
+    for (h = TagHashSlot(sig); Profile ->TagHash[h] != 0; h = (h + 1) & (TAG_HASH_SIZE - 1)) {
+
+        i = Profile ->TagHash[h] - 1;
         if (sig == Profile -> TagNames[i])
             return i;
     }
@@ -726,7 +1033,8 @@ void _cmsDeleteTagByPos(_cmsICCPROFILE* Icc, int i)
     _cmsAssert(Icc != NULL);
     _cmsAssert(i >= 0);
 
-   
+    _cmsStoreRelease8(&Icc ->TagCooked[i], 0);
+
     if (Icc -> TagPtrs[i] != NULL) {
 
         // Free previous version
@@ -776,6 +1084,8 @@ cmsBool _cmsNewTag(_cmsICCPROFILE* Icc, cmsTagSignature sig, int* NewPos)
 
         *NewPos = (int) Icc ->TagCount;
         Icc -> TagCount++;
+
+        IndexTag(Icc, sig, *NewPos);
     }
 
     return TRUE;
@@ -938,6 +1248,8 @@ cmsBool _cmsReadHeader(_cmsICCPROFILE* Icc)
 
     // Read tag directory
     Icc -> TagCount = 0;
+    memset(Icc ->TagHash, 0, sizeof(Icc ->TagHash));
+
     for (i=0; i < TagCount; i++) {
 
         if (!_cmsReadUInt32Number(io, (cmsUInt32Number *) &Tag.sig)) return FALSE;
@@ -952,6 +1264,12 @@ cmsBool _cmsReadHeader(_cmsICCPROFILE* Icc)
             continue;
         }
 
+        // Tags cannot be duplicate
+        if (SearchOneTag(Icc, Tag.sig) >= 0) {
+            cmsSignalError(Icc->ContextID, cmsERROR_RANGE, "Duplicate tag found");
+            return FALSE;
+        }
+
         Icc -> TagNames[Icc ->TagCount]   = Tag.sig;
         Icc -> TagOffsets[Icc ->TagCount] = Tag.offset;
         Icc -> TagSizes[Icc ->TagCount]   = Tag.size;
@@ -972,20 +1290,10 @@ cmsBool _cmsReadHeader(_cmsICCPROFILE* Icc)
 
         }
 
-        Icc ->TagCount++;
-    }
-
+        if (Tag.sig != (cmsTagSignature) 0)
+            IndexTag(Icc, Tag.sig, (int) Icc ->TagCount);
 
-    for (i = 0; i < Icc->TagCount; i++) {
-        for (j = 0; j < Icc->TagCount; j++) {
-
-            // Tags cannot be duplicate
-            if ((i != j) && (Icc->TagNames[i] == Icc->TagNames[j])) {
-                cmsSignalError(Icc->ContextID, cmsERROR_RANGE, "Duplicate tag found");
-                return FALSE;
-            }
-
-        }
+        Icc ->TagCount++;
     }
 
     // This is a small aid to diagnose malformed profiles. Please note that execution
@@ -1074,6 +1382,16 @@ cmsBool _cmsWriteHeader(_cmsICCPROFILE* Icc, cmsUInt32Number UsedSpace)
 
 // ----------------------------------------------------------------------- Set/Get several struct members
 
+// Shared handles cannot be modified, other holders would see the changes
+static
+cmsBool IsSharedProfile(_cmsICCPROFILE* Icc)
+{
+    if (Icc ->SharedRefs == 0) return FALSE;
+
+    cmsSignalError(Icc ->ContextID, cmsERROR_NOT_SUITABLE, "Shared profiles are read only");
+    return TRUE;
+}
+
 cmsUInt32Number CMSEXPORT cmsGetHeaderCMM(cmsHPROFILE hProfile)
 {
     _cmsICCPROFILE* Icc = (_cmsICCPROFILE*)hProfile;
@@ -1083,6 +1401,8 @@ cmsUInt32Number CMSEXPORT cmsGetHeaderCMM(cmsHPROFILE hProfile)
 void CMSEXPORT _cmsSetHeaderCMM(cmsHPROFILE hProfile, cmsUInt32Number CMM)
 {
     _cmsICCPROFILE* Icc = (_cmsICCPROFILE*)hProfile;
+
+    if (IsSharedProfile(Icc)) return;
     Icc->CMM = CMM;
 }
 
@@ -1095,6 +1415,8 @@ cmsUInt32Number CMSEXPORT cmsGetHeaderRenderingIntent(cmsHPROFILE hProfile)
 void CMSEXPORT cmsSetHeaderRenderingIntent(cmsHPROFILE hProfile, cmsUInt32Number RenderingIntent)
 {
     _cmsICCPROFILE*  Icc = (_cmsICCPROFILE*) hProfile;
+
+    if (IsSharedProfile(Icc)) return;
     Icc -> RenderingIntent = RenderingIntent;
 }
 
@@ -1107,6 +1429,8 @@ cmsUInt32Number CMSEXPORT cmsGetHeaderFlags(cmsHPROFILE hProfile)
 void CMSEXPORT cmsSetHeaderFlags(cmsHPROFILE hProfile, cmsUInt32Number Flags)
 {
     _cmsICCPROFILE*  Icc = (_cmsICCPROFILE*) hProfile;
+
+    if (IsSharedProfile(Icc)) return;
     Icc -> flags = (cmsUInt32Number) Flags;
 }
 
@@ -1119,6 +1443,8 @@ cmsUInt32Number CMSEXPORT cmsGetHeaderManufacturer(cmsHPROFILE hProfile)
 void CMSEXPORT cmsSetHeaderManufacturer(cmsHPROFILE hProfile, cmsUInt32Number manufacturer)
 {
     _cmsICCPROFILE*  Icc = (_cmsICCPROFILE*) hProfile;
+
+    if (IsSharedProfile(Icc)) return;
     Icc -> manufacturer = manufacturer;
 }
 
@@ -1137,6 +1463,8 @@ cmsUInt32Number CMSEXPORT cmsGetHeaderModel(cmsHPROFILE hProfile)
 void CMSEXPORT cmsSetHeaderModel(cmsHPROFILE hProfile, cmsUInt32Number model)
 {
     _cmsICCPROFILE*  Icc = (_cmsICCPROFILE*) hProfile;
+
+    if (IsSharedProfile(Icc)) return;
     Icc -> model = model;
 }
 
@@ -1149,6 +1477,8 @@ void CMSEXPORT cmsGetHeaderAttributes(cmsHPROFILE hProfile, cmsUInt64Number* Fla
 void CMSEXPORT cmsSetHeaderAttributes(cmsHPROFILE hProfile, cmsUInt64Number Flags)
 {
     _cmsICCPROFILE*  Icc = (_cmsICCPROFILE*) hProfile;
+
+    if (IsSharedProfile(Icc)) return;
     memmove(&Icc -> attributes, &Flags, sizeof(cmsUInt64Number));
 }
 
@@ -1161,6 +1491,8 @@ void CMSEXPORT cmsGetHeaderProfileID(cmsHPROFILE hProfile, cmsUInt8Number* Profi
 void CMSEXPORT cmsSetHeaderProfileID(cmsHPROFILE hProfile, cmsUInt8Number* ProfileID)
 {
     _cmsICCPROFILE*  Icc = (_cmsICCPROFILE*) hProfile;
+
+    if (IsSharedProfile(Icc)) return;
     memmove(&Icc -> ProfileID, ProfileID, 16);
 }
 
@@ -1180,6 +1512,8 @@ cmsColorSpaceSignature CMSEXPORT cmsGetPCS(cmsHPROFILE hProfile)
 void CMSEXPORT cmsSetPCS(cmsHPROFILE hProfile, cmsColorSpaceSignature pcs)
 {
     _cmsICCPROFILE*  Icc = (_cmsICCPROFILE*) hProfile;
+
+    if (IsSharedProfile(Icc)) return;
     Icc -> PCS = pcs;
 }
 
@@ -1192,6 +1526,8 @@ cmsColorSpaceSignature CMSEXPORT cmsGetColorSpace(cmsHPROFILE hProfile)
 void CMSEXPORT cmsSetColorSpace(cmsHPROFILE hProfile, cmsColorSpaceSignature sig)
 {
     _cmsICCPROFILE*  Icc = (_cmsICCPROFILE*) hProfile;
+
+    if (IsSharedProfile(Icc)) return;
     Icc -> ColorSpace = sig;
 }
 
@@ -1204,6 +1540,8 @@ cmsProfileClassSignature CMSEXPORT cmsGetDeviceClass(cmsHPROFILE hProfile)
 void CMSEXPORT cmsSetDeviceClass(cmsHPROFILE hProfile, cmsProfileClassSignature sig)
 {
     _cmsICCPROFILE*  Icc = (_cmsICCPROFILE*) hProfile;
+
+    if (IsSharedProfile(Icc)) return;
     Icc -> DeviceClass = sig;
 }
 
@@ -1216,6 +1554,8 @@ cmsUInt32Number CMSEXPORT cmsGetEncodedICCversion(cmsHPROFILE hProfile)
 void CMSEXPORT cmsSetEncodedICCversion(cmsHPROFILE hProfile, cmsUInt32Number Version)
 {
     _cmsICCPROFILE*  Icc = (_cmsICCPROFILE*) hProfile;
+
+    if (IsSharedProfile(Icc)) return;
     Icc -> Version = Version;
 }
 
@@ -1244,6 +1584,8 @@ void  CMSEXPORT cmsSetProfileVersion(cmsHPROFILE hProfile, cmsFloat64Number Vers
 {
     _cmsICCPROFILE*  Icc = (_cmsICCPROFILE*) hProfile;
 
+    if (IsSharedProfile(Icc)) return;
+
     // 4.2 -> 0x4200000
 
     Icc -> Version = BaseToBase((cmsUInt32Number) floor(Version * 100.0 + 0.5), 10, 16) << 16;
@@ -1400,6 +1742,171 @@ cmsHPROFILE CMSEXPORT cmsOpenProfileFromMem(const void* MemPtr, cmsUInt32Number
     return cmsOpenProfileFromMemTHR(NULL, MemPtr, dwSize);
 }
 
+// Open from a memory block owned by the caller, which has to outlive the profile. Tags are read from the block
+// as needed, and nothing is copied on opening
+cmsHPROFILE CMSEXPORT cmsOpenProfileFromBorrowedMemTHR(cmsContext ContextID, const void* MemPtr, cmsUInt32Number dwSize)
+{
+    _cmsICCPROFILE* NewIcc;
+    cmsHPROFILE hEmpty;
+
+    hEmpty = cmsCreateProfilePlaceholder(ContextID);
+    if (hEmpty == NULL) return NULL;
+
+    NewIcc = (_cmsICCPROFILE*) hEmpty;
+
+    NewIcc ->IOhandler = cmsOpenIOhandlerFromBorrowedMem(ContextID, MemPtr, dwSize);
+    if (NewIcc ->IOhandler == NULL) goto Error;
+
+    if (!_cmsReadHeader(NewIcc)) goto Error;
+
+    return hEmpty;
+
+Error:
+    cmsCloseProfile(hEmpty);
+    return NULL;
+}
+
+cmsHPROFILE CMSEXPORT cmsOpenProfileFromBorrowedMem(const void* MemPtr, cmsUInt32Number dwSize)
+{
+    return cmsOpenProfileFromBorrowedMemTHR(NULL, MemPtr, dwSize);
+}
+
+// Open from a file mapped in memory. Read only.
+cmsHPROFILE CMSEXPORT cmsOpenProfileFromMappedFileTHR(cmsContext ContextID, const char *lpFileName)
+{
+    _cmsICCPROFILE* NewIcc;
+    cmsHPROFILE hEmpty;
+
+    hEmpty = cmsCreateProfilePlaceholder(ContextID);
+    if (hEmpty == NULL) return NULL;
+
+    NewIcc = (_cmsICCPROFILE*) hEmpty;
+
+    NewIcc ->IOhandler = cmsOpenIOhandlerFromMappedFile(ContextID, lpFileName);
+    if (NewIcc ->IOhandler == NULL) goto Error;
+
+    if (!_cmsReadHeader(NewIcc)) goto Error;
+
+    return hEmpty;
+
+Error:
+    cmsCloseProfile(hEmpty);
+    return NULL;
+}
+
+cmsHPROFILE CMSEXPORT cmsOpenProfileFromMappedFile(const char *ICCProfile)
+{
+    return cmsOpenProfileFromMappedFileTHR(NULL, ICCProfile);
+}
+
+// Shared profiles. Profiles are kept in a process-wide list keyed by their MD5 profile ID, and
+// identical profiles opened from any context resolve to the same handle. Those handles live in
+// the global context, have all their tags decoded upfront and are read only. cmsCloseProfile
+// drops one reference and the last one frees the profile.
+
+static _cmsICCPROFILE* SharedProfilesHead = NULL;
+
+// Search the registry. Must be called with the registry locked
+static
+_cmsICCPROFILE* SearchSharedProfile(const cmsProfileID* ID)
+{
+    _cmsICCPROFILE* Icc;
+
+    for (Icc = SharedProfilesHead; Icc != NULL; Icc = Icc ->SharedNext) {
+
+        if (memcmp(Icc ->ProfileID.ID8, ID ->ID8, sizeof(cmsProfileID)) == 0) return Icc;
+    }
+
+    return NULL;
+}
+
+// Takes ownership of a freshly opened profile. Returns either this profile, now in the
+// registry, or an already registered one with the same ID, in which case hProfile is closed.
+static
+cmsHPROFILE ShareProfile(cmsHPROFILE hProfile)
+{
+    _cmsICCPROFILE* Icc = (_cmsICCPROFILE*) hProfile;
+    _cmsICCPROFILE* Found;
+
+    if (hProfile == NULL) return NULL;
+
+    if (!cmsMD5computeID(hProfile)) goto Error;
+
+    if (!_cmsLockSharedProfiles()) goto Error;
+    Found = SearchSharedProfile(&Icc ->ProfileID);
+    if (Found != NULL) Found ->SharedRefs++;
+    _cmsUnlockSharedProfiles();
+
+    if (Found != NULL) {
+        cmsCloseProfile(hProfile);
+        return (cmsHPROFILE) Found;
+    }
+
+    // Decode outside the lock, it may take a while. Tags that fail will do it again on cmsReadTag.
+    cmsReadAllTags(hProfile);
+
+    if (!_cmsLockSharedProfiles()) goto Error;
+
+    // Someone else may have registered the same profile meanwhile
+    Found = SearchSharedProfile(&Icc ->ProfileID);
+    if (Found != NULL) {
+        Found ->SharedRefs++;
+    }
+    else {
+        Icc ->SharedRefs = 1;
+        Icc ->SharedNext = SharedProfilesHead;
+        SharedProfilesHead = Icc;
+    }
+
+    _cmsUnlockSharedProfiles();
+
+    if (Found != NULL) {
+        cmsCloseProfile(hProfile);
+        return (cmsHPROFILE) Found;
+    }
+
+    return hProfile;
+
+Error:
+    cmsCloseProfile(hProfile);
+    return NULL;
+}
+
+// Drops one reference. Returns TRUE if that was the last one and the profile is to be freed.
+static
+cmsBool ReleaseSharedProfile(_cmsICCPROFILE* Icc)
+{
+    _cmsICCPROFILE** Ptr;
+    cmsBool Last;
+
+    if (!_cmsLockSharedProfiles()) return FALSE;
+
+    Last = (--Icc ->SharedRefs == 0);
+    if (Last) {
+
+        for (Ptr = &SharedProfilesHead; *Ptr != NULL; Ptr = &(*Ptr) ->SharedNext) {
+
+            if (*Ptr == Icc) {
+                *Ptr = Icc ->SharedNext;
+                break;
+            }
+        }
+    }
+
+    _cmsUnlockSharedProfiles();
+    return Last;
+}
+
+cmsHPROFILE CMSEXPORT cmsOpenSharedProfileFromMem(const void* MemPtr, cmsUInt32Number dwSize)
+{
+    return ShareProfile(cmsOpenProfileFromMemTHR(NULL, MemPtr, dwSize));
+}
+
+cmsHPROFILE CMSEXPORT cmsOpenSharedProfileFromFile(const char *ICCProfile)
+{
+    return ShareProfile(cmsOpenProfileFromMappedFileTHR(NULL, ICCProfile));
+}
+
 
 
 // Dump tag contents. If the profile is being modified, untouched tags are copied from FileOrig
@@ -1552,11 +2059,13 @@ cmsBool SetLinks( _cmsICCPROFILE* Icc)
 
 // Low-level save to IOHANDLER. It returns the number of bytes used to
 // store the profile, or zero on error. io may be NULL and in this case
-// no data is written--only sizes are calculated
+// no data is written--only sizes are calculated. Offsets and sizes are
+// worked out on a copy, so the profile itself is never written and
+// shared profiles may be saved as any other.
 cmsUInt32Number CMSEXPORT cmsSaveProfileToIOhandler(cmsHPROFILE hProfile, cmsIOHANDLER* io)
 {
     _cmsICCPROFILE* Icc = (_cmsICCPROFILE*) hProfile;
-    _cmsICCPROFILE Keep;
+    _cmsICCPROFILE Work;
     cmsIOHANDLER* PrevIO = NULL;
     cmsUInt32Number UsedSpace;
     cmsContext ContextID;
@@ -1564,10 +2073,10 @@ cmsUInt32Number CMSEXPORT cmsSaveProfileToIOhandler(cmsHPROFILE hProfile, cmsIOH
     _cmsAssert(hProfile != NULL);
     
     if (!_cmsLockMutex(Icc->ContextID, Icc->UsrMutex)) return 0;
-    memmove(&Keep, Icc, sizeof(_cmsICCPROFILE));
+    memmove(&Work, Icc, sizeof(_cmsICCPROFILE));
 
     ContextID = cmsGetProfileContextID(hProfile);
-    PrevIO = Icc ->IOhandler = cmsOpenIOhandlerFromNULL(ContextID);
+    PrevIO = Work.IOhandler = cmsOpenIOhandlerFromNULL(ContextID);
     if (PrevIO == NULL) {
         _cmsUnlockMutex(Icc->ContextID, Icc->UsrMutex);
         return 0;
@@ -1575,8 +2084,8 @@ cmsUInt32Number CMSEXPORT cmsSaveProfileToIOhandler(cmsHPROFILE hProfile, cmsIOH
 
     // Pass #1 does compute offsets
 
-    if (!_cmsWriteHeader(Icc, 0)) goto Error;
-    if (!SaveTags(Icc, &Keep)) goto Error;
+    if (!_cmsWriteHeader(&Work, 0)) goto Error;
+    if (!SaveTags(&Work, Icc)) goto Error;
 
     UsedSpace = PrevIO ->UsedSpace;
 
@@ -1584,13 +2093,12 @@ cmsUInt32Number CMSEXPORT cmsSaveProfileToIOhandler(cmsHPROFILE hProfile, cmsIOH
 
     if (io != NULL) {
 
-        Icc ->IOhandler = io;
-        if (!SetLinks(Icc)) goto Error;
-        if (!_cmsWriteHeader(Icc, UsedSpace)) goto Error;
-        if (!SaveTags(Icc, &Keep)) goto Error;
+        Work.IOhandler = io;
+        if (!SetLinks(&Work)) goto Error;
+        if (!_cmsWriteHeader(&Work, UsedSpace)) goto Error;
+        if (!SaveTags(&Work, Icc)) goto Error;
     }
 
-    memmove(Icc, &Keep, sizeof(_cmsICCPROFILE));
     if (!cmsCloseIOhandler(PrevIO)) 
         UsedSpace = 0; // As a error marker
 
@@ -1601,7 +2109,6 @@ cmsUInt32Number CMSEXPORT cmsSaveProfileToIOhandler(cmsHPROFILE hProfile, cmsIOH
 
 Error:
     cmsCloseIOhandler(PrevIO);
-    memmove(Icc, &Keep, sizeof(_cmsICCPROFILE));
     _cmsUnlockMutex(Icc->ContextID, Icc->UsrMutex);
 
     return 0;
@@ -1671,6 +2178,8 @@ cmsBool CMSEXPORT cmsSaveProfileToMem(cmsHPROFILE hProfile, void *MemPtr, cmsUIn
 static
 void freeOneTag(_cmsICCPROFILE* Icc, cmsUInt32Number i)
 {
+    _cmsStoreRelease8(&Icc->TagCooked[i], 0);
+
     if (Icc->TagPtrs[i]) {
 
         cmsTagTypeHandler* TypeHandler = Icc->TagTypeHandlers[i];
@@ -1698,6 +2207,9 @@ cmsBool  CMSEXPORT cmsCloseProfile(cmsHPROFILE hProfile)
 
     if (!Icc) return FALSE;
 
+    // Shared profiles are freed on last close
+    if (Icc ->SharedRefs > 0 && !ReleaseSharedProfile(Icc)) return TRUE;
+
     // Was open in write mode?
     if (Icc ->IsWrite) {
 
@@ -1742,6 +2254,28 @@ cmsBool IsTypeSupported(cmsTagDescriptor* TagDescriptor, cmsTagTypeSignature Typ
     return FALSE;
 }
 
+// Sanity check on a tag already in memory, before handing it out as cooked
+static
+cmsBool IsCookedTagValid(_cmsICCPROFILE* Icc, cmsTagSignature sig, int n, cmsBool avoidCheck)
+{
+    cmsTagDescriptor* TagDescriptor;
+    cmsTagTypeSignature BaseType;
+
+    if (Icc->TagTypeHandlers[n] == NULL) return FALSE;
+
+    BaseType = Icc->TagTypeHandlers[n]->Signature;
+    if (BaseType == 0) return FALSE;
+
+    if (!avoidCheck) {
+
+        TagDescriptor = _cmsGetTagDescriptor(Icc->ContextID, sig);
+        if (TagDescriptor == NULL) return FALSE;
+        if (!IsTypeSupported(TagDescriptor, BaseType)) return FALSE;
+    }
+
+    return !Icc->TagSaveAsRaw[n];  // We don't support read raw tags as cooked
+}
+
 // That's the main read function
 void* CMSEXPORT cmsReadTag(cmsHPROFILE hProfile, cmsTagSignature sig)
 {
@@ -1756,10 +2290,16 @@ void* CMSEXPORT cmsReadTag(cmsHPROFILE hProfile, cmsTagSignature sig)
     cmsUInt32Number ElemCount;
     int n;
 
-    if (!_cmsLockMutex(Icc->ContextID, Icc->UsrMutex)) return NULL;
-
     avoidCheck = _cmsAvoidTypeCheckOnTags(Icc->ContextID);
 
+    // Tags already cooked are returned without locking, so readers of a shared profile don't wait
+    // on each other. Anything else, including failed checks, goes across the mutex.
+    n = _cmsSearchTag(Icc, sig, TRUE);
+    if (n >= 0 && _cmsLoadAcquire8(&Icc->TagCooked[n]) && IsCookedTagValid(Icc, sig, n, avoidCheck))
+        return Icc->TagPtrs[n];
+
+    if (!_cmsLockMutex(Icc->ContextID, Icc->UsrMutex)) return NULL;
+
     n = _cmsSearchTag(Icc, sig, TRUE);
     if (n < 0)
     {
@@ -1768,23 +2308,10 @@ void* CMSEXPORT cmsReadTag(cmsHPROFILE hProfile, cmsTagSignature sig)
         return NULL;
     }
 
-    // If the element is already in memory, return the pointer
+    // If the element is already in memory, return the pointer. Another thread may have read it meanwhile.
     if (Icc->TagPtrs[n]) {
 
-        if (Icc->TagTypeHandlers[n] == NULL) goto Error;
-
-        // Sanity check
-        BaseType = Icc->TagTypeHandlers[n]->Signature;
-        if (BaseType == 0) goto Error;
-
-        if (!avoidCheck) {
-
-            TagDescriptor = _cmsGetTagDescriptor(Icc->ContextID, sig);
-            if (TagDescriptor == NULL) goto Error;
-            if (!IsTypeSupported(TagDescriptor, BaseType)) goto Error;
-        }
-
-        if (Icc->TagSaveAsRaw[n]) goto Error;  // We don't support read raw tags as cooked
+        if (!IsCookedTagValid(Icc, sig, n, avoidCheck)) goto Error;
 
         _cmsUnlockMutex(Icc->ContextID, Icc->UsrMutex);
         return Icc->TagPtrs[n];
@@ -1871,7 +2398,9 @@ void* CMSEXPORT cmsReadTag(cmsHPROFILE hProfile, cmsTagSignature sig)
         }
     }
 
-    // Return the data
+    // Return the data. From now on, readers get it without locking
+    _cmsStoreRelease8(&Icc->TagCooked[n], 1);
+
     _cmsUnlockMutex(Icc->ContextID, Icc->UsrMutex);
     return Icc->TagPtrs[n];
 
@@ -1887,6 +2416,30 @@ Error:
 }
 
 
+// Decodes every known tag in the profile now, so later cmsReadTag calls are served from memory
+// without locking. Unknown (private) tags and tags written as raw are left alone. Returns FALSE
+// if any tag failed to decode; the remaining ones are decoded anyway.
+cmsBool CMSEXPORT cmsReadAllTags(cmsHPROFILE hProfile)
+{
+    _cmsICCPROFILE* Icc = (_cmsICCPROFILE*) hProfile;
+    cmsBool avoidCheck = _cmsAvoidTypeCheckOnTags(Icc->ContextID);
+    cmsBool rc = TRUE;
+    cmsUInt32Number i;
+
+    for (i=0; i < Icc->TagCount; i++) {
+
+        cmsTagSignature sig = Icc->TagNames[i];
+
+        if (sig == (cmsTagSignature) 0 || Icc->TagSaveAsRaw[i]) continue;
+        if (!avoidCheck && _cmsGetTagDescriptor(Icc->ContextID, sig) == NULL) continue;
+
+        if (cmsReadTag(hProfile, sig) == NULL) rc = FALSE;
+    }
+
+    return rc;
+}
+
+
 // Get true type of data
 cmsTagTypeSignature _cmsGetTagTrueType(cmsHPROFILE hProfile, cmsTagSignature sig)
 {
@@ -1919,6 +2472,8 @@ cmsBool CMSEXPORT cmsWriteTag(cmsHPROFILE hProfile, cmsTagSignature sig, const v
     cmsFloat64Number Version;
     char TypeString[5], SigString[5];
 
+    if (IsSharedProfile(Icc)) return FALSE;
+
     if (!_cmsLockMutex(Icc->ContextID, Icc ->UsrMutex)) return FALSE;
 
     // To delete tags.
@@ -2016,6 +2571,8 @@ cmsBool CMSEXPORT cmsWriteTag(cmsHPROFILE hProfile, cmsTagSignature sig, const v
         goto Error;
     }
 
+    _cmsStoreRelease8(&Icc ->TagCooked[i], 1);
+
     _cmsUnlockMutex(Icc->ContextID, Icc ->UsrMutex);
     return TRUE;
 
@@ -2161,6 +2718,8 @@ cmsBool CMSEXPORT cmsWriteRawTag(cmsHPROFILE hProfile, cmsTagSignature sig, cons
     _cmsICCPROFILE* Icc = (_cmsICCPROFILE*) hProfile;
     int i;
 
+    if (IsSharedProfile(Icc)) return FALSE;
+
     if (!_cmsLockMutex(Icc->ContextID, Icc ->UsrMutex)) return 0;
 
     if (!_cmsNewTag(Icc, sig, &i)) {
@@ -2193,6 +2752,8 @@ cmsBool CMSEXPORT cmsLinkTag(cmsHPROFILE hProfile, cmsTagSignature sig, cmsTagSi
     _cmsICCPROFILE* Icc = (_cmsICCPROFILE*) hProfile;
     int i;
 
+    if (IsSharedProfile(Icc)) return FALSE;
+
      if (!_cmsLockMutex(Icc->ContextID, Icc ->UsrMutex)) return FALSE;
 
     if (!_cmsNewTag(Icc, sig, &i)) {
@@ -26,6 +26,12 @@
 
 #include "lcms2_internal.h"
 
+// Batched evaluation works on blocks of at most this number of pixels, and scratch
+// buffers of at most MAX_BATCH_FLOATS per phase. Those live on the stack, so they are
+// kept to what a full block of cmsMAXCHANNELS channels takes
+#define MAX_BATCH_PIXELS    32
+#define MAX_BATCH_FLOATS    (MAX_BATCH_PIXELS * cmsMAXCHANNELS)
+
 
 // Allocates an empty multi profile element
 cmsStage* CMSEXPORT _cmsStageAllocPlaceholder(cmsContext ContextID,
@@ -40,6 +46,7 @@ cmsStage* CMSEXPORT _cmsStageAllocPlaceholder(cmsContext ContextID,
     cmsStage* ph = (cmsStage*) _cmsMallocZero(ContextID, sizeof(cmsStage));
 
     if (ph == NULL) return NULL;
+    _cmsSetMemoryKind(ContextID, ph, cmsMEMORY_PIPELINE);
 
 
     ph ->ContextID = ContextID;
@@ -183,6 +190,35 @@ void EvaluateCurves(const cmsFloat32Number In[],
     }
 }
 
+static
+void EvaluateCurvesBatch(const cmsFloat32Number In[],
+                         cmsFloat32Number Out[],
+                         cmsUInt32Number nPixels,
+                         cmsUInt32Number Stride,
+                         const cmsStage *mpe)
+{
+    _cmsStageToneCurvesData* Data;
+    cmsUInt32Number i, j;
+
+    _cmsAssert(mpe != NULL);
+
+    Data = (_cmsStageToneCurvesData*) mpe ->Data;
+    if (Data == NULL) return;
+
+    if (Data ->TheCurves == NULL) return;
+
+    for (i=0; i < Data ->nCurves; i++) {
+
+        const cmsToneCurve* Curve = Data ->TheCurves[i];
+        const cmsFloat32Number* Src = In + i * Stride;
+        cmsFloat32Number* Dst = Out + i * Stride;
+
+        for (j=0; j < nPixels; j++) {
+            Dst[j] = cmsEvalToneCurveFloat(Curve, Src[j]);
+        }
+    }
+}
+
 static
 void CurveSetElemTypeFree(cmsStage* mpe)
 {
@@ -256,6 +292,8 @@ cmsStage* CMSEXPORT cmsStageAllocToneCurves(cmsContext ContextID, cmsUInt32Numbe
                                      EvaluateCurves, CurveSetDup, CurveSetElemTypeFree, NULL );
     if (NewMPE == NULL) return NULL;
 
+    NewMPE ->EvalBatchPtr = EvaluateCurvesBatch;
+
     NewElem = (_cmsStageToneCurvesData*) _cmsMallocZero(ContextID, sizeof(_cmsStageToneCurvesData));
     if (NewElem == NULL) {
         cmsStageFree(NewMPE);
@@ -335,6 +373,45 @@ void EvaluateMatrix(const cmsFloat32Number In[],
     // Output in 0..1.0 domain
 }
 
+// Same as above, a whole block of pixels at once. The accumulation order is kept, so results are identical
+static
+void EvaluateMatrixBatch(const cmsFloat32Number In[],
+                         cmsFloat32Number Out[],
+                         cmsUInt32Number nPixels,
+                         cmsUInt32Number Stride,
+                         const cmsStage *mpe)
+{
+    cmsUInt32Number i, j, k;
+    _cmsStageMatrixData* Data = (_cmsStageMatrixData*) mpe ->Data;
+    cmsFloat64Number Tmp[MAX_BATCH_PIXELS];
+
+    _cmsAssert(nPixels <= MAX_BATCH_PIXELS);
+
+    for (i=0; i < mpe ->OutputChannels; i++) {
+
+        for (k=0; k < nPixels; k++)
+            Tmp[k] = 0;
+
+        for (j=0; j < mpe->InputChannels; j++) {
+
+            const cmsFloat32Number* Src = In + j * Stride;
+            cmsFloat64Number m = Data->Double[i*mpe->InputChannels + j];
+
+            for (k=0; k < nPixels; k++)
+                Tmp[k] += Src[k] * m;
+        }
+
+        if (Data ->Offset != NULL) {
+
+            for (k=0; k < nPixels; k++)
+                Tmp[k] += Data->Offset[i];
+        }
+
+        for (k=0; k < nPixels; k++)
+            Out[i * Stride + k] = (cmsFloat32Number) Tmp[k];
+    }
+}
+
 
 // Duplicate a yet-existing matrix element
 static
@@ -395,6 +472,8 @@ cmsStage*  CMSEXPORT cmsStageAllocMatrix(cmsContext ContextID, cmsUInt32Number R
                                      EvaluateMatrix, MatrixElemDup, MatrixElemTypeFree, NULL );
     if (NewMPE == NULL) return NULL;
 
+    NewMPE ->EvalBatchPtr = EvaluateMatrixBatch;
+
 
     NewElem = (_cmsStageMatrixData*) _cmsMallocZero(ContextID, sizeof(_cmsStageMatrixData));
     if (NewElem == NULL) goto Error;
@@ -455,6 +534,57 @@ void EvaluateCLUTfloatIn16(const cmsFloat32Number In[], cmsFloat32Number Out[],
     From16ToFloat(Out16, Out,  mpe ->OutputChannels);
 }
 
+// Block versions. Pixels are interleaved again to feed the batch interpolator
+static
+void EvaluateCLUTfloatBatch(const cmsFloat32Number In[], cmsFloat32Number Out[],
+                            cmsUInt32Number nPixels, cmsUInt32Number Stride, const cmsStage *mpe)
+{
+    _cmsStageCLutData* Data = (_cmsStageCLutData*) mpe ->Data;
+    cmsFloat32Number Pin[MAX_BATCH_FLOATS], Pout[MAX_BATCH_FLOATS];
+    cmsUInt32Number i, j;
+
+    _cmsAssert(nPixels * mpe ->InputChannels  <= MAX_BATCH_FLOATS);
+    _cmsAssert(nPixels * mpe ->OutputChannels <= MAX_BATCH_FLOATS);
+
+    // Nothing to interleave, and the interpolator would read an unset buffer
+    if (nPixels == 0) return;
+
+    for (i=0; i < nPixels; i++)
+        for (j=0; j < mpe ->InputChannels; j++)
+            Pin[i * mpe ->InputChannels + j] = In[j * Stride + i];
+
+    Data -> Params ->BatchInterpolation.LerpFloatBatch(Pin, Pout, nPixels, Data->Params);
+
+    for (i=0; i < nPixels; i++)
+        for (j=0; j < mpe ->OutputChannels; j++)
+            Out[j * Stride + i] = Pout[i * mpe ->OutputChannels + j];
+}
+
+static
+void EvaluateCLUTfloatIn16Batch(const cmsFloat32Number In[], cmsFloat32Number Out[],
+                                cmsUInt32Number nPixels, cmsUInt32Number Stride, const cmsStage *mpe)
+{
+    _cmsStageCLutData* Data = (_cmsStageCLutData*) mpe ->Data;
+    cmsUInt16Number In16[MAX_BATCH_FLOATS], Out16[MAX_BATCH_FLOATS];
+    cmsUInt32Number i, j;
+
+    _cmsAssert(nPixels * mpe ->InputChannels  <= MAX_BATCH_FLOATS);
+    _cmsAssert(nPixels * mpe ->OutputChannels <= MAX_BATCH_FLOATS);
+
+    // Nothing to interleave, and the interpolator would read an unset buffer
+    if (nPixels == 0) return;
+
+    for (i=0; i < nPixels; i++)
+        for (j=0; j < mpe ->InputChannels; j++)
+            In16[i * mpe ->InputChannels + j] = _cmsQuickSaturateWord(In[j * Stride + i] * 65535.0);
+
+    Data -> Params ->BatchInterpolation.Lerp16Batch(In16, Out16, nPixels, Data->Params);
+
+    for (i=0; i < nPixels; i++)
+        for (j=0; j < mpe ->OutputChannels; j++)
+            Out[j * Stride + i] = (cmsFloat32Number) Out16[i * mpe ->OutputChannels + j] / 65535.0F;
+}
+
 
 // Given an hypercube of b dimensions, with Dims[] number of nodes by dimension, calculate the total amount of nodes
 static
@@ -501,10 +631,12 @@ void* CLUTElemDup(cmsStage* mpe)
             NewElem ->Tab.TFloat = (cmsFloat32Number*) _cmsDupMem(mpe ->ContextID, Data ->Tab.TFloat, Data ->nEntries * sizeof (cmsFloat32Number));
             if (NewElem ->Tab.TFloat == NULL)
                 goto Error;
+            _cmsSetMemoryKind(mpe ->ContextID, NewElem ->Tab.TFloat, cmsMEMORY_CLUT);
         } else {
             NewElem ->Tab.T = (cmsUInt16Number*) _cmsDupMem(mpe ->ContextID, Data ->Tab.T, Data ->nEntries * sizeof (cmsUInt16Number));
             if (NewElem ->Tab.T == NULL)
                 goto Error;
+            _cmsSetMemoryKind(mpe ->ContextID, NewElem ->Tab.T, cmsMEMORY_CLUT);
         }
     }
 
@@ -567,6 +699,8 @@ cmsStage* CMSEXPORT cmsStageAllocCLut16bitGranular(cmsContext ContextID,
 
     if (NewMPE == NULL) return NULL;
 
+    NewMPE ->EvalBatchPtr = EvaluateCLUTfloatIn16Batch;
+
     NewElem = (_cmsStageCLutData*) _cmsMallocZero(ContextID, sizeof(_cmsStageCLutData));
     if (NewElem == NULL) {
         cmsStageFree(NewMPE);
@@ -589,6 +723,7 @@ cmsStage* CMSEXPORT cmsStageAllocCLut16bitGranular(cmsContext ContextID,
         cmsStageFree(NewMPE);
         return NULL;
     }
+    _cmsSetMemoryKind(ContextID, NewElem ->Tab.T, cmsMEMORY_CLUT);
 
     if (Table != NULL) {
         for (i=0; i < n; i++) {
@@ -657,6 +792,8 @@ cmsStage* CMSEXPORT cmsStageAllocCLutFloatGranular(cmsContext ContextID, const c
                                              EvaluateCLUTfloat, CLUTElemDup, CLutElemTypeFree, NULL);
     if (NewMPE == NULL) return NULL;
 
+    NewMPE ->EvalBatchPtr = EvaluateCLUTfloatBatch;
+
 
     NewElem = (_cmsStageCLutData*) _cmsMallocZero(ContextID, sizeof(_cmsStageCLutData));
     if (NewElem == NULL) {
@@ -680,6 +817,7 @@ cmsStage* CMSEXPORT cmsStageAllocCLutFloatGranular(cmsContext ContextID, const c
         cmsStageFree(NewMPE);
         return NULL;
     }
+    _cmsSetMemoryKind(ContextID, NewElem ->Tab.TFloat, cmsMEMORY_CLUT);
 
     if (Table != NULL) {
         for (i=0; i < n; i++) {
@@ -743,40 +881,22 @@ cmsUInt16Number CMSEXPORT _cmsQuantizeVal(cmsFloat64Number i, cmsUInt32Number Ma
 }
 
 
-// This routine does a sweep on whole input space, and calls its callback
-// function on knots. returns TRUE if all ok, FALSE otherwise.
-cmsBool CMSEXPORT cmsStageSampleCLut16bit(cmsStage* mpe, cmsSAMPLER16 Sampler, void * Cargo, cmsUInt32Number dwFlags)
+// Sweeps the nodes From..To-1 of the CLUT, calling the sampler on each one
+static
+cmsBool SampleNodes16(_cmsStageCLutData* clut, cmsSAMPLER16 Sampler, void * Cargo, cmsUInt32Number dwFlags,
+                      cmsUInt32Number From, cmsUInt32Number To)
 {
     int i, t, index, rest;
-    cmsUInt32Number nTotalPoints;
-    cmsUInt32Number nInputs, nOutputs;
-    cmsUInt32Number* nSamples;
+    cmsUInt32Number nInputs  = clut->Params ->nInputs;
+    cmsUInt32Number nOutputs = clut->Params ->nOutputs;
+    cmsUInt32Number* nSamples = clut->Params ->nSamples;
     cmsUInt16Number In[MAX_INPUT_DIMENSIONS+1], Out[MAX_STAGE_CHANNELS];
-    _cmsStageCLutData* clut;
-
-    if (mpe == NULL) return FALSE;
-
-    clut = (_cmsStageCLutData*) mpe->Data;
-
-    if (clut == NULL) return FALSE;
-
-    nSamples = clut->Params ->nSamples;
-    nInputs  = clut->Params ->nInputs;
-    nOutputs = clut->Params ->nOutputs;
-
-    if (nInputs <= 0) return FALSE;
-    if (nOutputs <= 0) return FALSE;
-    if (nInputs > MAX_INPUT_DIMENSIONS) return FALSE;
-    if (nOutputs >= MAX_STAGE_CHANNELS) return FALSE;
 
     memset(In, 0, sizeof(In));
     memset(Out, 0, sizeof(Out));
 
-    nTotalPoints = CubeSize(nSamples, nInputs);
-    if (nTotalPoints == 0) return FALSE;
-
-    index = 0;
-    for (i = 0; i < (int) nTotalPoints; i++) {
+    index = (int) (From * nOutputs);
+    for (i = (int) From; i < (int) To; i++) {
 
         rest = i;
         for (t = (int)nInputs - 1; t >= 0; --t) {
@@ -810,6 +930,90 @@ cmsBool CMSEXPORT cmsStageSampleCLut16bit(cmsStage* mpe, cmsSAMPLER16 Sampler, v
     return TRUE;
 }
 
+// Reentrant samplers are split in this number of tasks at most, each one of this size at least
+#define SAMPLER_MAX_TASKS       64
+#define SAMPLER_MIN_NODES       1024
+
+typedef struct {
+
+    _cmsStageCLutData* clut;
+    cmsSAMPLER16       Sampler;
+    void*              Cargo;
+    cmsUInt32Number    dwFlags;
+    cmsUInt32Number    nTotalPoints;
+    cmsUInt32Number    NodesPerTask;
+    cmsBool            Ok[SAMPLER_MAX_TASKS];
+
+} SamplerTasks16;
+
+static
+void SampleTask16(void* Cargo, cmsUInt32Number Task)
+{
+    SamplerTasks16* st = (SamplerTasks16*) Cargo;
+    cmsUInt32Number From = Task * st ->NodesPerTask;
+    cmsUInt32Number To   = From + st ->NodesPerTask;
+
+    if (To > st ->nTotalPoints) To = st ->nTotalPoints;
+
+    st ->Ok[Task] = SampleNodes16(st ->clut, st ->Sampler, st ->Cargo, st ->dwFlags, From, To);
+}
+
+// This routine does a sweep on whole input space, and calls its callback
+// function on knots. returns TRUE if all ok, FALSE otherwise.
+cmsBool CMSEXPORT cmsStageSampleCLut16bit(cmsStage* mpe, cmsSAMPLER16 Sampler, void * Cargo, cmsUInt32Number dwFlags)
+{
+    cmsUInt32Number nTotalPoints, nTasks, i;
+    cmsUInt32Number nInputs, nOutputs;
+    _cmsStageCLutData* clut;
+    SamplerTasks16 st;
+
+    if (mpe == NULL) return FALSE;
+
+    clut = (_cmsStageCLutData*) mpe->Data;
+
+    if (clut == NULL) return FALSE;
+
+    nInputs  = clut->Params ->nInputs;
+    nOutputs = clut->Params ->nOutputs;
+
+    if (nInputs <= 0) return FALSE;
+    if (nOutputs <= 0) return FALSE;
+    if (nInputs > MAX_INPUT_DIMENSIONS) return FALSE;
+    if (nOutputs >= MAX_STAGE_CHANNELS) return FALSE;
+
+    nTotalPoints = CubeSize(clut->Params ->nSamples, nInputs);
+    if (nTotalPoints == 0) return FALSE;
+
+    // Nodes write to their own entries only, so any split gives the same table
+    nTasks = 1;
+    if (dwFlags & SAMPLER_PARALLEL) {
+
+        nTasks = nTotalPoints / SAMPLER_MIN_NODES;
+        if (nTasks > SAMPLER_MAX_TASKS) nTasks = SAMPLER_MAX_TASKS;
+    }
+
+    if (nTasks <= 1)
+        return SampleNodes16(clut, Sampler, Cargo, dwFlags, 0, nTotalPoints);
+
+    st.clut = clut;
+    st.Sampler = Sampler;
+    st.Cargo = Cargo;
+    st.dwFlags = dwFlags;
+    st.nTotalPoints = nTotalPoints;
+    st.NodesPerTask = (nTotalPoints + nTasks - 1) / nTasks;
+
+    for (i = 0; i < nTasks; i++)
+        st.Ok[i] = FALSE;
+
+    _cmsRunTasks(mpe ->ContextID, SampleTask16, (void*) &st, nTasks);
+
+    for (i = 0; i < nTasks; i++) {
+        if (!st.Ok[i]) return FALSE;
+    }
+
+    return TRUE;
+}
+
 // Same as anterior, but for floating point
 cmsBool CMSEXPORT cmsStageSampleCLutFloat(cmsStage* mpe, cmsSAMPLERFLOAT Sampler, void * Cargo, cmsUInt32Number dwFlags)
 {
@@ -1263,7 +1467,8 @@ cmsStage* CMSEXPORT cmsStageDup(cmsStage* mpe)
                                      NULL);
     if (NewMPE == NULL) return NULL;
 
-    NewMPE ->Implements = mpe ->Implements;
+    NewMPE ->Implements   = mpe ->Implements;
+    NewMPE ->EvalBatchPtr = mpe ->EvalBatchPtr;
 
     if (mpe ->DupElemPtr) {
 
@@ -1385,6 +1590,7 @@ cmsPipeline* CMSEXPORT cmsPipelineAlloc(cmsContext ContextID, cmsUInt32Number In
 
        NewLUT = (cmsPipeline*) _cmsMallocZero(ContextID, sizeof(cmsPipeline));
        if (NewLUT == NULL) return NULL;
+       _cmsSetMemoryKind(ContextID, NewLUT, cmsMEMORY_PIPELINE);
 
        NewLUT -> InputChannels  = InputChannels;
        NewLUT -> OutputChannels = OutputChannels;
@@ -1460,6 +1666,209 @@ void CMSEXPORT cmsPipelineEvalFloat(const cmsFloat32Number In[], cmsFloat32Numbe
 }
 
 
+// Batched evaluation --------------------------------------------------------------------------------------------------
+
+// Stages not providing a block evaluator are called once per pixel
+static
+void EvaluateStageBatch(const cmsFloat32Number In[], cmsFloat32Number Out[],
+                        cmsUInt32Number nPixels, cmsUInt32Number Stride, const cmsStage* mpe)
+{
+    cmsFloat32Number Pin[MAX_STAGE_CHANNELS], Pout[MAX_STAGE_CHANNELS];
+    cmsUInt32Number i, j;
+
+    if (mpe ->EvalBatchPtr != NULL) {
+
+        mpe ->EvalBatchPtr(In, Out, nPixels, Stride, mpe);
+        return;
+    }
+
+    for (i=0; i < nPixels; i++) {
+
+        for (j=0; j < mpe ->InputChannels; j++)
+            Pin[j] = In[j * Stride + i];
+
+        mpe ->EvalPtr(Pin, Pout, mpe);
+
+        for (j=0; j < mpe ->OutputChannels; j++)
+            Out[j * Stride + i] = Pout[j];
+    }
+}
+
+// Pixels per block, so that the widest stage fits in the scratch buffers
+static
+cmsUInt32Number BatchBlockSize(const cmsPipeline* lut)
+{
+    cmsStage* mpe;
+    cmsUInt32Number MaxChannels = 1;
+    cmsUInt32Number n;
+
+    if (lut ->InputChannels > MaxChannels)  MaxChannels = lut ->InputChannels;
+    if (lut ->OutputChannels > MaxChannels) MaxChannels = lut ->OutputChannels;
+
+    for (mpe = lut ->Elements; mpe != NULL; mpe = mpe ->Next) {
+
+        if (mpe ->InputChannels > MaxChannels)  MaxChannels = mpe ->InputChannels;
+        if (mpe ->OutputChannels > MaxChannels) MaxChannels = mpe ->OutputChannels;
+    }
+
+    n = MAX_BATCH_FLOATS / MaxChannels;
+    return n > MAX_BATCH_PIXELS ? MAX_BATCH_PIXELS : n;
+}
+
+// Pushes a block through all stages, returns the phase holding the result
+static
+int EvalStagesBatch(const cmsPipeline* lut, cmsFloat32Number Storage[2][MAX_BATCH_FLOATS],
+                    cmsUInt32Number nPixels, cmsUInt32Number Stride)
+{
+    cmsStage *mpe;
+    int Phase = 0, NextPhase;
+
+    for (mpe = lut ->Elements;
+         mpe != NULL;
+         mpe = mpe ->Next) {
+
+             NextPhase = Phase ^ 1;
+             EvaluateStageBatch(&Storage[Phase][0], &Storage[NextPhase][0], nPixels, Stride, mpe);
+             Phase = NextPhase;
+    }
+
+    return Phase;
+}
+
+// Evaluates nPixels on 16 bit-basis. Gives same results as calling cmsPipelineEval16 on each pixel.
+void CMSEXPORT cmsPipelineEval16Batch(const cmsUInt16Number In[], cmsUInt16Number Out[], cmsUInt32Number nPixels, const cmsPipeline* lut)
+{
+    cmsFloat32Number Storage[2][MAX_BATCH_FLOATS];
+    cmsUInt32Number nIn, nOut, Block, n, i, j;
+    int Phase;
+
+    _cmsAssert(lut != NULL);
+
+    nIn  = lut ->InputChannels;
+    nOut = lut ->OutputChannels;
+
+    // Optimized pipelines have their own evaluator, which is already as fast as it gets
+    if (lut ->Eval16Fn != _LUTeval16) {
+
+        for (i=0; i < nPixels; i++) {
+            lut ->Eval16Fn(In + i * nIn, Out + i * nOut, lut ->Data);
+        }
+        return;
+    }
+
+    Block = BatchBlockSize(lut);
+
+    while (nPixels > 0) {
+
+        n = nPixels > Block ? Block : nPixels;
+
+        for (i=0; i < n; i++)
+            for (j=0; j < nIn; j++)
+                Storage[0][j * Block + i] = (cmsFloat32Number) In[i * nIn + j] / 65535.0F;
+
+        Phase = EvalStagesBatch(lut, Storage, n, Block);
+
+        for (i=0; i < n; i++)
+            for (j=0; j < nOut; j++)
+                Out[i * nOut + j] = _cmsQuickSaturateWord(Storage[Phase][j * Block + i] * 65535.0);
+
+        In  += n * nIn;
+        Out += n * nOut;
+        nPixels -= n;
+    }
+}
+
+// Evaluates nPixels on cmsFloat32Number-basis. Gives same results as calling cmsPipelineEvalFloat on each pixel.
+void CMSEXPORT cmsPipelineEvalFloatBatch(const cmsFloat32Number In[], cmsFloat32Number Out[], cmsUInt32Number nPixels, const cmsPipeline* lut)
+{
+    cmsFloat32Number Storage[2][MAX_BATCH_FLOATS];
+    cmsUInt32Number nIn, nOut, Block, n, i, j;
+    int Phase;
+
+    _cmsAssert(lut != NULL);
+
+    nIn  = lut ->InputChannels;
+    nOut = lut ->OutputChannels;
+
+    if (lut ->EvalFloatFn != _LUTevalFloat) {
+
+        for (i=0; i < nPixels; i++) {
+            lut ->EvalFloatFn(In + i * nIn, Out + i * nOut, lut);
+        }
+        return;
+    }
+
+    Block = BatchBlockSize(lut);
+
+    while (nPixels > 0) {
+
+        n = nPixels > Block ? Block : nPixels;
+
+        for (i=0; i < n; i++)
+            for (j=0; j < nIn; j++)
+                Storage[0][j * Block + i] = In[i * nIn + j];
+
+        Phase = EvalStagesBatch(lut, Storage, n, Block);
+
+        for (i=0; i < n; i++)
+            for (j=0; j < nOut; j++)
+                Out[i * nOut + j] = Storage[Phase][j * Block + i];
+
+        In  += n * nIn;
+        Out += n * nOut;
+        nPixels -= n;
+    }
+}
+
+// Same as above, but pixels are already in planes. Used by the row transforms
+void _cmsPipelineEvalFloatPlanar(const cmsFloat32Number In[], cmsFloat32Number Out[], cmsUInt32Number nPixels, cmsUInt32Number Stride, const cmsPipeline* lut)
+{
+    cmsFloat32Number Storage[2][MAX_BATCH_FLOATS];
+    cmsFloat32Number Pin[MAX_STAGE_CHANNELS], Pout[MAX_STAGE_CHANNELS];
+    cmsUInt32Number nIn, nOut, Block, n, i, j;
+    int Phase;
+
+    _cmsAssert(lut != NULL);
+
+    nIn  = lut ->InputChannels;
+    nOut = lut ->OutputChannels;
+
+    if (lut ->EvalFloatFn != _LUTevalFloat) {
+
+        for (i=0; i < nPixels; i++) {
+
+            for (j=0; j < nIn; j++)
+                Pin[j] = In[j * Stride + i];
+
+            lut ->EvalFloatFn(Pin, Pout, lut);
+
+            for (j=0; j < nOut; j++)
+                Out[j * Stride + i] = Pout[j];
+        }
+        return;
+    }
+
+    Block = BatchBlockSize(lut);
+
+    while (nPixels > 0) {
+
+        n = nPixels > Block ? Block : nPixels;
+
+        for (j=0; j < nIn; j++)
+            memmove(&Storage[0][j * Block], In + j * Stride, n * sizeof(cmsFloat32Number));
+
+        Phase = EvalStagesBatch(lut, Storage, n, Block);
+
+        for (j=0; j < nOut; j++)
+            memmove(Out + j * Stride, &Storage[Phase][j * Block], n * sizeof(cmsFloat32Number));
+
+        In  += n;
+        Out += n;
+        nPixels -= n;
+    }
+}
+
+
 
 // Duplicates a LUT
 cmsPipeline* CMSEXPORT cmsPipelineDup(const cmsPipeline* lut)
@@ -1473,6 +1882,16 @@ cmsPipeline* CMSEXPORT cmsPipelineDup(const cmsPipeline* lut)
     NewLUT = cmsPipelineAlloc(lut ->ContextID, lut ->InputChannels, lut ->OutputChannels);
     if (NewLUT == NULL) return NULL;
 
+    // Optimization data goes first, as evaluators that fill their tables on demand complete
+    // them on duplication, and the stages should get the complete tables.
+    NewLUT ->Eval16Fn    = lut ->Eval16Fn;
+    NewLUT ->EvalFloatFn = lut ->EvalFloatFn;
+    NewLUT ->DupDataFn   = lut ->DupDataFn;
+    NewLUT ->FreeDataFn  = lut ->FreeDataFn;
+
+    if (NewLUT ->DupDataFn != NULL)
+        NewLUT ->Data = NewLUT ->DupDataFn(lut ->ContextID, lut->Data);
+
     for (mpe = lut ->Elements;
          mpe != NULL;
          mpe = mpe ->Next) {
@@ -1496,14 +1915,6 @@ cmsPipeline* CMSEXPORT cmsPipelineDup(const cmsPipeline* lut)
             Anterior = NewMPE;
     }
 
-    NewLUT ->Eval16Fn    = lut ->Eval16Fn;
-    NewLUT ->EvalFloatFn = lut ->EvalFloatFn;
-    NewLUT ->DupDataFn   = lut ->DupDataFn;
-    NewLUT ->FreeDataFn  = lut ->FreeDataFn;
-
-    if (NewLUT ->DupDataFn != NULL)
-        NewLUT ->Data = NewLUT ->DupDataFn(lut ->ContextID, lut->Data);
-
 
     NewLUT ->SaveAs8Bits    = lut ->SaveAs8Bits;
 
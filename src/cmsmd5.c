@@ -252,7 +252,8 @@ void CMSEXPORT cmsMD5finish(cmsProfileID* ProfileID,  cmsHANDLE Handle)
 
 // Assuming io points to an ICC profile, compute and store MD5 checksum
 // In the header, rendering intentent, flags and ID should be set to zero
-// before computing MD5 checksum (per 7.2.18 of ICC spec 4.4)
+// before computing MD5 checksum (per 7.2.18 of ICC spec 4.4). Those are cleared
+// on a copy of the profile, which is the one saved.
 
 cmsBool CMSEXPORT cmsMD5computeID(cmsHPROFILE hProfile)
 {
@@ -261,29 +262,32 @@ cmsBool CMSEXPORT cmsMD5computeID(cmsHPROFILE hProfile)
     cmsUInt8Number* Mem = NULL;
     cmsHANDLE  MD5 = NULL;
     _cmsICCPROFILE* Icc = (_cmsICCPROFILE*) hProfile;
-    _cmsICCPROFILE Keep;
+    _cmsICCPROFILE Work;
 
     _cmsAssert(hProfile != NULL);
 
+    // Shared profiles cannot change, and got their ID when registered
+    if (Icc ->SharedRefs > 0) return TRUE;
+
     ContextID = cmsGetProfileContextID(hProfile);
 
-    // Save a copy of the profile header
-    memmove(&Keep, Icc, sizeof(_cmsICCPROFILE));
+    // Work on a copy of the profile header
+    memmove(&Work, Icc, sizeof(_cmsICCPROFILE));
 
     // Set RI, flags and ID
-    Icc ->flags = 0;
-    Icc ->RenderingIntent = 0;
-    memset(&Icc ->ProfileID, 0, sizeof(Icc ->ProfileID));
+    Work.flags = 0;
+    Work.RenderingIntent = 0;
+    memset(&Work.ProfileID, 0, sizeof(Work.ProfileID));
 
     // Compute needed storage
-    if (!cmsSaveProfileToMem(hProfile, NULL, &BytesNeeded)) goto Error;
+    if (!cmsSaveProfileToMem((cmsHPROFILE) &Work, NULL, &BytesNeeded)) goto Error;
 
     // Allocate memory
     Mem = (cmsUInt8Number*) _cmsMalloc(ContextID, BytesNeeded);
     if (Mem == NULL) goto Error;
 
     // Save to temporary storage
-    if (!cmsSaveProfileToMem(hProfile, Mem, &BytesNeeded)) goto Error;
+    if (!cmsSaveProfileToMem((cmsHPROFILE) &Work, Mem, &BytesNeeded)) goto Error;
 
     // Create MD5 object
     MD5 = cmsMD5alloc(ContextID);
@@ -295,9 +299,6 @@ cmsBool CMSEXPORT cmsMD5computeID(cmsHPROFILE hProfile)
     // Temp storage is no longer needed
     _cmsFree(ContextID, Mem);
 
-    // Restore header
-    memmove(Icc, &Keep, sizeof(_cmsICCPROFILE));
-
     // And store the ID
     cmsMD5finish(&Icc ->ProfileID,  MD5);
     return TRUE;
@@ -307,7 +308,6 @@ Error:
     // Free resources as something went wrong
     // "MD5" cannot be other than NULL here, so no need to free it
     if (Mem != NULL) _cmsFree(ContextID, Mem);
-    memmove(Icc, &Keep, sizeof(_cmsICCPROFILE));
     return FALSE;
 }
 
@@ -26,7 +26,6 @@
 
 #include "lcms2_internal.h"
 
-
 //----------------------------------------------------------------------------------
 
 // Optimization for 8 bits, Shaper-CLUT (3 inputs only)
@@ -66,6 +65,29 @@ typedef struct {
 } Prelin16Data;
 
 
+// Resampled CLUT whose cells are filled on first use (cmsFLAGS_LAZYPRECALC)
+typedef struct {
+
+    cmsContext ContextID;
+
+    cmsPipeline* Src;                   // Original pipeline, without pre/post linearization. Owned.
+    const cmsInterpParams* CLUTparams;  // Grid being filled (not-owned pointer)
+    cmsUInt16Number* Table;             // Its nodes (not-owned pointer)
+
+    Prelin16Data* p16;                  // Pre/post linearization, or NULL if there are none
+
+    cmsUInt32Number CellStride[MAX_INPUT_DIMENSIONS];
+    cmsUInt32Number nCells;
+    cmsUInt32Number nNodes;
+    cmsBool Complete;                   // All nodes filled. Only accessed holding the mutex
+
+    volatile cmsUInt8Number* CellReady; // All nodes of the cell are filled. Read without locking.
+    cmsUInt8Number* NodeReady;          // Only accessed holding the mutex
+    void* Mutex;
+
+} LazyCLUTData;
+
+
 // Optimization for matrix-shaper in 8 bits. Numbers are operated in n.14 signed, tables are stored in 1.14 fixed
 
 typedef cmsInt32Number cmsS1Fixed14Number;   // Note that this may hold more than 16 bits!
@@ -89,6 +111,29 @@ typedef struct {
 
 } MatShaper8Data;
 
+// Optimization for matrix-shaper in 16 bits. Shapers are floating point tables, linearly interpolated. The second
+// shaper is usually the inverse of a gamma, which is steep near zero, so it takes more intervals.
+
+#define MATSHAPER16_SHAPER1   4096
+#define MATSHAPER16_SHAPER2   16384
+
+typedef struct {
+
+    cmsContext ContextID;
+
+    cmsFloat32Number Shaper1R[MATSHAPER16_SHAPER1 + 1];   // from 0..1.0 to linear
+    cmsFloat32Number Shaper1G[MATSHAPER16_SHAPER1 + 1];
+    cmsFloat32Number Shaper1B[MATSHAPER16_SHAPER1 + 1];
+
+    cmsFloat32Number Mat[3][3];
+    cmsFloat32Number Off[3];
+
+    cmsFloat32Number Shaper2R[MATSHAPER16_SHAPER2 + 1];   // from linear, clipped to 0..1.0, to 0..1.0
+    cmsFloat32Number Shaper2G[MATSHAPER16_SHAPER2 + 1];
+    cmsFloat32Number Shaper2B[MATSHAPER16_SHAPER2 + 1];
+
+} MatShaper16Data;
+
 // Curves, optimization is shared between 8 and 16 bits
 typedef struct {
 
@@ -634,6 +679,245 @@ cmsBool FixWhiteMisalignment(cmsPipeline* Lut, cmsColorSpaceSignature EntryColor
     return TRUE;
 }
 
+// Lazy resampling --------------------------------------------------------------------------------
+
+// With cmsFLAGS_LAZYPRECALC, the CLUT is not sampled when the transform is created. Instead, each
+// cell of the grid is filled the first time a color falls into it, by evaluating the original
+// pipeline on the nodes of the cell not yet filled. Readers only check a flag per cell, and fills
+// are serialized by a mutex. Nodes are computed as cmsStageSampleCLut16bit would do, so the table
+// ends with the same contents as if it were sampled up front.
+
+// Computes the node number and the table index of the node at the given coordinates
+static
+cmsUInt32Number LazyNodeIndex(const cmsInterpParams* p, const cmsUInt32Number Coord[], cmsUInt16Number In[])
+{
+    cmsUInt32Number i, Index = 0;
+
+    for (i=0; i < p ->nInputs; i++) {
+
+        In[i]  = _cmsQuantizeVal((cmsFloat64Number) Coord[i], p ->nSamples[i]);
+        Index += Coord[i] * p ->opta[p ->nInputs - 1 - i];
+    }
+
+    return Index;
+}
+
+// Evaluates the original pipeline on a node, if not done yet. Mutex should be held.
+static
+void LazyFillNode(LazyCLUTData* d, const cmsUInt32Number Coord[])
+{
+    cmsUInt16Number In[MAX_INPUT_DIMENSIONS+1];
+    cmsUInt32Number Index = LazyNodeIndex(d ->CLUTparams, Coord, In);
+    cmsUInt32Number Node  = Index / d ->CLUTparams ->nOutputs;
+
+    if (d ->NodeReady[Node]) return;
+
+    XFormSampler16(In, d ->Table + Index, (void*) d ->Src);
+    d ->NodeReady[Node] = 1;
+}
+
+// Makes sure all nodes surrounding the input are filled. This is the same cell the interpolation
+// routines use. Returns FALSE if the mutex cannot be taken.
+static
+cmsBool LazyTouch(LazyCLUTData* d, const cmsUInt16Number Input[])
+{
+    const cmsInterpParams* p = d ->CLUTparams;
+    cmsUInt32Number Base[MAX_INPUT_DIMENSIONS], Coord[MAX_INPUT_DIMENSIONS];
+    cmsUInt32Number i, Corner, Cell = 0;
+
+    for (i=0; i < p ->nInputs; i++) {
+
+        cmsUInt32Number x = (cmsUInt32Number) FIXED_TO_INT(_cmsToFixedDomain((int) Input[i] * (int) p ->Domain[i]));
+
+        // The last node belongs to the last cell
+        if (x >= p ->Domain[i]) x = p ->Domain[i] - 1;
+
+        Base[i] = x;
+        Cell += x * d ->CellStride[i];
+    }
+
+    if (_cmsLoadAcquire8(&d ->CellReady[Cell])) return TRUE;
+
+    if (!_cmsLockMutex(d ->ContextID, d ->Mutex)) return FALSE;
+
+    // Somebody may have filled it meanwhile
+    if (!d ->CellReady[Cell]) {
+
+        for (Corner = 0; Corner < (1U << p ->nInputs); Corner++) {
+
+            for (i=0; i < p ->nInputs; i++)
+                Coord[i] = Base[i] + ((Corner >> i) & 1);
+
+            LazyFillNode(d, Coord);
+        }
+
+        _cmsStoreRelease8(&d ->CellReady[Cell], 1);
+    }
+
+    _cmsUnlockMutex(d ->ContextID, d ->Mutex);
+    return TRUE;
+}
+
+// Fills whatever is left of the table
+static
+void LazyComplete(LazyCLUTData* d)
+{
+    cmsUInt32Number Coord[MAX_INPUT_DIMENSIONS];
+    cmsUInt32Number i, Node, rest;
+
+    if (!_cmsLockMutex(d ->ContextID, d ->Mutex)) return;
+
+    // Duplicates are complete, and may outlive the grid they were made from
+    if (!d ->Complete) {
+
+        for (Node = 0; Node < d ->nNodes; Node++) {
+
+            rest = Node;
+            for (i = d ->CLUTparams ->nInputs; i > 0; --i) {
+
+                Coord[i-1] = rest % d ->CLUTparams ->nSamples[i-1];
+                rest /= d ->CLUTparams ->nSamples[i-1];
+            }
+
+            LazyFillNode(d, Coord);
+        }
+
+        for (i=0; i < d ->nCells; i++)
+            _cmsStoreRelease8(&d ->CellReady[i], 1);
+
+        d ->Complete = TRUE;
+    }
+
+    _cmsUnlockMutex(d ->ContextID, d ->Mutex);
+}
+
+static
+void LazyEval16(CMSREGISTER const cmsUInt16Number Input[],
+                CMSREGISTER cmsUInt16Number Output[],
+                CMSREGISTER const void* D)
+{
+    LazyCLUTData* d = (LazyCLUTData*) D;
+    Prelin16Data* p16 = d ->p16;
+    cmsUInt16Number  StageABC[MAX_INPUT_DIMENSIONS];
+    cmsUInt16Number  StageDEF[cmsMAXCHANNELS];
+    cmsUInt32Number i;
+
+    if (p16 == NULL) {
+
+        // If the cell cannot be filled, evaluate the original pipeline instead
+        if (LazyTouch(d, Input))
+            d ->CLUTparams ->Interpolation.Lerp16(Input, Output, d ->CLUTparams);
+        else
+            XFormSampler16(Input, Output, (void*) d ->Src);
+        return;
+    }
+
+    for (i=0; i < p16 ->nInputs; i++) {
+
+        p16 ->EvalCurveIn16[i](&Input[i], &StageABC[i], p16 ->ParamsCurveIn16[i]);
+    }
+
+    if (LazyTouch(d, StageABC))
+        p16 ->EvalCLUT(StageABC, StageDEF, p16 ->CLUTparams);
+    else
+        XFormSampler16(StageABC, StageDEF, (void*) d ->Src);
+
+    for (i=0; i < p16 ->nOutputs; i++) {
+
+        p16 ->EvalCurveOut16[i](&StageDEF[i], &Output[i], p16 ->ParamsCurveOut16[i]);
+    }
+}
+
+static
+void LazyCLUTfree(cmsContext ContextID, void* ptr)
+{
+    LazyCLUTData* d = (LazyCLUTData*) ptr;
+
+    if (d ->p16 != NULL) PrelinOpt16free(ContextID, d ->p16);
+    if (d ->Mutex != NULL) _cmsDestroyMutex(ContextID, d ->Mutex);
+
+    cmsPipelineFree(d ->Src);
+    _cmsFree(ContextID, (void*) d ->CellReady);
+    _cmsFree(ContextID, d ->NodeReady);
+    _cmsFree(ContextID, d);
+}
+
+// Duplicates are complete. The table is shared with the original stage, as Prelin16dup does.
+static
+void* LazyCLUTdup(cmsContext ContextID, const void* ptr)
+{
+    LazyCLUTData* d = (LazyCLUTData*) ptr;
+    LazyCLUTData* Duped;
+
+    LazyComplete(d);
+
+    Duped = (LazyCLUTData*) _cmsDupMem(ContextID, d, sizeof(LazyCLUTData));
+    if (Duped == NULL) return NULL;
+
+    Duped ->ContextID = ContextID;
+    Duped ->p16       = NULL;
+    Duped ->Src       = cmsPipelineDup(d ->Src);
+    Duped ->CellReady = (volatile cmsUInt8Number*) _cmsDupMem(ContextID, (const void*) d ->CellReady, d ->nCells);
+    Duped ->NodeReady = (cmsUInt8Number*) _cmsDupMem(ContextID, d ->NodeReady, d ->nNodes);
+    Duped ->Mutex     = _cmsCreateMutex(ContextID);
+
+    if (d ->p16 != NULL)
+        Duped ->p16 = (Prelin16Data*) Prelin16dup(ContextID, d ->p16);
+
+    if (Duped ->Src == NULL || Duped ->CellReady == NULL || Duped ->NodeReady == NULL ||
+        Duped ->Mutex == NULL || (d ->p16 != NULL && Duped ->p16 == NULL)) {
+
+        LazyCLUTfree(ContextID, Duped);
+        return NULL;
+    }
+
+    return Duped;
+}
+
+// Takes ownership of Src on success
+static
+LazyCLUTData* LazyCLUTalloc(cmsPipeline* Src, cmsStage* CLUT, cmsToneCurve** DataSetIn, cmsToneCurve** DataSetOut)
+{
+    cmsContext ContextID = Src ->ContextID;
+    _cmsStageCLutData* DataCLUT = (_cmsStageCLutData*) CLUT ->Data;
+    const cmsInterpParams* p = DataCLUT ->Params;
+    LazyCLUTData* d;
+    cmsUInt32Number i;
+
+    d = (LazyCLUTData*) _cmsMallocZero(ContextID, sizeof(LazyCLUTData));
+    if (d == NULL) return NULL;
+
+    d ->ContextID  = ContextID;
+    d ->CLUTparams = p;
+    d ->Table      = DataCLUT ->Tab.T;
+    d ->nNodes     = DataCLUT ->nEntries / p ->nOutputs;
+
+    // Cells are stored as nodes are, last input varying fastest
+    d ->nCells = 1;
+    for (i = p ->nInputs; i > 0; --i) {
+
+        d ->CellStride[i-1] = d ->nCells;
+        d ->nCells *= p ->Domain[i-1];
+    }
+
+    d ->CellReady = (volatile cmsUInt8Number*) _cmsMallocZero(ContextID, d ->nCells);
+    d ->NodeReady = (cmsUInt8Number*) _cmsMallocZero(ContextID, d ->nNodes);
+    d ->Mutex     = _cmsCreateMutex(ContextID);
+
+    if (DataSetIn != NULL || DataSetOut != NULL)
+        d ->p16 = PrelinOpt16alloc(ContextID, p, p ->nInputs, DataSetIn, p ->nOutputs, DataSetOut);
+
+    if (d ->Table == NULL || d ->CellReady == NULL || d ->NodeReady == NULL || d ->Mutex == NULL ||
+        ((DataSetIn != NULL || DataSetOut != NULL) && d ->p16 == NULL)) {
+
+        LazyCLUTfree(ContextID, d);
+        return NULL;
+    }
+
+    d ->Src = Src;
+    return d;
+}
+
 // -----------------------------------------------------------------------------------------------------------------------------------------------
 // This function creates simple LUT from complex ones. The generated LUT has an optional set of
 // prelinearization curves, a CLUT of nGridPoints and optional postlinearization tables.
@@ -658,6 +942,7 @@ cmsBool OptimizeByResampling(cmsPipeline** Lut, cmsUInt32Number Intent, cmsUInt3
     cmsToneCurve** DataSetIn;
     cmsToneCurve** DataSetOut;
     Prelin16Data* p16;
+    LazyCLUTData* Lazy = NULL;
 
     // This is a lossy optimization! does not apply in floating-point cases
     if (_cmsFormatterIsFloat(*InputFormat) || _cmsFormatterIsFloat(*OutputFormat)) return FALSE;
@@ -742,9 +1027,20 @@ cmsBool OptimizeByResampling(cmsPipeline** Lut, cmsUInt32Number Intent, cmsUInt3
         }
     }
 
+    if (NewPreLin == NULL) DataSetIn = NULL;
+    else DataSetIn = ((_cmsStageToneCurvesData*) NewPreLin ->Data) ->TheCurves;
+
+    if (NewPostLin == NULL) DataSetOut = NULL;
+    else  DataSetOut = ((_cmsStageToneCurvesData*) NewPostLin ->Data) ->TheCurves;
+
+    // On lazy mode, cells are sampled on first use and the source LUT is kept to do so.
+    // If that cannot be set up, just sample the whole table.
+    if (*dwFlags & cmsFLAGS_LAZYPRECALC)
+        Lazy = LazyCLUTalloc(Src, CLUT, DataSetIn, DataSetOut);
+
     // Now its time to do the sampling. We have to ignore pre/post linearization
     // The source LUT without pre/post curves is passed as parameter.
-    if (!cmsStageSampleCLut16bit(CLUT, XFormSampler16, (void*) Src, 0)) {
+    if (Lazy == NULL && !cmsStageSampleCLut16bit(CLUT, XFormSampler16, (void*) Src, SAMPLER_PARALLEL)) {
 Error:
         // Ops, something went wrong, Restore stages
         if (KeepPreLin != NULL) {
@@ -765,17 +1061,15 @@ Error:
 
     if (KeepPreLin != NULL) cmsStageFree(KeepPreLin);
     if (KeepPostLin != NULL) cmsStageFree(KeepPostLin);
-    cmsPipelineFree(Src);
+    if (Lazy == NULL) cmsPipelineFree(Src);
 
     DataCLUT = (_cmsStageCLutData*) CLUT ->Data;
 
-    if (NewPreLin == NULL) DataSetIn = NULL;
-    else DataSetIn = ((_cmsStageToneCurvesData*) NewPreLin ->Data) ->TheCurves;
-
-    if (NewPostLin == NULL) DataSetOut = NULL;
-    else  DataSetOut = ((_cmsStageToneCurvesData*) NewPostLin ->Data) ->TheCurves;
-
+    if (Lazy != NULL) {
 
+        _cmsPipelineSetOptimizationParameters(Dest, LazyEval16, (void*) Lazy, LazyCLUTfree, LazyCLUTdup);
+    }
+    else
     if (DataSetIn == NULL && DataSetOut == NULL) {
 
         _cmsPipelineSetOptimizationParameters(Dest, (_cmsPipelineEval16Fn) DataCLUT->Params->Interpolation.Lerp16, DataCLUT->Params, NULL, NULL);
@@ -1073,6 +1367,9 @@ cmsBool OptimizeByComputingLinearization(cmsPipeline** Lut, cmsUInt32Number Inte
         if (!(*dwFlags & cmsFLAGS_CLUT_PRE_LINEARIZATION)) return FALSE;
     }
 
+    // Sampling the whole CLUT is what lazy mode wants to avoid, leave it to resampling
+    if (*dwFlags & cmsFLAGS_LAZYPRECALC) return FALSE;
+
     OriginalLut = *Lut;
    
     ColorSpace       = _cmsICCcolorSpace((int) T_COLORSPACE(*InputFormat));
@@ -1185,7 +1482,7 @@ cmsBool OptimizeByComputingLinearization(cmsPipeline** Lut, cmsUInt32Number Inte
         goto Error;
 
     // Resample the LUT
-    if (!cmsStageSampleCLut16bit(OptimizedCLUTmpe, XFormSampler16, (void*) LutPlusCurves, 0)) goto Error;
+    if (!cmsStageSampleCLut16bit(OptimizedCLUTmpe, XFormSampler16, (void*) LutPlusCurves, SAMPLER_PARALLEL)) goto Error;
 
     // Free resources
     for (t = 0; t < OriginalLut ->InputChannels; t++) {
@@ -1676,7 +1973,167 @@ cmsBool SetMatShaper(cmsPipeline* Dest, cmsToneCurve* Curve1[3], cmsMAT3* Mat, c
     return TRUE;
 }
 
+static
+void* DupMatShaper16(cmsContext ContextID, const void* Data)
+{
+    return _cmsDupMem(ContextID, Data, sizeof(MatShaper16Data));
+}
+
+#define MATSHAPER16_SCALE1  ((cmsFloat32Number) MATSHAPER16_SHAPER1 / 65535.0F)
+
+// Linear interpolation on the 16 bits tables. x is the position in intervals, the last one takes the upper end
+cmsINLINE cmsFloat32Number MatShaperLerp(const cmsFloat32Number Table[], cmsFloat32Number x, int Last)
+{
+    int i = (int) x;
+    cmsFloat32Number f;
+
+    if (i > Last) i = Last;
+    f = x - (cmsFloat32Number) i;
+
+    return Table[i] + f * (Table[i+1] - Table[i]);
+}
+
+// Clip to 0..1.0. Written this way, NaN ends as 1.0 as the SSE2 min/max would do
+cmsINLINE cmsFloat32Number MatShaperClip(cmsFloat32Number v)
+{
+    v = (v < 1.0F) ? v : 1.0F;
+    return (v > 0.0F) ? v : 0.0F;
+}
+
+cmsINLINE cmsUInt16Number MatShaperWord(cmsFloat32Number v)
+{
+    return (cmsUInt16Number) (int) (v * 65535.0F + 0.5F);
+}
+
+// The matrix-shaper evaluator for 16 bits. Operations are in single precision and in the very same order
+// as the vectorized scanline routine below, so both give identical results
+static
+void MatShaperEval16to16(CMSREGISTER const cmsUInt16Number In[],
+                         CMSREGISTER cmsUInt16Number Out[],
+                         CMSREGISTER const void* D)
+{
+    MatShaper16Data* p = (MatShaper16Data*) D;
+    cmsFloat32Number r, g, b, l1, l2, l3;
+
+    // Across first shaper
+    r = MatShaperLerp(p->Shaper1R, In[0] * MATSHAPER16_SCALE1, MATSHAPER16_SHAPER1 - 1);
+    g = MatShaperLerp(p->Shaper1G, In[1] * MATSHAPER16_SCALE1, MATSHAPER16_SHAPER1 - 1);
+    b = MatShaperLerp(p->Shaper1B, In[2] * MATSHAPER16_SCALE1, MATSHAPER16_SHAPER1 - 1);
+
+    // Evaluate the matrix
+    l1 = p->Mat[0][0] * r + p->Mat[0][1] * g + p->Mat[0][2] * b + p->Off[0];
+    l2 = p->Mat[1][0] * r + p->Mat[1][1] * g + p->Mat[1][2] * b + p->Off[1];
+    l3 = p->Mat[2][0] * r + p->Mat[2][1] * g + p->Mat[2][2] * b + p->Off[2];
+
+    // Clip and across second shaper
+    Out[0] = MatShaperWord(MatShaperLerp(p->Shaper2R, MatShaperClip(l1) * MATSHAPER16_SHAPER2, MATSHAPER16_SHAPER2 - 1));
+    Out[1] = MatShaperWord(MatShaperLerp(p->Shaper2G, MatShaperClip(l2) * MATSHAPER16_SHAPER2, MATSHAPER16_SHAPER2 - 1));
+    Out[2] = MatShaperWord(MatShaperLerp(p->Shaper2B, MatShaperClip(l3) * MATSHAPER16_SHAPER2, MATSHAPER16_SHAPER2 - 1));
+}
+
+static
+void FillFirstShaper16(cmsFloat32Number* Table, cmsToneCurve* Curve)
+{
+    int i;
+
+    for (i=0; i <= MATSHAPER16_SHAPER1; i++) {
+
+        Table[i] = cmsEvalToneCurveFloat(Curve, (cmsFloat32Number) i / MATSHAPER16_SHAPER1);
+    }
+}
+
+static
+void FillSecondShaper16(cmsFloat32Number* Table, cmsToneCurve* Curve)
+{
+    int i;
+
+    for (i=0; i <= MATSHAPER16_SHAPER2; i++) {
+
+        Table[i] = MatShaperClip(cmsEvalToneCurveFloat(Curve, (cmsFloat32Number) i / MATSHAPER16_SHAPER2));
+    }
+}
+
+// Compute the 16 bits matrix-shaper structure. The output format is not touched, as there is no quantization to 8 bits
+static
+cmsBool SetMatShaper16(cmsPipeline* Dest, cmsToneCurve* Curve1[3], cmsMAT3* Mat, cmsVEC3* Off, cmsToneCurve* Curve2[3])
+{
+    MatShaper16Data* p;
+    int i, j;
+
+    p = (MatShaper16Data*) _cmsMalloc(Dest ->ContextID, sizeof(MatShaper16Data));
+    if (p == NULL) return FALSE;
+
+    p -> ContextID = Dest -> ContextID;
+
+    FillFirstShaper16(p ->Shaper1R, Curve1[0]);
+    FillFirstShaper16(p ->Shaper1G, Curve1[1]);
+    FillFirstShaper16(p ->Shaper1B, Curve1[2]);
+
+    FillSecondShaper16(p ->Shaper2R, Curve2[0]);
+    FillSecondShaper16(p ->Shaper2G, Curve2[1]);
+    FillSecondShaper16(p ->Shaper2B, Curve2[2]);
+
+    for (i=0; i < 3; i++) {
+        for (j=0; j < 3; j++) {
+            p ->Mat[i][j] = (cmsFloat32Number) Mat->v[i].n[j];
+        }
+
+        p ->Off[i] = (Off == NULL) ? 0.0F : (cmsFloat32Number) Off->n[i];
+    }
+
+    _cmsPipelineSetOptimizationParameters(Dest, MatShaperEval16to16, (void*) p, FreeMatShaper, DupMatShaper16);
+    return TRUE;
+}
+
+// There is no CLUT node to fix here, so white is reached by scaling the matrix row up to the clipping point
+// and pinning the top of the second shaper. Only channels whose white is 0xffff can be fixed this way.
+static
+cmsBool FixMatShaper16White(cmsPipeline* Dest, cmsColorSpaceSignature EntryColorSpace, cmsColorSpaceSignature ExitColorSpace)
+{
+    MatShaper16Data* p = (MatShaper16Data*) Dest ->Data;
+    cmsUInt16Number *WhitePointIn, *WhitePointOut;
+    cmsUInt16Number ObtainedOut[cmsMAXCHANNELS];
+    cmsFloat32Number* Shaper2[3];
+    cmsFloat32Number r, g, b, l;
+    cmsUInt32Number i, j, nIns, nOuts;
+
+    if (!_cmsEndPointsBySpace(EntryColorSpace, &WhitePointIn, NULL, &nIns)) return FALSE;
+    if (!_cmsEndPointsBySpace(ExitColorSpace, &WhitePointOut, NULL, &nOuts)) return FALSE;
+
+    if (nIns != 3 || nOuts != 3) return FALSE;
+
+    MatShaperEval16to16(WhitePointIn, ObtainedOut, p);
+    if (WhitesAreEqual(nOuts, WhitePointOut, ObtainedOut)) return TRUE; // whites already match
+
+    Shaper2[0] = p ->Shaper2R;
+    Shaper2[1] = p ->Shaper2G;
+    Shaper2[2] = p ->Shaper2B;
+
+    r = MatShaperLerp(p->Shaper1R, WhitePointIn[0] * MATSHAPER16_SCALE1, MATSHAPER16_SHAPER1 - 1);
+    g = MatShaperLerp(p->Shaper1G, WhitePointIn[1] * MATSHAPER16_SCALE1, MATSHAPER16_SHAPER1 - 1);
+    b = MatShaperLerp(p->Shaper1B, WhitePointIn[2] * MATSHAPER16_SCALE1, MATSHAPER16_SHAPER1 - 1);
+
+    for (i=0; i < 3; i++) {
+
+        if (ObtainedOut[i] == WhitePointOut[i]) continue;
+        if (WhitePointOut[i] != 0xffff) return FALSE;
+
+        l = p->Mat[i][0] * r + p->Mat[i][1] * g + p->Mat[i][2] * b;
+        if (l <= 0) return FALSE;
+
+        // Overshoot a bit, the result gets clipped to 1.0 anyway
+        for (j=0; j < 3; j++)
+            p->Mat[i][j] *= (1.0F - p->Off[i]) / l * 1.0001F;
+
+        Shaper2[i][MATSHAPER16_SHAPER2] = 1.0F;
+    }
+
+    MatShaperEval16to16(WhitePointIn, ObtainedOut, p);
+    return WhitesAreEqual(nOuts, WhitePointOut, ObtainedOut);
+}
+
 //  8 bits on input allows matrix-shaper boot up to 25 Mpixels per second on RGB. That's fast!
+//  16 bits input takes floating point shapers instead of the 1.14 fixed point ones, with cmsFLAGS_MATSHAPER16.
 static
 cmsBool OptimizeMatrixShaper(cmsPipeline** Lut, cmsUInt32Number Intent, cmsUInt32Number* InputFormat, cmsUInt32Number* OutputFormat, cmsUInt32Number* dwFlags)
 {
@@ -1686,12 +2143,17 @@ cmsBool OptimizeMatrixShaper(cmsPipeline** Lut, cmsUInt32Number Intent, cmsUInt3
        cmsBool IdentityMat;
        cmsPipeline* Dest, *Src;
        cmsFloat64Number* Offset;
+       cmsBool Is16Bits;
 
        // Only works on RGB to RGB
        if (T_CHANNELS(*InputFormat) != 3 || T_CHANNELS(*OutputFormat) != 3) return FALSE;
 
-       // Only works on 8 bit input
-       if (!_cmsFormatterIs8bit(*InputFormat)) return FALSE;
+       // Only works on 8 bit input, or on 16 bits if the whole transform is integer and the caller asked for it.
+       // Its results are not bit-exact with the resampled CLUT 16 bits input gets otherwise, so that one stays the default.
+       Is16Bits = (*dwFlags & cmsFLAGS_MATSHAPER16) && T_BYTES(*InputFormat) == 2 &&
+                  !_cmsFormatterIsFloat(*InputFormat) && !_cmsFormatterIsFloat(*OutputFormat);
+
+       if (!_cmsFormatterIs8bit(*InputFormat) && !Is16Bits) return FALSE;
 
        // Seems suitable, proceed
        Src = *Lut;
@@ -1792,7 +2254,20 @@ cmsBool OptimizeMatrixShaper(cmsPipeline** Lut, cmsUInt32Number Intent, cmsUInt3
         *dwFlags |= cmsFLAGS_NOCACHE;
 
         // Setup the optimizarion routines
-        SetMatShaper(Dest, mpeC1 ->TheCurves, &res, (cmsVEC3*) Offset, mpeC2->TheCurves, OutputFormat);
+        if (Is16Bits) {
+
+            if (!SetMatShaper16(Dest, mpeC1 ->TheCurves, &res, (cmsVEC3*) Offset, mpeC2->TheCurves))
+                goto Error;
+
+            // Same white fixup as the resampled LUTs, but not on absolute colorimetric
+            if (Intent != INTENT_ABSOLUTE_COLORIMETRIC && !(*dwFlags & cmsFLAGS_NOWHITEONWHITEFIXUP)) {
+
+                FixMatShaper16White(Dest, _cmsICCcolorSpace((int) T_COLORSPACE(*InputFormat)),
+                                          _cmsICCcolorSpace((int) T_COLORSPACE(*OutputFormat)));
+            }
+        }
+        else
+            SetMatShaper(Dest, mpeC1 ->TheCurves, &res, (cmsVEC3*) Offset, mpeC2->TheCurves, OutputFormat);
     }
 
     cmsPipelineFree(Src);
@@ -1805,6 +2280,1206 @@ Error:
 }
 
 
+// -------------------------------------------------------------------------------------------------------------------------------------
+// Scanline routines for matrix-shaper pipelines. Chunky RGB, with an optional extra channel, is read and written straight
+// from the buffers four pixels at once, with no formatters in between. Results are the same as the formatters plus the
+// evaluators above (8 and 16 bits) or the floating point pipeline. Any other layout goes through the formatters.
+
+// Where the colorants are
+typedef struct {
+
+    cmsUInt32Number nBytes;         // Bytes per sample: 1, 2 or 4 (float)
+    cmsUInt32Number PixelSize;      // Bytes per pixel
+    cmsUInt32Number Offset[3];      // Position of R, G and B in bytes
+
+} MatShaperLayout;
+
+static
+cmsBool GetMatShaperLayout(cmsUInt32Number Format, MatShaperLayout* Layout)
+{
+    cmsUInt32Number i, First, nExtra = T_EXTRA(Format);
+    cmsUInt32Number DoSwap    = T_DOSWAP(Format);
+    cmsUInt32Number SwapFirst = T_SWAPFIRST(Format);
+
+    if (T_COLORSPACE(Format) != PT_RGB || T_CHANNELS(Format) != 3 || nExtra > 1 ||
+        T_PLANAR(Format) || T_ENDIAN16(Format) || T_FLAVOR(Format) || T_PREMUL(Format)) return FALSE;
+
+    // Swapping first with no extra channel would rotate the colorants
+    if (SwapFirst && nExtra == 0) return FALSE;
+
+    Layout ->nBytes = T_BYTES(Format);
+
+    if (T_FLOAT(Format)) {
+        if (Layout ->nBytes != 4) return FALSE;
+    }
+    else {
+        if (Layout ->nBytes != 1 && Layout ->nBytes != 2) return FALSE;
+    }
+
+    // The extra channel comes first if either swap is set, but not both
+    First = (DoSwap ^ SwapFirst) ? nExtra : 0;
+
+    for (i=0; i < 3; i++)
+        Layout ->Offset[i] = (First + (DoSwap ? 2 - i : i)) * Layout ->nBytes;
+
+    Layout ->PixelSize = (3 + nExtra) * Layout ->nBytes;
+    return TRUE;
+}
+
+// Evaluates four pixels on 8 or 16 bits samples, as the evaluator expects them. Outputs are 16 bits
+typedef void (* MatShaperBlockFn)(const void* Data, const cmsUInt32Number In[3][4], cmsUInt16Number Out[3][4]);
+
+static
+void MatShaper8Block(const void* Data, const cmsUInt32Number In[3][4], cmsUInt16Number Out[3][4])
+{
+    cmsUInt16Number wIn[3], wOut[3];
+    int i;
+
+    for (i=0; i < 4; i++) {
+
+        wIn[0] = (cmsUInt16Number) In[0][i];
+        wIn[1] = (cmsUInt16Number) In[1][i];
+        wIn[2] = (cmsUInt16Number) In[2][i];
+
+        MatShaperEval16(wIn, wOut, Data);
+
+        Out[0][i] = wOut[0];
+        Out[1][i] = wOut[1];
+        Out[2][i] = wOut[2];
+    }
+}
+
+static
+void MatShaper16Block(const void* Data, const cmsUInt32Number In[3][4], cmsUInt16Number Out[3][4])
+{
+    cmsUInt16Number wIn[3], wOut[3];
+    int i;
+
+    for (i=0; i < 4; i++) {
+
+        wIn[0] = (cmsUInt16Number) In[0][i];
+        wIn[1] = (cmsUInt16Number) In[1][i];
+        wIn[2] = (cmsUInt16Number) In[2][i];
+
+        MatShaperEval16to16(wIn, wOut, Data);
+
+        Out[0][i] = wOut[0];
+        Out[1][i] = wOut[1];
+        Out[2][i] = wOut[2];
+    }
+}
+
+#ifdef CMS_USE_SSE2
+
+// Low 32 bits of a 32x32 product, SSE2 has no _mm_mullo_epi32
+cmsINLINE __m128i MulLo32(__m128i a, __m128i b)
+{
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd  = _mm_mul_epu32(_mm_srli_si128(a, 4), _mm_srli_si128(b, 4));
+
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                              _mm_shuffle_epi32(odd,  _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+// Same integer arithmetic as MatShaperEval16, including the wrap-around of products
+static CMS_NO_SANITIZE
+void MatShaper8BlockSSE2(const void* Data, const cmsUInt32Number In[3][4], cmsUInt16Number Out[3][4])
+{
+    const MatShaper8Data* p = (const MatShaper8Data*) Data;
+    const cmsUInt16Number* Shaper2[3];
+    cmsUInt32Number Index[4];
+    __m128i r, g, b, l, Over;
+    __m128i Round = _mm_set1_epi32(0x2000);
+    __m128i One   = _mm_set1_epi32(16384);
+    int i, j;
+
+    r = _mm_setr_epi32(p ->Shaper1R[In[0][0]], p ->Shaper1R[In[0][1]], p ->Shaper1R[In[0][2]], p ->Shaper1R[In[0][3]]);
+    g = _mm_setr_epi32(p ->Shaper1G[In[1][0]], p ->Shaper1G[In[1][1]], p ->Shaper1G[In[1][2]], p ->Shaper1G[In[1][3]]);
+    b = _mm_setr_epi32(p ->Shaper1B[In[2][0]], p ->Shaper1B[In[2][1]], p ->Shaper1B[In[2][2]], p ->Shaper1B[In[2][3]]);
+
+    Shaper2[0] = p ->Shaper2R;
+    Shaper2[1] = p ->Shaper2G;
+    Shaper2[2] = p ->Shaper2B;
+
+    for (i=0; i < 3; i++) {
+
+        l = MulLo32(_mm_set1_epi32(p ->Mat[i][0]), r);
+        l = _mm_add_epi32(l, MulLo32(_mm_set1_epi32(p ->Mat[i][1]), g));
+        l = _mm_add_epi32(l, MulLo32(_mm_set1_epi32(p ->Mat[i][2]), b));
+        l = _mm_add_epi32(l, _mm_set1_epi32(p ->Off[i]));
+        l = _mm_srai_epi32(_mm_add_epi32(l, Round), 14);
+
+        // Clip to 0..1.0
+        l    = _mm_and_si128(l, _mm_cmpgt_epi32(l, _mm_set1_epi32(-1)));
+        Over = _mm_cmpgt_epi32(l, One);
+        l    = _mm_or_si128(_mm_andnot_si128(Over, l), _mm_and_si128(Over, One));
+
+        _mm_storeu_si128((__m128i*) Index, l);
+
+        for (j=0; j < 4; j++)
+            Out[i][j] = Shaper2[i][Index[j]];
+    }
+}
+
+// Linear interpolation of four values, as MatShaperLerp does
+cmsINLINE __m128 MatShaperLerpSSE2(const cmsFloat32Number Table[], __m128 x, int Last)
+{
+    cmsUInt32Number Index[4];
+    __m128i i = _mm_cvttps_epi32(_mm_min_ps(x, _mm_set1_ps((cmsFloat32Number) Last)));
+    __m128  f = _mm_sub_ps(x, _mm_cvtepi32_ps(i));
+    __m128  a, b;
+
+    _mm_storeu_si128((__m128i*) Index, i);
+
+    a = _mm_setr_ps(Table[Index[0]],     Table[Index[1]],     Table[Index[2]],     Table[Index[3]]);
+    b = _mm_setr_ps(Table[Index[0] + 1], Table[Index[1] + 1], Table[Index[2] + 1], Table[Index[3] + 1]);
+
+    return _mm_add_ps(a, _mm_mul_ps(f, _mm_sub_ps(b, a)));
+}
+
+// Same single precision operations as MatShaperEval16to16
+static
+void MatShaper16BlockSSE2(const void* Data, const cmsUInt32Number In[3][4], cmsUInt16Number Out[3][4])
+{
+    const MatShaper16Data* p = (const MatShaper16Data*) Data;
+    const cmsFloat32Number* Shaper1[3];
+    const cmsFloat32Number* Shaper2[3];
+    cmsUInt32Number Words[4];
+    __m128 v[3], l;
+    int i, j;
+
+    Shaper1[0] = p ->Shaper1R; Shaper1[1] = p ->Shaper1G; Shaper1[2] = p ->Shaper1B;
+    Shaper2[0] = p ->Shaper2R; Shaper2[1] = p ->Shaper2G; Shaper2[2] = p ->Shaper2B;
+
+    for (i=0; i < 3; i++) {
+
+        __m128 x = _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*) In[i])), _mm_set1_ps(MATSHAPER16_SCALE1));
+        v[i] = MatShaperLerpSSE2(Shaper1[i], x, MATSHAPER16_SHAPER1 - 1);
+    }
+
+    for (i=0; i < 3; i++) {
+
+        l = _mm_mul_ps(_mm_set1_ps(p ->Mat[i][0]), v[0]);
+        l = _mm_add_ps(l, _mm_mul_ps(_mm_set1_ps(p ->Mat[i][1]), v[1]));
+        l = _mm_add_ps(l, _mm_mul_ps(_mm_set1_ps(p ->Mat[i][2]), v[2]));
+        l = _mm_add_ps(l, _mm_set1_ps(p ->Off[i]));
+
+        l = _mm_max_ps(_mm_min_ps(l, _mm_set1_ps(1.0F)), _mm_setzero_ps());
+        l = MatShaperLerpSSE2(Shaper2[i], _mm_mul_ps(l, _mm_set1_ps((cmsFloat32Number) MATSHAPER16_SHAPER2)), MATSHAPER16_SHAPER2 - 1);
+
+        _mm_storeu_si128((__m128i*) Words, _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(l, _mm_set1_ps(65535.0F)), _mm_set1_ps(0.5F))));
+
+        for (j=0; j < 4; j++)
+            Out[i][j] = (cmsUInt16Number) Words[j];
+    }
+}
+
+#endif
+
+// Any layout the scanline routines cannot take goes as in PrecalculatedXFORM
+static
+void MatShaperFormatters16(_cmsTRANSFORM* p,
+                           const void* in,
+                           void* out,
+                           cmsUInt32Number PixelsPerLine,
+                           cmsUInt32Number LineCount,
+                           const cmsStride* Stride)
+{
+    cmsUInt8Number* accum;
+    cmsUInt8Number* output;
+    cmsUInt16Number wIn[cmsMAXCHANNELS], wOut[cmsMAXCHANNELS];
+    cmsUInt32Number i, j;
+
+    memset(wIn, 0, sizeof(wIn));
+    memset(wOut, 0, sizeof(wOut));
+
+    for (i=0; i < LineCount; i++) {
+
+        accum  = (cmsUInt8Number*) in  + (size_t) i * Stride ->BytesPerLineIn;
+        output = (cmsUInt8Number*) out + (size_t) i * Stride ->BytesPerLineOut;
+
+        for (j=0; j < PixelsPerLine; j++) {
+
+            accum  = p ->FromInput(p, wIn, accum, Stride ->BytesPerPlaneIn);
+            p ->Lut ->Eval16Fn(wIn, wOut, p ->Lut ->Data);
+            output = p ->ToOutput(p, wOut, output, Stride ->BytesPerPlaneOut);
+        }
+    }
+}
+
+cmsINLINE void MatShaperScanline16(_cmsTRANSFORM* p,
+                                   const void* in,
+                                   void* out,
+                                   cmsUInt32Number PixelsPerLine,
+                                   cmsUInt32Number LineCount,
+                                   const cmsStride* Stride,
+                                   MatShaperBlockFn Block)
+{
+    MatShaperLayout In, Out;
+    const cmsUInt8Number* accum;
+    cmsUInt8Number* output;
+    cmsUInt32Number Src[3][4];
+    cmsUInt16Number Dst[3][4];
+    cmsUInt32Number i, j, k, c, n;
+
+    _cmsHandleExtraChannels(p, in, out, PixelsPerLine, LineCount, Stride);
+
+    if (!GetMatShaperLayout(p ->InputFormat, &In) || !GetMatShaperLayout(p ->OutputFormat, &Out) ||
+        In.nBytes == 4 || Out.nBytes == 4) {
+
+        MatShaperFormatters16(p, in, out, PixelsPerLine, LineCount, Stride);
+        return;
+    }
+
+    memset(Src, 0, sizeof(Src));
+
+    for (i=0; i < LineCount; i++) {
+
+        accum  = (const cmsUInt8Number*) in + (size_t) i * Stride ->BytesPerLineIn;
+        output = (cmsUInt8Number*) out      + (size_t) i * Stride ->BytesPerLineOut;
+
+        for (j=0; j < PixelsPerLine; j += n) {
+
+            n = PixelsPerLine - j;
+            if (n > 4) n = 4;
+
+            for (k=0; k < n; k++, accum += In.PixelSize) {
+                for (c=0; c < 3; c++) {
+
+                    Src[c][k] = (In.nBytes == 1) ? accum[In.Offset[c]] :
+                                                   *(const cmsUInt16Number*) (accum + In.Offset[c]);
+                }
+            }
+
+            Block(p ->Lut ->Data, (const cmsUInt32Number (*)[4]) Src, Dst);
+
+            for (k=0; k < n; k++, output += Out.PixelSize) {
+                for (c=0; c < 3; c++) {
+
+                    if (Out.nBytes == 1)
+                        output[Out.Offset[c]] = FROM_16_TO_8(Dst[c][k]);
+                    else
+                        *(cmsUInt16Number*) (output + Out.Offset[c]) = Dst[c][k];
+                }
+            }
+        }
+    }
+}
+
+static
+void MatShaperXform8(_cmsTRANSFORM* p, const void* in, void* out,
+                     cmsUInt32Number PixelsPerLine, cmsUInt32Number LineCount, const cmsStride* Stride)
+{
+    MatShaperScanline16(p, in, out, PixelsPerLine, LineCount, Stride, MatShaper8Block);
+}
+
+static
+void MatShaperXform16(_cmsTRANSFORM* p, const void* in, void* out,
+                      cmsUInt32Number PixelsPerLine, cmsUInt32Number LineCount, const cmsStride* Stride)
+{
+    MatShaperScanline16(p, in, out, PixelsPerLine, LineCount, Stride, MatShaper16Block);
+}
+
+#ifdef CMS_USE_SSE2
+
+static
+void MatShaperXform8SSE2(_cmsTRANSFORM* p, const void* in, void* out,
+                         cmsUInt32Number PixelsPerLine, cmsUInt32Number LineCount, const cmsStride* Stride)
+{
+    MatShaperScanline16(p, in, out, PixelsPerLine, LineCount, Stride, MatShaper8BlockSSE2);
+}
+
+static
+void MatShaperXform16SSE2(_cmsTRANSFORM* p, const void* in, void* out,
+                          cmsUInt32Number PixelsPerLine, cmsUInt32Number LineCount, const cmsStride* Stride)
+{
+    MatShaperScanline16(p, in, out, PixelsPerLine, LineCount, Stride, MatShaper16BlockSSE2);
+}
+
+#endif
+
+// Floating point pipelines are not optimized, so the stages are evaluated as they are
+typedef struct {
+
+    cmsToneCurve** Curve1;
+    const cmsFloat64Number* Mat;
+    const cmsFloat64Number* Off;
+    cmsToneCurve** Curve2;
+
+} MatShaperFloatStages;
+
+static
+cmsBool GetMatShaperFloatStages(const cmsPipeline* Lut, MatShaperFloatStages* s)
+{
+    cmsStage *Curve1, *Matrix, *Curve2;
+
+    if (!cmsPipelineCheckAndRetreiveStages(Lut, 3,
+              cmsSigCurveSetElemType, cmsSigMatrixElemType, cmsSigCurveSetElemType,
+              &Curve1, &Matrix, &Curve2)) return FALSE;
+
+    if (Curve1 ->InputChannels != 3 || Matrix ->InputChannels != 3 ||
+        Matrix ->OutputChannels != 3 || Curve2 ->OutputChannels != 3) return FALSE;
+
+    s ->Curve1 = ((_cmsStageToneCurvesData*) Curve1 ->Data) ->TheCurves;
+    s ->Mat    = ((_cmsStageMatrixData*) Matrix ->Data) ->Double;
+    s ->Off    = ((_cmsStageMatrixData*) Matrix ->Data) ->Offset;
+    s ->Curve2 = ((_cmsStageToneCurvesData*) Curve2 ->Data) ->TheCurves;
+
+    return TRUE;
+}
+
+// Evaluates four pixels in place
+typedef void (* MatShaperFloatBlockFn)(const MatShaperFloatStages* s, cmsFloat32Number v[3][4]);
+
+// Same operations as EvaluateCurves and EvaluateMatrix
+static
+void MatShaperFloatBlock(const MatShaperFloatStages* s, cmsFloat32Number v[3][4])
+{
+    cmsFloat32Number l[3];
+    cmsFloat64Number Tmp;
+    int i, j, k;
+
+    for (k=0; k < 4; k++) {
+
+        for (i=0; i < 3; i++)
+            l[i] = cmsEvalToneCurveFloat(s ->Curve1[i], v[i][k]);
+
+        for (i=0; i < 3; i++) {
+
+            Tmp = 0;
+            for (j=0; j < 3; j++) {
+                Tmp += l[j] * s ->Mat[i*3 + j];
+            }
+
+            if (s ->Off != NULL)
+                Tmp += s ->Off[i];
+
+            v[i][k] = cmsEvalToneCurveFloat(s ->Curve2[i], (cmsFloat32Number) Tmp);
+        }
+    }
+}
+
+#ifdef CMS_USE_SSE2
+
+// The curves are evaluated one by one, the matrix in double precision two pixels at once
+static
+void MatShaperFloatBlockSSE2(const MatShaperFloatStages* s, cmsFloat32Number v[3][4])
+{
+    __m128d Lo[3], Hi[3], TmpLo, TmpHi, m;
+    cmsFloat32Number l[4];
+    int i, j, k;
+
+    for (i=0; i < 3; i++) {
+
+        for (k=0; k < 4; k++)
+            l[k] = cmsEvalToneCurveFloat(s ->Curve1[i], v[i][k]);
+
+        Lo[i] = _mm_cvtps_pd(_mm_loadu_ps(l));
+        Hi[i] = _mm_cvtps_pd(_mm_movehl_ps(_mm_loadu_ps(l), _mm_loadu_ps(l)));
+    }
+
+    for (i=0; i < 3; i++) {
+
+        TmpLo = TmpHi = _mm_setzero_pd();
+
+        for (j=0; j < 3; j++) {
+
+            m = _mm_set1_pd(s ->Mat[i*3 + j]);
+            TmpLo = _mm_add_pd(TmpLo, _mm_mul_pd(Lo[j], m));
+            TmpHi = _mm_add_pd(TmpHi, _mm_mul_pd(Hi[j], m));
+        }
+
+        if (s ->Off != NULL) {
+
+            m = _mm_set1_pd(s ->Off[i]);
+            TmpLo = _mm_add_pd(TmpLo, m);
+            TmpHi = _mm_add_pd(TmpHi, m);
+        }
+
+        _mm_storeu_ps(l, _mm_movelh_ps(_mm_cvtpd_ps(TmpLo), _mm_cvtpd_ps(TmpHi)));
+
+        for (k=0; k < 4; k++)
+            v[i][k] = cmsEvalToneCurveFloat(s ->Curve2[i], l[k]);
+    }
+}
+
+#endif
+
+// Any layout the scanline routines cannot take goes as in FloatXFORM
+static
+void MatShaperFormattersFloat(_cmsTRANSFORM* p,
+                              const void* in,
+                              void* out,
+                              cmsUInt32Number PixelsPerLine,
+                              cmsUInt32Number LineCount,
+                              const cmsStride* Stride)
+{
+    cmsUInt8Number* accum;
+    cmsUInt8Number* output;
+    cmsFloat32Number fIn[cmsMAXCHANNELS], fOut[cmsMAXCHANNELS];
+    cmsUInt32Number i, j;
+
+    memset(fIn, 0, sizeof(fIn));
+    memset(fOut, 0, sizeof(fOut));
+
+    for (i=0; i < LineCount; i++) {
+
+        accum  = (cmsUInt8Number*) in  + (size_t) i * Stride ->BytesPerLineIn;
+        output = (cmsUInt8Number*) out + (size_t) i * Stride ->BytesPerLineOut;
+
+        for (j=0; j < PixelsPerLine; j++) {
+
+            accum  = p ->FromInputFloat(p, fIn, accum, Stride ->BytesPerPlaneIn);
+            cmsPipelineEvalFloat(fIn, fOut, p ->Lut);
+            output = p ->ToOutputFloat(p, fOut, output, Stride ->BytesPerPlaneOut);
+        }
+    }
+}
+
+cmsINLINE void MatShaperScanlineFloat(_cmsTRANSFORM* p,
+                                      const void* in,
+                                      void* out,
+                                      cmsUInt32Number PixelsPerLine,
+                                      cmsUInt32Number LineCount,
+                                      const cmsStride* Stride,
+                                      MatShaperFloatBlockFn Block)
+{
+    MatShaperLayout In, Out;
+    MatShaperFloatStages s;
+    const cmsUInt8Number* accum;
+    cmsUInt8Number* output;
+    cmsFloat32Number v[3][4];
+    cmsUInt32Number i, j, k, c, n;
+
+    _cmsHandleExtraChannels(p, in, out, PixelsPerLine, LineCount, Stride);
+
+    if (!GetMatShaperLayout(p ->InputFormat, &In) || !GetMatShaperLayout(p ->OutputFormat, &Out) ||
+        In.nBytes != 4 || Out.nBytes != 4 || !GetMatShaperFloatStages(p ->Lut, &s)) {
+
+        MatShaperFormattersFloat(p, in, out, PixelsPerLine, LineCount, Stride);
+        return;
+    }
+
+    memset(v, 0, sizeof(v));
+
+    for (i=0; i < LineCount; i++) {
+
+        accum  = (const cmsUInt8Number*) in + (size_t) i * Stride ->BytesPerLineIn;
+        output = (cmsUInt8Number*) out      + (size_t) i * Stride ->BytesPerLineOut;
+
+        for (j=0; j < PixelsPerLine; j += n) {
+
+            n = PixelsPerLine - j;
+            if (n > 4) n = 4;
+
+            for (k=0; k < n; k++, accum += In.PixelSize) {
+                for (c=0; c < 3; c++)
+                    v[c][k] = *(const cmsFloat32Number*) (accum + In.Offset[c]);
+            }
+
+            Block(&s, v);
+
+            for (k=0; k < n; k++, output += Out.PixelSize) {
+                for (c=0; c < 3; c++)
+                    *(cmsFloat32Number*) (output + Out.Offset[c]) = v[c][k];
+            }
+        }
+    }
+}
+
+static
+void MatShaperXformFloat(_cmsTRANSFORM* p, const void* in, void* out,
+                         cmsUInt32Number PixelsPerLine, cmsUInt32Number LineCount, const cmsStride* Stride)
+{
+    MatShaperScanlineFloat(p, in, out, PixelsPerLine, LineCount, Stride, MatShaperFloatBlock);
+}
+
+#ifdef CMS_USE_SSE2
+
+static
+void MatShaperXformFloatSSE2(_cmsTRANSFORM* p, const void* in, void* out,
+                             cmsUInt32Number PixelsPerLine, cmsUInt32Number LineCount, const cmsStride* Stride)
+{
+    MatShaperScanlineFloat(p, in, out, PixelsPerLine, LineCount, Stride, MatShaperFloatBlockSSE2);
+}
+
+#endif
+
+static const _cmsKernelEntry MatShaper8Kernels[] = {
+#ifdef CMS_USE_SSE2
+    { cmsCPU_SSE2, (_cmsKernelFn) MatShaperXform8SSE2 },
+#endif
+    { 0,           (_cmsKernelFn) MatShaperXform8 }
+};
+
+static const _cmsKernelEntry MatShaper16Kernels[] = {
+#ifdef CMS_USE_SSE2
+    { cmsCPU_SSE2, (_cmsKernelFn) MatShaperXform16SSE2 },
+#endif
+    { 0,           (_cmsKernelFn) MatShaperXform16 }
+};
+
+static const _cmsKernelEntry MatShaperFloatKernels[] = {
+#ifdef CMS_USE_SSE2
+    { cmsCPU_SSE2, (_cmsKernelFn) MatShaperXformFloatSSE2 },
+#endif
+    { 0,           (_cmsKernelFn) MatShaperXformFloat }
+};
+
+#define NKERNELS(t) (sizeof(t) / sizeof(_cmsKernelEntry))
+
+// Returns the scanline routine for a matrix-shaper pipeline on those formats, or NULL if there is none
+_cmsTransform2Fn _cmsMatShaperXform(cmsContext ContextID, const cmsPipeline* Lut, cmsUInt32Number InputFormat, cmsUInt32Number OutputFormat)
+{
+    MatShaperLayout In, Out;
+    MatShaperFloatStages s;
+
+    if (Lut == NULL) return NULL;
+    if (!GetMatShaperLayout(InputFormat, &In) || !GetMatShaperLayout(OutputFormat, &Out)) return NULL;
+
+    if (In.nBytes == 4 || Out.nBytes == 4) {
+
+        if (In.nBytes != 4 || Out.nBytes != 4 || !GetMatShaperFloatStages(Lut, &s)) return NULL;
+        return (_cmsTransform2Fn) _cmsSelectKernel(ContextID, MatShaperFloatKernels, NKERNELS(MatShaperFloatKernels));
+    }
+
+    if (Lut ->Eval16Fn == MatShaperEval16 && In.nBytes == 1)
+        return (_cmsTransform2Fn) _cmsSelectKernel(ContextID, MatShaper8Kernels, NKERNELS(MatShaper8Kernels));
+
+    if (Lut ->Eval16Fn == MatShaperEval16to16 && In.nBytes == 2)
+        return (_cmsTransform2Fn) _cmsSelectKernel(ContextID, MatShaper16Kernels, NKERNELS(MatShaper16Kernels));
+
+    return NULL;
+}
+
+// -------------------------------------------------------------------------------------------------------------------------------------
+// Serialization of optimized pipelines. Only the built-in 16 bits evaluators are known here, so
+// pipelines optimized by plug-ins (or not optimized at all) are refused. Stages are stored as
+// they are evaluated in 16 bits: curves as tables, CLUT as 16 bits grids. The precomputed data of
+// the curves joining and matrix-shaper optimizations is stored verbatim, the remaining kinds only
+// keep pointers into the stages and are rebuilt on load.
+
+#define OPT_KIND_IDENTITY     1
+#define OPT_KIND_CLUT         2
+#define OPT_KIND_PRELIN16     3
+#define OPT_KIND_PRELIN8      4
+#define OPT_KIND_CURVES8      5
+#define OPT_KIND_CURVES16     6
+#define OPT_KIND_MATSHAPER    7
+#define OPT_KIND_MATSHAPER16  8
+
+static
+cmsUInt32Number GetOptimizationKind(const cmsPipeline* Lut)
+{
+    _cmsPipelineEval16Fn Fn = Lut ->Eval16Fn;
+    cmsStage* mpe = Lut ->Elements;
+
+    if (Fn == FastIdentity16)        return OPT_KIND_IDENTITY;
+    if (Fn == PrelinEval16)          return OPT_KIND_PRELIN16;
+    if (Fn == PrelinEval8)           return OPT_KIND_PRELIN8;
+    if (Fn == FastEvaluateCurves8)   return OPT_KIND_CURVES8;
+    if (Fn == FastEvaluateCurves16)  return OPT_KIND_CURVES16;
+    if (Fn == MatShaperEval16)       return OPT_KIND_MATSHAPER;
+    if (Fn == MatShaperEval16to16)   return OPT_KIND_MATSHAPER16;
+
+    // Lazy CLUTs are stored once complete, as the ones sampled up front
+    if (Fn == LazyEval16)
+        return ((LazyCLUTData*) Lut ->Data) ->p16 != NULL ? OPT_KIND_PRELIN16 : OPT_KIND_CLUT;
+
+    // A lone CLUT evaluated straight by the interpolation routine
+    if (mpe != NULL && mpe ->Next == NULL && mpe ->Type == cmsSigCLutElemType) {
+
+        _cmsStageCLutData* Data = (_cmsStageCLutData*) mpe ->Data;
+
+        if (!Data ->HasFloatValues && Lut ->Data == (void*) Data ->Params &&
+            Fn == (_cmsPipelineEval16Fn) Data ->Params ->Interpolation.Lerp16) return OPT_KIND_CLUT;
+    }
+
+    return 0;
+}
+
+// Doubles are stored bit by bit as well. Transform blobs use these for their header
+cmsBool _cmsWriteFloat64Bits(cmsIOHANDLER* io, cmsFloat64Number d)
+{
+    cmsUInt64Number q;
+
+    memcpy(&q, &d, sizeof(q));
+    return _cmsWriteUInt64Number(io, &q);
+}
+
+cmsBool _cmsReadFloat64Bits(cmsIOHANDLER* io, cmsFloat64Number* d)
+{
+    cmsUInt64Number q;
+
+    if (!_cmsReadUInt64Number(io, &q)) return FALSE;
+    memcpy(d, &q, sizeof(q));
+    return TRUE;
+}
+
+static
+cmsBool WriteFixed14Array(cmsIOHANDLER* io, cmsUInt32Number n, const cmsS1Fixed14Number* Array)
+{
+    cmsUInt32Number i;
+
+    for (i=0; i < n; i++) {
+        if (!_cmsWriteUInt32Number(io, (cmsUInt32Number) Array[i])) return FALSE;
+    }
+    return TRUE;
+}
+
+static
+cmsBool ReadFixed14Array(cmsIOHANDLER* io, cmsUInt32Number n, cmsS1Fixed14Number* Array)
+{
+    cmsUInt32Number i, v;
+
+    for (i=0; i < n; i++) {
+        if (!_cmsReadUInt32Number(io, &v)) return FALSE;
+        Array[i] = (cmsS1Fixed14Number) v;
+    }
+    return TRUE;
+}
+
+// Floats are stored bit by bit, the tables should not change on a round trip
+static
+cmsBool WriteFloat32Array(cmsIOHANDLER* io, cmsUInt32Number n, const cmsFloat32Number* Array)
+{
+    cmsUInt32Number i, v;
+
+    for (i=0; i < n; i++) {
+
+        memcpy(&v, &Array[i], sizeof(v));
+        if (!_cmsWriteUInt32Number(io, v)) return FALSE;
+    }
+    return TRUE;
+}
+
+static
+cmsBool ReadFloat32Array(cmsIOHANDLER* io, cmsUInt32Number n, cmsFloat32Number* Array)
+{
+    cmsUInt32Number i, v;
+
+    for (i=0; i < n; i++) {
+
+        if (!_cmsReadUInt32Number(io, &v)) return FALSE;
+        memcpy(&Array[i], &v, sizeof(v));
+    }
+    return TRUE;
+}
+
+static
+cmsBool WriteStage(cmsIOHANDLER* io, cmsStage* mpe)
+{
+    cmsUInt32Number i, n;
+
+    if (!_cmsWriteUInt32Number(io, (cmsUInt32Number) mpe ->Type)) return FALSE;
+    if (!_cmsWriteUInt32Number(io, mpe ->InputChannels)) return FALSE;
+    if (!_cmsWriteUInt32Number(io, mpe ->OutputChannels)) return FALSE;
+
+    switch (mpe ->Type) {
+
+    case cmsSigIdentityElemType:
+        return TRUE;
+
+    case cmsSigCurveSetElemType: {
+
+        _cmsStageToneCurvesData* Data = (_cmsStageToneCurvesData*) mpe ->Data;
+
+        for (i=0; i < Data ->nCurves; i++) {
+
+            n = cmsGetToneCurveEstimatedTableEntries(Data ->TheCurves[i]);
+            if (!_cmsWriteUInt32Number(io, n)) return FALSE;
+            if (!_cmsWriteUInt16Array(io, n, cmsGetToneCurveEstimatedTable(Data ->TheCurves[i]))) return FALSE;
+        }
+        }
+        return TRUE;
+
+    case cmsSigMatrixElemType: {
+
+        _cmsStageMatrixData* Data = (_cmsStageMatrixData*) mpe ->Data;
+
+        n = mpe ->InputChannels * mpe ->OutputChannels;
+        for (i=0; i < n; i++) {
+            if (!_cmsWriteFloat64Bits(io, Data ->Double[i])) return FALSE;
+        }
+
+        if (!_cmsWriteUInt32Number(io, Data ->Offset != NULL)) return FALSE;
+        if (Data ->Offset != NULL) {
+
+            for (i=0; i < mpe ->OutputChannels; i++) {
+                if (!_cmsWriteFloat64Bits(io, Data ->Offset[i])) return FALSE;
+            }
+        }
+        }
+        return TRUE;
+
+    case cmsSigCLutElemType: {
+
+        _cmsStageCLutData* Data = (_cmsStageCLutData*) mpe ->Data;
+
+        if (Data ->HasFloatValues) return FALSE;
+
+        if (!_cmsWriteUInt32Number(io, Data ->Params ->dwFlags)) return FALSE;
+        for (i=0; i < mpe ->InputChannels; i++) {
+            if (!_cmsWriteUInt32Number(io, Data ->Params ->nSamples[i])) return FALSE;
+        }
+        if (!_cmsWriteUInt32Number(io, Data ->nEntries)) return FALSE;
+        return _cmsWriteUInt16Array(io, Data ->nEntries, Data ->Tab.T);
+        }
+
+    default:
+        return FALSE;
+    }
+}
+
+static
+cmsStage* ReadStage(cmsContext ContextID, cmsIOHANDLER* io)
+{
+    cmsUInt32Number Type, nIn, nOut, i, n;
+    cmsStage* mpe = NULL;
+
+    if (!_cmsReadUInt32Number(io, &Type)) return NULL;
+    if (!_cmsReadUInt32Number(io, &nIn)) return NULL;
+    if (!_cmsReadUInt32Number(io, &nOut)) return NULL;
+
+    if (nIn == 0 || nIn > MAX_INPUT_DIMENSIONS || nOut == 0 || nOut > cmsMAXCHANNELS) return NULL;
+
+    switch (Type) {
+
+    case cmsSigIdentityElemType:
+        return (nIn == nOut) ? cmsStageAllocIdentity(ContextID, nIn) : NULL;
+
+    case cmsSigCurveSetElemType: {
+
+        cmsToneCurve* Curves[cmsMAXCHANNELS];
+        cmsUInt16Number* Table;
+
+        if (nIn != nOut) return NULL;
+
+        memset(Curves, 0, sizeof(Curves));
+        for (i=0; i < nIn; i++) {
+
+            if (!_cmsReadUInt32Number(io, &n) || n < 2 || n > 65536) break;
+
+            Table = (cmsUInt16Number*) _cmsCalloc(ContextID, n, sizeof(cmsUInt16Number));
+            if (Table == NULL) break;
+
+            if (_cmsReadUInt16Array(io, n, Table))
+                Curves[i] = cmsBuildTabulatedToneCurve16(ContextID, n, Table);
+
+            _cmsFree(ContextID, Table);
+            if (Curves[i] == NULL) break;
+        }
+
+        if (i == nIn)
+            mpe = cmsStageAllocToneCurves(ContextID, nIn, Curves);
+
+        for (n=0; n < i; n++)
+            cmsFreeToneCurve(Curves[n]);
+        }
+        return mpe;
+
+    case cmsSigMatrixElemType: {
+
+        cmsFloat64Number* Matrix;
+        cmsFloat64Number  Offset[cmsMAXCHANNELS];
+        cmsUInt32Number   HasOffset = 0;
+        cmsBool           ok = TRUE;
+
+        n = nIn * nOut;
+        Matrix = (cmsFloat64Number*) _cmsCalloc(ContextID, n, sizeof(cmsFloat64Number));
+        if (Matrix == NULL) return NULL;
+
+        for (i=0; ok && i < n; i++)
+            ok = _cmsReadFloat64Bits(io, &Matrix[i]);
+
+        ok = ok && _cmsReadUInt32Number(io, &HasOffset);
+        for (i=0; ok && HasOffset && i < nOut; i++)
+            ok = _cmsReadFloat64Bits(io, &Offset[i]);
+
+        if (ok)
+            mpe = cmsStageAllocMatrix(ContextID, nOut, nIn, Matrix, HasOffset ? Offset : NULL);
+
+        _cmsFree(ContextID, Matrix);
+        }
+        return mpe;
+
+    case cmsSigCLutElemType: {
+
+        cmsUInt32Number  dwFlags, nEntries;
+        cmsUInt32Number  GridPoints[MAX_INPUT_DIMENSIONS];
+        cmsUInt64Number  nNodes = 1;
+        cmsUInt16Number* Table;
+        _cmsStageCLutData* Data;
+
+        if (!_cmsReadUInt32Number(io, &dwFlags)) return NULL;
+        for (i=0; i < nIn; i++) {
+            if (!_cmsReadUInt32Number(io, &GridPoints[i])) return NULL;
+            if (GridPoints[i] < 2 || GridPoints[i] > 255) return NULL;
+            nNodes *= GridPoints[i];
+            if (nNodes > UINT_MAX) return NULL;
+        }
+        if (!_cmsReadUInt32Number(io, &nEntries)) return NULL;
+
+        // The table must match the grid exactly
+        if ((cmsUInt64Number) nEntries != nNodes * nOut) return NULL;
+
+        Table = (cmsUInt16Number*) _cmsCalloc(ContextID, nEntries, sizeof(cmsUInt16Number));
+        if (Table == NULL) return NULL;
+
+        if (_cmsReadUInt16Array(io, nEntries, Table))
+            mpe = cmsStageAllocCLut16bitGranular(ContextID, GridPoints, nIn, nOut, Table);
+
+        _cmsFree(ContextID, Table);
+        if (mpe == NULL) return NULL;
+
+        // Interpolation hints, as trilinear on Lab, should survive. The table is 16 bits, so that is all
+        // that may be set
+        if ((dwFlags & ~(cmsUInt32Number) (CMS_LERP_FLAGS_16BITS|CMS_LERP_FLAGS_TRILINEAR)) != 0) {
+            cmsStageFree(mpe);
+            return NULL;
+        }
+
+        Data = (_cmsStageCLutData*) mpe ->Data;
+        if (Data ->Params ->dwFlags != dwFlags) {
+
+            Data ->Params ->dwFlags = dwFlags;
+            if (!_cmsSetInterpolationRoutine(ContextID, Data ->Params)) {
+                cmsStageFree(mpe);
+                return NULL;
+            }
+        }
+        }
+        return mpe;
+
+    default:
+        return NULL;
+    }
+}
+
+// Locate the optional curves around a CLUT, as left by the resampling and linearization optimizations
+static
+cmsBool GetPrelinStages(cmsPipeline* Lut, cmsStage** PreLin, cmsStage** CLUT, cmsStage** PostLin)
+{
+    cmsStage* mpe = Lut ->Elements;
+
+    *PreLin = *CLUT = *PostLin = NULL;
+
+    if (mpe != NULL && mpe ->Type == cmsSigCurveSetElemType) {
+        *PreLin = mpe;
+        mpe = mpe ->Next;
+    }
+
+    if (mpe == NULL || mpe ->Type != cmsSigCLutElemType) return FALSE;
+    *CLUT = mpe;
+    mpe = mpe ->Next;
+
+    if (mpe != NULL && mpe ->Type == cmsSigCurveSetElemType) {
+        *PostLin = mpe;
+        mpe = mpe ->Next;
+    }
+
+    return mpe == NULL;
+}
+
+// Write the pipeline and the kind of its 16 bits evaluator. Returns FALSE if the pipeline is not
+// optimized by any of the built-in optimizations above.
+cmsBool _cmsWriteOptimizedPipeline(cmsIOHANDLER* io, const cmsPipeline* Lut)
+{
+    cmsUInt32Number Kind = GetOptimizationKind(Lut);
+    cmsUInt32Number i, nStages = 0;
+    cmsStage* mpe;
+
+    if (Kind == 0) return FALSE;
+
+    if (Lut ->Eval16Fn == LazyEval16)
+        LazyComplete((LazyCLUTData*) Lut ->Data);
+
+    for (mpe = Lut ->Elements; mpe != NULL; mpe = mpe ->Next)
+        nStages++;
+
+    if (!_cmsWriteUInt32Number(io, Kind)) return FALSE;
+    if (!_cmsWriteUInt32Number(io, Lut ->InputChannels)) return FALSE;
+    if (!_cmsWriteUInt32Number(io, Lut ->OutputChannels)) return FALSE;
+    if (!_cmsWriteUInt32Number(io, nStages)) return FALSE;
+
+    for (mpe = Lut ->Elements; mpe != NULL; mpe = mpe ->Next) {
+        if (!WriteStage(io, mpe)) return FALSE;
+    }
+
+    switch (Kind) {
+
+    case OPT_KIND_CURVES8:
+    case OPT_KIND_CURVES16: {
+
+        Curves16Data* c16 = (Curves16Data*) Lut ->Data;
+
+        if (!_cmsWriteUInt32Number(io, c16 ->nCurves)) return FALSE;
+        if (!_cmsWriteUInt32Number(io, c16 ->nElements)) return FALSE;
+
+        for (i=0; i < c16 ->nCurves; i++) {
+            if (!_cmsWriteUInt16Array(io, c16 ->nElements, c16 ->Curves[i])) return FALSE;
+        }
+        }
+        break;
+
+    case OPT_KIND_MATSHAPER: {
+
+        MatShaper8Data* p = (MatShaper8Data*) Lut ->Data;
+
+        if (!WriteFixed14Array(io, 256, p ->Shaper1R)) return FALSE;
+        if (!WriteFixed14Array(io, 256, p ->Shaper1G)) return FALSE;
+        if (!WriteFixed14Array(io, 256, p ->Shaper1B)) return FALSE;
+        if (!WriteFixed14Array(io, 9, &p ->Mat[0][0])) return FALSE;
+        if (!WriteFixed14Array(io, 3, p ->Off)) return FALSE;
+        if (!_cmsWriteUInt16Array(io, 16385, p ->Shaper2R)) return FALSE;
+        if (!_cmsWriteUInt16Array(io, 16385, p ->Shaper2G)) return FALSE;
+        if (!_cmsWriteUInt16Array(io, 16385, p ->Shaper2B)) return FALSE;
+        }
+        break;
+
+    case OPT_KIND_MATSHAPER16: {
+
+        MatShaper16Data* p = (MatShaper16Data*) Lut ->Data;
+
+        if (!WriteFloat32Array(io, MATSHAPER16_SHAPER1 + 1, p ->Shaper1R)) return FALSE;
+        if (!WriteFloat32Array(io, MATSHAPER16_SHAPER1 + 1, p ->Shaper1G)) return FALSE;
+        if (!WriteFloat32Array(io, MATSHAPER16_SHAPER1 + 1, p ->Shaper1B)) return FALSE;
+        if (!WriteFloat32Array(io, 9, &p ->Mat[0][0])) return FALSE;
+        if (!WriteFloat32Array(io, 3, p ->Off)) return FALSE;
+        if (!WriteFloat32Array(io, MATSHAPER16_SHAPER2 + 1, p ->Shaper2R)) return FALSE;
+        if (!WriteFloat32Array(io, MATSHAPER16_SHAPER2 + 1, p ->Shaper2G)) return FALSE;
+        if (!WriteFloat32Array(io, MATSHAPER16_SHAPER2 + 1, p ->Shaper2B)) return FALSE;
+        }
+        break;
+
+    default:;    // Nothing else, the evaluator data is rebuilt from the stages
+    }
+
+    return TRUE;
+}
+
+static
+cmsBool ReadCurves16Data(cmsPipeline* Lut, cmsIOHANDLER* io, cmsUInt32Number ExpectedElements)
+{
+    cmsContext ContextID = Lut ->ContextID;
+    cmsUInt32Number i, nCurves, nElements;
+    Curves16Data* c16;
+
+    if (!_cmsReadUInt32Number(io, &nCurves)) return FALSE;
+    if (!_cmsReadUInt32Number(io, &nElements)) return FALSE;
+    if (nCurves != Lut ->InputChannels || nElements != ExpectedElements) return FALSE;
+
+    c16 = (Curves16Data*) _cmsMallocZero(ContextID, sizeof(Curves16Data));
+    if (c16 == NULL) return FALSE;
+
+    c16 ->ContextID = ContextID;
+    c16 ->Curves = (cmsUInt16Number**) _cmsCalloc(ContextID, nCurves, sizeof(cmsUInt16Number*));
+    if (c16 ->Curves == NULL) {
+        _cmsFree(ContextID, c16);
+        return FALSE;
+    }
+    c16 ->nElements = nElements;
+
+    for (i=0; i < nCurves; i++) {
+
+        c16 ->Curves[i] = (cmsUInt16Number*) _cmsCalloc(ContextID, nElements, sizeof(cmsUInt16Number));
+        if (c16 ->Curves[i] == NULL) break;
+        c16 ->nCurves++;
+
+        if (!_cmsReadUInt16Array(io, nElements, c16 ->Curves[i])) break;
+    }
+
+    if (i < nCurves) {
+        CurvesFree(ContextID, c16);
+        return FALSE;
+    }
+
+    _cmsPipelineSetOptimizationParameters(Lut, ExpectedElements == 256 ? FastEvaluateCurves8 : FastEvaluateCurves16,
+                                          (void*) c16, CurvesFree, CurvesDup);
+    return TRUE;
+}
+
+static
+cmsBool ReadMatShaperData(cmsPipeline* Lut, cmsIOHANDLER* io)
+{
+    MatShaper8Data* p;
+
+    if (Lut ->InputChannels != 3 || Lut ->OutputChannels != 3) return FALSE;
+
+    p = (MatShaper8Data*) _cmsMalloc(Lut ->ContextID, sizeof(MatShaper8Data));
+    if (p == NULL) return FALSE;
+
+    p ->ContextID = Lut ->ContextID;
+
+    if (!ReadFixed14Array(io, 256, p ->Shaper1R) ||
+        !ReadFixed14Array(io, 256, p ->Shaper1G) ||
+        !ReadFixed14Array(io, 256, p ->Shaper1B) ||
+        !ReadFixed14Array(io, 9, &p ->Mat[0][0]) ||
+        !ReadFixed14Array(io, 3, p ->Off) ||
+        !_cmsReadUInt16Array(io, 16385, p ->Shaper2R) ||
+        !_cmsReadUInt16Array(io, 16385, p ->Shaper2G) ||
+        !_cmsReadUInt16Array(io, 16385, p ->Shaper2B)) {
+
+        _cmsFree(Lut ->ContextID, p);
+        return FALSE;
+    }
+
+    _cmsPipelineSetOptimizationParameters(Lut, MatShaperEval16, (void*) p, FreeMatShaper, DupMatShaper);
+    return TRUE;
+}
+
+// The second shaper goes straight to the output words. NaN fails the test as well
+static
+cmsBool IsValidSecondShaper16(const cmsFloat32Number* Table)
+{
+    int i;
+
+    for (i=0; i <= MATSHAPER16_SHAPER2; i++) {
+
+        if (!(Table[i] >= 0.0F && Table[i] <= 1.0F)) return FALSE;
+    }
+    return TRUE;
+}
+
+static
+cmsBool ReadMatShaper16Data(cmsPipeline* Lut, cmsIOHANDLER* io)
+{
+    MatShaper16Data* p;
+
+    if (Lut ->InputChannels != 3 || Lut ->OutputChannels != 3) return FALSE;
+
+    p = (MatShaper16Data*) _cmsMalloc(Lut ->ContextID, sizeof(MatShaper16Data));
+    if (p == NULL) return FALSE;
+
+    p ->ContextID = Lut ->ContextID;
+
+    if (!ReadFloat32Array(io, MATSHAPER16_SHAPER1 + 1, p ->Shaper1R) ||
+        !ReadFloat32Array(io, MATSHAPER16_SHAPER1 + 1, p ->Shaper1G) ||
+        !ReadFloat32Array(io, MATSHAPER16_SHAPER1 + 1, p ->Shaper1B) ||
+        !ReadFloat32Array(io, 9, &p ->Mat[0][0]) ||
+        !ReadFloat32Array(io, 3, p ->Off) ||
+        !ReadFloat32Array(io, MATSHAPER16_SHAPER2 + 1, p ->Shaper2R) ||
+        !ReadFloat32Array(io, MATSHAPER16_SHAPER2 + 1, p ->Shaper2G) ||
+        !ReadFloat32Array(io, MATSHAPER16_SHAPER2 + 1, p ->Shaper2B) ||
+        !IsValidSecondShaper16(p ->Shaper2R) ||
+        !IsValidSecondShaper16(p ->Shaper2G) ||
+        !IsValidSecondShaper16(p ->Shaper2B)) {
+
+        _cmsFree(Lut ->ContextID, p);
+        return FALSE;
+    }
+
+    _cmsPipelineSetOptimizationParameters(Lut, MatShaperEval16to16, (void*) p, FreeMatShaper, DupMatShaper16);
+    return TRUE;
+}
+
+// Attach the evaluators of the given kind, no resampling takes place
+static
+cmsBool RestoreOptimization(cmsPipeline* Lut, cmsUInt32Number Kind, cmsIOHANDLER* io)
+{
+    cmsContext ContextID = Lut ->ContextID;
+    cmsStage *PreLin, *CLUT, *PostLin;
+    _cmsStageCLutData* DataCLUT;
+
+    switch (Kind) {
+
+    case OPT_KIND_IDENTITY:
+        if (Lut ->InputChannels != Lut ->OutputChannels) return FALSE;
+        _cmsPipelineSetOptimizationParameters(Lut, FastIdentity16, (void*) Lut, NULL, NULL);
+        return TRUE;
+
+    case OPT_KIND_CURVES8:
+    case OPT_KIND_CURVES16:
+        return ReadCurves16Data(Lut, io, Kind == OPT_KIND_CURVES8 ? 256U : 65536U);
+
+    case OPT_KIND_MATSHAPER:
+        return ReadMatShaperData(Lut, io);
+
+    case OPT_KIND_MATSHAPER16:
+        return ReadMatShaper16Data(Lut, io);
+
+    default:;
+    }
+
+    if (!GetPrelinStages(Lut, &PreLin, &CLUT, &PostLin)) return FALSE;
+    DataCLUT = (_cmsStageCLutData*) CLUT ->Data;
+
+    switch (Kind) {
+
+    case OPT_KIND_CLUT:
+        if (PreLin != NULL || PostLin != NULL) return FALSE;
+        _cmsPipelineSetOptimizationParameters(Lut, (_cmsPipelineEval16Fn) DataCLUT ->Params ->Interpolation.Lerp16,
+                                              DataCLUT ->Params, NULL, NULL);
+        return TRUE;
+
+    case OPT_KIND_PRELIN16: {
+
+        Prelin16Data* p16 = PrelinOpt16alloc(ContextID, DataCLUT ->Params,
+                                   CLUT ->InputChannels,
+                                   PreLin  ? ((_cmsStageToneCurvesData*) PreLin ->Data) ->TheCurves : NULL,
+                                   CLUT ->OutputChannels,
+                                   PostLin ? ((_cmsStageToneCurvesData*) PostLin ->Data) ->TheCurves : NULL);
+        if (p16 == NULL) return FALSE;
+
+        _cmsPipelineSetOptimizationParameters(Lut, PrelinEval16, (void*) p16, PrelinOpt16free, Prelin16dup);
+        }
+        return TRUE;
+
+    case OPT_KIND_PRELIN8: {
+
+        Prelin8Data* p8;
+
+        if (PreLin == NULL || PostLin != NULL || CLUT ->InputChannels != 3) return FALSE;
+
+        p8 = PrelinOpt8alloc(ContextID, DataCLUT ->Params, ((_cmsStageToneCurvesData*) PreLin ->Data) ->TheCurves);
+        if (p8 == NULL) return FALSE;
+
+        _cmsPipelineSetOptimizationParameters(Lut, PrelinEval8, (void*) p8, Prelin8free, Prelin8dup);
+        }
+        return TRUE;
+
+    default:
+        return FALSE;
+    }
+}
+
+// Read back a pipeline written by _cmsWriteOptimizedPipeline, with its fast evaluator already set
+cmsPipeline* _cmsReadOptimizedPipeline(cmsContext ContextID, cmsIOHANDLER* io)
+{
+    cmsUInt32Number Kind, nIn, nOut, nStages, i;
+    cmsPipeline* Lut;
+    cmsStage* mpe;
+
+    if (!_cmsReadUInt32Number(io, &Kind)) return NULL;
+    if (!_cmsReadUInt32Number(io, &nIn)) return NULL;
+    if (!_cmsReadUInt32Number(io, &nOut)) return NULL;
+    if (!_cmsReadUInt32Number(io, &nStages)) return NULL;
+
+    if (nStages > 16) return NULL;
+
+    Lut = cmsPipelineAlloc(ContextID, nIn, nOut);
+    if (Lut == NULL) return NULL;
+
+    for (i=0; i < nStages; i++) {
+
+        mpe = ReadStage(ContextID, io);
+        if (mpe == NULL) goto Error;
+
+        if (!cmsPipelineInsertStage(Lut, cmsAT_END, mpe)) goto Error;
+    }
+
+    if (cmsPipelineInputChannels(Lut) != nIn || cmsPipelineOutputChannels(Lut) != nOut) goto Error;
+
+    if (!RestoreOptimization(Lut, Kind, io)) goto Error;
+
+    return Lut;
+
+Error:
+    cmsPipelineFree(Lut);
+    return NULL;
+}
+
+
 // -------------------------------------------------------------------------------------------------------------------------------------
 // Optimization plug-ins
 
@@ -3568,6 +3568,513 @@ cmsUInt8Number* PackHalfFromFloat(_cmsTRANSFORM* info,
 
 #endif
 
+// Row formatters -------------------------------------------------------------------------------------------------
+
+// Those move whole runs of pixels between the buffer and planes of values, one plane per channel. Results are the
+// same as the generic per-pixel formatters, whose channel placement is worked out once per call. Extra channels are
+// left untouched, as on the per-pixel formatters.
+
+typedef struct {
+
+    cmsUInt32Number nChan;
+    cmsUInt32Number Pos[cmsMAXCHANNELS];    // Sample (chunky) or plane (planar) holding each channel
+    cmsUInt32Number PixelSamples;           // Samples from one pixel to the next, 1 on planar
+    cmsUInt32Number Reverse;
+    cmsUInt32Number SwapEndian;
+
+} _cmsRowLayout;
+
+// Planar 16 bits formatters don't rotate channels on swap first, all others do
+static
+void ComputeRowLayout(_cmsRowLayout* l, cmsUInt32Number Format, cmsFormatterDirection Dir, cmsBool RotatePlanar)
+{
+    cmsUInt32Number nChan      = T_CHANNELS(Format);
+    cmsUInt32Number DoSwap     = T_DOSWAP(Format);
+    cmsUInt32Number SwapFirst  = T_SWAPFIRST(Format);
+    cmsUInt32Number Extra      = T_EXTRA(Format);
+    cmsUInt32Number Planar     = T_PLANAR(Format);
+    cmsUInt32Number ExtraFirst = DoSwap ^ SwapFirst;
+    cmsUInt32Number Start      = ExtraFirst ? Extra : 0;
+    cmsUInt32Number i, tmp;
+
+    l ->nChan        = nChan;
+    l ->PixelSamples = Planar ? 1 : nChan + Extra;
+    l ->Reverse      = T_FLAVOR(Format);
+    l ->SwapEndian   = T_ENDIAN16(Format);
+
+    for (i=0; i < nChan; i++) {
+
+        cmsUInt32Number index = DoSwap ? (nChan - i - 1) : i;
+        l ->Pos[index] = Start + i;
+    }
+
+    if (Extra == 0 && SwapFirst && (!Planar || RotatePlanar)) {
+
+        if (Dir == cmsFormatterInput) {
+
+            // Values are rotated one place down once read
+            tmp = l ->Pos[0];
+            memmove(&l ->Pos[0], &l ->Pos[1], (nChan-1) * sizeof(cmsUInt32Number));
+            l ->Pos[nChan-1] = tmp;
+        }
+        else {
+
+            // Samples are rotated one place up once written
+            for (i=0; i < nChan; i++)
+                l ->Pos[i] = (l ->Pos[i] + 1) % nChan;
+        }
+    }
+}
+
+// Where channel c starts, in bytes
+cmsINLINE cmsUInt32Number RowChannelOffset(const _cmsRowLayout* l, cmsUInt32Number c, cmsUInt32Number Bytes, cmsUInt32Number Stride)
+{
+    return l ->PixelSamples == 1 ? l ->Pos[c] * Stride : l ->Pos[c] * Bytes;
+}
+
+#ifdef CMS_USE_SSE2
+
+// 16 chunky pixels of 4 samples each, to one register per sample
+cmsINLINE void Deinterleave4x16(const cmsUInt8Number* accum, __m128i s[4])
+{
+    __m128i a0 = _mm_loadu_si128((const __m128i*) accum);
+    __m128i a1 = _mm_loadu_si128((const __m128i*) (accum + 16));
+    __m128i a2 = _mm_loadu_si128((const __m128i*) (accum + 32));
+    __m128i a3 = _mm_loadu_si128((const __m128i*) (accum + 48));
+    __m128i t0, t1, t2, t3;
+
+    t0 = _mm_unpacklo_epi8(a0, a1);
+    t1 = _mm_unpackhi_epi8(a0, a1);
+    t2 = _mm_unpacklo_epi8(a2, a3);
+    t3 = _mm_unpackhi_epi8(a2, a3);
+
+    a0 = _mm_unpacklo_epi8(t0, t1);
+    a1 = _mm_unpackhi_epi8(t0, t1);
+    a2 = _mm_unpacklo_epi8(t2, t3);
+    a3 = _mm_unpackhi_epi8(t2, t3);
+
+    t0 = _mm_unpacklo_epi8(a0, a1);
+    t1 = _mm_unpackhi_epi8(a0, a1);
+    t2 = _mm_unpacklo_epi8(a2, a3);
+    t3 = _mm_unpackhi_epi8(a2, a3);
+
+    s[0] = _mm_unpacklo_epi64(t0, t2);
+    s[1] = _mm_unpackhi_epi64(t0, t2);
+    s[2] = _mm_unpacklo_epi64(t1, t3);
+    s[3] = _mm_unpackhi_epi64(t1, t3);
+}
+
+// The other way around
+cmsINLINE void Interleave4x16(const __m128i s[4], cmsUInt8Number* output)
+{
+    __m128i t0 = _mm_unpacklo_epi8(s[0], s[1]);
+    __m128i t1 = _mm_unpackhi_epi8(s[0], s[1]);
+    __m128i t2 = _mm_unpacklo_epi8(s[2], s[3]);
+    __m128i t3 = _mm_unpackhi_epi8(s[2], s[3]);
+
+    _mm_storeu_si128((__m128i*) output,        _mm_unpacklo_epi16(t0, t2));
+    _mm_storeu_si128((__m128i*) (output + 16), _mm_unpackhi_epi16(t0, t2));
+    _mm_storeu_si128((__m128i*) (output + 32), _mm_unpacklo_epi16(t1, t3));
+    _mm_storeu_si128((__m128i*) (output + 48), _mm_unpackhi_epi16(t1, t3));
+}
+
+// FROM_8_TO_16 on 16 bytes. x * 257 is the byte repeated on both halves
+cmsINLINE void Widen8To16(__m128i s, cmsUInt32Number Reverse, cmsUInt16Number* Plane)
+{
+    if (Reverse) s = _mm_xor_si128(s, _mm_set1_epi8((char) 0xff));
+
+    _mm_storeu_si128((__m128i*) Plane,       _mm_unpacklo_epi8(s, s));
+    _mm_storeu_si128((__m128i*) (Plane + 8), _mm_unpackhi_epi8(s, s));
+}
+
+// FROM_16_TO_8 on 16 words. The low half of x * 65281 never carries once 0x800000 is added, so the rounding
+// can be done on the high half alone
+cmsINLINE __m128i Narrow16To8(const cmsUInt16Number* Plane, cmsUInt32Number Reverse)
+{
+    const __m128i k    = _mm_set1_epi16((short) 65281);
+    const __m128i half = _mm_set1_epi16(0x80);
+    __m128i lo = _mm_loadu_si128((const __m128i*) Plane);
+    __m128i hi = _mm_loadu_si128((const __m128i*) (Plane + 8));
+
+    if (Reverse) {
+        lo = _mm_xor_si128(lo, _mm_set1_epi16(-1));
+        hi = _mm_xor_si128(hi, _mm_set1_epi16(-1));
+    }
+
+    lo = _mm_srli_epi16(_mm_add_epi16(_mm_mulhi_epu16(lo, k), half), 8);
+    hi = _mm_srli_epi16(_mm_add_epi16(_mm_mulhi_epu16(hi, k), half), 8);
+
+    return _mm_packus_epi16(lo, hi);
+}
+
+#endif
+
+// Scalar rows, one channel at a time. Step is in samples, and those also take care of the planar case, with a
+// step of one, which is the vectorized one.
+static
+void Row8To16(cmsUInt16Number* Plane, const cmsUInt8Number* src, cmsUInt32Number n, cmsUInt32Number Step, cmsUInt32Number Reverse)
+{
+    cmsUInt32Number i = 0;
+
+#ifdef CMS_USE_SSE2
+    if (Step == 1) {
+
+        for (; i + 16 <= n; i += 16)
+            Widen8To16(_mm_loadu_si128((const __m128i*) (src + i)), Reverse, Plane + i);
+    }
+#endif
+
+    for (; i < n; i++) {
+
+        cmsUInt16Number v = FROM_8_TO_16(src[i * Step]);
+        Plane[i] = Reverse ? REVERSE_FLAVOR_16(v) : v;
+    }
+}
+
+static
+void Row16To8(cmsUInt8Number* dst, const cmsUInt16Number* Plane, cmsUInt32Number n, cmsUInt32Number Step, cmsUInt32Number Reverse)
+{
+    cmsUInt32Number i = 0;
+
+#ifdef CMS_USE_SSE2
+    if (Step == 1) {
+
+        for (; i + 16 <= n; i += 16)
+            _mm_storeu_si128((__m128i*) (dst + i), Narrow16To8(Plane + i, Reverse));
+    }
+#endif
+
+    for (; i < n; i++) {
+
+        cmsUInt16Number v = Plane[i];
+        if (Reverse) v = REVERSE_FLAVOR_16(v);
+        dst[i * Step] = FROM_16_TO_8(v);
+    }
+}
+
+static
+void RowWordsTo16(cmsUInt16Number* Plane, const cmsUInt16Number* src, cmsUInt32Number n, cmsUInt32Number Step,
+                  cmsUInt32Number SwapEndian, cmsUInt32Number Reverse)
+{
+    cmsUInt32Number i;
+
+    for (i=0; i < n; i++) {
+
+        cmsUInt16Number v = src[i * Step];
+
+        if (SwapEndian) v = CHANGE_ENDIAN(v);
+        Plane[i] = Reverse ? REVERSE_FLAVOR_16(v) : v;
+    }
+}
+
+static
+void Row16ToWords(cmsUInt16Number* dst, const cmsUInt16Number* Plane, cmsUInt32Number n, cmsUInt32Number Step,
+                  cmsUInt32Number SwapEndian, cmsUInt32Number Reverse)
+{
+    cmsUInt32Number i;
+
+    for (i=0; i < n; i++) {
+
+        cmsUInt16Number v = Plane[i];
+
+        if (SwapEndian) v = CHANGE_ENDIAN(v);
+        if (Reverse)    v = REVERSE_FLAVOR_16(v);
+        dst[i * Step] = v;
+    }
+}
+
+// 1 and 2 bytes, to 16 bits planes
+static
+cmsUInt8Number* UnrollRowTo16(_cmsTRANSFORM* info,
+                              cmsUInt16Number Planes[],
+                              cmsUInt32Number PlaneStride,
+                              cmsUInt8Number* accum,
+                              cmsUInt32Number nPixels,
+                              cmsUInt32Number Stride)
+{
+    cmsUInt32Number Bytes = T_BYTES(info ->InputFormat);
+    cmsUInt32Number Done = 0;
+    cmsUInt32Number c;
+    _cmsRowLayout l;
+
+    ComputeRowLayout(&l, info ->InputFormat, cmsFormatterInput, FALSE);
+
+#ifdef CMS_USE_SSE2
+    if (Bytes == 1 && l.PixelSamples == 4) {
+
+        __m128i s[4];
+
+        for (; Done + 16 <= nPixels; Done += 16) {
+
+            Deinterleave4x16(accum + Done * 4, s);
+
+            for (c=0; c < l.nChan; c++)
+                Widen8To16(s[l.Pos[c]], l.Reverse, Planes + c * PlaneStride + Done);
+        }
+    }
+#endif
+
+    for (c=0; c < l.nChan; c++) {
+
+        cmsUInt8Number* src = accum + RowChannelOffset(&l, c, Bytes, Stride) + Done * l.PixelSamples * Bytes;
+        cmsUInt16Number* Plane = Planes + c * PlaneStride + Done;
+
+        if (Bytes == 1)
+            Row8To16(Plane, src, nPixels - Done, l.PixelSamples, l.Reverse);
+        else
+            RowWordsTo16(Plane, (cmsUInt16Number*) src, nPixels - Done, l.PixelSamples, l.SwapEndian, l.Reverse);
+    }
+
+    return accum + nPixels * l.PixelSamples * Bytes;
+}
+
+static
+cmsUInt8Number* PackRowFrom16(_cmsTRANSFORM* info,
+                              cmsUInt16Number Planes[],
+                              cmsUInt32Number PlaneStride,
+                              cmsUInt8Number* output,
+                              cmsUInt32Number nPixels,
+                              cmsUInt32Number Stride)
+{
+    cmsUInt32Number Bytes = T_BYTES(info ->OutputFormat);
+    cmsUInt32Number Done = 0;
+    cmsUInt32Number c;
+    _cmsRowLayout l;
+
+    ComputeRowLayout(&l, info ->OutputFormat, cmsFormatterOutput, FALSE);
+
+#ifdef CMS_USE_SSE2
+    if (Bytes == 1 && l.PixelSamples == 4) {
+
+        __m128i s[4];
+
+        for (; Done + 16 <= nPixels; Done += 16) {
+
+            // Samples not holding a channel keep whatever they had
+            if (l.nChan < 4)
+                Deinterleave4x16(output + Done * 4, s);
+
+            for (c=0; c < l.nChan; c++)
+                s[l.Pos[c]] = Narrow16To8(Planes + c * PlaneStride + Done, l.Reverse);
+
+            Interleave4x16(s, output + Done * 4);
+        }
+    }
+#endif
+
+    for (c=0; c < l.nChan; c++) {
+
+        cmsUInt8Number* dst = output + RowChannelOffset(&l, c, Bytes, Stride) + Done * l.PixelSamples * Bytes;
+        cmsUInt16Number* Plane = Planes + c * PlaneStride + Done;
+
+        if (Bytes == 1)
+            Row16To8(dst, Plane, nPixels - Done, l.PixelSamples, l.Reverse);
+        else
+            Row16ToWords((cmsUInt16Number*) dst, Plane, nPixels - Done, l.PixelSamples, l.SwapEndian, l.Reverse);
+    }
+
+    return output + nPixels * l.PixelSamples * Bytes;
+}
+
+// Float planes. Integers go to 0..1.0 and floating point is divided by the maximum, 100 on ink spaces.
+static
+void RowToFloat(cmsFloat32Number* Plane, const cmsUInt8Number* src, cmsUInt32Number n, cmsUInt32Number Step,
+                cmsUInt32Number Format, cmsFloat32Number maximum, cmsUInt32Number Reverse)
+{
+    cmsUInt32Number i;
+    cmsFloat32Number v;
+
+    if (!T_FLOAT(Format)) {
+
+        if (T_BYTES(Format) == 1) {
+
+            for (i=0; i < n; i++) {
+                v = (cmsFloat32Number) src[i * Step] / 255.0F;
+                Plane[i] = Reverse ? 1 - v : v;
+            }
+        }
+        else {
+
+            for (i=0; i < n; i++) {
+                v = (cmsFloat32Number) ((const cmsUInt16Number*) src)[i * Step] / 65535.0F;
+                Plane[i] = Reverse ? 1 - v : v;
+            }
+        }
+        return;
+    }
+
+#ifndef CMS_NO_HALF_SUPPORT
+    if (T_BYTES(Format) == 2) {
+
+        for (i=0; i < n; i++) {
+            v = _cmsHalf2Float(((const cmsUInt16Number*) src)[i * Step]) / maximum;
+            Plane[i] = Reverse ? 1 - v : v;
+        }
+        return;
+    }
+#endif
+
+    for (i=0; i < n; i++) {
+        v = ((const cmsFloat32Number*) src)[i * Step] / maximum;
+        Plane[i] = Reverse ? 1 - v : v;
+    }
+}
+
+// Packing scales on doubles, as the per-pixel formatters do
+static
+void RowFromFloat(cmsUInt8Number* dst, const cmsFloat32Number* Plane, cmsUInt32Number n, cmsUInt32Number Step,
+                  cmsUInt32Number Format, cmsFloat32Number maximum, cmsUInt32Number Reverse)
+{
+    cmsUInt32Number i;
+    cmsFloat64Number v;
+
+    if (!T_FLOAT(Format)) {
+
+        for (i=0; i < n; i++) {
+
+            v = Plane[i] * 65535.0;
+            if (Reverse) v = 65535.0 - v;
+
+            if (T_BYTES(Format) == 1)
+                dst[i * Step] = FROM_16_TO_8(_cmsQuickSaturateWord(v));
+            else
+                ((cmsUInt16Number*) dst)[i * Step] = _cmsQuickSaturateWord(v);
+        }
+        return;
+    }
+
+#ifndef CMS_NO_HALF_SUPPORT
+    if (T_BYTES(Format) == 2) {
+
+        for (i=0; i < n; i++) {
+
+            cmsFloat32Number h = Plane[i] * maximum;
+            if (Reverse) h = maximum - h;
+            ((cmsUInt16Number*) dst)[i * Step] = _cmsFloat2Half(h);
+        }
+        return;
+    }
+#endif
+
+    for (i=0; i < n; i++) {
+
+        v = Plane[i] * (cmsFloat64Number) maximum;
+        if (Reverse) v = maximum - v;
+        ((cmsFloat32Number*) dst)[i * Step] = (cmsFloat32Number) v;
+    }
+}
+
+static
+cmsUInt8Number* UnrollRowToFloat(_cmsTRANSFORM* info,
+                                 cmsFloat32Number Planes[],
+                                 cmsUInt32Number PlaneStride,
+                                 cmsUInt8Number* accum,
+                                 cmsUInt32Number nPixels,
+                                 cmsUInt32Number Stride)
+{
+    cmsUInt32Number Format = info ->InputFormat;
+    cmsUInt32Number Bytes = T_BYTES(Format);
+    cmsFloat32Number maximum = IsInkSpace(Format) ? 100.0F : 1.0F;
+    cmsUInt32Number Done = 0;
+    cmsUInt32Number c;
+    _cmsRowLayout l;
+
+    ComputeRowLayout(&l, Format, cmsFormatterInput, TRUE);
+
+#ifdef CMS_USE_SSE2
+    if (T_FLOAT(Format) && Bytes == 4 && l.PixelSamples == 4 && !l.Reverse) {
+
+        const __m128 m = _mm_set1_ps(maximum);
+        const cmsFloat32Number* src = (const cmsFloat32Number*) accum;
+
+        for (; Done + 4 <= nPixels; Done += 4) {
+
+            __m128 s[4];
+
+            s[0] = _mm_loadu_ps(src + Done * 4);
+            s[1] = _mm_loadu_ps(src + Done * 4 + 4);
+            s[2] = _mm_loadu_ps(src + Done * 4 + 8);
+            s[3] = _mm_loadu_ps(src + Done * 4 + 12);
+
+            _MM_TRANSPOSE4_PS(s[0], s[1], s[2], s[3]);
+
+            for (c=0; c < l.nChan; c++)
+                _mm_storeu_ps(Planes + c * PlaneStride + Done, _mm_div_ps(s[l.Pos[c]], m));
+        }
+    }
+#endif
+
+    for (c=0; c < l.nChan; c++) {
+
+        cmsUInt8Number* src = accum + RowChannelOffset(&l, c, Bytes, Stride) + Done * l.PixelSamples * Bytes;
+
+        RowToFloat(Planes + c * PlaneStride + Done, src, nPixels - Done, l.PixelSamples, Format, maximum, l.Reverse);
+    }
+
+    return accum + nPixels * l.PixelSamples * Bytes;
+}
+
+static
+cmsUInt8Number* PackRowFromFloat(_cmsTRANSFORM* info,
+                                 cmsFloat32Number Planes[],
+                                 cmsUInt32Number PlaneStride,
+                                 cmsUInt8Number* output,
+                                 cmsUInt32Number nPixels,
+                                 cmsUInt32Number Stride)
+{
+    cmsUInt32Number Format = info ->OutputFormat;
+    cmsUInt32Number Bytes = T_BYTES(Format);
+    cmsFloat32Number maximum = IsInkSpace(Format) ? 100.0F : 1.0F;
+    cmsUInt32Number Done = 0;
+    cmsUInt32Number c;
+    _cmsRowLayout l;
+
+    ComputeRowLayout(&l, Format, cmsFormatterOutput, TRUE);
+
+#ifdef CMS_USE_SSE2
+
+    // Scaling goes on doubles, so only the plain copy is done here
+    if (T_FLOAT(Format) && Bytes == 4 && l.PixelSamples == 4 && !l.Reverse && maximum == 1.0F) {
+
+        cmsFloat32Number* dst = (cmsFloat32Number*) output;
+
+        for (; Done + 4 <= nPixels; Done += 4) {
+
+            __m128 s[4];
+
+            if (l.nChan < 4) {
+
+                s[0] = _mm_loadu_ps(dst + Done * 4);
+                s[1] = _mm_loadu_ps(dst + Done * 4 + 4);
+                s[2] = _mm_loadu_ps(dst + Done * 4 + 8);
+                s[3] = _mm_loadu_ps(dst + Done * 4 + 12);
+
+                _MM_TRANSPOSE4_PS(s[0], s[1], s[2], s[3]);
+            }
+
+            for (c=0; c < l.nChan; c++)
+                s[l.Pos[c]] = _mm_loadu_ps(Planes + c * PlaneStride + Done);
+
+            _MM_TRANSPOSE4_PS(s[0], s[1], s[2], s[3]);
+
+            _mm_storeu_ps(dst + Done * 4,      s[0]);
+            _mm_storeu_ps(dst + Done * 4 + 4,  s[1]);
+            _mm_storeu_ps(dst + Done * 4 + 8,  s[2]);
+            _mm_storeu_ps(dst + Done * 4 + 12, s[3]);
+        }
+    }
+#endif
+
+    for (c=0; c < l.nChan; c++) {
+
+        cmsUInt8Number* dst = output + RowChannelOffset(&l, c, Bytes, Stride) + Done * l.PixelSamples * Bytes;
+
+        RowFromFloat(dst, Planes + c * PlaneStride + Done, nPixels - Done, l.PixelSamples, Format, maximum, l.Reverse);
+    }
+
+    return output + nPixels * l.PixelSamples * Bytes;
+}
+
 // ----------------------------------------------------------------------------------------------------------------
 
 
@@ -3891,6 +4398,122 @@ cmsFormatter _cmsGetStockOutputFormatter(cmsUInt32Number dwInput, cmsUInt32Numbe
     return fr;
 }
 
+typedef struct {
+    cmsUInt32Number   Type;
+    cmsUInt32Number   Mask;
+    cmsFormatterRow16 Frm;
+
+} cmsFormattersRow16;
+
+typedef struct {
+    cmsUInt32Number      Type;
+    cmsUInt32Number      Mask;
+    cmsFormatterRowFloat Frm;
+
+} cmsFormattersRowFloat;
+
+// Masks are the ones of the generic per-pixel formatters, since row formatters give the same values
+static const cmsFormattersRow16 InputRowFormatters16[] = {
+
+    { BYTES_SH(1),  ANYPLANAR|ANYFLAVOR|ANYSWAPFIRST|ANYSWAP|ANYEXTRA|ANYCHANNELS|ANYSPACE,           UnrollRowTo16},
+    { BYTES_SH(2)|PLANAR_SH(1),  ANYFLAVOR|ANYSWAP|ANYENDIAN|ANYEXTRA|ANYCHANNELS|ANYSPACE,           UnrollRowTo16},
+    { BYTES_SH(2),  ANYFLAVOR|ANYSWAPFIRST|ANYSWAP|ANYENDIAN|ANYEXTRA|ANYCHANNELS|ANYSPACE,           UnrollRowTo16}
+};
+
+static const cmsFormattersRow16 OutputRowFormatters16[] = {
+
+    { BYTES_SH(1),  ANYPLANAR|ANYFLAVOR|ANYSWAPFIRST|ANYSWAP|ANYEXTRA|ANYCHANNELS|ANYSPACE,           PackRowFrom16},
+    { BYTES_SH(2)|PLANAR_SH(1),  ANYFLAVOR|ANYSWAP|ANYENDIAN|ANYEXTRA|ANYCHANNELS|ANYSPACE,           PackRowFrom16},
+    { BYTES_SH(2),  ANYFLAVOR|ANYSWAPFIRST|ANYSWAP|ANYENDIAN|ANYEXTRA|ANYCHANNELS|ANYSPACE,           PackRowFrom16}
+};
+
+static const cmsFormattersRowFloat InputRowFormattersFloat[] = {
+
+    { FLOAT_SH(1)|BYTES_SH(4),  ANYPLANAR|ANYSWAPFIRST|ANYSWAP|ANYEXTRA|ANYCHANNELS|ANYSPACE,         UnrollRowToFloat},
+    { BYTES_SH(1),              ANYPLANAR|ANYSWAPFIRST|ANYSWAP|ANYEXTRA|ANYCHANNELS|ANYSPACE,         UnrollRowToFloat},
+    { BYTES_SH(2),              ANYPLANAR|ANYSWAPFIRST|ANYSWAP|ANYEXTRA|ANYCHANNELS|ANYSPACE,         UnrollRowToFloat},
+#ifndef CMS_NO_HALF_SUPPORT
+    { FLOAT_SH(1)|BYTES_SH(2),  ANYPLANAR|ANYSWAPFIRST|ANYSWAP|ANYEXTRA|ANYCHANNELS|ANYSPACE,         UnrollRowToFloat},
+#endif
+};
+
+static const cmsFormattersRowFloat OutputRowFormattersFloat[] = {
+
+    { FLOAT_SH(1)|BYTES_SH(4),  ANYPLANAR|ANYFLAVOR|ANYSWAPFIRST|ANYSWAP|ANYEXTRA|ANYCHANNELS|ANYSPACE, PackRowFromFloat},
+    { BYTES_SH(2),              ANYPLANAR|ANYFLAVOR|ANYSWAPFIRST|ANYSWAP|ANYEXTRA|ANYCHANNELS|ANYSPACE, PackRowFromFloat},
+    { BYTES_SH(1),              ANYPLANAR|ANYFLAVOR|ANYSWAPFIRST|ANYSWAP|ANYEXTRA|ANYCHANNELS|ANYSPACE, PackRowFromFloat},
+#ifndef CMS_NO_HALF_SUPPORT
+    { FLOAT_SH(1)|BYTES_SH(2),            ANYFLAVOR|ANYSWAPFIRST|ANYSWAP|ANYEXTRA|ANYCHANNELS|ANYSPACE, PackRowFromFloat},
+#endif
+};
+
+// Formats having per-pixel formatters of their own, or where the per-pixel formatter does something a row
+// cannot reproduce, are left to the per-pixel formatters
+static
+cmsBool IsRowFormat(cmsUInt32Number Type, cmsFormatterDirection Dir, cmsUInt32Number dwFlags)
+{
+    cmsUInt32Number Space = T_COLORSPACE(Type);
+
+    if (Space == PT_LabV2) return FALSE;
+    if (T_FLOAT(Type) && (Space == PT_Lab || Space == PT_XYZ)) return FALSE;
+
+    // Swapping both ways with no extra channels, the special cased formatters don't agree with the generic ones
+    if (T_DOSWAP(Type) && T_SWAPFIRST(Type) && T_EXTRA(Type) == 0) return FALSE;
+
+    // Packing floats on planar, the swap first rotation moves samples along the plane
+    if (dwFlags == CMS_PACK_FLAGS_FLOAT && Dir == cmsFormatterOutput &&
+        T_PLANAR(Type) && T_SWAPFIRST(Type) && T_EXTRA(Type) == 0) return FALSE;
+
+    return TRUE;
+}
+
+cmsFormatterRow _cmsGetStockRowFormatter(cmsUInt32Number Type, cmsFormatterDirection Dir, cmsUInt32Number dwFlags)
+{
+    cmsUInt32Number i;
+    cmsFormatterRow fr;
+
+    fr.Row16 = NULL;
+
+    if (!IsRowFormat(Type, Dir, dwFlags)) return fr;
+
+    switch (dwFlags) {
+
+    case CMS_PACK_FLAGS_16BITS: {
+
+        const cmsFormattersRow16* Table = (Dir == cmsFormatterInput) ? InputRowFormatters16 : OutputRowFormatters16;
+        cmsUInt32Number Count = (Dir == cmsFormatterInput) ? sizeof(InputRowFormatters16) / sizeof(cmsFormattersRow16) :
+                                                             sizeof(OutputRowFormatters16) / sizeof(cmsFormattersRow16);
+        for (i=0; i < Count; i++) {
+
+            if ((Type & ~Table[i].Mask) == Table[i].Type) {
+                fr.Row16 = Table[i].Frm;
+                return fr;
+            }
+        }
+        }
+        break;
+
+    case CMS_PACK_FLAGS_FLOAT: {
+
+        const cmsFormattersRowFloat* Table = (Dir == cmsFormatterInput) ? InputRowFormattersFloat : OutputRowFormattersFloat;
+        cmsUInt32Number Count = (Dir == cmsFormatterInput) ? sizeof(InputRowFormattersFloat) / sizeof(cmsFormattersRowFloat) :
+                                                             sizeof(OutputRowFormattersFloat) / sizeof(cmsFormattersRowFloat);
+        for (i=0; i < Count; i++) {
+
+            if ((Type & ~Table[i].Mask) == Table[i].Type) {
+                fr.RowFloat = Table[i].Frm;
+                return fr;
+            }
+        }
+        }
+        break;
+
+    default:;
+    }
+
+    return fr;
+}
+
 
 typedef struct _cms_formatters_factory_list {
 
@@ -3899,6 +4522,13 @@ typedef struct _cms_formatters_factory_list {
 
 } cmsFormattersFactoryList;
 
+typedef struct _cms_formatters_row_factory_list {
+
+    cmsFormatterRowFactory Factory;
+    struct _cms_formatters_row_factory_list *Next;
+
+} cmsFormattersRowFactoryList;
+
 _cmsFormattersPluginChunkType _cmsFormattersPluginChunk = { NULL };
 
 
@@ -3910,6 +4540,8 @@ void DupFormatterFactoryList(struct _cmsContext_struct* ctx,
    _cmsFormattersPluginChunkType newHead = { NULL };
    cmsFormattersFactoryList*  entry;
    cmsFormattersFactoryList*  Anterior = NULL;
+   cmsFormattersRowFactoryList*  rowEntry;
+   cmsFormattersRowFactoryList*  RowAnterior = NULL;
    _cmsFormattersPluginChunkType* head = (_cmsFormattersPluginChunkType*) src->chunks[FormattersPlugin];
 
      _cmsAssert(head != NULL);
@@ -3935,6 +4567,26 @@ void DupFormatterFactoryList(struct _cmsContext_struct* ctx,
                newHead.FactoryList = newEntry;
    }
 
+   // Same for the row formatters
+   for (rowEntry = head->RowFactoryList;
+       rowEntry != NULL;
+       rowEntry = rowEntry ->Next) {
+
+           cmsFormattersRowFactoryList *newEntry = ( cmsFormattersRowFactoryList *) _cmsSubAllocDup(ctx ->MemPool, rowEntry, sizeof(cmsFormattersRowFactoryList));
+
+           if (newEntry == NULL)
+               return;
+
+           newEntry -> Next = NULL;
+           if (RowAnterior)
+               RowAnterior -> Next = newEntry;
+
+           RowAnterior = newEntry;
+
+           if (newHead.RowFactoryList == NULL)
+               newHead.RowFactoryList = newEntry;
+   }
+
    ctx ->chunks[FormattersPlugin] = _cmsSubAllocDup(ctx->MemPool, &newHead, sizeof(_cmsFormattersPluginChunkType));
 }
 
@@ -3982,6 +4634,31 @@ cmsBool  _cmsRegisterFormattersPlugin(cmsContext ContextID, cmsPluginBase* Data)
     return TRUE;
 }
 
+// Row formatters management. Those share the container of the per-pixel formatters
+cmsBool  _cmsRegisterFormattersRowPlugin(cmsContext ContextID, cmsPluginBase* Data)
+{
+    _cmsFormattersPluginChunkType* ctx = ( _cmsFormattersPluginChunkType*) _cmsContextGetClientChunk(ContextID, FormattersPlugin);
+    cmsPluginFormattersRow* Plugin = (cmsPluginFormattersRow*) Data;
+    cmsFormattersRowFactoryList* fl ;
+
+    // Reset to built-in defaults
+    if (Data == NULL) {
+
+          ctx ->RowFactoryList = NULL;
+          return TRUE;
+    }
+
+    fl = (cmsFormattersRowFactoryList*) _cmsPluginMalloc(ContextID, sizeof(cmsFormattersRowFactoryList));
+    if (fl == NULL) return FALSE;
+
+    fl ->Factory    = Plugin ->FormattersRowFactory;
+
+    fl ->Next = ctx -> RowFactoryList;
+    ctx ->RowFactoryList = fl;
+
+    return TRUE;
+}
+
 cmsFormatter CMSEXPORT _cmsGetFormatter(cmsContext ContextID,
                                         cmsUInt32Number Type,         // Specific type, i.e. TYPE_RGB_8
                                         cmsFormatterDirection Dir,
@@ -4008,6 +4685,48 @@ cmsFormatter CMSEXPORT _cmsGetFormatter(cmsContext ContextID,
         return _cmsGetStockOutputFormatter(Type, dwFlags);
 }
 
+// Tells whatever Fn is the built-in formatter of the format, the one _cmsGetFormatter() reverts to
+cmsBool _cmsIsStockFormatter(cmsFormatter Fn, cmsUInt32Number Type, cmsFormatterDirection Dir, cmsUInt32Number dwFlags)
+{
+    cmsFormatter Stock;
+
+    if (Dir == cmsFormatterInput)
+        Stock = _cmsGetStockInputFormatter(Type, dwFlags);
+    else
+        Stock = _cmsGetStockOutputFormatter(Type, dwFlags);
+
+    return Fn.Fmt16 == Stock.Fmt16;
+}
+
+// Row formatter plug-ins come first. The built-in row formatters give way to any per-pixel plug-in claiming the format
+cmsFormatterRow _cmsGetRowFormatter(cmsContext ContextID,
+                                    cmsUInt32Number Type,
+                                    cmsFormatterDirection Dir,
+                                    cmsUInt32Number dwFlags)
+{
+    _cmsFormattersPluginChunkType* ctx = ( _cmsFormattersPluginChunkType*) _cmsContextGetClientChunk(ContextID, FormattersPlugin);
+    cmsFormattersRowFactoryList* r;
+    cmsFormattersFactoryList* f;
+    cmsFormatterRow fr;
+
+    fr.Row16 = NULL;
+
+    if (T_CHANNELS(Type) == 0) return fr;
+
+    for (r =ctx->RowFactoryList; r != NULL; r = r ->Next) {
+
+        fr = r ->Factory(Type, Dir, dwFlags);
+        if (fr.Row16 != NULL) return fr;
+    }
+
+    for (f =ctx->FactoryList; f != NULL; f = f ->Next) {
+
+        if (f ->Factory(Type, Dir, dwFlags).Fmt16 != NULL) return fr;
+    }
+
+    return _cmsGetStockRowFormatter(Type, Dir, dwFlags);
+}
+
 
 // Return whatever given formatter refers to float values
 cmsBool  _cmsFormatterIsFloat(cmsUInt32Number Type)
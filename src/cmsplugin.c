@@ -584,6 +584,10 @@ cmsBool CMSEXPORT cmsPluginTHR(cmsContext id, void* Plug_in)
                     if (!_cmsRegisterFormattersPlugin(id, Plugin)) return FALSE;
                     break;
 
+                case cmsPluginFormattersRowSig:
+                    if (!_cmsRegisterFormattersRowPlugin(id, Plugin)) return FALSE;
+                    break;
+
                 case cmsPluginRenderingIntentSig:
                     if (!_cmsRegisterRenderingIntentPlugin(id, Plugin)) return FALSE;
                     break;
@@ -652,10 +656,12 @@ static struct _cmsContext_struct globalContext = {
         &_cmsOptimizationPluginChunk,    //  OptimizationPlugin,
         &_cmsTransformPluginChunk,       //  TransformPlugin,
         &_cmsMutexPluginChunk,           //  MutexPlugin,
-        &_cmsParallelizationPluginChunk  //  ParallelizationPlugin
+        &_cmsParallelizationPluginChunk, //  ParallelizationPlugin
+        &_cmsCPUFeaturesChunk,           //  CPUFeatures
+        &_cmsTransformCacheChunk         //  TransformCache
     },
     
-    { NULL, NULL, NULL, NULL, NULL, NULL } // The default memory allocator is not used for context 0
+    { NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL } // The default memory allocator is not used for context 0
 };
 
 
@@ -663,6 +669,9 @@ static struct _cmsContext_struct globalContext = {
 static _cmsMutex _cmsContextPoolHeadMutex = CMS_MUTEX_INITIALIZER;
 static struct _cmsContext_struct* _cmsContextPoolHead = NULL;
 
+// Guards the process-wide registry of shared profiles
+static _cmsMutex _cmsSharedProfilesMutex = CMS_MUTEX_INITIALIZER;
+
 
 // Make sure context is initialized (needed on windows)
 static
@@ -694,6 +703,8 @@ cmsBool InitContextMutex(void)
         }
         if (((void**)&_cmsContextPoolHeadMutex)[0] == NULL)
             InitializeCriticalSection(&_cmsContextPoolHeadMutex);
+        if (((void**)&_cmsSharedProfilesMutex)[0] == NULL)
+            InitializeCriticalSection(&_cmsSharedProfilesMutex);
         if (*mutex == NULL || !ReleaseMutex(*mutex))
         {
             cmsSignalError(0, cmsERROR_INTERNAL, "Mutex unlock failed");
@@ -710,6 +721,21 @@ cmsBool InitContextMutex(void)
 
 
 
+// Process-wide lock for the shared profiles registry
+cmsBool _cmsLockSharedProfiles(void)
+{
+    if (!InitContextMutex()) return FALSE;
+
+    _cmsEnterCriticalSectionPrimitive(&_cmsSharedProfilesMutex);
+    return TRUE;
+}
+
+void _cmsUnlockSharedProfiles(void)
+{
+    _cmsLeaveCriticalSectionPrimitive(&_cmsSharedProfilesMutex);
+}
+
+
 // Internal, get associated pointer, with guessing. Never returns NULL.
 struct _cmsContext_struct* _cmsGetContext(cmsContext ContextID)
 {
@@ -784,6 +810,7 @@ void CMSEXPORT cmsUnregisterPluginsTHR(cmsContext ContextID)
     _cmsRegisterTagTypePlugin(ContextID, NULL);
     _cmsRegisterTagPlugin(ContextID, NULL);
     _cmsRegisterFormattersPlugin(ContextID, NULL);
+    _cmsRegisterFormattersRowPlugin(ContextID, NULL);
     _cmsRegisterRenderingIntentPlugin(ContextID, NULL);
     _cmsRegisterParametricCurvesPlugin(ContextID, NULL);
     _cmsRegisterMultiProcessElementPlugin(ContextID, NULL);
@@ -876,6 +903,8 @@ cmsContext CMSEXPORT cmsCreateContext(void* Plugin, void* UserData)
     _cmsAllocTransformPluginChunk(ctx, NULL);
     _cmsAllocMutexPluginChunk(ctx, NULL);
     _cmsAllocParallelizationPluginChunk(ctx, NULL);
+    _cmsAllocCPUFeaturesChunk(ctx, NULL);
+    _cmsAllocTransformCacheChunk(ctx, NULL);
 
     // Setup the plug-ins
     if (!cmsPluginTHR(ctx, Plugin)) {
@@ -903,6 +932,9 @@ cmsContext CMSEXPORT cmsDupContext(cmsContext ContextID, void* NewUserData)
     if (ctx == NULL)   
         return NULL;     // Something very wrong happened
 
+    // cmsDeleteContext frees it with the default allocators, so it is not accounted to ContextID
+    _cmsUnaccountMemory(ContextID, ctx);
+
     if (!InitContextMutex()) return NULL;
 
     // Setup default memory allocators
@@ -943,6 +975,8 @@ cmsContext CMSEXPORT cmsDupContext(cmsContext ContextID, void* NewUserData)
     _cmsAllocTransformPluginChunk(ctx, src);
     _cmsAllocMutexPluginChunk(ctx, src);
     _cmsAllocParallelizationPluginChunk(ctx, src);
+    _cmsAllocCPUFeaturesChunk(ctx, src);
+    _cmsAllocTransformCacheChunk(ctx, src);
 
     // Make sure no one failed
     for (i=Logger; i < MemoryClientMax; i++) {
@@ -962,6 +996,14 @@ cmsContext CMSEXPORT cmsDupContext(cmsContext ContextID, void* NewUserData)
 // The ContextID can no longer be used in any THR operation.  
 void CMSEXPORT cmsDeleteContext(cmsContext ContextID)
 {
+    // Cached transforms go first, they may need the mutex and memory plug-ins
+    _cmsFreeTransformCache(ContextID);
+
+    if (ContextID != NULL)
+        _cmsFreeArena(ContextID);
+
+    _cmsFreeMemoryStats(ContextID);
+
     if (ContextID == NULL) {
 
         cmsUnregisterPlugins();
@@ -926,7 +926,9 @@ cmsBool WriteInputLUT(cmsIOHANDLER* m, cmsHPROFILE hProfile, cmsUInt32Number Int
                 return FALSE;
             }
 
+            // The CLUT is emitted from the stages, so it has to be filled up front
             dwFlags |= cmsFLAGS_FORCE_CLUT;
+            dwFlags &= ~cmsFLAGS_LAZYPRECALC;
             _cmsOptimizePipeline(m->ContextID, &DeviceLink, Intent, &InputFormat, &OutFrm, &dwFlags);
 
             rc = EmitCIEBasedDEF(m, DeviceLink, Intent, &BlackPointAdaptedToD50);
@@ -1347,8 +1349,9 @@ cmsBool WriteOutputLUT(cmsIOHANDLER* m, cmsHPROFILE hProfile, cmsUInt32Number In
         return FALSE;
     }
 
-     // We need a CLUT
+     // We need a CLUT, filled up front since it is emitted from the stages
     dwFlags |= cmsFLAGS_FORCE_CLUT;
+    dwFlags &= ~cmsFLAGS_LAZYPRECALC;
     if (!_cmsOptimizePipeline(m->ContextID, &DeviceLink, RelativeEncodingIntent, &InFrm, &OutputFormat, &dwFlags)) {
         cmsPipelineFree(DeviceLink);
         cmsDeleteTransform(xform);
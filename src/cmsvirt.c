@@ -1210,6 +1210,12 @@ cmsHPROFILE CMSEXPORT cmsTransform2DeviceLink(cmsHTRANSFORM hTransform, cmsFloat
     // Check if the pipeline holding is valid
     if (xform -> Lut == NULL) return NULL;
 
+    // Pipelines of transforms in an arena go away with the transform, and the profile would outlive it
+    if (xform ->InArena) {
+        cmsSignalError(ContextID, cmsERROR_NOT_SUITABLE, "Device links cannot be built from transforms in an arena");
+        return NULL;
+    }
+
     // Get the first mpe to check for named color
     mpe = cmsPipelineGetPtrToFirstStage(xform ->Lut);
 
@@ -1221,6 +1227,9 @@ cmsHPROFILE CMSEXPORT cmsTransform2DeviceLink(cmsHTRANSFORM hTransform, cmsFloat
         }
     }
 
+    // The devicelink is written from the stages, so any CLUT has to be filled up front
+    dwFlags &= ~cmsFLAGS_LAZYPRECALC;
+
     // First thing to do is to get a copy of the transformation
     LUT = cmsPipelineDup(xform ->Lut);
     if (LUT == NULL) return NULL;
@@ -144,12 +144,17 @@ void _cmsAllocAlarmCodesChunk(struct _cmsContext_struct* ctx,
 // -----------------------------------------------------------------------
 
 // Get rid of transform resources
-void CMSEXPORT cmsDeleteTransform(cmsHTRANSFORM hTransform)
+static
+void FreeTransform(_cmsTRANSFORM* p)
 {
-    _cmsTRANSFORM* p = (_cmsTRANSFORM*) hTransform;
+    cmsContext ContextID;
+    cmsBool InArena;
 
     _cmsAssert(p != NULL);
 
+    ContextID = p ->ContextID;
+    InArena   = p ->InArena;
+
     if (p -> GamutCheck)
         cmsPipelineFree(p -> GamutCheck);
 
@@ -168,9 +173,226 @@ void CMSEXPORT cmsDeleteTransform(cmsHTRANSFORM hTransform)
     if (p ->UserData)
         p ->FreeUserData(p ->ContextID, p ->UserData);
 
+    if (p ->CacheMutex)
+        _cmsDestroyMutex(p ->ContextID, p ->CacheMutex);
+
+    if (p ->MultiCache)
+        _cmsFree(p ->ContextID, p ->MultiCache);
+
     _cmsFree(p ->ContextID, (void *) p);
+
+    // Frees above were no-ops for anything in the arena, this gives all of it back
+    if (InArena)
+        cmsDeleteContext(ContextID);
+}
+
+// The context the transform was created in
+static
+cmsContext OwnerContext(const _cmsTRANSFORM* p)
+{
+    return p ->InArena ? p ->OwnerContextID : p ->ContextID;
+}
+
+// Transform cache -------------------------------------------------------------------------------------------------------
+
+// Each context may keep a bounded list of transforms, most recently used first. Transforms found there are
+// shared by all callers asking for the same thing, and are freed when the last holder, cache included, lets
+// them go. Keys are built from the profile IDs, so profiles without an ID are never cached.
+
+typedef struct _cmsTransformCacheEntry_st {
+
+    cmsUInt32Number  Hash;
+    cmsUInt32Number  KeyLen;        // In words
+    cmsUInt32Number* Key;
+    _cmsTRANSFORM*   Transform;     // NULL once released
+
+    struct _cmsTransformCacheEntry_st* Next;
+
+} _cmsTransformCacheEntry;
+
+// The global Context0 storage, disabled by default
+_cmsTransformCacheChunkType _cmsTransformCacheChunk = { 0, 0, NULL, NULL };
+
+// Cached transforms belong to a context, so they are never inherited
+void _cmsAllocTransformCacheChunk(struct _cmsContext_struct* ctx,
+                                  const struct _cmsContext_struct* src)
+{
+    static _cmsTransformCacheChunkType TransformCacheChunk = { 0, 0, NULL, NULL };
+
+    ctx ->chunks[TransformCacheContext] = _cmsSubAllocDup(ctx ->MemPool, &TransformCacheChunk, sizeof(_cmsTransformCacheChunkType));
+
+    cmsUNUSED_PARAMETER(src);
 }
 
+// Unlinks entries past MaxEntries and returns them as a list. Holders are released, so the transforms
+// left in the list are the ones to be freed. Must be called with the mutex locked
+static
+_cmsTransformCacheEntry* TrimCache(_cmsTransformCacheChunkType* Cache, cmsUInt32Number MaxEntries)
+{
+    _cmsTransformCacheEntry** Link = &Cache ->Head;
+    _cmsTransformCacheEntry* Evicted;
+    _cmsTransformCacheEntry* e;
+    cmsUInt32Number n = 0;
+
+    while (*Link != NULL && n < MaxEntries) {
+        Link = &(*Link) ->Next;
+        n++;
+    }
+
+    Evicted = *Link;
+    *Link = NULL;
+
+    for (e = Evicted; e != NULL; e = e ->Next) {
+
+        if (--e ->Transform ->RefCount > 0)
+            e ->Transform = NULL;
+
+        Cache ->nEntries--;
+    }
+
+    return Evicted;
+}
+
+// Frees what TrimCache returned, out of the lock
+static
+void FreeEvicted(cmsContext ContextID, _cmsTransformCacheEntry* e)
+{
+    _cmsTransformCacheEntry* Next;
+
+    for (; e != NULL; e = Next) {
+
+        Next = e ->Next;
+
+        if (e ->Transform != NULL)
+            FreeTransform(e ->Transform);
+
+        _cmsFree(ContextID, e ->Key);
+        _cmsFree(ContextID, e);
+    }
+}
+
+// Drops one reference of a shared transform. Returns TRUE if it was the last one
+static
+cmsBool ReleaseSharedTransform(_cmsTRANSFORM* p)
+{
+    cmsContext ContextID = OwnerContext(p);
+    _cmsTransformCacheChunkType* Cache = (_cmsTransformCacheChunkType*) _cmsContextGetClientChunk(ContextID, TransformCacheContext);
+    cmsBool Last;
+
+    // Cache already gone, as when the context is deleted first
+    if (Cache ->Mutex == NULL) return (--p ->RefCount == 0);
+
+    if (!_cmsLockMutex(ContextID, Cache ->Mutex)) return FALSE;
+
+    Last = (--p ->RefCount == 0);
+
+    _cmsUnlockMutex(ContextID, Cache ->Mutex);
+    return Last;
+}
+
+// Looks for a key and takes a reference of the transform. Must be called with the mutex locked
+static
+_cmsTRANSFORM* LookupCache(_cmsTransformCacheChunkType* Cache, const cmsUInt32Number Key[], cmsUInt32Number KeyLen, cmsUInt32Number Hash)
+{
+    _cmsTransformCacheEntry** Link;
+    _cmsTransformCacheEntry* e;
+
+    for (Link = &Cache ->Head; *Link != NULL; Link = &(*Link) ->Next) {
+
+        e = *Link;
+
+        if (e ->Hash == Hash && e ->KeyLen == KeyLen &&
+            memcmp(e ->Key, Key, KeyLen * sizeof(cmsUInt32Number)) == 0) {
+
+            // Move to front
+            *Link = e ->Next;
+            e ->Next = Cache ->Head;
+            Cache ->Head = e;
+
+            e ->Transform ->RefCount++;
+            return e ->Transform;
+        }
+    }
+
+    return NULL;
+}
+
+// Sets the maximum number of cached transforms, zero disables the cache and drops its contents.
+// Returns the previous size
+cmsUInt32Number CMSEXPORT cmsSetTransformCacheSize(cmsContext ContextID, cmsUInt32Number MaxEntries)
+{
+    _cmsTransformCacheChunkType* Cache = (_cmsTransformCacheChunkType*) _cmsContextGetClientChunk(ContextID, TransformCacheContext);
+    _cmsTransformCacheEntry* Evicted;
+    cmsUInt32Number Prev;
+
+    if (Cache ->Mutex == NULL) {
+
+        if (MaxEntries == 0) return 0;
+
+        Cache ->Mutex = _cmsCreateMutex(ContextID);
+        if (Cache ->Mutex == NULL) return 0;
+    }
+
+    if (!_cmsLockMutex(ContextID, Cache ->Mutex)) return 0;
+
+    Prev = Cache ->MaxEntries;
+    Cache ->MaxEntries = MaxEntries;
+    Evicted = TrimCache(Cache, MaxEntries);
+
+    _cmsUnlockMutex(ContextID, Cache ->Mutex);
+
+    FreeEvicted(ContextID, Evicted);
+    return Prev;
+}
+
+// Drops all cached transforms. Transforms still held by callers stay valid until deleted
+void CMSEXPORT cmsFlushTransformCache(cmsContext ContextID)
+{
+    _cmsTransformCacheChunkType* Cache = (_cmsTransformCacheChunkType*) _cmsContextGetClientChunk(ContextID, TransformCacheContext);
+    _cmsTransformCacheEntry* Evicted;
+
+    if (Cache ->Mutex == NULL) return;
+    if (!_cmsLockMutex(ContextID, Cache ->Mutex)) return;
+
+    Evicted = TrimCache(Cache, 0);
+
+    _cmsUnlockMutex(ContextID, Cache ->Mutex);
+
+    FreeEvicted(ContextID, Evicted);
+}
+
+// On context deletion. The chunk is looked up directly, as a context that failed to build has none
+void _cmsFreeTransformCache(cmsContext ContextID)
+{
+    _cmsTransformCacheChunkType* Cache;
+
+    if (ContextID == NULL)
+        Cache = &_cmsTransformCacheChunk;
+    else
+        Cache = (_cmsTransformCacheChunkType*) ((struct _cmsContext_struct*) ContextID) ->chunks[TransformCacheContext];
+
+    if (Cache == NULL || Cache ->Mutex == NULL) return;
+
+    cmsFlushTransformCache(ContextID);
+
+    _cmsDestroyMutex(ContextID, Cache ->Mutex);
+    Cache ->Mutex = NULL;
+    Cache ->MaxEntries = 0;
+}
+
+// Get rid of transform resources. Shared transforms are only freed when nobody holds them
+void CMSEXPORT cmsDeleteTransform(cmsHTRANSFORM hTransform)
+{
+    _cmsTRANSFORM* p = (_cmsTRANSFORM*) hTransform;
+
+    _cmsAssert(p != NULL);
+
+    if (p ->Shared && !ReleaseSharedTransform(p)) return;
+
+    FreeTransform(p);
+}
+
+
 
 static
 cmsUInt32Number PixelSize(cmsUInt32Number Format)
@@ -609,6 +831,661 @@ void CachedXFORMGamutCheck(_cmsTRANSFORM* p,
     }
 }
 
+// Multi-entry cache -----------------------------------------------------------------------------------------------------
+
+// Number of entries of the hashed cache. Must be a power of two.
+#define MULTICACHE_ENTRIES  128
+
+typedef struct {
+
+    cmsUInt8Number  Valid[MULTICACHE_ENTRIES];
+    cmsUInt16Number CacheIn[MULTICACHE_ENTRIES][cmsMAXCHANNELS];
+    cmsUInt16Number CacheOut[MULTICACHE_ENTRIES][cmsMAXCHANNELS];
+
+} _cmsMULTICACHE;
+
+// FNV-1a on the input channels, folded to the table size
+cmsINLINE
+cmsUInt32Number HashPixel(const cmsUInt16Number wIn[], cmsUInt32Number nChannels)
+{
+    cmsUInt32Number h = 2166136261U;
+    cmsUInt32Number i;
+
+    for (i = 0; i < nChannels; i++) {
+
+        h ^= wIn[i];
+        h *= 16777619U;
+    }
+
+    return (h ^ (h >> 15)) & (MULTICACHE_ENTRIES - 1);
+}
+
+// Adds without wrapping around
+cmsINLINE
+cmsUInt32Number SaturatedAdd(cmsUInt32Number a, cmsUInt32Number b)
+{
+    return (a + b < a) ? 0xFFFFFFFFU : a + b;
+}
+
+// Empties the cache, then seeds it with the zero entry
+static
+void InitMultiCache(_cmsMULTICACHE* Cache, const _cmsTRANSFORM* p)
+{
+    cmsUInt32Number Slot = HashPixel(p->Cache.CacheIn, cmsPipelineInputChannels(p->Lut));
+
+    memset(Cache->Valid, 0, sizeof(Cache->Valid));
+
+    memcpy(Cache->CacheIn[Slot], p->Cache.CacheIn, sizeof(p->Cache.CacheIn));
+    memcpy(Cache->CacheOut[Slot], p->Cache.CacheOut, sizeof(p->Cache.CacheOut));
+    Cache->Valid[Slot] = 1;
+}
+
+// Direct-mapped cache of several pixels. It lives in the scratch memory attached to the transform, if any,
+// or else in the one allocated with the transform; both are kept between calls. Scratch memory is not used
+// when running as a worker of a parallelization plug-in, as several threads would share it. A call finding
+// the cache of the transform taken by another one goes with the 1-pixel cache instead, so nothing is
+// allocated here. Gamut check is handled here as well, it is only evaluated on misses.
+static
+void MultiCachedXFORM(_cmsTRANSFORM* p,
+                      const void* in,
+                      void* out,
+                      cmsUInt32Number PixelsPerLine,
+                      cmsUInt32Number LineCount,
+                      const cmsStride* Stride)
+{
+    cmsUInt8Number* accum;
+    cmsUInt8Number* output;
+    cmsUInt16Number wIn[cmsMAXCHANNELS], wOut[cmsMAXCHANNELS];
+    _cmsMULTICACHE* Cache = NULL;
+    _cmsCACHE Last;
+    cmsBool Owned = FALSE, Hit;
+    cmsUInt32Number nIn, nOut, Slot = 0;
+    cmsUInt32Number Hits = 0, Misses = 0;
+    size_t i, j, strideIn, strideOut;
+
+    _cmsHandleExtraChannels(p, in, out, PixelsPerLine, LineCount, Stride);
+
+    nIn  = cmsPipelineInputChannels(p->Lut);
+    nOut = cmsPipelineOutputChannels(p->Lut);
+
+    // Empty buffers for quick memcmp
+    memset(wIn, 0, sizeof(wIn));
+    memset(wOut, 0, sizeof(wOut));
+
+    // Get copy of zero cache, used only if the multi-entry one is not available
+    memcpy(&Last, &p->Cache, sizeof(Last));
+
+    if (p->Worker == NULL && p->ScratchSize >= sizeof(_cmsMULTICACHE)) {
+
+        // Already initialized when attached
+        Cache = (_cmsMULTICACHE*) p->Scratch;
+    }
+    else {
+
+        if (_cmsLockMutex(p->ContextID, p->CacheMutex)) {
+
+            if (!p->MultiCacheBusy) {
+
+                p->MultiCacheBusy = TRUE;
+                Owned = TRUE;
+            }
+
+            _cmsUnlockMutex(p->ContextID, p->CacheMutex);
+        }
+
+        if (Owned)
+            Cache = (_cmsMULTICACHE*) p->MultiCache;
+    }
+
+    strideIn = 0;
+    strideOut = 0;
+
+    for (i = 0; i < LineCount; i++) {
+
+        accum = (cmsUInt8Number*)in + strideIn;
+        output = (cmsUInt8Number*)out + strideOut;
+
+        for (j = 0; j < PixelsPerLine; j++) {
+
+            accum = p->FromInput(p, wIn, accum, Stride->BytesPerPlaneIn);
+
+            if (Cache != NULL) {
+
+                Slot = HashPixel(wIn, nIn);
+                Hit = Cache->Valid[Slot] && memcmp(wIn, Cache->CacheIn[Slot], nIn * sizeof(cmsUInt16Number)) == 0;
+                if (Hit)
+                    memcpy(wOut, Cache->CacheOut[Slot], nOut * sizeof(cmsUInt16Number));
+            }
+            else {
+
+                Hit = memcmp(wIn, Last.CacheIn, sizeof(Last.CacheIn)) == 0;
+                if (Hit)
+                    memcpy(wOut, Last.CacheOut, sizeof(Last.CacheOut));
+            }
+
+            if (Hit) {
+
+                Hits++;
+            }
+            else {
+
+                if (p->GamutCheck != NULL)
+                    TransformOnePixelWithGamutCheck(p, wIn, wOut);
+                else
+                    p->Lut->Eval16Fn(wIn, wOut, p->Lut->Data);
+
+                if (Cache != NULL) {
+
+                    memcpy(Cache->CacheIn[Slot], wIn, nIn * sizeof(cmsUInt16Number));
+                    memcpy(Cache->CacheOut[Slot], wOut, nOut * sizeof(cmsUInt16Number));
+                    Cache->Valid[Slot] = 1;
+                }
+                else {
+
+                    memcpy(Last.CacheIn, wIn, sizeof(Last.CacheIn));
+                    memcpy(Last.CacheOut, wOut, sizeof(Last.CacheOut));
+                }
+                Misses++;
+            }
+
+            output = p->ToOutput(p, wOut, output, Stride->BytesPerPlaneOut);
+        }
+
+        strideIn += Stride->BytesPerLineIn;
+        strideOut += Stride->BytesPerLineOut;
+    }
+
+    // Counters are shared by all threads using this transform
+    if (_cmsLockMutex(p->ContextID, p->CacheMutex)) {
+
+        p->CacheHits   = SaturatedAdd(p->CacheHits, Hits);
+        p->CacheMisses = SaturatedAdd(p->CacheMisses, Misses);
+
+        if (Owned)
+            p->MultiCacheBusy = FALSE;
+
+        _cmsUnlockMutex(p->ContextID, p->CacheMutex);
+    }
+}
+
+// Fused routines --------------------------------------------------------------------------------------------------------
+
+// The layouts carrying most of the traffic get routines of their own, with unrolling and packing inlined around
+// the evaluator, so there are no calls to formatters in between. Those stand for PrecalculatedXFORM, CachedXFORM
+// and FloatXFORM, and give the same results as the stock formatters of cmspack.c do.
+
+// Bytes per pixel and channels of each layout
+#define FUSED_RGB_8_SIZE        3
+#define FUSED_RGB_8_CHANNELS    3
+#define FUSED_RGBA_8_SIZE       4
+#define FUSED_RGBA_8_CHANNELS   3
+#define FUSED_BGRA_8_SIZE       4
+#define FUSED_BGRA_8_CHANNELS   3
+#define FUSED_CMYK_8_SIZE       4
+#define FUSED_CMYK_8_CHANNELS   4
+#define FUSED_RGB_16_SIZE       6
+#define FUSED_RGB_16_CHANNELS   3
+
+cmsINLINE void FusedUnrollRGB_8(const cmsUInt8Number* accum, cmsUInt16Number wIn[])
+{
+    wIn[0] = FROM_8_TO_16(accum[0]);
+    wIn[1] = FROM_8_TO_16(accum[1]);
+    wIn[2] = FROM_8_TO_16(accum[2]);
+}
+
+cmsINLINE void FusedPackRGB_8(const cmsUInt16Number wOut[], cmsUInt8Number* output)
+{
+    output[0] = FROM_16_TO_8(wOut[0]);
+    output[1] = FROM_16_TO_8(wOut[1]);
+    output[2] = FROM_16_TO_8(wOut[2]);
+}
+
+// Alpha is skipped, it is copied by _cmsHandleExtraChannels when asked to
+#define FusedUnrollRGBA_8   FusedUnrollRGB_8
+#define FusedPackRGBA_8     FusedPackRGB_8
+
+cmsINLINE void FusedUnrollBGRA_8(const cmsUInt8Number* accum, cmsUInt16Number wIn[])
+{
+    wIn[2] = FROM_8_TO_16(accum[0]);
+    wIn[1] = FROM_8_TO_16(accum[1]);
+    wIn[0] = FROM_8_TO_16(accum[2]);
+}
+
+cmsINLINE void FusedPackBGRA_8(const cmsUInt16Number wOut[], cmsUInt8Number* output)
+{
+    output[0] = FROM_16_TO_8(wOut[2]);
+    output[1] = FROM_16_TO_8(wOut[1]);
+    output[2] = FROM_16_TO_8(wOut[0]);
+}
+
+cmsINLINE void FusedUnrollCMYK_8(const cmsUInt8Number* accum, cmsUInt16Number wIn[])
+{
+    wIn[0] = FROM_8_TO_16(accum[0]);
+    wIn[1] = FROM_8_TO_16(accum[1]);
+    wIn[2] = FROM_8_TO_16(accum[2]);
+    wIn[3] = FROM_8_TO_16(accum[3]);
+}
+
+cmsINLINE void FusedPackCMYK_8(const cmsUInt16Number wOut[], cmsUInt8Number* output)
+{
+    output[0] = FROM_16_TO_8(wOut[0]);
+    output[1] = FROM_16_TO_8(wOut[1]);
+    output[2] = FROM_16_TO_8(wOut[2]);
+    output[3] = FROM_16_TO_8(wOut[3]);
+}
+
+cmsINLINE void FusedUnrollRGB_16(const cmsUInt8Number* accum, cmsUInt16Number wIn[])
+{
+    wIn[0] = ((const cmsUInt16Number*) accum)[0];
+    wIn[1] = ((const cmsUInt16Number*) accum)[1];
+    wIn[2] = ((const cmsUInt16Number*) accum)[2];
+}
+
+cmsINLINE void FusedPackRGB_16(const cmsUInt16Number wOut[], cmsUInt8Number* output)
+{
+    ((cmsUInt16Number*) output)[0] = wOut[0];
+    ((cmsUInt16Number*) output)[1] = wOut[1];
+    ((cmsUInt16Number*) output)[2] = wOut[2];
+}
+
+// The routines for a pair of layouts, one without cache and one with the 1-pixel cache. Only the channels
+// in use take part in the cache compare, the rest of wIn is always zero.
+#define FUSED_XFORMS(IN, OUT) \
+ \
+static \
+void Fused##IN##_##OUT(_cmsTRANSFORM* p, const void* in, void* out, \
+                       cmsUInt32Number PixelsPerLine, cmsUInt32Number LineCount, const cmsStride* Stride) \
+{ \
+    _cmsPipelineEval16Fn Eval16Fn = p ->Lut ->Eval16Fn; \
+    void* Data = p ->Lut ->Data; \
+    const cmsUInt8Number* accum; \
+    cmsUInt8Number* output; \
+    cmsUInt16Number wIn[cmsMAXCHANNELS], wOut[cmsMAXCHANNELS]; \
+    size_t i, j; \
+ \
+    _cmsHandleExtraChannels(p, in, out, PixelsPerLine, LineCount, Stride); \
+ \
+    memset(wIn, 0, sizeof(wIn)); \
+    memset(wOut, 0, sizeof(wOut)); \
+ \
+    for (i = 0; i < LineCount; i++) { \
+ \
+        accum  = (const cmsUInt8Number*) in + i * Stride ->BytesPerLineIn; \
+        output = (cmsUInt8Number*) out + i * Stride ->BytesPerLineOut; \
+ \
+        for (j = 0; j < PixelsPerLine; j++) { \
+ \
+            FusedUnroll##IN(accum, wIn); \
+            Eval16Fn(wIn, wOut, Data); \
+            FusedPack##OUT(wOut, output); \
+ \
+            accum  += FUSED_##IN##_SIZE; \
+            output += FUSED_##OUT##_SIZE; \
+        } \
+    } \
+} \
+ \
+static \
+void FusedCached##IN##_##OUT(_cmsTRANSFORM* p, const void* in, void* out, \
+                             cmsUInt32Number PixelsPerLine, cmsUInt32Number LineCount, const cmsStride* Stride) \
+{ \
+    _cmsPipelineEval16Fn Eval16Fn = p ->Lut ->Eval16Fn; \
+    void* Data = p ->Lut ->Data; \
+    const cmsUInt8Number* accum; \
+    cmsUInt8Number* output; \
+    cmsUInt16Number wIn[cmsMAXCHANNELS]; \
+    cmsUInt16Number CacheIn[cmsMAXCHANNELS], CacheOut[cmsMAXCHANNELS]; \
+    size_t i, j; \
+ \
+    _cmsHandleExtraChannels(p, in, out, PixelsPerLine, LineCount, Stride); \
+ \
+    memset(wIn, 0, sizeof(wIn)); \
+ \
+    /* Get copy of zero cache */ \
+    memcpy(CacheIn, p ->Cache.CacheIn, sizeof(CacheIn)); \
+    memcpy(CacheOut, p ->Cache.CacheOut, sizeof(CacheOut)); \
+ \
+    for (i = 0; i < LineCount; i++) { \
+ \
+        accum  = (const cmsUInt8Number*) in + i * Stride ->BytesPerLineIn; \
+        output = (cmsUInt8Number*) out + i * Stride ->BytesPerLineOut; \
+ \
+        for (j = 0; j < PixelsPerLine; j++) { \
+ \
+            FusedUnroll##IN(accum, wIn); \
+ \
+            if (memcmp(wIn, CacheIn, FUSED_##IN##_CHANNELS * sizeof(cmsUInt16Number)) != 0) { \
+ \
+                Eval16Fn(wIn, CacheOut, Data); \
+                memcpy(CacheIn, wIn, FUSED_##IN##_CHANNELS * sizeof(cmsUInt16Number)); \
+            } \
+ \
+            FusedPack##OUT(CacheOut, output); \
+ \
+            accum  += FUSED_##IN##_SIZE; \
+            output += FUSED_##OUT##_SIZE; \
+        } \
+    } \
+}
+
+#define FUSED_XFORMS_FROM(IN) \
+    FUSED_XFORMS(IN, RGB_8) \
+    FUSED_XFORMS(IN, RGBA_8) \
+    FUSED_XFORMS(IN, BGRA_8) \
+    FUSED_XFORMS(IN, CMYK_8) \
+    FUSED_XFORMS(IN, RGB_16)
+
+FUSED_XFORMS_FROM(RGB_8)
+FUSED_XFORMS_FROM(RGBA_8)
+FUSED_XFORMS_FROM(BGRA_8)
+FUSED_XFORMS_FROM(CMYK_8)
+FUSED_XFORMS_FROM(RGB_16)
+
+// Floating point RGBA, with no gamut check. The stock formatters scale RGB by 1.0, that is, they just copy
+static
+void FusedFloatRGBA_FLT_RGBA_FLT(_cmsTRANSFORM* p, const void* in, void* out,
+                                 cmsUInt32Number PixelsPerLine, cmsUInt32Number LineCount, const cmsStride* Stride)
+{
+    _cmsPipelineEvalFloatFn EvalFloatFn = p ->Lut ->EvalFloatFn;
+    const cmsFloat32Number* accum;
+    cmsFloat32Number* output;
+    cmsFloat32Number fIn[cmsMAXCHANNELS], fOut[cmsMAXCHANNELS];
+    size_t i, j;
+
+    _cmsHandleExtraChannels(p, in, out, PixelsPerLine, LineCount, Stride);
+
+    memset(fIn, 0, sizeof(fIn));
+    memset(fOut, 0, sizeof(fOut));
+
+    for (i = 0; i < LineCount; i++) {
+
+        accum  = (const cmsFloat32Number*) ((const cmsUInt8Number*) in + i * Stride ->BytesPerLineIn);
+        output = (cmsFloat32Number*) ((cmsUInt8Number*) out + i * Stride ->BytesPerLineOut);
+
+        for (j = 0; j < PixelsPerLine; j++) {
+
+            fIn[0] = accum[0];
+            fIn[1] = accum[1];
+            fIn[2] = accum[2];
+
+            EvalFloatFn(fIn, fOut, p ->Lut);
+
+            output[0] = fOut[0];
+            output[1] = fOut[1];
+            output[2] = fOut[2];
+
+            accum  += 4;
+            output += 4;
+        }
+    }
+}
+
+// Which routine stands for which
+typedef struct {
+
+    cmsUInt32Number  InputFormat;       // Any colorspace, unless on floating point
+    cmsUInt32Number  OutputFormat;
+    _cmsTransform2Fn Generic;
+    _cmsTransform2Fn Fused;
+
+} _cmsFusedXform;
+
+#define FUSED_ENTRIES(IN, OUT) \
+    { TYPE_##IN, TYPE_##OUT, PrecalculatedXFORM, Fused##IN##_##OUT }, \
+    { TYPE_##IN, TYPE_##OUT, CachedXFORM, FusedCached##IN##_##OUT }
+
+#define FUSED_ENTRIES_FROM(IN) \
+    FUSED_ENTRIES(IN, RGB_8), \
+    FUSED_ENTRIES(IN, RGBA_8), \
+    FUSED_ENTRIES(IN, BGRA_8), \
+    FUSED_ENTRIES(IN, CMYK_8), \
+    FUSED_ENTRIES(IN, RGB_16)
+
+static const _cmsFusedXform FusedXforms[] = {
+
+    FUSED_ENTRIES_FROM(RGB_8),
+    FUSED_ENTRIES_FROM(RGBA_8),
+    FUSED_ENTRIES_FROM(BGRA_8),
+    FUSED_ENTRIES_FROM(CMYK_8),
+    FUSED_ENTRIES_FROM(RGB_16),
+
+    { TYPE_RGBA_FLT, TYPE_RGBA_FLT, FloatXFORM, FusedFloatRGBA_FLT_RGBA_FLT }
+};
+
+#define ANYCOLORSPACE   COLORSPACE_SH(31)
+
+// On integers the layout is what matters, as long as the formatter in use is the stock one of the layout. That
+// leaves out formatter plug-ins and the few formats, as Lab V2, having formatters of their own. Floating point
+// formatters scale by colorspace, so there the whole format should match.
+static
+cmsBool MatchFusedLayout(cmsUInt32Number Format, cmsUInt32Number Layout, cmsFormatter Current, cmsFormatterDirection Dir)
+{
+    cmsUInt32Number dwFlags = _cmsFormatterIsFloat(Layout) ? CMS_PACK_FLAGS_FLOAT : CMS_PACK_FLAGS_16BITS;
+
+    if (_cmsFormatterIsFloat(Layout)) {
+
+        if (Format != Layout) return FALSE;
+    }
+    else {
+
+        if ((Format & ~ANYCOLORSPACE) != (Layout & ~ANYCOLORSPACE)) return FALSE;
+    }
+
+    return _cmsIsStockFormatter(Current, Layout, Dir, dwFlags);
+}
+
+// Returns the fused routine standing for Generic on the transform formats, or NULL if there is none
+static
+_cmsTransform2Fn GetFusedXform(_cmsTRANSFORM* p, _cmsTransform2Fn Generic)
+{
+    cmsFormatter FromInput, ToOutput;
+    cmsUInt32Number i;
+
+    if (Generic == FloatXFORM) {
+
+        // FloatXFORM does the gamut check by itself
+        if (p ->GamutCheck != NULL) return NULL;
+
+        FromInput.FmtFloat = p ->FromInputFloat;
+        ToOutput.FmtFloat  = p ->ToOutputFloat;
+    }
+    else {
+
+        FromInput.Fmt16 = p ->FromInput;
+        ToOutput.Fmt16  = p ->ToOutput;
+    }
+
+    for (i=0; i < sizeof(FusedXforms) / sizeof(_cmsFusedXform); i++) {
+
+        const _cmsFusedXform* f = FusedXforms + i;
+
+        if (f ->Generic == Generic &&
+            MatchFusedLayout(p ->InputFormat, f ->InputFormat, FromInput, cmsFormatterInput) &&
+            MatchFusedLayout(p ->OutputFormat, f ->OutputFormat, ToOutput, cmsFormatterOutput))
+                return f ->Fused;
+    }
+
+    return NULL;
+}
+
+// Row routines ----------------------------------------------------------------------------------------------------------
+
+// Layouts having row formatters go by blocks of pixels, unpacked and packed in one call each. Pixels are kept in
+// planes in between, ROW_BLOCK_PIXELS values apart. The planes live on the stack, on top of
+// the batch buffers of the pipeline on floating point, so blocks are kept small.
+#define ROW_BLOCK_PIXELS    64
+
+// 16 bits pipelines are evaluated one pixel at time, with or without the 1-pixel cache
+cmsINLINE void EvalRow16(_cmsTRANSFORM* p, const cmsUInt16Number In[], cmsUInt16Number Out[],
+                         cmsUInt32Number n, _cmsCACHE* Cache)
+{
+    cmsUInt16Number wIn[cmsMAXCHANNELS], wOut[cmsMAXCHANNELS];
+    cmsUInt32Number nIn  = T_CHANNELS(p ->InputFormat);
+    cmsUInt32Number nOut = T_CHANNELS(p ->OutputFormat);
+    cmsUInt32Number i, c;
+
+    memset(wIn, 0, sizeof(wIn));
+    memset(wOut, 0, sizeof(wOut));
+
+    for (i=0; i < n; i++) {
+
+        for (c=0; c < nIn; c++)
+            wIn[c] = In[c * ROW_BLOCK_PIXELS + i];
+
+        if (Cache != NULL && memcmp(wIn, Cache ->CacheIn, sizeof(Cache ->CacheIn)) == 0) {
+
+            memcpy(wOut, Cache ->CacheOut, sizeof(Cache ->CacheOut));
+        }
+        else {
+
+            p ->Lut ->Eval16Fn(wIn, wOut, p ->Lut ->Data);
+
+            if (Cache != NULL) {
+                memcpy(Cache ->CacheIn, wIn, sizeof(Cache ->CacheIn));
+                memcpy(Cache ->CacheOut, wOut, sizeof(Cache ->CacheOut));
+            }
+        }
+
+        for (c=0; c < nOut; c++)
+            Out[c * ROW_BLOCK_PIXELS + i] = wOut[c];
+    }
+}
+
+cmsINLINE void DoRowXFORM16(_cmsTRANSFORM* p, const void* in, void* out,
+                            cmsUInt32Number PixelsPerLine, cmsUInt32Number LineCount, const cmsStride* Stride,
+                            cmsBool UseCache)
+{
+    cmsUInt16Number In[cmsMAXCHANNELS * ROW_BLOCK_PIXELS], Out[cmsMAXCHANNELS * ROW_BLOCK_PIXELS];
+    cmsUInt8Number* accum;
+    cmsUInt8Number* output;
+    _cmsCACHE Cache;
+    cmsUInt32Number j, n;
+    size_t i, strideIn, strideOut;
+
+    _cmsHandleExtraChannels(p, in, out, PixelsPerLine, LineCount, Stride);
+
+    // Get copy of zero cache
+    memcpy(&Cache, &p ->Cache, sizeof(Cache));
+
+    strideIn = 0;
+    strideOut = 0;
+
+    for (i = 0; i < LineCount; i++) {
+
+        accum = (cmsUInt8Number*) in + strideIn;
+        output = (cmsUInt8Number*) out + strideOut;
+
+        for (j = 0; j < PixelsPerLine; j += n) {
+
+            n = PixelsPerLine - j;
+            if (n > ROW_BLOCK_PIXELS) n = ROW_BLOCK_PIXELS;
+
+            accum = p ->FromInputRow.Row16(p, In, ROW_BLOCK_PIXELS, accum, n, Stride ->BytesPerPlaneIn);
+            EvalRow16(p, In, Out, n, UseCache ? &Cache : NULL);
+            output = p ->ToOutputRow.Row16(p, Out, ROW_BLOCK_PIXELS, output, n, Stride ->BytesPerPlaneOut);
+        }
+
+        strideIn += Stride ->BytesPerLineIn;
+        strideOut += Stride ->BytesPerLineOut;
+    }
+}
+
+// Stands for PrecalculatedXFORM
+static
+void RowXFORM(_cmsTRANSFORM* p, const void* in, void* out,
+              cmsUInt32Number PixelsPerLine, cmsUInt32Number LineCount, const cmsStride* Stride)
+{
+    DoRowXFORM16(p, in, out, PixelsPerLine, LineCount, Stride, FALSE);
+}
+
+// Stands for CachedXFORM
+static
+void CachedRowXFORM(_cmsTRANSFORM* p, const void* in, void* out,
+                    cmsUInt32Number PixelsPerLine, cmsUInt32Number LineCount, const cmsStride* Stride)
+{
+    DoRowXFORM16(p, in, out, PixelsPerLine, LineCount, Stride, TRUE);
+}
+
+// Stands for FloatXFORM with no gamut check. The whole block goes across the pipeline at once
+static
+void RowFloatXFORM(_cmsTRANSFORM* p, const void* in, void* out,
+                   cmsUInt32Number PixelsPerLine, cmsUInt32Number LineCount, const cmsStride* Stride)
+{
+    cmsFloat32Number In[cmsMAXCHANNELS * ROW_BLOCK_PIXELS], Out[cmsMAXCHANNELS * ROW_BLOCK_PIXELS];
+    cmsUInt8Number* accum;
+    cmsUInt8Number* output;
+    cmsUInt32Number j, n;
+    size_t i, strideIn, strideOut;
+
+    _cmsHandleExtraChannels(p, in, out, PixelsPerLine, LineCount, Stride);
+
+    strideIn = 0;
+    strideOut = 0;
+
+    for (i = 0; i < LineCount; i++) {
+
+        accum = (cmsUInt8Number*) in + strideIn;
+        output = (cmsUInt8Number*) out + strideOut;
+
+        for (j = 0; j < PixelsPerLine; j += n) {
+
+            n = PixelsPerLine - j;
+            if (n > ROW_BLOCK_PIXELS) n = ROW_BLOCK_PIXELS;
+
+            accum = p ->FromInputRow.RowFloat(p, In, ROW_BLOCK_PIXELS, accum, n, Stride ->BytesPerPlaneIn);
+            _cmsPipelineEvalFloatPlanar(In, Out, n, ROW_BLOCK_PIXELS, p ->Lut);
+            output = p ->ToOutputRow.RowFloat(p, Out, ROW_BLOCK_PIXELS, output, n, Stride ->BytesPerPlaneOut);
+        }
+
+        strideIn += Stride ->BytesPerLineIn;
+        strideOut += Stride ->BytesPerLineOut;
+    }
+}
+
+// Returns the row routine standing for Generic, or NULL if any of the formats lacks row formatters. FromPlugin
+// tells whatever any of the row formatters comes from a plug-in
+static
+_cmsTransform2Fn GetRowXform(_cmsTRANSFORM* p, _cmsTransform2Fn Generic, cmsBool* FromPlugin)
+{
+    _cmsTransform2Fn Row;
+    cmsUInt32Number dwFlags;
+
+    if (Generic == PrecalculatedXFORM) {
+
+        Row = RowXFORM;
+        dwFlags = CMS_PACK_FLAGS_16BITS;
+    }
+    else
+    if (Generic == CachedXFORM) {
+
+        Row = CachedRowXFORM;
+        dwFlags = CMS_PACK_FLAGS_16BITS;
+    }
+    else
+    if (Generic == FloatXFORM && p ->GamutCheck == NULL) {
+
+        Row = RowFloatXFORM;
+        dwFlags = CMS_PACK_FLAGS_FLOAT;
+    }
+    else
+        return NULL;
+
+    // Planes are filled for the channels of the format only
+    if (p ->Lut == NULL ||
+        T_CHANNELS(p ->InputFormat)  != p ->Lut ->InputChannels ||
+        T_CHANNELS(p ->OutputFormat) != p ->Lut ->OutputChannels) return NULL;
+
+    p ->FromInputRow = _cmsGetRowFormatter(p ->ContextID, p ->InputFormat, cmsFormatterInput, dwFlags);
+    p ->ToOutputRow  = _cmsGetRowFormatter(p ->ContextID, p ->OutputFormat, cmsFormatterOutput, dwFlags);
+
+    if (p ->FromInputRow.Row16 == NULL || p ->ToOutputRow.Row16 == NULL) return NULL;
+
+    *FromPlugin = p ->FromInputRow.Row16 != _cmsGetStockRowFormatter(p ->InputFormat, cmsFormatterInput, dwFlags).Row16 ||
+                  p ->ToOutputRow.Row16 != _cmsGetStockRowFormatter(p ->OutputFormat, cmsFormatterOutput, dwFlags).Row16;
+
+    return Row;
+}
+
 // Transform plug-ins ----------------------------------------------------------------------------------------------------
 
 // List of used-defined transform factories
@@ -800,7 +1677,15 @@ cmsInt32Number CMSEXPORT _cmsGetTransformMaxWorkers(struct _cmstransform_struct*
 cmsUInt32Number CMSEXPORT _cmsGetTransformWorkerFlags(struct _cmstransform_struct* CMMcargo)
 {
     _cmsAssert(CMMcargo != NULL);
-    return CMMcargo->WorkerFlags;
+    return CMMcargo->WorkerFlags;
+}
+
+// Scratch memory attached by the caller, if any
+void* CMSEXPORT _cmsGetTransformScratch(struct _cmstransform_struct* CMMcargo, cmsUInt32Number* Size)
+{
+    _cmsAssert(CMMcargo != NULL);
+    if (Size != NULL) *Size = CMMcargo->ScratchSize;
+    return CMMcargo->Scratch;
 }
 
 // In the case there is a parallelization plug-in, let it to do its job
@@ -816,9 +1701,47 @@ void ParalellizeIfSuitable(_cmsTRANSFORM* p)
         p->xform = ctx->SchedulerFn;
         p->MaxWorkers = ctx->MaxWorkers;
         p->WorkerFlags = ctx->WorkerFlags;
+        p->SchedulerScratch = ctx->ScratchSizeFn;
     }
 }
 
+// Some routines are specialized on the formats, and stand only for the plain ones, with no gamut check. Those are
+// matrix-shaper pipelines on chunky RGB, run by scanline routines, the fused routines of the commonest layouts and,
+// for the remaining layouts having row formatters, the row routines. Row formatters coming from plug-ins take
+// precedence over all built-in routines.
+// The routine picked from the flags is kept, so the choice can be done again when formats change.
+static
+void SetSpecializedXform(_cmsTRANSFORM* p)
+{
+    _cmsTransform2Fn* Fn = (p ->Worker != NULL) ? &p ->Worker : &p ->xform;
+    _cmsTransform2Fn Special = NULL;
+    _cmsTransform2Fn Row;
+    cmsBool RowFromPlugin = FALSE;
+
+    if (p ->GenericXform == NULL)
+        p ->GenericXform = *Fn;
+
+    *Fn = p ->GenericXform;
+
+    if (p ->dwOriginalFlags & cmsFLAGS_GAMUTCHECK) return;
+
+    Row = GetRowXform(p, *Fn, &RowFromPlugin);
+    if (RowFromPlugin)
+        Special = Row;
+
+    if (Special == NULL && !(p ->dwOriginalFlags & cmsFLAGS_NOOPTIMIZE) && (*Fn == PrecalculatedXFORM || *Fn == FloatXFORM))
+        Special = _cmsMatShaperXform(p ->ContextID, p ->Lut, p ->InputFormat, p ->OutputFormat);
+
+    if (Special == NULL)
+        Special = GetFusedXform(p, *Fn);
+
+    if (Special == NULL)
+        Special = Row;
+
+    if (Special != NULL)
+        *Fn = Special;
+}
+
 
 /**
 * An empty unroll to avoid a check with NULL on cmsDoTransform()
@@ -864,6 +1787,7 @@ _cmsTRANSFORM* AllocEmptyTransform(cmsContext ContextID, cmsPipeline* lut,
               cmsPipelineFree(lut);
               return NULL;
        }
+       _cmsSetMemoryKind(ContextID, p, cmsMEMORY_TRANSFORM);
 
        // Store the proposed pipeline
        p->Lut = lut;
@@ -981,6 +1905,18 @@ _cmsTRANSFORM* AllocEmptyTransform(cmsContext ContextID, cmsPipeline* lut,
             }
             else {
 
+                if (*dwFlags & cmsFLAGS_MULTICACHE) {
+
+                    p ->CacheMutex = _cmsCreateMutex(ContextID);
+                    p ->MultiCache = _cmsMallocZero(ContextID, sizeof(_cmsMULTICACHE));
+                    if (p ->CacheMutex == NULL || p ->MultiCache == NULL) {
+                        cmsDeleteTransform(p);
+                        return NULL;
+                    }
+
+                    p ->xform = MultiCachedXFORM;  // Hashed cache, with or without gamut check
+                }
+                else
                 if (*dwFlags & cmsFLAGS_GAMUTCHECK)
                     p ->xform = CachedXFORMGamutCheck;    // Gamut check, cache
                 else
@@ -1008,6 +1944,7 @@ _cmsTRANSFORM* AllocEmptyTransform(cmsContext ContextID, cmsPipeline* lut,
     p ->dwOriginalFlags = *dwFlags;
     p ->ContextID       = ContextID;
     p ->UserData        = NULL;
+    SetSpecializedXform(p);
     ParalellizeIfSuitable(p);
     return p;
 }
@@ -1119,16 +2056,17 @@ void SetWhitePoint(cmsCIEXYZ* wtPt, const cmsCIEXYZ* src)
 }
 
 // New to lcms 2.0 -- have all parameters available.
-cmsHTRANSFORM CMSEXPORT cmsCreateExtendedTransform(cmsContext ContextID,
-                                                   cmsUInt32Number nProfiles, cmsHPROFILE hProfiles[],
-                                                   cmsBool  BPC[],
-                                                   cmsUInt32Number Intents[],
-                                                   cmsFloat64Number AdaptationStates[],
-                                                   cmsHPROFILE hGamutProfile,
-                                                   cmsUInt32Number nGamutPCSposition,
-                                                   cmsUInt32Number InputFormat,
-                                                   cmsUInt32Number OutputFormat,
-                                                   cmsUInt32Number dwFlags)
+static
+cmsHTRANSFORM CreateExtendedTransform(cmsContext ContextID,
+                                      cmsUInt32Number nProfiles, cmsHPROFILE hProfiles[],
+                                      cmsBool  BPC[],
+                                      cmsUInt32Number Intents[],
+                                      cmsFloat64Number AdaptationStates[],
+                                      cmsHPROFILE hGamutProfile,
+                                      cmsUInt32Number nGamutPCSposition,
+                                      cmsUInt32Number InputFormat,
+                                      cmsUInt32Number OutputFormat,
+                                      cmsUInt32Number dwFlags)
 {
     _cmsTRANSFORM* xform;    
     cmsColorSpaceSignature EntryColorSpace;
@@ -1142,6 +2080,28 @@ cmsHTRANSFORM CMSEXPORT cmsCreateExtendedTransform(cmsContext ContextID,
         return NULL;
     }
 
+    // The transform is built on a private arena context that goes away with it
+    if (dwFlags & cmsFLAGS_ARENA) {
+
+        cmsContext Arena = _cmsCreateArenaContext(ContextID);
+        if (Arena == NULL) return NULL;
+
+        xform = (_cmsTRANSFORM*) CreateExtendedTransform(Arena, nProfiles, hProfiles, BPC, Intents, AdaptationStates,
+                                                         hGamutProfile, nGamutPCSposition, InputFormat, OutputFormat,
+                                                         dwFlags & ~cmsFLAGS_ARENA);
+        if (xform == NULL) {
+            cmsDeleteContext(Arena);
+            return NULL;
+        }
+
+        xform ->InArena = TRUE;
+        xform ->OwnerContextID = ContextID;
+
+        // Calls on the transform may come from several threads
+        _cmsSealArena(Arena);
+        return (cmsHTRANSFORM) xform;
+    }
+
     LastIntent = Intents[nProfiles - 1];
 
     // If it is a fake transform
@@ -1281,6 +2241,215 @@ cmsHTRANSFORM CMSEXPORT cmsCreateExtendedTransform(cmsContext ContextID,
     return (cmsHTRANSFORM) xform;
 }
 
+// Words needed by the cache key of a transform, see BuildCacheKey()
+#define CACHE_KEY_WORDS(n)  (10 + (n) * 8 + cmsMAXCHANNELS / 2)
+
+// Appends the ID of a profile, FALSE if the profile has none
+static
+cmsBool AddProfileID(cmsUInt32Number Key[], cmsUInt32Number* n, cmsHPROFILE hProfile)
+{
+    cmsUInt8Number ID[16];
+    cmsUInt32Number i;
+    cmsBool IsZero = TRUE;
+
+    cmsGetHeaderProfileID(hProfile, ID);
+
+    for (i=0; i < 16; i++)
+        if (ID[i] != 0) IsZero = FALSE;
+
+    if (IsZero) return FALSE;
+
+    memmove(Key + *n, ID, 16);
+    *n += 4;
+    return TRUE;
+}
+
+// Builds the key of a transform in the cache: everything that goes into its creation. Alarm codes are
+// copied from the context when the transform is built, so they are part of the key as well. Returns the
+// length in words, or zero if the transform cannot be cached.
+static
+cmsUInt32Number BuildCacheKey(cmsContext ContextID, cmsUInt32Number Key[],
+                              cmsUInt32Number nProfiles, cmsHPROFILE hProfiles[],
+                              cmsBool  BPC[],
+                              cmsUInt32Number Intents[],
+                              cmsFloat64Number AdaptationStates[],
+                              cmsHPROFILE hGamutProfile,
+                              cmsUInt32Number nGamutPCSposition,
+                              cmsUInt32Number InputFormat,
+                              cmsUInt32Number OutputFormat,
+                              cmsUInt32Number dwFlags)
+{
+    cmsUInt16Number AlarmCodes[cmsMAXCHANNELS];
+    cmsUInt32Number i, n = 0;
+
+    if (nProfiles <= 0 || nProfiles > 255) return 0;
+    if (dwFlags & cmsFLAGS_NULLTRANSFORM) return 0;
+
+    Key[n++] = nProfiles;
+    Key[n++] = InputFormat;
+    Key[n++] = OutputFormat;
+    Key[n++] = dwFlags;
+    Key[n++] = nGamutPCSposition;
+
+    if ((dwFlags & cmsFLAGS_GAMUTCHECK) && hGamutProfile != NULL) {
+
+        Key[n++] = 1;
+        if (!AddProfileID(Key, &n, hGamutProfile)) return 0;
+    }
+    else {
+
+        Key[n++] = 0;
+        memset(Key + n, 0, 16);
+        n += 4;
+    }
+
+    for (i=0; i < nProfiles; i++) {
+
+        if (hProfiles[i] == NULL) return 0;
+        if (!AddProfileID(Key, &n, hProfiles[i])) return 0;
+
+        Key[n++] = BPC[i] ? 1 : 0;
+        Key[n++] = Intents[i];
+        memmove(Key + n, &AdaptationStates[i], sizeof(cmsFloat64Number));
+        n += 2;
+    }
+
+    cmsGetAlarmCodesTHR(ContextID, AlarmCodes);
+    memmove(Key + n, AlarmCodes, sizeof(AlarmCodes));
+    n += cmsMAXCHANNELS / 2;
+
+    return n;
+}
+
+// FNV-1a on the key
+static
+cmsUInt32Number HashCacheKey(const cmsUInt32Number Key[], cmsUInt32Number KeyLen)
+{
+    cmsUInt32Number h = 2166136261U;
+    cmsUInt32Number i;
+
+    for (i=0; i < KeyLen; i++) {
+
+        h ^= Key[i];
+        h *= 16777619U;
+    }
+
+    return h;
+}
+
+// Goes through the transform cache of the context when enabled. Transforms coming from the cache are
+// shared, so they cannot be changed afterwards (cmsChangeBuffersFormat, cmsSetTransformScratch)
+cmsHTRANSFORM CMSEXPORT cmsCreateExtendedTransform(cmsContext ContextID,
+                                                   cmsUInt32Number nProfiles, cmsHPROFILE hProfiles[],
+                                                   cmsBool  BPC[],
+                                                   cmsUInt32Number Intents[],
+                                                   cmsFloat64Number AdaptationStates[],
+                                                   cmsHPROFILE hGamutProfile,
+                                                   cmsUInt32Number nGamutPCSposition,
+                                                   cmsUInt32Number InputFormat,
+                                                   cmsUInt32Number OutputFormat,
+                                                   cmsUInt32Number dwFlags)
+{
+    _cmsTransformCacheChunkType* Cache = (_cmsTransformCacheChunkType*) _cmsContextGetClientChunk(ContextID, TransformCacheContext);
+    cmsUInt32Number* Key;
+    cmsUInt32Number KeyLen, Hash;
+    _cmsTransformCacheEntry* e;
+    _cmsTransformCacheEntry* Evicted;
+    _cmsTRANSFORM* xform;
+    _cmsTRANSFORM* Found;
+
+    if (Cache ->Mutex == NULL || Cache ->MaxEntries == 0)
+        goto NotCached;
+
+    // Wrong counts are reported by the creation itself
+    if (nProfiles <= 0 || nProfiles > 255)
+        goto NotCached;
+
+    // The key goes to the cache entry if the transform gets there
+    Key = (cmsUInt32Number*) _cmsMalloc(ContextID, CACHE_KEY_WORDS(nProfiles) * sizeof(cmsUInt32Number));
+    if (Key == NULL)
+        goto NotCached;
+
+    KeyLen = BuildCacheKey(ContextID, Key, nProfiles, hProfiles, BPC, Intents, AdaptationStates,
+                           hGamutProfile, nGamutPCSposition, InputFormat, OutputFormat, dwFlags);
+    if (KeyLen == 0) {
+        _cmsFree(ContextID, Key);
+        goto NotCached;
+    }
+
+    Hash = HashCacheKey(Key, KeyLen);
+
+    if (!_cmsLockMutex(ContextID, Cache ->Mutex)) {
+        _cmsFree(ContextID, Key);
+        goto NotCached;
+    }
+
+    Found = LookupCache(Cache, Key, KeyLen, Hash);
+    _cmsUnlockMutex(ContextID, Cache ->Mutex);
+
+    if (Found != NULL) {
+        _cmsFree(ContextID, Key);
+        return (cmsHTRANSFORM) Found;
+    }
+
+    // Build it out of the lock, this is the slow part
+    xform = (_cmsTRANSFORM*) CreateExtendedTransform(ContextID, nProfiles, hProfiles, BPC, Intents, AdaptationStates,
+                                                     hGamutProfile, nGamutPCSposition, InputFormat, OutputFormat, dwFlags);
+    if (xform == NULL) {
+        _cmsFree(ContextID, Key);
+        return NULL;
+    }
+
+    e = (_cmsTransformCacheEntry*) _cmsMallocZero(ContextID, sizeof(_cmsTransformCacheEntry));
+    if (e == NULL) {
+        _cmsFree(ContextID, Key);
+        return (cmsHTRANSFORM) xform;
+    }
+
+    e ->Key = Key;
+    e ->Hash = Hash;
+    e ->KeyLen = KeyLen;
+    e ->Transform = xform;
+
+    if (!_cmsLockMutex(ContextID, Cache ->Mutex)) {
+
+        e ->Transform = NULL;
+        FreeEvicted(ContextID, e);
+        return (cmsHTRANSFORM) xform;
+    }
+
+    // Some other thread may have built the same transform meanwhile
+    Found = LookupCache(Cache, Key, KeyLen, Hash);
+    if (Found == NULL) {
+
+        xform ->Shared = TRUE;
+        xform ->RefCount = 2;   // Caller and cache
+
+        e ->Next = Cache ->Head;
+        Cache ->Head = e;
+        Cache ->nEntries++;
+    }
+
+    Evicted = TrimCache(Cache, Cache ->MaxEntries);
+
+    _cmsUnlockMutex(ContextID, Cache ->Mutex);
+
+    FreeEvicted(ContextID, Evicted);
+
+    // Ours is not needed then
+    if (Found != NULL) {
+
+        FreeEvicted(ContextID, e);
+        return (cmsHTRANSFORM) Found;
+    }
+
+    return (cmsHTRANSFORM) xform;
+
+NotCached:
+    return CreateExtendedTransform(ContextID, nProfiles, hProfiles, BPC, Intents, AdaptationStates,
+                                   hGamutProfile, nGamutPCSposition, InputFormat, OutputFormat, dwFlags);
+}
+
 // Multiprofile transforms: Gamut check is not available here, as it is unclear from which profile the gamut comes.
 cmsHTRANSFORM CMSEXPORT cmsCreateMultiprofileTransformTHR(cmsContext ContextID,
                                                        cmsHPROFILE hProfiles[],
@@ -1421,7 +2590,7 @@ cmsContext CMSEXPORT cmsGetTransformContextID(cmsHTRANSFORM hTransform)
     _cmsTRANSFORM* xform = (_cmsTRANSFORM*) hTransform;
 
     if (xform == NULL) return NULL;
-    return xform -> ContextID;
+    return OwnerContext(xform);
 }
 
 // Grab the input/output formats
@@ -1457,6 +2626,324 @@ cmsPipeline* CMSEXPORT cmsGetTransformGamutCheckPipeline(cmsHTRANSFORM hTransfor
     return xform->GamutCheck;
 }
 
+// Returns the hit/miss counters of the multi-entry cache
+cmsBool CMSEXPORT cmsGetTransformCacheStats(cmsHTRANSFORM hTransform, cmsUInt32Number* Hits, cmsUInt32Number* Misses)
+{
+    _cmsTRANSFORM* xform = (_cmsTRANSFORM*) hTransform;
+    cmsUInt32Number h = 0, m = 0;
+    cmsBool rc = FALSE;
+
+    if (xform != NULL && xform->CacheMutex != NULL) {
+
+        if (_cmsLockMutex(xform->ContextID, xform->CacheMutex)) {
+
+            h = xform->CacheHits;
+            m = xform->CacheMisses;
+            rc = TRUE;
+
+            _cmsUnlockMutex(xform->ContextID, xform->CacheMutex);
+        }
+    }
+
+    if (Hits != NULL) *Hits = h;
+    if (Misses != NULL) *Misses = m;
+
+    return rc;
+}
+
+// Sets the hit/miss counters back to zero
+void CMSEXPORT cmsResetTransformCacheStats(cmsHTRANSFORM hTransform)
+{
+    _cmsTRANSFORM* xform = (_cmsTRANSFORM*) hTransform;
+
+    if (xform == NULL || xform->CacheMutex == NULL) return;
+
+    if (_cmsLockMutex(xform->ContextID, xform->CacheMutex)) {
+
+        xform->CacheHits = 0;
+        xform->CacheMisses = 0;
+
+        _cmsUnlockMutex(xform->ContextID, xform->CacheMutex);
+    }
+}
+
+// Attaches caller-owned scratch memory, or detaches it if Buffer is NULL. Buffers too small for a
+// given routine are just ignored by it.
+cmsBool CMSEXPORT cmsSetTransformScratch(cmsHTRANSFORM hTransform, void* Buffer, cmsUInt32Number BufferSize)
+{
+    _cmsTRANSFORM* xform = (_cmsTRANSFORM*) hTransform;
+    cmsUInt32Number Skip;
+
+    if (xform == NULL) return FALSE;
+
+    // Calls on a shared transform may overlap
+    if (xform ->Shared) {
+
+        cmsSignalError(xform ->ContextID, cmsERROR_NOT_SUITABLE, "Scratch memory cannot be attached to cached transforms");
+        return FALSE;
+    }
+
+    if (Buffer == NULL || BufferSize == 0) {
+
+        xform->Scratch = NULL;
+        xform->ScratchSize = 0;
+        return TRUE;
+    }
+
+    // Keep it aligned
+    Skip = (cmsUInt32Number) (_cmsALIGNMEM((size_t) Buffer) - (size_t) Buffer);
+    if (BufferSize <= Skip) {
+
+        cmsSignalError(xform->ContextID, cmsERROR_RANGE, "Scratch buffer too small");
+        return FALSE;
+    }
+
+    xform->Scratch = (cmsUInt8Number*) Buffer + Skip;
+    xform->ScratchSize = BufferSize - Skip;
+
+    // Workers do not use the scratch memory, it belongs to the scheduler then
+    if (xform->Worker == NULL && xform->CacheMutex != NULL && xform->ScratchSize >= sizeof(_cmsMULTICACHE))
+        InitMultiCache((_cmsMULTICACHE*) xform->Scratch, xform);
+
+    return TRUE;
+}
+
+// Size of scratch memory this transform can use, including room for alignment. When parallelized, that is
+// what the scheduler asks for, as the built-in routines leave the scratch memory alone then. Zero if the
+// transform does not need any.
+cmsUInt32Number CMSEXPORT cmsGetTransformScratchSize(cmsHTRANSFORM hTransform)
+{
+    _cmsTRANSFORM* xform = (_cmsTRANSFORM*) hTransform;
+    cmsUInt32Number Size = 0;
+
+    if (xform == NULL) return 0;
+
+    if (xform->Worker != NULL) {
+
+        if (xform->SchedulerScratch != NULL)
+            Size = xform->SchedulerScratch(xform);
+    }
+    else {
+
+        if (xform->CacheMutex != NULL)
+            Size = (cmsUInt32Number) sizeof(_cmsMULTICACHE);
+    }
+
+    return (Size == 0) ? 0 : Size + CMS_PTR_ALIGNMENT;
+}
+
+// Transform blobs ---------------------------------------------------------------------------------------------------
+
+#define TRANSFORM_BLOB_MAGIC     0x6C637866     // 'lcxf'
+#define TRANSFORM_BLOB_VERSION   1
+
+// Only the built-in 16 bits routines are known to depend on nothing but the pipeline
+static
+cmsBool IsSerializableTransform(_cmsTRANSFORM* p)
+{
+    // Routines specialized on the formats are picked again on load
+    _cmsTransform2Fn Fn = p ->GenericXform;
+
+    if (p ->Lut == NULL || p ->GamutCheck != NULL || p ->OldXform != NULL) return FALSE;
+
+    // Blobs whose formats do not match the pipeline are refused on load
+    if (T_CHANNELS(p ->InputFormat)  != cmsPipelineInputChannels(p ->Lut) ||
+        T_CHANNELS(p ->OutputFormat) != cmsPipelineOutputChannels(p ->Lut)) return FALSE;
+
+    return Fn == NullXFORM || Fn == PrecalculatedXFORM || Fn == CachedXFORM || Fn == MultiCachedXFORM;
+}
+
+static
+cmsBool WriteTransformBlob(cmsIOHANDLER* io, _cmsTRANSFORM* p)
+{
+    // Built-in payloads are portable, the kernels are selected again for the host on load,
+    // so they need no CPU feature at all
+    cmsUInt32Number Requires = 0;
+
+    if (!_cmsWriteUInt32Number(io, TRANSFORM_BLOB_MAGIC)) return FALSE;
+    if (!_cmsWriteUInt32Number(io, TRANSFORM_BLOB_VERSION)) return FALSE;
+    if (!_cmsWriteUInt32Number(io, LCMS_VERSION)) return FALSE;
+    if (!_cmsWriteUInt32Number(io, Requires)) return FALSE;
+
+    if (!_cmsWriteUInt32Number(io, p ->InputFormat)) return FALSE;
+    if (!_cmsWriteUInt32Number(io, p ->OutputFormat)) return FALSE;
+    if (!_cmsWriteUInt32Number(io, p ->dwOriginalFlags)) return FALSE;
+    if (!_cmsWriteUInt32Number(io, p ->RenderingIntent)) return FALSE;
+    if (!_cmsWriteUInt32Number(io, (cmsUInt32Number) p ->EntryColorSpace)) return FALSE;
+    if (!_cmsWriteUInt32Number(io, (cmsUInt32Number) p ->ExitColorSpace)) return FALSE;
+
+    if (!_cmsWriteFloat64Bits(io, p ->AdaptationState)) return FALSE;
+    if (!_cmsWriteFloat64Bits(io, p ->EntryWhitePoint.X)) return FALSE;
+    if (!_cmsWriteFloat64Bits(io, p ->EntryWhitePoint.Y)) return FALSE;
+    if (!_cmsWriteFloat64Bits(io, p ->EntryWhitePoint.Z)) return FALSE;
+    if (!_cmsWriteFloat64Bits(io, p ->ExitWhitePoint.X)) return FALSE;
+    if (!_cmsWriteFloat64Bits(io, p ->ExitWhitePoint.Y)) return FALSE;
+    if (!_cmsWriteFloat64Bits(io, p ->ExitWhitePoint.Z)) return FALSE;
+
+    return _cmsWriteOptimizedPipeline(io, p ->Lut);
+}
+
+// Saves the optimized pipeline, formats and parameters of a transform. If MemPtr is NULL, only
+// the needed size is computed. Colorant tables and the profile sequence are not kept.
+cmsBool CMSEXPORT cmsSaveTransformToMem(cmsHTRANSFORM hTransform, void* MemPtr, cmsUInt32Number* BytesNeeded)
+{
+    _cmsTRANSFORM* p = (_cmsTRANSFORM*) hTransform;
+    cmsIOHANDLER* io;
+    cmsUInt32Number Size;
+    cmsBool rc;
+
+    _cmsAssert(BytesNeeded != NULL);
+
+    if (p == NULL) return FALSE;
+
+    if (!IsSerializableTransform(p)) {
+
+        cmsSignalError(p ->ContextID, cmsERROR_NOT_SUITABLE, "Only built-in 16 bits transforms without gamut check can be saved");
+        return FALSE;
+    }
+
+    // Writes to the NULL handler never fail, so this tells apart pipelines that cannot be stored
+    io = cmsOpenIOhandlerFromNULL(p ->ContextID);
+    if (io == NULL) return FALSE;
+
+    rc = WriteTransformBlob(io, p);
+    Size = io ->UsedSpace;
+    cmsCloseIOhandler(io);
+
+    if (!rc) {
+
+        cmsSignalError(p ->ContextID, cmsERROR_NOT_SUITABLE, "Transform pipeline is not optimized by a built-in optimization");
+        return FALSE;
+    }
+
+    if (MemPtr == NULL) {
+
+        *BytesNeeded = Size;
+        return TRUE;
+    }
+
+    // Memory handlers would silently truncate the blob
+    if (*BytesNeeded < Size) {
+
+        cmsSignalError(p ->ContextID, cmsERROR_RANGE, "Buffer too small for transform blob, %u bytes needed", Size);
+        return FALSE;
+    }
+
+    io = cmsOpenIOhandlerFromMem(p ->ContextID, MemPtr, *BytesNeeded, "w");
+    if (io == NULL) return FALSE;
+
+    rc = WriteTransformBlob(io, p);
+    if (!rc)
+        cmsSignalError(p ->ContextID, cmsERROR_WRITE, "Error writing transform blob");
+
+    rc &= cmsCloseIOhandler(io);
+    return rc;
+}
+
+// Rebuilds a transform saved by cmsSaveTransformToMem. No profile is read nor any optimization run,
+// the blob must come from the same library version and not depend on CPU features the host lacks.
+cmsHTRANSFORM CMSEXPORT cmsLoadTransformFromMemTHR(cmsContext ContextID, const void* MemPtr, cmsUInt32Number dwSize)
+{
+    cmsIOHANDLER* io;
+    cmsUInt32Number Magic, Version, LibVersion, Requires;
+    cmsUInt32Number InputFormat, OutputFormat, dwFlags, Intent, EntryColorSpace, ExitColorSpace;
+    cmsFloat64Number AdaptationState;
+    cmsCIEXYZ EntryWhitePoint, ExitWhitePoint;
+    cmsPipeline* Lut = NULL;
+    _cmsTRANSFORM* xform;
+
+    io = cmsOpenIOhandlerFromMem(ContextID, (void*) MemPtr, dwSize, "r");
+    if (io == NULL) return NULL;
+
+    if (!_cmsReadUInt32Number(io, &Magic) || Magic != TRANSFORM_BLOB_MAGIC) {
+
+        cmsSignalError(ContextID, cmsERROR_BAD_SIGNATURE, "Not a transform blob");
+        goto Error;
+    }
+
+    if (!_cmsReadUInt32Number(io, &Version) || !_cmsReadUInt32Number(io, &LibVersion) ||
+        Version != TRANSFORM_BLOB_VERSION || LibVersion != LCMS_VERSION) {
+
+        cmsSignalError(ContextID, cmsERROR_NOT_SUITABLE, "Transform blob was saved by a different version");
+        goto Error;
+    }
+
+    if (!_cmsReadUInt32Number(io, &Requires) || (Requires & ~cmsGetCPUFeatures(ContextID)) != 0) {
+
+        cmsSignalError(ContextID, cmsERROR_NOT_SUITABLE, "Transform blob needs CPU features this host lacks");
+        goto Error;
+    }
+
+    if (!_cmsReadUInt32Number(io, &InputFormat) ||
+        !_cmsReadUInt32Number(io, &OutputFormat) ||
+        !_cmsReadUInt32Number(io, &dwFlags) ||
+        !_cmsReadUInt32Number(io, &Intent) ||
+        !_cmsReadUInt32Number(io, &EntryColorSpace) ||
+        !_cmsReadUInt32Number(io, &ExitColorSpace) ||
+        !_cmsReadFloat64Bits(io, &AdaptationState) ||
+        !_cmsReadFloat64Bits(io, &EntryWhitePoint.X) ||
+        !_cmsReadFloat64Bits(io, &EntryWhitePoint.Y) ||
+        !_cmsReadFloat64Bits(io, &EntryWhitePoint.Z) ||
+        !_cmsReadFloat64Bits(io, &ExitWhitePoint.X) ||
+        !_cmsReadFloat64Bits(io, &ExitWhitePoint.Y) ||
+        !_cmsReadFloat64Bits(io, &ExitWhitePoint.Z)) goto Corrupted;
+
+    if (_cmsFormatterIsFloat(InputFormat) || _cmsFormatterIsFloat(OutputFormat) ||
+        (dwFlags & cmsFLAGS_GAMUTCHECK)) goto Corrupted;
+
+    Lut = _cmsReadOptimizedPipeline(ContextID, io);
+    if (Lut == NULL) goto Corrupted;
+
+    // The routines picked on the formats take the channels of the pipeline for granted
+    if (T_CHANNELS(InputFormat)  != cmsPipelineInputChannels(Lut) ||
+        T_CHANNELS(OutputFormat) != cmsPipelineOutputChannels(Lut)) {
+
+        cmsPipelineFree(Lut);
+        goto Corrupted;
+    }
+
+    cmsCloseIOhandler(io);
+    io = NULL;
+
+    // The pipeline is already optimized, so let only the routines and formatters to be set
+    xform = AllocEmptyTransform(ContextID, NULL, Intent, &InputFormat, &OutputFormat, &dwFlags);
+    if (xform == NULL) {
+        cmsPipelineFree(Lut);
+        return NULL;
+    }
+
+    xform ->Lut             = Lut;
+    xform ->RenderingIntent = Intent;
+    xform ->AdaptationState = AdaptationState;
+    xform ->EntryColorSpace = (cmsColorSpaceSignature) EntryColorSpace;
+    xform ->ExitColorSpace  = (cmsColorSpaceSignature) ExitColorSpace;
+    xform ->EntryWhitePoint = EntryWhitePoint;
+    xform ->ExitWhitePoint  = ExitWhitePoint;
+
+    SetSpecializedXform(xform);
+
+    // Seed the cache, as cmsCreateExtendedTransform does
+    if (!(dwFlags & cmsFLAGS_NOCACHE)) {
+
+        memset(&xform ->Cache.CacheIn, 0, sizeof(xform ->Cache.CacheIn));
+        xform ->Lut ->Eval16Fn(xform ->Cache.CacheIn, xform ->Cache.CacheOut, xform ->Lut ->Data);
+    }
+
+    return (cmsHTRANSFORM) xform;
+
+Corrupted:
+    cmsSignalError(ContextID, cmsERROR_CORRUPTION_DETECTED, "Corrupted transform blob");
+
+Error:
+    if (io != NULL) cmsCloseIOhandler(io);
+    return NULL;
+}
+
+cmsHTRANSFORM CMSEXPORT cmsLoadTransformFromMem(const void* MemPtr, cmsUInt32Number dwSize)
+{
+    return cmsLoadTransformFromMemTHR(NULL, MemPtr, dwSize);
+}
+
 // For backwards compatibility
 cmsBool CMSEXPORT cmsChangeBuffersFormat(cmsHTRANSFORM hTransform,
                                          cmsUInt32Number InputFormat,
@@ -1465,6 +2952,12 @@ cmsBool CMSEXPORT cmsChangeBuffersFormat(cmsHTRANSFORM hTransform,
     _cmsTRANSFORM* xform = (_cmsTRANSFORM*) hTransform;
     cmsFormatter16 FromInput, ToOutput;
 
+    // Transforms from the cache are shared by several holders
+    if (xform ->Shared) {
+
+        cmsSignalError(xform ->ContextID, cmsERROR_NOT_SUITABLE, "cmsChangeBuffersFormat cannot be used on cached transforms");
+        return FALSE;
+    }
 
     // We only can afford to change formatters if previous transform is at least 16 bits
     if (!(xform ->dwOriginalFlags & cmsFLAGS_CAN_CHANGE_FORMATTER)) {
@@ -1486,6 +2979,12 @@ cmsBool CMSEXPORT cmsChangeBuffersFormat(cmsHTRANSFORM hTransform,
     xform ->OutputFormat = OutputFormat;
     xform ->FromInput    = FromInput;
     xform ->ToOutput     = ToOutput;
+
+    // Routines specialized on the old formats won't do. Matrix-shaper scanline routines, for instance, are
+    // bound to the sample size they were picked for
+    if (xform ->GenericXform != NULL)
+        SetSpecializedXform(xform);
+
     return TRUE;
 }
 
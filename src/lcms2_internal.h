@@ -95,6 +95,12 @@
 #   define CMS_NO_SANITIZE 
 #endif
 
+// SSE2 is part of the x86-64 baseline, vectorized code is built whenever the compiler targets it
+#if !defined(CMS_DONT_USE_SSE2) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#   define CMS_USE_SSE2 1
+#   include <emmintrin.h>
+#endif
+
 // Other replacement functions
 #ifdef _MSC_VER
 # ifndef snprintf
@@ -401,6 +407,44 @@ cmsINLINE int _cmsLeaveCriticalSectionPrimitive(_cmsMutex *m)
 }
 #endif
 
+// Publishing flags ------------------------------------------------------------------
+
+// A flag set with release semantics guarantees whatever was written before is seen by any
+// thread that reads the flag with acquire semantics. This allows lock-free readers of tables
+// that are filled on demand.
+#if defined(CMS_NO_PTHREADS)
+
+cmsINLINE cmsUInt8Number _cmsLoadAcquire8(const volatile cmsUInt8Number* p)         { return *p; }
+cmsINLINE void           _cmsStoreRelease8(volatile cmsUInt8Number* p, cmsUInt8Number v) { *p = v; }
+
+#elif defined(__GNUC__) || defined(__clang__)
+
+cmsINLINE cmsUInt8Number _cmsLoadAcquire8(const volatile cmsUInt8Number* p)         { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+cmsINLINE void           _cmsStoreRelease8(volatile cmsUInt8Number* p, cmsUInt8Number v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+
+#elif defined(CMS_IS_WINDOWS_)
+
+cmsINLINE cmsUInt8Number _cmsLoadAcquire8(const volatile cmsUInt8Number* p)
+{
+    cmsUInt8Number v = *p;
+    MemoryBarrier();
+    return v;
+}
+
+cmsINLINE void _cmsStoreRelease8(volatile cmsUInt8Number* p, cmsUInt8Number v)
+{
+    MemoryBarrier();
+    *p = v;
+}
+
+#else
+
+// Other compilers: volatile access only, which is enough on strongly ordered CPUs
+cmsINLINE cmsUInt8Number _cmsLoadAcquire8(const volatile cmsUInt8Number* p)         { return *p; }
+cmsINLINE void           _cmsStoreRelease8(volatile cmsUInt8Number* p, cmsUInt8Number v) { *p = v; }
+
+#endif
+
 // Plug-In registration ---------------------------------------------------------------
 
 // Specialized function for plug-in memory management. No pairing free() since whole pool is freed at once.
@@ -417,6 +461,7 @@ cmsBool  _cmsRegisterParametricCurvesPlugin(cmsContext ContextID, cmsPluginBase*
 
 // Formatters management
 cmsBool  _cmsRegisterFormattersPlugin(cmsContext ContextID, cmsPluginBase* Plugin);
+cmsBool  _cmsRegisterFormattersRowPlugin(cmsContext ContextID, cmsPluginBase* Plugin);
 
 // Tag type management
 cmsBool  _cmsRegisterTagTypePlugin(cmsContext ContextID, cmsPluginBase* Plugin);
@@ -490,6 +535,8 @@ typedef enum {
     TransformPlugin,
     MutexPlugin,
     ParallelizationPlugin,
+    CPUFeaturesContext,
+    TransformCacheContext,
 
     // Last in list
     MemoryClientMax
@@ -507,11 +554,26 @@ typedef struct {
     _cmsCallocFnPtrType     CallocPtr;
     _cmsDupFnPtrType        DupPtr;
 
+    void*                   Arena;        // Set when the context is an arena, see _cmsInstallArena()
+    void*                   Stats;        // Set when memory is accounted, see cmsEnableMemoryStats()
+
 } _cmsMemPluginChunkType;
 
 // Copy memory management function pointers from plug-in to chunk, taking care of missing routines
 void  _cmsInstallAllocFunctions(cmsPluginMemHandler* Plugin, _cmsMemPluginChunkType* ptr);
 
+// Arena contexts. Memory is released all at once when the context is deleted
+cmsBool    _cmsInstallArena(cmsContext ContextID);
+void       _cmsFreeArena(cmsContext ContextID);
+cmsContext _cmsCreateArenaContext(cmsContext ContextID);
+void       _cmsSealArena(cmsContext ContextID);
+cmsContext _cmsGetArenaOwner(cmsContext ContextID);
+
+// Memory accounting. Tags a block with the kind of object it belongs to
+void       _cmsSetMemoryKind(cmsContext ContextID, const void* Ptr, cmsUInt32Number Kind);
+void       _cmsUnaccountMemory(cmsContext ContextID, const void* Ptr);
+void       _cmsFreeMemoryStats(cmsContext ContextID);
+
 // Internal structure for context
 struct _cmsContext_struct {
     
@@ -528,6 +590,10 @@ struct _cmsContext_struct {
 // Verifies the magic number.
 struct _cmsContext_struct* _cmsGetContext(cmsContext ContextID);
 
+// Process-wide lock for the registry of shared profiles
+cmsBool _cmsLockSharedProfiles(void);
+void    _cmsUnlockSharedProfiles(void);
+
 // Returns the block assigned to the specific zone. 
 void*     _cmsContextGetClientChunk(cmsContext id, _cmsMemoryClient mc);
 
@@ -618,6 +684,7 @@ void _cmsAllocCurvesPluginChunk(struct _cmsContext_struct* ctx,
 typedef struct {
 
     struct _cms_formatters_factory_list* FactoryList;
+    struct _cms_formatters_row_factory_list* RowFactoryList;
 
 } _cmsFormattersPluginChunkType;
 
@@ -731,6 +798,9 @@ typedef struct {
     cmsInt32Number      MaxWorkers;       // Number of workers to do as maximum
     cmsInt32Number      WorkerFlags;      // reserved
     _cmsTransform2Fn    SchedulerFn;      // callback to setup functions 
+    _cmsSchedulerShutdownFn ShutdownFn;   // optional, releases per-context resources
+    _cmsRunTasksFn      RunTasksFn;       // optional, runs independent tasks
+    _cmsSchedulerScratchFn ScratchSizeFn; // optional, scratch memory the scheduler can use
     
 } _cmsParallelizationPluginChunkType;
 
@@ -741,6 +811,58 @@ extern  _cmsParallelizationPluginChunkType _cmsParallelizationPluginChunk;
 void _cmsAllocParallelizationPluginChunk(struct _cmsContext_struct* ctx,
                                          const struct _cmsContext_struct* src);
 
+// Runs the tasks through the parallelization plug-in if it knows how, or serially otherwise
+void _cmsRunTasks(cmsContext ContextID, _cmsTaskFn Fn, void* Cargo, cmsUInt32Number nTasks);
+
+// Container for CPU features -- not a plug-in
+typedef struct {
+
+    cmsUInt32Number Mask;       // Features kernels are allowed to use on this context
+
+} _cmsCPUFeaturesChunkType;
+
+// The global Context0 storage for CPU features
+extern  _cmsCPUFeaturesChunkType _cmsCPUFeaturesChunk;
+
+// Allocate and init CPU features container.
+void _cmsAllocCPUFeaturesChunk(struct _cmsContext_struct* ctx,
+                               const struct _cmsContext_struct* src);
+
+// Container for the cache of shared transforms -- not a plug-in
+typedef struct {
+
+    cmsUInt32Number MaxEntries;     // Zero if disabled
+    cmsUInt32Number nEntries;
+    void*           Mutex;          // Created when the cache is enabled
+
+    struct _cmsTransformCacheEntry_st* Head;    // Most recently used first
+
+} _cmsTransformCacheChunkType;
+
+// The global Context0 storage for the transform cache
+extern  _cmsTransformCacheChunkType _cmsTransformCacheChunk;
+
+// Allocate and init the transform cache container. Duplicated contexts start with the cache disabled
+void _cmsAllocTransformCacheChunk(struct _cmsContext_struct* ctx,
+                                  const struct _cmsContext_struct* src);
+
+// Drops all cached transforms and the mutex, called on context deletion
+void _cmsFreeTransformCache(cmsContext ContextID);
+
+// Kernel registry. Tables list the implementations of a kernel from best to worst, and
+// end with an entry that requires no feature at all. Entries are cast back by the caller.
+typedef void (* _cmsKernelFn)(void);
+
+typedef struct {
+
+    cmsUInt32Number Requires;   // cmsCPU_* flags the kernel needs
+    _cmsKernelFn    Kernel;
+
+} _cmsKernelEntry;
+
+// Returns the first kernel the context can run
+_cmsKernelFn _cmsSelectKernel(cmsContext ContextID, const _cmsKernelEntry Table[], cmsUInt32Number nEntries);
+
 
 
 // ----------------------------------------------------------------------------------
@@ -801,6 +923,9 @@ struct _cms_NAMEDCOLORLIST_struct {
 // Maximum supported tags in a profile
 #define MAX_TABLE_TAG       100
 
+// Slots in the hash indexing the tag directory. Power of two, and big enough to never fill up with MAX_TABLE_TAG tags
+#define TAG_HASH_SIZE       256
+
 typedef struct _cms_iccprofile_struct {
 
     // I/O handler
@@ -841,12 +966,18 @@ typedef struct _cms_iccprofile_struct {
     cmsTagTypeHandler*       TagTypeHandlers[MAX_TABLE_TAG];     // Same structure may be serialized on different types
                                                                  // depending on profile version, so we keep track of the
                                                                  // type handler for each tag in the list.
+    cmsUInt8Number           TagHash[TAG_HASH_SIZE];             // Open addressing index on TagNames. Position + 1, 0=empty
+    volatile cmsUInt8Number  TagCooked[MAX_TABLE_TAG];           // Set once TagPtrs holds the cooked tag. Read without locking.
     // Special
     cmsBool                  IsWrite;
 
     // Keep a mutex for cmsReadTag -- Note that this only works if the user includes a mutex plugin
     void *                   UsrMutex;
 
+    // Shared profiles registry. References held on this handle, 0 if not shared.
+    cmsUInt32Number          SharedRefs;
+    struct _cms_iccprofile_struct* SharedNext;
+
 } _cmsICCPROFILE;
 
 // IO helpers for profiles
@@ -896,6 +1027,10 @@ struct _cms_curve_struct {
 //  Pipelines & Stages ---------------------------------------------------------------------------------------------
 
 // A single stage
+// Evaluates a block of pixels stored planar: channel c of pixel i is at [c * Stride + i]
+typedef void (* _cmsStageEvalBatchFn)(const cmsFloat32Number In[], cmsFloat32Number Out[],
+                                      cmsUInt32Number nPixels, cmsUInt32Number Stride, const cmsStage* mpe);
+
 struct _cmsStage_struct {
 
     cmsContext          ContextID;
@@ -915,6 +1050,9 @@ struct _cmsStage_struct {
 
     // Maintains linked list (used internally)
     struct _cmsStage_struct* Next;
+
+    // Optional evaluator for blocks of pixels. If NULL, EvalPtr is called once per pixel
+    _cmsStageEvalBatchFn EvalBatchPtr;
 };
 
 
@@ -956,6 +1094,9 @@ struct _cmsPipeline_struct {
     cmsBool  SaveAs8Bits;            // Implementation-specific: save as 8 bits if possible
 };
 
+// Evaluates nPixels kept in planes, one per channel and Stride values apart. Same results as cmsPipelineEvalFloat
+void _cmsPipelineEvalFloatPlanar(const cmsFloat32Number In[], cmsFloat32Number Out[], cmsUInt32Number nPixels, cmsUInt32Number Stride, const cmsPipeline* lut);
+
 // LUT reading & creation -------------------------------------------------------------------------------------------
 
 // Read tags using low-level function, provide necessary glue code to adapt versions, etc. All those return a brand new copy
@@ -1007,6 +1148,15 @@ CMSAPI cmsBool CMSEXPORT _cmsOptimizePipeline(cmsContext ContextID,
                                       cmsUInt32Number* OutputFormat,
                                       cmsUInt32Number* dwFlags );
 
+// Serialization of pipelines optimized by the built-in optimizations, used by transform blobs
+cmsBool          _cmsWriteOptimizedPipeline(cmsIOHANDLER* io, const cmsPipeline* Lut);
+cmsPipeline*     _cmsReadOptimizedPipeline(cmsContext ContextID, cmsIOHANDLER* io);
+cmsBool          _cmsWriteFloat64Bits(cmsIOHANDLER* io, cmsFloat64Number d);
+cmsBool          _cmsReadFloat64Bits(cmsIOHANDLER* io, cmsFloat64Number* d);
+
+// Scanline routines for matrix-shaper pipelines on chunky RGB, selected once the pipeline is optimized
+_cmsTransform2Fn _cmsMatShaperXform(cmsContext ContextID, const cmsPipeline* Lut, cmsUInt32Number InputFormat, cmsUInt32Number OutputFormat);
+
 
 // Hi level LUT building ----------------------------------------------------------------------------------------------
 
@@ -1031,6 +1181,13 @@ CMSCHECKPOINT cmsFormatter CMSEXPORT _cmsGetFormatter(cmsContext ContextID,
                                                       cmsFormatterDirection Dir,
                                                       cmsUInt32Number dwFlags);
 
+// Tells whatever Fn is the built-in formatter _cmsGetFormatter() reverts to when no plug-in claims the format
+cmsBool         _cmsIsStockFormatter(cmsFormatter Fn, cmsUInt32Number Type, cmsFormatterDirection Dir, cmsUInt32Number dwFlags);
+
+// Row formatters. Plug-ins come first. The built-in ones give the same values as the per-pixel formatters of the format
+cmsFormatterRow _cmsGetRowFormatter(cmsContext ContextID, cmsUInt32Number Type, cmsFormatterDirection Dir, cmsUInt32Number dwFlags);
+cmsFormatterRow _cmsGetStockRowFormatter(cmsUInt32Number Type, cmsFormatterDirection Dir, cmsUInt32Number dwFlags);
+
 
 #ifndef CMS_NO_HALF_SUPPORT 
 
@@ -1062,6 +1219,9 @@ typedef struct _cmstransform_struct {
     // Points to transform code
     _cmsTransform2Fn xform;
 
+    // The routine picked from the flags, before any replacement specialized on the formats
+    _cmsTransform2Fn GenericXform;
+
     // Formatters, cannot be embedded into LUT because cache
     cmsFormatter16 FromInput;
     cmsFormatter16 ToOutput;
@@ -1069,6 +1229,10 @@ typedef struct _cmstransform_struct {
     cmsFormatterFloat FromInputFloat;
     cmsFormatterFloat ToOutputFloat;
 
+    // Row formatters, set when the row routines are in use
+    cmsFormatterRow FromInputRow;
+    cmsFormatterRow ToOutputRow;
+
     // 1-pixel cache seed for zero as input (16 bits, read only)
     _cmsCACHE Cache;
 
@@ -1113,6 +1277,29 @@ typedef struct _cmstransform_struct {
     _cmsTransform2Fn Worker;
     cmsInt32Number   MaxWorkers;
     cmsUInt32Number  WorkerFlags;
+    _cmsSchedulerScratchFn SchedulerScratch;
+
+    // Hit/miss counters of the multi-entry cache (cmsFLAGS_MULTICACHE only)
+    void*            CacheMutex;
+    cmsUInt32Number  CacheHits;
+    cmsUInt32Number  CacheMisses;
+
+    // The multi-entry cache itself, taken by one call at a time. Guarded by CacheMutex
+    void*            MultiCache;
+    cmsBool          MultiCacheBusy;
+
+    // Caller-owned scratch memory, see cmsSetTransformScratch()
+    void*            Scratch;
+    cmsUInt32Number  ScratchSize;
+
+    // Transforms handed out by the transform cache are shared, and released when the count drops to zero
+    cmsBool          Shared;
+    cmsUInt32Number  RefCount;
+
+    // Transforms created with cmsFLAGS_ARENA live in a private arena context, ContextID, which goes away
+    // with them. OwnerContextID is the context they were created in
+    cmsBool          InArena;
+    cmsContext       OwnerContextID;
 
 } _cmsTRANSFORM;
 
@@ -72,6 +72,9 @@ void* chknull(void* mem)
 // maximum requested as a single block and maximum allocated at a given time. Results are printed at the end
 static cmsUInt32Number SingleHit, MaxAllocated=0, TotalMemory=0;
 
+// Number of allocations so far, used to check code paths that should not allocate
+static cmsUInt32Number AllocCount = 0;
+
 // I'm hiding the size before the block. This is a well-known technique and probably the blocks coming from
 // malloc are built in a way similar to that, but I do on my own to be portable.
 typedef struct {
@@ -117,6 +120,7 @@ void* DebugMalloc(cmsContext ContextID, cmsUInt32Number size)
     }
 
     TotalMemory += size;
+    AllocCount++;
 
     if (TotalMemory > MaxAllocated)
         MaxAllocated = TotalMemory;
@@ -4263,6 +4267,191 @@ cmsInt32Number CheckFormattersHalf(void)
 
 #endif
 
+// Row formatters should give the same values as the per-pixel ones, on every layout they take
+#define ROW_PIXELS 37
+
+static
+cmsUInt32Number RowRandom(cmsUInt32Number* Seed)
+{
+    *Seed = *Seed * 1103515245U + 12345U;
+    return *Seed >> 8;
+}
+
+// Fills a buffer with values the formatters of Type can read back
+static
+void FillRowBuffer(cmsUInt8Number* Buffer, cmsUInt32Number Type, cmsUInt32Number Size, cmsUInt32Number* Seed)
+{
+    cmsUInt32Number i;
+
+    if (!T_FLOAT(Type)) {
+
+        for (i=0; i < Size; i++)
+            Buffer[i] = (cmsUInt8Number) RowRandom(Seed);
+        return;
+    }
+
+#ifndef CMS_NO_HALF_SUPPORT
+    if (T_BYTES(Type) == 2) {
+
+        for (i=0; i < Size / 2; i++)
+            ((cmsUInt16Number*) Buffer)[i] = _cmsFloat2Half((cmsFloat32Number) (RowRandom(Seed) % 1000) / 10.0F);
+        return;
+    }
+#endif
+
+    for (i=0; i < Size / 4; i++)
+        ((cmsFloat32Number*) Buffer)[i] = (cmsFloat32Number) RowRandom(Seed) / 167772.16F;
+}
+
+static
+int CheckOneRowFormatter(cmsUInt32Number Type, cmsUInt32Number dwFlags, cmsUInt32Number* nChecked)
+{
+    cmsUInt32Number nChan = T_CHANNELS(Type);
+    cmsUInt32Number BytesPerPlane = ROW_PIXELS * T_BYTES(Type);
+    cmsUInt32Number Size = (nChan + T_EXTRA(Type)) * BytesPerPlane;
+    cmsUInt8Number  Buffer[cmsMAXCHANNELS * ROW_PIXELS * 4], Ref[cmsMAXCHANNELS * ROW_PIXELS * 4];
+    cmsFloat32Number PlanesF[cmsMAXCHANNELS * ROW_PIXELS], RefF[cmsMAXCHANNELS * ROW_PIXELS], wF[cmsMAXCHANNELS];
+    cmsUInt16Number Planes16[cmsMAXCHANNELS * ROW_PIXELS], Ref16[cmsMAXCHANNELS * ROW_PIXELS], w16[cmsMAXCHANNELS];
+    cmsUInt32Number i, c, Seed = Type;
+    cmsUInt8Number *Ptr, *RowPtr;
+    cmsFormatter f, b;
+    cmsFormatterRow rf, rb;
+    _cmsTRANSFORM info;
+
+    memset(&info, 0, sizeof(info));
+    info.InputFormat = info.OutputFormat = Type;
+
+    f  = _cmsGetFormatter(DbgThread(), Type, cmsFormatterInput, dwFlags);
+    b  = _cmsGetFormatter(DbgThread(), Type, cmsFormatterOutput, dwFlags);
+    rf = _cmsGetRowFormatter(DbgThread(), Type, cmsFormatterInput, dwFlags);
+    rb = _cmsGetRowFormatter(DbgThread(), Type, cmsFormatterOutput, dwFlags);
+
+    if (f.Fmt16 != NULL && rf.Row16 != NULL) {
+
+        FillRowBuffer(Buffer, Type, Size, &Seed);
+
+        Ptr = Buffer;
+        for (i=0; i < ROW_PIXELS; i++) {
+
+            if (dwFlags == CMS_PACK_FLAGS_FLOAT) {
+
+                Ptr = f.FmtFloat(&info, wF, Ptr, BytesPerPlane);
+                for (c=0; c < nChan; c++) RefF[c * ROW_PIXELS + i] = wF[c];
+            }
+            else {
+
+                Ptr = f.Fmt16(&info, w16, Ptr, BytesPerPlane);
+                for (c=0; c < nChan; c++) Ref16[c * ROW_PIXELS + i] = w16[c];
+            }
+        }
+
+        if (dwFlags == CMS_PACK_FLAGS_FLOAT)
+            RowPtr = rf.RowFloat(&info, PlanesF, ROW_PIXELS, Buffer, ROW_PIXELS, BytesPerPlane);
+        else
+            RowPtr = rf.Row16(&info, Planes16, ROW_PIXELS, Buffer, ROW_PIXELS, BytesPerPlane);
+
+        if (RowPtr != Ptr ||
+            (dwFlags == CMS_PACK_FLAGS_FLOAT ? memcmp(PlanesF, RefF, nChan * ROW_PIXELS * sizeof(cmsFloat32Number)) :
+                                               memcmp(Planes16, Ref16, nChan * ROW_PIXELS * sizeof(cmsUInt16Number))) != 0) {
+
+            Fail("Row unroll differs on format 0x%x", Type);
+            return 0;
+        }
+
+        (*nChecked)++;
+    }
+
+    if (b.Fmt16 != NULL && rb.Row16 != NULL) {
+
+        for (i=0; i < nChan * ROW_PIXELS; i++) {
+
+            PlanesF[i]  = (cmsFloat32Number) (RowRandom(&Seed) % 12000) / 10000.0F - 0.1F;
+            Planes16[i] = (cmsUInt16Number) RowRandom(&Seed);
+        }
+
+        // Samples of extra channels should survive
+        FillRowBuffer(Ref, Type, Size, &Seed);
+        memcpy(Buffer, Ref, Size);
+
+        Ptr = Ref;
+        for (i=0; i < ROW_PIXELS; i++) {
+
+            if (dwFlags == CMS_PACK_FLAGS_FLOAT) {
+
+                for (c=0; c < nChan; c++) wF[c] = PlanesF[c * ROW_PIXELS + i];
+                Ptr = b.FmtFloat(&info, wF, Ptr, BytesPerPlane);
+            }
+            else {
+
+                for (c=0; c < nChan; c++) w16[c] = Planes16[c * ROW_PIXELS + i];
+                Ptr = b.Fmt16(&info, w16, Ptr, BytesPerPlane);
+            }
+        }
+
+        if (dwFlags == CMS_PACK_FLAGS_FLOAT)
+            RowPtr = rb.RowFloat(&info, PlanesF, ROW_PIXELS, Buffer, ROW_PIXELS, BytesPerPlane);
+        else
+            RowPtr = rb.Row16(&info, Planes16, ROW_PIXELS, Buffer, ROW_PIXELS, BytesPerPlane);
+
+        if (RowPtr - Buffer != Ptr - Ref || memcmp(Buffer, Ref, Size) != 0) {
+
+            Fail("Row pack differs on format 0x%x", Type);
+            return 0;
+        }
+
+        (*nChecked)++;
+    }
+
+    return 1;
+}
+
+static
+cmsInt32Number CheckRowFormatters(void)
+{
+    static const cmsUInt32Number Kinds[][2] = {
+
+        { CMS_PACK_FLAGS_16BITS, BYTES_SH(1) },
+        { CMS_PACK_FLAGS_16BITS, BYTES_SH(2) },
+        { CMS_PACK_FLAGS_FLOAT,  BYTES_SH(1) },
+        { CMS_PACK_FLAGS_FLOAT,  BYTES_SH(2) },
+        { CMS_PACK_FLAGS_FLOAT,  FLOAT_SH(1)|BYTES_SH(2) },
+        { CMS_PACK_FLAGS_FLOAT,  FLOAT_SH(1)|BYTES_SH(4) }
+    };
+    static const cmsUInt32Number Channels[] = { 1, 2, 3, 4, 5, 6, 8 };
+    cmsUInt32Number k, s, c, Extra, Bits, Type, nChecked = 0;
+
+    for (k=0; k < sizeof(Kinds) / sizeof(Kinds[0]); k++)
+    for (s=0; s < 2; s++)
+    for (c=0; c < sizeof(Channels) / sizeof(Channels[0]); c++)
+    for (Extra=0; Extra < 3; Extra++)
+    for (Bits=0; Bits < 32; Bits++) {
+
+        Type = Kinds[k][1] | COLORSPACE_SH(s ? PT_CMYK : PT_RGB) | CHANNELS_SH(Channels[c]) | EXTRA_SH(Extra) |
+               PLANAR_SH(Bits & 1) | DOSWAP_SH((Bits >> 1) & 1) | SWAPFIRST_SH((Bits >> 2) & 1) |
+               FLAVOR_SH((Bits >> 3) & 1) | ENDIAN16_SH((Bits >> 4) & 1);
+
+        if (!CheckOneRowFormatter(Type, Kinds[k][0], &nChecked)) return 0;
+    }
+
+    // The commonest layouts should be there
+    if (_cmsGetRowFormatter(DbgThread(), TYPE_RGBA_8, cmsFormatterInput, CMS_PACK_FLAGS_16BITS).Row16 == NULL ||
+        _cmsGetRowFormatter(DbgThread(), TYPE_CMYK_16_PLANAR, cmsFormatterOutput, CMS_PACK_FLAGS_16BITS).Row16 == NULL ||
+        _cmsGetRowFormatter(DbgThread(), TYPE_BGRA_FLT, cmsFormatterInput, CMS_PACK_FLAGS_FLOAT).RowFloat == NULL) {
+
+        Fail("Missing row formatters");
+        return 0;
+    }
+
+    // Lab V2 has formatters of its own
+    if (_cmsGetRowFormatter(DbgThread(), TYPE_LabV2_8, cmsFormatterInput, CMS_PACK_FLAGS_16BITS).Row16 != NULL) {
+
+        Fail("Row formatter on Lab V2");
+        return 0;
+    }
+
+    return nChecked > 1000;
+}
+
 static
 cmsInt32Number CheckOneRGB(cmsHTRANSFORM xform, cmsUInt16Number R, cmsUInt16Number G, cmsUInt16Number B, cmsUInt16Number Ro, cmsUInt16Number Go, cmsUInt16Number Bo)
 {
@@ -8070,870 +8259,2757 @@ cmsInt32Number CheckRemoveTag(void)
 }
 
 
+// Private tags filling most of the directory, some of them linked, deleted and written again
+#define TAGDIR_SIG(n)  ((cmsTagSignature) (0x7A7A0000U + (cmsUInt32Number) (n)))
+#define TAGDIR_COUNT   80
+
 static
-cmsInt32Number CheckMatrixSimplify(void)
+cmsInt32Number CheckTagDirectoryContents(cmsHPROFILE h, cmsBool Reopened)
 {
-     
-       cmsHPROFILE pIn;
-       cmsHPROFILE pOut;
-       cmsHTRANSFORM t;
-       unsigned char buf[3] = { 127, 32, 64 };
+    cmsUInt32Number Data, i;
 
-       
-       pIn = cmsCreate_sRGBProfile();
-       pOut = cmsOpenProfileFromFile("ibm-t61.icc", "r");
-       if (pIn == NULL || pOut == NULL)
-              return 0;
+    for (i=0; i < TAGDIR_COUNT; i++) {
 
-       t = cmsCreateTransform(pIn, TYPE_RGB_8, pOut, TYPE_RGB_8, INTENT_PERCEPTUAL, 0);
-       cmsDoTransformStride(t, buf, buf, 1, 1);
-       cmsDeleteTransform(t);
-       cmsCloseProfile(pIn);
-       cmsCloseProfile(pOut);
-      
+        cmsTagSignature sig = TAGDIR_SIG(i);
+        cmsBool Deleted = (i % 7) == 3 && !Reopened;   // Written again later only on the saved profile
 
-       return buf[0] == 144 && buf[1] == 0 && buf[2] == 69;
-}
+        if (cmsIsTag(h, sig) == Deleted) return 0;
+        if (Deleted) continue;
 
+        if (cmsReadRawTag(h, sig, &Data, sizeof(Data)) != sizeof(Data)) return 0;
 
+        // Linked tags share the data of the first tag, unless deleted and written again
+        if (Data != (((i % 10) == 9 && (i % 7) != 3) ? 0 : i)) return 0;
+    }
+
+    // Never written
+    if (cmsIsTag(h, TAGDIR_SIG(TAGDIR_COUNT))) return 0;
+    if (cmsIsTag(h, TAGDIR_SIG(0x10000))) return 0;
+
+    return 1;
+}
 
 static
-cmsInt32Number CheckTransformLineStride(void)
+cmsInt32Number CheckTagDirectory(void)
 {
+    cmsHPROFILE h, h2;
+    cmsUInt32Number i, Data, Size;
+    void* Mem;
+    cmsInt32Number rc = 1;
 
-       cmsHPROFILE pIn;
-       cmsHPROFILE pOut;
-       cmsHTRANSFORM t;
-
-       // Our buffer is formed by 4 RGB8 lines, each line is 2 pixels wide plus a padding of one byte
+    h = cmsCreateProfilePlaceholder(DbgThread());
 
-       cmsUInt8Number buf1[]= { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0,
-                                0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0, 
-                                0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0, 
-                                0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0, };
+    for (i=0; i < TAGDIR_COUNT; i++) {
 
-       // Our buffer2 is formed by 4 RGBA lines, each line is 2 pixels wide plus a padding of one byte
+        if ((i % 10) == 9) {
+            if (!cmsLinkTag(h, TAGDIR_SIG(i), TAGDIR_SIG(0))) rc = 0;
+        }
+        else {
+            Data = i;
+            if (!cmsWriteRawTag(h, TAGDIR_SIG(i), &Data, sizeof(Data))) rc = 0;
+        }
+    }
 
-       cmsUInt8Number buf2[] = { 0xff, 0xff, 0xff, 1, 0xff, 0xff, 0xff, 1, 0,
-                                 0xff, 0xff, 0xff, 1, 0xff, 0xff, 0xff, 1, 0,
-                                 0xff, 0xff, 0xff, 1, 0xff, 0xff, 0xff, 1, 0,
-                                 0xff, 0xff, 0xff, 1, 0xff, 0xff, 0xff, 1, 0};
+    for (i=3; i < TAGDIR_COUNT; i += 7)
+        if (!cmsWriteTag(h, TAGDIR_SIG(i), NULL)) rc = 0;
 
-       // Our buffer3 is formed by 4 RGBA16 lines, each line is 2 pixels wide plus a padding of two bytes
+    if (!CheckTagDirectoryContents(h, FALSE)) rc = 0;
 
-       cmsUInt16Number buf3[] = { 0xffff, 0xffff, 0xffff, 0x0101, 0xffff, 0xffff, 0xffff, 0x0101, 0,
-                                  0xffff, 0xffff, 0xffff, 0x0101, 0xffff, 0xffff, 0xffff, 0x0101, 0,
-                                  0xffff, 0xffff, 0xffff, 0x0101, 0xffff, 0xffff, 0xffff, 0x0101, 0,
-                                  0xffff, 0xffff, 0xffff, 0x0101, 0xffff, 0xffff, 0xffff, 0x0101, 0 };
+    // Writing deleted tags again takes new positions
+    for (i=3; i < TAGDIR_COUNT; i += 7) {
 
-       cmsUInt8Number out[1024];
+        Data = i;
+        if (!cmsWriteRawTag(h, TAGDIR_SIG(i), &Data, sizeof(Data))) rc = 0;
+    }
 
+    if (cmsGetTagCount(h) != TAGDIR_COUNT + (TAGDIR_COUNT + 3) / 7) rc = 0;
 
-       memset(out, 0, sizeof(out));
-       pIn = cmsCreate_sRGBProfile();
-       pOut = cmsOpenProfileFromFile("ibm-t61.icc", "r");
-       if (pIn == NULL || pOut == NULL)
-              return 0;
+    // Up to a full directory
+    Data = 0;
+    for (i = (cmsUInt32Number) cmsGetTagCount(h); i < 100; i++)
+        if (!cmsWriteRawTag(h, TAGDIR_SIG(0x100 + i), &Data, sizeof(Data))) rc = 0;
 
-       t = cmsCreateTransform(pIn, TYPE_RGB_8, pOut, TYPE_RGB_8, INTENT_PERCEPTUAL, cmsFLAGS_COPY_ALPHA);
-       
-       cmsDoTransformLineStride(t, buf1, out, 2, 4, 7, 7, 0, 0);
-       cmsDeleteTransform(t);
+    cmsSetLogErrorHandler(ErrorReportingFunction);
+    if (cmsWriteRawTag(h, TAGDIR_SIG(0x1000), &Data, sizeof(Data))) rc = 0;
+    cmsSetLogErrorHandler(FatalErrorQuit);
 
-       if (memcmp(out, buf1, sizeof(buf1)) != 0) {
-              Fail("Failed transform line stride on RGB8");
-              cmsCloseProfile(pIn);
-              cmsCloseProfile(pOut);
-              return 0;
-       }
+    if (!TrappedError) rc = 0;
+    TrappedError = FALSE;
 
-       memset(out, 0, sizeof(out));
+    if (!cmsSaveProfileToMem(h, NULL, &Size)) rc = 0;
+    Mem = chknull(malloc(Size));
+    if (!cmsSaveProfileToMem(h, Mem, &Size)) rc = 0;
+    cmsCloseProfile(h);
 
-       t = cmsCreateTransform(pIn, TYPE_RGBA_8, pOut, TYPE_RGBA_8, INTENT_PERCEPTUAL, cmsFLAGS_COPY_ALPHA);
-       
-       cmsDoTransformLineStride(t, buf2, out, 2, 4, 9, 9, 0, 0);
+    h2 = cmsOpenProfileFromMemTHR(DbgThread(), Mem, Size);
+    if (h2 == NULL) rc = 0;
+    else {
 
-       cmsDeleteTransform(t);
+        if (!CheckTagDirectoryContents(h2, TRUE)) rc = 0;
+        cmsCloseProfile(h2);
+    }
 
+    free(Mem);
+    return rc;
+}
 
-       if (memcmp(out, buf2, sizeof(buf2)) != 0) {
-              cmsCloseProfile(pIn);
-              cmsCloseProfile(pOut);
-              Fail("Failed transform line stride on RGBA8");
-              return 0;
-       }
 
-       memset(out, 0, sizeof(out));
+// Profiles opened on a mapped file and on borrowed memory should be the same as when opened from the file
+static
+cmsInt32Number CheckOneMappedProfile(cmsHPROFILE hProfile, const cmsUInt8Number* RefSaved, cmsUInt32Number RefSize, const cmsUInt16Number* RefLab)
+{
+    cmsHPROFILE hLab = cmsCreateLab4ProfileTHR(DbgThread(), NULL);
+    cmsHTRANSFORM xform;
+    cmsUInt16Number CMYK[4 * 8], Lab[3 * 8];
+    cmsUInt8Number* Saved;
+    cmsUInt32Number i, Size;
+    cmsInt32Number rc = 1;
 
-       t = cmsCreateTransform(pIn, TYPE_RGBA_16, pOut, TYPE_RGBA_16, INTENT_PERCEPTUAL, cmsFLAGS_COPY_ALPHA);
+    if (hProfile == NULL) return 0;
 
-       cmsDoTransformLineStride(t, buf3, out, 2, 4, 18, 18, 0, 0);
+    if (!cmsSaveProfileToMem(hProfile, NULL, &Size) || Size != RefSize) rc = 0;
+    else {
+        Saved = (cmsUInt8Number*) chknull(malloc(Size));
+        if (!cmsSaveProfileToMem(hProfile, Saved, &Size) || memcmp(Saved, RefSaved, Size) != 0) rc = 0;
+        free(Saved);
+    }
 
-       cmsDeleteTransform(t);
+    for (i=0; i < 4 * 8; i++)
+        CMYK[i] = (cmsUInt16Number) (i * 2039);
 
-       if (memcmp(out, buf3, sizeof(buf3)) != 0) {
-              cmsCloseProfile(pIn);
-              cmsCloseProfile(pOut);
-              Fail("Failed transform line stride on RGBA16");
-              return 0;
-       }
+    xform = cmsCreateTransformTHR(DbgThread(), hProfile, TYPE_CMYK_16, hLab, TYPE_Lab_16, INTENT_PERCEPTUAL, 0);
+    if (xform == NULL) rc = 0;
+    else {
+        cmsDoTransform(xform, CMYK, Lab, 8);
+        cmsDeleteTransform(xform);
 
+        if (RefLab != NULL && memcmp(Lab, RefLab, sizeof(Lab)) != 0) rc = 0;
+    }
 
-       memset(out, 0, sizeof(out));
+    cmsCloseProfile(hLab);
+    cmsCloseProfile(hProfile);
+    return rc;
+}
 
+static
+cmsInt32Number CheckMappedProfiles(void)
+{
+    cmsHPROFILE h;
+    cmsHPROFILE hLab;
+    cmsHTRANSFORM xform;
+    cmsUInt8Number *Buffer, *RefSaved;
+    cmsUInt16Number CMYK[4 * 8], RefLab[3 * 8];
+    cmsUInt32Number i, Size, RefSize;
+    FILE* f;
+    cmsInt32Number rc = 1;
 
-       // From 8 to 16
-       t = cmsCreateTransform(pIn, TYPE_RGBA_8, pOut, TYPE_RGBA_16, INTENT_PERCEPTUAL, cmsFLAGS_COPY_ALPHA);
+    f = fopen("test1.icc", "rb");
+    if (f == NULL) return 0;
+    fseek(f, 0, SEEK_END);
+    Size = (cmsUInt32Number) ftell(f);
+    fseek(f, 0, SEEK_SET);
+    Buffer = (cmsUInt8Number*) chknull(malloc(Size));
+    if (fread(Buffer, 1, Size, f) != Size) rc = 0;
+    fclose(f);
 
-       cmsDoTransformLineStride(t, buf2, out, 2, 4, 9, 18, 0, 0);
+    // Reference, as from the file
+    h = cmsOpenProfileFromFileTHR(DbgThread(), "test1.icc", "r");
+    cmsSaveProfileToMem(h, NULL, &RefSize);
+    RefSaved = (cmsUInt8Number*) chknull(malloc(RefSize));
+    cmsSaveProfileToMem(h, RefSaved, &RefSize);
 
-       cmsDeleteTransform(t);
+    for (i=0; i < 4 * 8; i++)
+        CMYK[i] = (cmsUInt16Number) (i * 2039);
 
-       if (memcmp(out, buf3, sizeof(buf3)) != 0) {
-              cmsCloseProfile(pIn);
-              cmsCloseProfile(pOut);
-              Fail("Failed transform line stride on RGBA16");
-              return 0;
-       }
+    hLab = cmsCreateLab4ProfileTHR(DbgThread(), NULL);
+    xform = cmsCreateTransformTHR(DbgThread(), h, TYPE_CMYK_16, hLab, TYPE_Lab_16, INTENT_PERCEPTUAL, 0);
+    cmsDoTransform(xform, CMYK, RefLab, 8);
+    cmsDeleteTransform(xform);
+    cmsCloseProfile(hLab);
+    cmsCloseProfile(h);
 
+    if (!CheckOneMappedProfile(cmsOpenProfileFromMappedFileTHR(DbgThread(), "test1.icc"), RefSaved, RefSize, RefLab)) rc = 0;
+    if (!CheckOneMappedProfile(cmsOpenProfileFromBorrowedMemTHR(DbgThread(), Buffer, Size), RefSaved, RefSize, RefLab)) rc = 0;
 
+    // Borrowed memory is read only
+    h = cmsOpenProfileFromBorrowedMemTHR(DbgThread(), Buffer, Size);
+    cmsSetLogErrorHandler(ErrorReportingFunction);
+    if (cmsGetProfileIOhandler(h) ->Write(cmsGetProfileIOhandler(h), 4, "abcd")) rc = 0;
+    if (cmsOpenProfileFromMappedFileTHR(DbgThread(), "nonexistent.icc") != NULL) rc = 0;
+    cmsSetLogErrorHandler(FatalErrorQuit);
+    cmsCloseProfile(h);
 
-       cmsCloseProfile(pIn);
-       cmsCloseProfile(pOut);
+    if (!TrappedError) rc = 0;
+    TrappedError = FALSE;
 
-       return 1;
+    free(RefSaved);
+    free(Buffer);
+    return rc;
 }
 
-
+// Cooked tags are served from the cache, and the cache follows writes and deletions
 static
-int CheckPlanar8opt(void)
+cmsInt32Number CheckCookedTags(void)
 {
-    cmsHPROFILE aboveRGB = Create_AboveRGB();
-    cmsHPROFILE sRGB = cmsCreate_sRGBProfile();
-
-    cmsHTRANSFORM transform = cmsCreateTransform(sRGB, TYPE_RGB_8_PLANAR,
-        aboveRGB, TYPE_RGB_8_PLANAR,
-        INTENT_PERCEPTUAL, 0);
+    cmsHPROFILE h;
+    cmsCIEXYZ* wp1, *wp2;
+    cmsCIEXYZ NewWp = { 0.5, 0.6, 0.7 };
+    cmsInt32Number rc = 1;
 
-    cmsDeleteTransform(transform);
-    cmsCloseProfile(aboveRGB);
-    cmsCloseProfile(sRGB);
+    h = cmsOpenProfileFromFileTHR(DbgThread(), "test1.icc", "r");
+    if (h == NULL) return 0;
 
-    return 1;
-}
+    wp1 = (cmsCIEXYZ*) cmsReadTag(h, cmsSigMediaWhitePointTag);
+    wp2 = (cmsCIEXYZ*) cmsReadTag(h, cmsSigMediaWhitePointTag);
+    if (wp1 == NULL || wp1 != wp2) rc = 0;
 
-/**
-* Bug reported from float32 to uint16 planar
-*/
-#define TYPE_RGB_FLT_PLANAR   (FLOAT_SH(1)|COLORSPACE_SH(PT_RGB)|CHANNELS_SH(3)|BYTES_SH(4)|PLANAR_SH(1))
+    // A rewrite replaces the cached object
+    if (!cmsWriteTag(h, cmsSigMediaWhitePointTag, &NewWp)) rc = 0;
+    wp1 = (cmsCIEXYZ*) cmsReadTag(h, cmsSigMediaWhitePointTag);
+    if (wp1 == NULL || !IsGoodVal("Cached X", wp1 ->X, 0.5, 1E-6)) rc = 0;
 
-static
-int CheckPlanarFloat2int(void)
-{    
-    cmsHPROFILE sRGB = cmsCreate_sRGBProfile();
+    // A deletion drops it
+    if (!cmsWriteTag(h, cmsSigMediaWhitePointTag, NULL)) rc = 0;
+    if (cmsReadTag(h, cmsSigMediaWhitePointTag) != NULL) rc = 0;
 
-    cmsHTRANSFORM transform = cmsCreateTransform(sRGB, TYPE_RGB_FLT_PLANAR,
-        sRGB, TYPE_RGB_16_PLANAR,INTENT_PERCEPTUAL, 0);
+    // Raw tags never come back cooked
+    if (!cmsWriteRawTag(h, cmsSigMediaWhitePointTag, "abcd", 4)) rc = 0;
+    cmsSetLogErrorHandler(ErrorReportingFunction);
+    if (cmsReadTag(h, cmsSigMediaWhitePointTag) != NULL) rc = 0;
+    cmsSetLogErrorHandler(FatalErrorQuit);
+    TrappedError = FALSE;
 
-    const cmsFloat32Number input[] = { 0.0f, 0.4f, 0.8f,  0.1f, 0.5f, 0.9f,  0.2f, 0.6f, 1.0f,   0.3f, 0.7f, 1.0f };
-    cmsUInt16Number output[3*4] = { 0 };
+    cmsCloseProfile(h);
+    return rc;
+}
 
-    cmsDoTransform(transform, input, output, 4);
+// All known tags are decoded on request, after that they are read from memory
+static
+cmsInt32Number CheckReadAllTags(void)
+{
+    cmsHPROFILE h;
+    _cmsICCPROFILE* Icc;
+    cmsUInt32Number i;
+    cmsInt32Number rc = 1;
 
-    cmsDeleteTransform(transform);    
+    h = cmsOpenProfileFromFileTHR(DbgThread(), "test1.icc", "r");
+    if (h == NULL) return 0;
+    Icc = (_cmsICCPROFILE*) h;
+
+    // A private tag is not decoded, nor does it count as a failure
+    if (!cmsWriteRawTag(h, (cmsTagSignature) 0x70726976, "abcdefgh", 8)) rc = 0;
+
+    if (!cmsReadAllTags(h)) rc = 0;
+
+    for (i=0; i < Icc ->TagCount; i++) {
+
+        if (Icc ->TagSaveAsRaw[i] || Icc ->TagLinked[i]) continue;
+        if (!Icc ->TagCooked[i] || Icc ->TagPtrs[i] == NULL) rc = 0;
+    }
+
+    if (cmsReadTag(h, cmsSigAToB0Tag) != Icc ->TagPtrs[_cmsSearchTag(Icc, cmsSigAToB0Tag, TRUE)]) rc = 0;
+
+    cmsCloseProfile(h);
+    return rc;
+}
+
+// Identical profiles resolve to the same read only handle, released on last close
+static
+cmsInt32Number CheckSharedProfiles(void)
+{
+    cmsHPROFILE h, h1, h2, h3, hOther, hLab;
+    cmsHTRANSFORM xform;
+    cmsUInt8Number* Mem;
+    cmsUInt32Number Size, SharedSize, Intent;
+    cmsUInt16Number CMYK[4] = { 0x1000, 0x2000, 0x3000, 0x4000 }, Lab[3];
+    cmsCIEXYZ Wp = { 0.5, 0.5, 0.5 };
+    cmsProfileID ID, ID2;
+    cmsInt32Number rc = 1;
+
+    h1 = cmsOpenSharedProfileFromFile("test1.icc");
+    if (h1 == NULL) return 0;
+
+    h = cmsOpenProfileFromFileTHR(DbgThread(), "test1.icc", "r");
+    cmsSaveProfileToMem(h, NULL, &Size);
+    Mem = (cmsUInt8Number*) chknull(malloc(Size));
+    cmsSaveProfileToMem(h, Mem, &Size);
+    cmsCloseProfile(h);
+
+    h2 = cmsOpenSharedProfileFromFile("test1.icc");
+    h3 = cmsOpenSharedProfileFromMem(Mem, Size);
+    hOther = cmsOpenSharedProfileFromFile("test2.icc");
+
+    if (h1 != h2 || h1 != h3) rc = 0;
+    if (hOther == NULL || hOther == h1) rc = 0;
+    if (cmsReadTag(h1, cmsSigAToB0Tag) != cmsReadTag(h3, cmsSigAToB0Tag)) rc = 0;
+
+    // Cannot be modified
+    cmsSetLogErrorHandler(ErrorReportingFunction);
+    if (cmsWriteTag(h1, cmsSigMediaWhitePointTag, &Wp)) rc = 0;
+    if (cmsLinkTag(h1, cmsSigAToB1Tag, cmsSigAToB0Tag)) rc = 0;
+    cmsSetLogErrorHandler(FatalErrorQuit);
+    if (!TrappedError) rc = 0;
+    TrappedError = FALSE;
+
+    // Neither the header
+    Intent = cmsGetHeaderRenderingIntent(h1);
+    cmsSetLogErrorHandler(ErrorReportingFunction);
+    cmsSetHeaderRenderingIntent(h1, Intent + 1);
+    cmsSetDeviceClass(h1, cmsSigAbstractClass);
+    cmsSetProfileVersion(h1, 2.1);
+    cmsSetLogErrorHandler(FatalErrorQuit);
+    if (!TrappedError) rc = 0;
+    TrappedError = FALSE;
+
+    if (cmsGetHeaderRenderingIntent(h1) != Intent ||
+        cmsGetDeviceClass(h1) != cmsSigOutputClass) rc = 0;
+
+    // Saving and computing the ID leave it as it was
+    cmsGetHeaderProfileID(h1, ID.ID8);
+    if (!cmsSaveProfileToMem(h1, NULL, &SharedSize)) rc = 0;
+    if (!cmsMD5computeID(h1)) rc = 0;
+    cmsGetHeaderProfileID(h1, ID2.ID8);
+    if (memcmp(ID.ID8, ID2.ID8, sizeof(cmsProfileID)) != 0) rc = 0;
+
+    // Usable from any context
+    hLab = cmsCreateLab4ProfileTHR(DbgThread(), NULL);
+    xform = cmsCreateTransformTHR(DbgThread(), h2, TYPE_CMYK_16, hLab, TYPE_Lab_16, INTENT_PERCEPTUAL, 0);
+    if (xform == NULL) rc = 0;
+    else {
+        cmsDoTransform(xform, CMYK, Lab, 1);
+        cmsDeleteTransform(xform);
+    }
+    cmsCloseProfile(hLab);
+
+    // Still alive until the last close
+    cmsCloseProfile(h1);
+    cmsCloseProfile(h2);
+    if (cmsReadTag(h3, cmsSigMediaWhitePointTag) == NULL) rc = 0;
+    cmsCloseProfile(h3);
+    cmsCloseProfile(hOther);
+
+    free(Mem);
+    return rc;
+}
+
+// Transforms in an arena give the same results, and report the context they were created in
+static
+cmsInt32Number CheckArenaTransforms(void)
+{
+    cmsContext ctx = WatchDogContext(NULL);
+    cmsHPROFILE hIn, hOut, hLink;
+    cmsHTRANSFORM xformRef, xform, xform2;
+    _cmsTRANSFORM* p;
+    cmsUInt8Number In[256 * 4], OutRef[256 * 3], Out[256 * 3];
+    cmsUInt32Number i;
+    cmsInt32Number rc = 1;
+
+    for (i=0; i < 256 * 4; i++)
+        In[i] = (cmsUInt8Number) (i * 7);
+
+    hIn  = cmsOpenProfileFromFileTHR(ctx, "test1.icc", "r");
+    hOut = cmsCreate_sRGBProfileTHR(ctx);
+
+    xformRef = cmsCreateTransformTHR(ctx, hIn, TYPE_CMYK_8, hOut, TYPE_RGB_8, INTENT_PERCEPTUAL, 0);
+    xform    = cmsCreateTransformTHR(ctx, hIn, TYPE_CMYK_8, hOut, TYPE_RGB_8, INTENT_PERCEPTUAL, cmsFLAGS_ARENA);
+    if (xformRef == NULL || xform == NULL) return 0;
+
+    // The arena context block is freed with a different id, as any other context
+    p = (_cmsTRANSFORM*) xform;
+    DebugMemDontCheckThis(p ->ContextID);
+
+    if (!p ->InArena || p ->ContextID == ctx) rc = 0;
+    if (((_cmsMemPluginChunkType*) _cmsContextGetClientChunk(p ->ContextID, MemPlugin)) ->Arena == NULL) rc = 0;
+    if (cmsGetTransformContextID(xform) != ctx) rc = 0;
+    if (p ->Lut != NULL && cmsGetPipelineContextID(p ->Lut) != p ->ContextID) rc = 0;
+
+    cmsDoTransform(xformRef, In, OutRef, 256);
+    cmsDoTransform(xform, In, Out, 256);
+    if (memcmp(Out, OutRef, sizeof(Out)) != 0) rc = 0;
+
+    // Device links would outlive the arena their pipeline is in
+    cmsSetLogErrorHandlerTHR(ctx, ErrorReportingFunction);
+    hLink = cmsTransform2DeviceLink(xform, 4.3, 0);
+    cmsSetLogErrorHandlerTHR(ctx, FatalErrorQuit);
+    if (hLink != NULL || !TrappedError) rc = 0;
+    if (hLink != NULL) cmsCloseProfile(hLink);
+    TrappedError = FALSE;
+
+    cmsDeleteTransform(xform);
+
+    // Going through the transform cache
+    cmsSetTransformCacheSize(ctx, 4);
+    cmsMD5computeID(hIn);
+    cmsMD5computeID(hOut);
+
+    xform  = cmsCreateTransformTHR(ctx, hIn, TYPE_CMYK_8, hOut, TYPE_RGB_8, INTENT_PERCEPTUAL, cmsFLAGS_ARENA);
+    xform2 = cmsCreateTransformTHR(ctx, hIn, TYPE_CMYK_8, hOut, TYPE_RGB_8, INTENT_PERCEPTUAL, cmsFLAGS_ARENA);
+    if (xform == NULL || xform != xform2) rc = 0;
+    else DebugMemDontCheckThis(((_cmsTRANSFORM*) xform) ->ContextID);
+
+    memset(Out, 0, sizeof(Out));
+    cmsDoTransform(xform2, In, Out, 256);
+    if (memcmp(Out, OutRef, sizeof(Out)) != 0) rc = 0;
+
+    cmsDeleteTransform(xform);
+    cmsDeleteTransform(xform2);
+    cmsSetTransformCacheSize(ctx, 0);
+
+    cmsDeleteTransform(xformRef);
+    cmsCloseProfile(hIn);
+    cmsCloseProfile(hOut);
+    cmsDeleteContext(ctx);
+    return rc;
+}
+
+// Memory in use is accounted by kind, and goes back to where it was once objects are released
+static
+cmsInt32Number CheckMemoryStats(void)
+{
+    cmsContext ctx = WatchDogContext(NULL);
+    cmsMemoryStats Base, Stats;
+    cmsHPROFILE hIn, hLab;
+    cmsHTRANSFORM xform, xformArena;
+    cmsUInt8Number* Mem;
+    cmsUInt32Number Size;
+    FILE* f;
+    cmsInt32Number rc = 1;
+
+    if (cmsGetMemoryStats(ctx, &Stats) || Stats.CurrentBytes != 0) rc = 0;
+    if (cmsEnableMemoryStats(NULL)) rc = 0;
+    if (!cmsEnableMemoryStats(ctx)) {
+        cmsDeleteContext(ctx);
+        return 0;
+    }
+    if (!cmsGetMemoryStats(ctx, &Base)) rc = 0;
+
+    f = fopen("test1.icc", "rb");
+    if (f == NULL) {
+        cmsDeleteContext(ctx);
+        return 0;
+    }
+    fseek(f, 0, SEEK_END);
+    Size = (cmsUInt32Number) ftell(f);
+    fseek(f, 0, SEEK_SET);
+    Mem = (cmsUInt8Number*) chknull(malloc(Size));
+    if (fread(Mem, 1, Size, f) != Size) rc = 0;
+    fclose(f);
+
+    hIn  = cmsOpenProfileFromMemTHR(ctx, Mem, Size);
+    hLab = cmsCreateLab4ProfileTHR(ctx, NULL);
+
+    cmsGetMemoryStats(ctx, &Stats);
+    if (Stats.Bytes[cmsMEMORY_PROFILE] < Size) rc = 0;
+
+    xform = cmsCreateTransformTHR(ctx, hIn, TYPE_CMYK_16, hLab, TYPE_Lab_16, INTENT_PERCEPTUAL, 0);
+    xformArena = cmsCreateTransformTHR(ctx, hIn, TYPE_CMYK_16, hLab, TYPE_Lab_16, INTENT_PERCEPTUAL, cmsFLAGS_ARENA);
+    if (xform == NULL || xformArena == NULL) {
+
+        if (xform != NULL) cmsDeleteTransform(xform);
+        if (xformArena != NULL) cmsDeleteTransform(xformArena);
+        cmsCloseProfile(hIn);
+        cmsCloseProfile(hLab);
+        free(Mem);
+        cmsDeleteContext(ctx);
+        return 0;
+    }
+    DebugMemDontCheckThis(((_cmsTRANSFORM*) xformArena) ->ContextID);
+
+    cmsGetMemoryStats(ctx, &Stats);
+    if (Stats.Bytes[cmsMEMORY_CLUT] == 0 || Stats.Bytes[cmsMEMORY_CURVE] == 0 ||
+        Stats.Bytes[cmsMEMORY_PIPELINE] == 0 || Stats.Bytes[cmsMEMORY_TRANSFORM] == 0) rc = 0;
+    if (Stats.PeakBytes < Stats.CurrentBytes || Stats.Allocations <= Base.Allocations) rc = 0;
+
+    cmsDeleteTransform(xform);
+    cmsDeleteTransform(xformArena);
+    cmsCloseProfile(hIn);
+    cmsCloseProfile(hLab);
+
+    cmsGetMemoryStats(ctx, &Stats);
+    if (Stats.CurrentBytes != Base.CurrentBytes || Stats.Bytes[cmsMEMORY_CLUT] != 0) {
+        Fail("%u bytes still accounted", (cmsUInt32Number) (Stats.CurrentBytes - Base.CurrentBytes));
+        rc = 0;
+    }
+    if (Stats.PeakBytes <= Stats.CurrentBytes) rc = 0;
+
+    free(Mem);
+    cmsDeleteContext(ctx);
+    return rc;
+}
+
+
+static
+cmsInt32Number CheckMatrixSimplify(void)
+{
+     
+       cmsHPROFILE pIn;
+       cmsHPROFILE pOut;
+       cmsHTRANSFORM t;
+       unsigned char buf[3] = { 127, 32, 64 };
+
+       
+       pIn = cmsCreate_sRGBProfile();
+       pOut = cmsOpenProfileFromFile("ibm-t61.icc", "r");
+       if (pIn == NULL || pOut == NULL)
+              return 0;
+
+       t = cmsCreateTransform(pIn, TYPE_RGB_8, pOut, TYPE_RGB_8, INTENT_PERCEPTUAL, 0);
+       cmsDoTransformStride(t, buf, buf, 1, 1);
+       cmsDeleteTransform(t);
+       cmsCloseProfile(pIn);
+       cmsCloseProfile(pOut);
+      
+
+       return buf[0] == 144 && buf[1] == 0 && buf[2] == 69;
+}
+
+
+
+static
+cmsInt32Number CheckTransformLineStride(void)
+{
+
+       cmsHPROFILE pIn;
+       cmsHPROFILE pOut;
+       cmsHTRANSFORM t;
+
+       // Our buffer is formed by 4 RGB8 lines, each line is 2 pixels wide plus a padding of one byte
+
+       cmsUInt8Number buf1[]= { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0,
+                                0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0, 
+                                0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0, 
+                                0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0, };
+
+       // Our buffer2 is formed by 4 RGBA lines, each line is 2 pixels wide plus a padding of one byte
+
+       cmsUInt8Number buf2[] = { 0xff, 0xff, 0xff, 1, 0xff, 0xff, 0xff, 1, 0,
+                                 0xff, 0xff, 0xff, 1, 0xff, 0xff, 0xff, 1, 0,
+                                 0xff, 0xff, 0xff, 1, 0xff, 0xff, 0xff, 1, 0,
+                                 0xff, 0xff, 0xff, 1, 0xff, 0xff, 0xff, 1, 0};
+
+       // Our buffer3 is formed by 4 RGBA16 lines, each line is 2 pixels wide plus a padding of two bytes
+
+       cmsUInt16Number buf3[] = { 0xffff, 0xffff, 0xffff, 0x0101, 0xffff, 0xffff, 0xffff, 0x0101, 0,
+                                  0xffff, 0xffff, 0xffff, 0x0101, 0xffff, 0xffff, 0xffff, 0x0101, 0,
+                                  0xffff, 0xffff, 0xffff, 0x0101, 0xffff, 0xffff, 0xffff, 0x0101, 0,
+                                  0xffff, 0xffff, 0xffff, 0x0101, 0xffff, 0xffff, 0xffff, 0x0101, 0 };
+
+       cmsUInt8Number out[1024];
+
+
+       memset(out, 0, sizeof(out));
+       pIn = cmsCreate_sRGBProfile();
+       pOut = cmsOpenProfileFromFile("ibm-t61.icc", "r");
+       if (pIn == NULL || pOut == NULL)
+              return 0;
+
+       t = cmsCreateTransform(pIn, TYPE_RGB_8, pOut, TYPE_RGB_8, INTENT_PERCEPTUAL, cmsFLAGS_COPY_ALPHA);
+       
+       cmsDoTransformLineStride(t, buf1, out, 2, 4, 7, 7, 0, 0);
+       cmsDeleteTransform(t);
+
+       if (memcmp(out, buf1, sizeof(buf1)) != 0) {
+              Fail("Failed transform line stride on RGB8");
+              cmsCloseProfile(pIn);
+              cmsCloseProfile(pOut);
+              return 0;
+       }
+
+       memset(out, 0, sizeof(out));
+
+       t = cmsCreateTransform(pIn, TYPE_RGBA_8, pOut, TYPE_RGBA_8, INTENT_PERCEPTUAL, cmsFLAGS_COPY_ALPHA);
+       
+       cmsDoTransformLineStride(t, buf2, out, 2, 4, 9, 9, 0, 0);
+
+       cmsDeleteTransform(t);
+
+
+       if (memcmp(out, buf2, sizeof(buf2)) != 0) {
+              cmsCloseProfile(pIn);
+              cmsCloseProfile(pOut);
+              Fail("Failed transform line stride on RGBA8");
+              return 0;
+       }
+
+       memset(out, 0, sizeof(out));
+
+       t = cmsCreateTransform(pIn, TYPE_RGBA_16, pOut, TYPE_RGBA_16, INTENT_PERCEPTUAL, cmsFLAGS_COPY_ALPHA);
+
+       cmsDoTransformLineStride(t, buf3, out, 2, 4, 18, 18, 0, 0);
+
+       cmsDeleteTransform(t);
+
+       if (memcmp(out, buf3, sizeof(buf3)) != 0) {
+              cmsCloseProfile(pIn);
+              cmsCloseProfile(pOut);
+              Fail("Failed transform line stride on RGBA16");
+              return 0;
+       }
+
+
+       memset(out, 0, sizeof(out));
+
+
+       // From 8 to 16
+       t = cmsCreateTransform(pIn, TYPE_RGBA_8, pOut, TYPE_RGBA_16, INTENT_PERCEPTUAL, cmsFLAGS_COPY_ALPHA);
+
+       cmsDoTransformLineStride(t, buf2, out, 2, 4, 9, 18, 0, 0);
+
+       cmsDeleteTransform(t);
+
+       if (memcmp(out, buf3, sizeof(buf3)) != 0) {
+              cmsCloseProfile(pIn);
+              cmsCloseProfile(pOut);
+              Fail("Failed transform line stride on RGBA16");
+              return 0;
+       }
+
+
+
+       cmsCloseProfile(pIn);
+       cmsCloseProfile(pOut);
+
+       return 1;
+}
+
+
+static
+int CheckPlanar8opt(void)
+{
+    cmsHPROFILE aboveRGB = Create_AboveRGB();
+    cmsHPROFILE sRGB = cmsCreate_sRGBProfile();
+
+    cmsHTRANSFORM transform = cmsCreateTransform(sRGB, TYPE_RGB_8_PLANAR,
+        aboveRGB, TYPE_RGB_8_PLANAR,
+        INTENT_PERCEPTUAL, 0);
+
+    cmsDeleteTransform(transform);
+    cmsCloseProfile(aboveRGB);
     cmsCloseProfile(sRGB);
 
     return 1;
 }
 
+/**
+* Bug reported from float32 to uint16 planar
+*/
+#define TYPE_RGB_FLT_PLANAR   (FLOAT_SH(1)|COLORSPACE_SH(PT_RGB)|CHANNELS_SH(3)|BYTES_SH(4)|PLANAR_SH(1))
+
+static
+int CheckPlanarFloat2int(void)
+{    
+    cmsHPROFILE sRGB = cmsCreate_sRGBProfile();
+
+    cmsHTRANSFORM transform = cmsCreateTransform(sRGB, TYPE_RGB_FLT_PLANAR,
+        sRGB, TYPE_RGB_16_PLANAR,INTENT_PERCEPTUAL, 0);
+
+    const cmsFloat32Number input[] = { 0.0f, 0.4f, 0.8f,  0.1f, 0.5f, 0.9f,  0.2f, 0.6f, 1.0f,   0.3f, 0.7f, 1.0f };
+    cmsUInt16Number output[3*4] = { 0 };
+
+    cmsDoTransform(transform, input, output, 4);
+
+    cmsDeleteTransform(transform);    
+    cmsCloseProfile(sRGB);
+
+    return 1;
+}
+
+
+
+
+
+/**
+* Bug reported & fixed. Thanks to Kornel Lesinski for spotting this.
+*/
+static
+int CheckSE(void)
+{
+    cmsHPROFILE input_profile = Create_AboveRGB();
+    cmsHPROFILE output_profile = cmsCreate_sRGBProfile();
+
+    cmsHTRANSFORM tr = cmsCreateTransform(input_profile, TYPE_RGBA_8, output_profile, TYPE_RGBA_16_SE, INTENT_RELATIVE_COLORIMETRIC, cmsFLAGS_COPY_ALPHA);
+   
+    cmsUInt8Number rgba[4] = { 40, 41, 41, 0xfa };
+    cmsUInt16Number out[4];
+
+    cmsDoTransform(tr, rgba, out, 1);
+    cmsCloseProfile(input_profile);
+    cmsCloseProfile(output_profile);
+    cmsDeleteTransform(tr);
+
+    if (out[0] != 0xf622 || out[1] != 0x7f24 || out[2] != 0x7f24)
+        return 0;
+
+    return 1;
+}
+
+/**
+* Bug reported.
+*/
+static
+int CheckForgedMPE(void) 
+{
+    cmsUInt32Number i;
+    cmsHPROFILE srcProfile;
+    cmsHPROFILE dstProfile;
+    cmsColorSpaceSignature srcCS;
+    cmsUInt32Number nSrcComponents;
+    cmsUInt32Number srcFormat;
+    cmsUInt32Number intent = 0;
+    cmsUInt32Number flags = 0;
+    cmsHTRANSFORM hTransform;
+    cmsUInt8Number output[4];
+
+    srcProfile = cmsOpenProfileFromFile("bad_mpe.icc", "r");
+    if (!srcProfile)
+        return 0;
+
+    dstProfile = cmsCreate_sRGBProfile();
+    if (!dstProfile) {
+        cmsCloseProfile(srcProfile);
+        return 0;
+    }
+
+    srcCS = cmsGetColorSpace(srcProfile);
+    nSrcComponents = cmsChannelsOfColorSpace(srcCS);
+    
+    if (srcCS == cmsSigLabData) {
+        srcFormat =
+            COLORSPACE_SH(PT_Lab) | CHANNELS_SH(nSrcComponents) | BYTES_SH(0);
+    }
+    else {
+        srcFormat =
+            COLORSPACE_SH(PT_ANY) | CHANNELS_SH(nSrcComponents) | BYTES_SH(1);
+    }
+
+    cmsSetLogErrorHandler(ErrorReportingFunction);
+
+    hTransform = cmsCreateTransform(srcProfile, srcFormat, dstProfile,
+        TYPE_BGR_8, intent, flags);
+    cmsCloseProfile(srcProfile);
+    cmsCloseProfile(dstProfile);
+
+    cmsSetLogErrorHandler(FatalErrorQuit);    
+
+    // Should report error
+    if (!TrappedError) return 0;
+
+    TrappedError = FALSE;
+
+    // Transform should NOT be created
+    if (!hTransform) return 1;
+    
+    // Never should reach here
+    if (T_BYTES(srcFormat) == 0) {  // 0 means double
+        double input[128];
+        for (i = 0; i < nSrcComponents; i++)
+            input[i] = 0.5f;
+        cmsDoTransform(hTransform, input, output, 1);
+    }
+    else {
+        cmsUInt8Number input[128];
+        for (i = 0; i < nSrcComponents; i++)
+            input[i] = 128;
+        cmsDoTransform(hTransform, input, output, 1);
+    }
+    cmsDeleteTransform(hTransform);
+
+    return 0;
+}
+
+/**
+* What the self test is trying to do is creating a proofing transform
+* with gamut check, so we can getting the coverage of one profile of
+* another, i.e. to approximate the gamut intersection. e.g.
+* Thanks to Richard Hughes for providing the test
+*/
+static
+int CheckProofingIntersection(void)
+{
+    cmsHPROFILE profile_null, hnd1, hnd2;
+    cmsHTRANSFORM transform;
+
+    hnd1 = cmsCreate_sRGBProfile();
+    hnd2 = Create_AboveRGB();
+
+    profile_null = cmsCreateNULLProfileTHR(DbgThread());
+    transform = cmsCreateProofingTransformTHR(DbgThread(),
+        hnd1,
+        TYPE_RGB_FLT,
+        profile_null,
+        TYPE_GRAY_FLT,
+        hnd2,
+        INTENT_ABSOLUTE_COLORIMETRIC,
+        INTENT_ABSOLUTE_COLORIMETRIC,
+        cmsFLAGS_GAMUTCHECK |
+        cmsFLAGS_SOFTPROOFING);
+
+    cmsCloseProfile(hnd1);
+    cmsCloseProfile(hnd2);
+    cmsCloseProfile(profile_null);
+
+    // Failed?
+    if (transform == NULL) return 0;
+
+    cmsDeleteTransform(transform);
+    return 1;
+}
+
+/**
+* In 2.11: When I create a RGB profile, set the copyright data with an empty string, 
+* then call cmsMD5computeID on said profile, the program crashes.
+*/
+static
+int CheckEmptyMLUC(void)
+{
+    cmsContext context = cmsCreateContext(NULL, NULL);    
+    cmsCIExyY white = { 0.31271, 0.32902, 1.0 };
+    cmsCIExyYTRIPLE primaries =
+    {
+    .Red = { 0.640, 0.330, 1.0 },
+    .Green = { 0.300, 0.600, 1.0 },
+    .Blue = { 0.150, 0.060, 1.0 }
+    };
+
+    cmsFloat64Number parameters[10] = { 2.6, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+    cmsToneCurve* toneCurve = cmsBuildParametricToneCurve(context, 1, parameters);
+    cmsToneCurve* toneCurves[3] = { toneCurve, toneCurve, toneCurve };
+
+    cmsHPROFILE profile = cmsCreateRGBProfileTHR(context, &white, &primaries, toneCurves);
+    
+    cmsSetLogErrorHandlerTHR(context, FatalErrorQuit);
+
+    cmsFreeToneCurve(toneCurve);
+
+    // Set an empty copyright tag. This should log an error.
+    cmsMLU* mlu = cmsMLUalloc(context, 1);
+    
+    cmsMLUsetASCII(mlu, "en", "AU", "");
+    cmsMLUsetWide(mlu,  "en", "EN", L"");
+    cmsWriteTag(profile, cmsSigCopyrightTag, mlu);
+    cmsMLUfree(mlu);
+
+    // This will cause a crash after setting an empty copyright tag.
+    cmsMD5computeID(profile);
+
+    // Cleanup
+    cmsCloseProfile(profile);
+    DebugMemDontCheckThis(context);
+    cmsDeleteContext(context);
+
+    return 1;
+}
+
+static
+double distance(const cmsUInt16Number* a, const cmsUInt16Number* b)
+{
+    double d1 = a[0] - b[0];
+    double d2 = a[1] - b[1];
+    double d3 = a[2] - b[2];
+
+    return sqrt(d1 * d1 + d2 * d2 + d3 * d3);
+}
+
+/**
+* In 2.12, a report suggest that the built-in sRGB has roundtrip errors that makes color to move
+* when roundtripping again and again
+*/
+static
+int Check_sRGB_Rountrips(void)
+{
+    cmsUInt16Number rgb[3], seed[3];
+    cmsCIELab Lab;
+    int i, r, g, b;
+    double err, maxErr;
+    cmsHPROFILE hsRGB = cmsCreate_sRGBProfile();
+    cmsHPROFILE hLab = cmsCreateLab4Profile(NULL);
+
+    cmsHTRANSFORM hBack = cmsCreateTransform(hLab, TYPE_Lab_DBL, hsRGB, TYPE_RGB_16, INTENT_RELATIVE_COLORIMETRIC, 0);
+    cmsHTRANSFORM hForth = cmsCreateTransform(hsRGB, TYPE_RGB_16, hLab, TYPE_Lab_DBL, INTENT_RELATIVE_COLORIMETRIC, 0);
+
+    cmsCloseProfile(hLab);
+    cmsCloseProfile(hsRGB);
+
+    maxErr = 0.0;
+    for (r = 0; r <= 255; r += 16)
+        for (g = 0; g <= 255; g += 16)
+            for (b = 0; b <= 255; b += 16)
+            {
+                seed[0] = rgb[0] = (cmsUInt16Number) ((r << 8) | r);
+                seed[1] = rgb[1] = (cmsUInt16Number) ((g << 8) | g);
+                seed[2] = rgb[2] = (cmsUInt16Number) ((b << 8) | b);
+
+                for (i = 0; i < 50; i++)
+                {
+                    cmsDoTransform(hForth, rgb, &Lab, 1);
+                    cmsDoTransform(hBack, &Lab, rgb, 1);
+                }
+
+                err = distance(seed, rgb);
+
+                if (err > maxErr)
+                    maxErr = err;
+            }
+
+
+    cmsDeleteTransform(hBack);
+    cmsDeleteTransform(hForth);
+
+    if (maxErr > 20.0)
+    {
+        printf("Maximum sRGB roundtrip error %f!\n", maxErr);
+        return 0;
+    }
+    
+    return 1;
+}
+
+
+static
+int CheckCenteringOfLab(void)
+{
+    cmsHPROFILE hProPhoto = cmsOpenProfileFromFile("test4.icc", "r");
+    cmsHPROFILE hLab = cmsCreateLab4Profile(NULL);
+
+    cmsHTRANSFORM xform1 = cmsCreateTransform(hProPhoto, TYPE_BGR_16, hLab, TYPE_Lab_16, INTENT_RELATIVE_COLORIMETRIC, cmsFLAGS_HIGHRESPRECALC);
+    cmsHTRANSFORM xform2 = cmsCreateTransform(hLab, TYPE_Lab_16, hProPhoto, TYPE_BGR_16, INTENT_RELATIVE_COLORIMETRIC, cmsFLAGS_HIGHRESPRECALC);
+
+    cmsUInt16Number bgr[3] = { 0xffff, 0xffff, 0xffff };
+    cmsUInt16Number bgr2[3];
+    cmsUInt16Number lab[3];
+
+    cmsDoTransform(xform1, bgr, lab, 1);
+    cmsDoTransform(xform2, lab, bgr2, 1);
+
+    if ((0xffff - bgr2[0]) > 5 ||
+        (0xffff - bgr2[1]) > 5 ||
+        (0xffff - bgr2[2]) > 5)
+    {
+        printf("Centering of Lab16 failed. Got %x %x %x\n", bgr2[0], bgr2[1], bgr2[2]);
+        return 0;
+    }
+
+
+    cmsCloseProfile(hLab);
+    cmsCloseProfile(hProPhoto);
+    cmsDeleteTransform(xform1);
+    cmsDeleteTransform(xform2);
+
+    return 1;
+}
+
+
+/**
+* Check OKLab colorspace
+*/
+static
+int Check_OkLab(void)
+{
+    cmsHPROFILE hOkLab = cmsCreate_OkLabProfile(NULL);
+    cmsHPROFILE hXYZ = cmsCreateXYZProfile();
+    cmsCIEXYZ xyz, xyz2;
+    cmsCIELab okLab;
+
+#define TYPE_OKLAB_DBL          (FLOAT_SH(1)|COLORSPACE_SH(PT_MCH3)|CHANNELS_SH(3)|BYTES_SH(0))
+
+    cmsHTRANSFORM xform  = cmsCreateTransform(hXYZ, TYPE_XYZ_DBL,  hOkLab, TYPE_OKLAB_DBL, INTENT_RELATIVE_COLORIMETRIC, 0);
+    cmsHTRANSFORM xform2 = cmsCreateTransform(hOkLab, TYPE_OKLAB_DBL, hXYZ, TYPE_XYZ_DBL,  INTENT_RELATIVE_COLORIMETRIC, 0);
+
+    /**
+    * D50 should be converted to white by PCS definition
+    */
+    xyz.X = 0.9642; xyz.Y = 1.0000; xyz.Z = 0.8249;
+    cmsDoTransform(xform, &xyz, &okLab, 1);
+    cmsDoTransform(xform2, &okLab, &xyz2, 1);
+
+
+    xyz.X = 1.0; xyz.Y = 0.0; xyz.Z = 0.0;
+    cmsDoTransform(xform, &xyz, &okLab, 1);
+    cmsDoTransform(xform2, &okLab, &xyz2, 1);
+
+
+    xyz.X = 0.0; xyz.Y = 1.0; xyz.Z = 0.0;
+    cmsDoTransform(xform, &xyz, &okLab, 1);
+    cmsDoTransform(xform2, &okLab, &xyz2, 1);
+
+    xyz.X = 0.0; xyz.Y = 0.0; xyz.Z = 1.0;
+    cmsDoTransform(xform, &xyz, &okLab, 1);
+    cmsDoTransform(xform2, &okLab, &xyz2, 1);
+
+    xyz.X = 0.143046; xyz.Y = 0.060610; xyz.Z = 0.713913;
+    cmsDoTransform(xform, &xyz, &okLab, 1);
+    cmsDoTransform(xform2, &okLab, &xyz2, 1);
+    
+    cmsDeleteTransform(xform);
+    cmsDeleteTransform(xform2);
+    cmsCloseProfile(hOkLab);
+    cmsCloseProfile(hXYZ);
+
+    return 1;
+}
+
+
+static
+int Check_OkLab2(void)
+{
+#define TYPE_LABA_F32 (FLOAT_SH(1)|COLORSPACE_SH(PT_MCH3)|EXTRA_SH(1)|CHANNELS_SH(3)|BYTES_SH(4))
+
+    cmsUInt16Number rgb[3];
+    cmsFloat32Number lab[4];
+
+    cmsHPROFILE labProfile = cmsCreate_OkLabProfile(NULL);
+    cmsHPROFILE rgbProfile = cmsCreate_sRGBProfile();
+
+    cmsHTRANSFORM hBack = cmsCreateTransform(labProfile, TYPE_LABA_F32, rgbProfile, TYPE_RGB_16, INTENT_RELATIVE_COLORIMETRIC, 0);
+    cmsHTRANSFORM hForth = cmsCreateTransform(rgbProfile, TYPE_RGB_16, labProfile, TYPE_LABA_F32, INTENT_RELATIVE_COLORIMETRIC, 0);
+
+    cmsCloseProfile(labProfile);
+    cmsCloseProfile(rgbProfile);
+
+    rgb[0] = 0;
+    rgb[1] = 0;
+    rgb[2] = 65535;
+
+    cmsDoTransform(hForth, rgb, &lab, 1);
+    cmsDoTransform(hBack, lab, &rgb, 1);
+
+    cmsDeleteTransform(hBack);
+    cmsDeleteTransform(hForth);
+
+    if (rgb[0] != 0 || rgb[1] != 0 || rgb[2] != 65535) return 0;
+
+    return 1;
+}
+
+
+static
+cmsHPROFILE createRgbGamma(cmsFloat64Number g)
+{
+    cmsCIExyY       D65 = { 0.3127, 0.3290, 1.0 };
+    cmsCIExyYTRIPLE Rec709Primaries = {
+                                {0.6400, 0.3300, 1.0},
+                                {0.3000, 0.6000, 1.0},
+                                {0.1500, 0.0600, 1.0}
+    };
+    cmsToneCurve* Gamma[3];
+    cmsHPROFILE  hRGB;
+    
+    Gamma[0] = Gamma[1] = Gamma[2] = cmsBuildGamma(0, g);
+    if (Gamma[0] == NULL) return NULL;
+
+    hRGB = cmsCreateRGBProfile(&D65, &Rec709Primaries, Gamma);
+    cmsFreeToneCurve(Gamma[0]);    
+    return hRGB;
+}
+
+
+static
+int CheckGammaSpaceDetection(void)
+{
+    cmsFloat64Number i;
+
+    for (i = 0.5; i < 3; i += 0.1)
+    {                
+        cmsHPROFILE hProfile = createRgbGamma(i);
+
+        cmsFloat64Number gamma = cmsDetectRGBProfileGamma(hProfile, 0.01);
+
+        cmsCloseProfile(hProfile);
+
+        if (fabs(gamma - i) > 0.1)
+        {
+            Fail("Failed profile gamma detection of %f (got %f)", i, gamma);
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// Per issue #308. A built-in is corrupted by using write raw tag was causing a segfault
+static
+int CheckInducedCorruption(void)
+{
+    cmsHTRANSFORM xform0;
+    char garbage[] = "\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0a\x0b";
+    cmsHPROFILE hsrgb = cmsCreate_sRGBProfile();
+    cmsHPROFILE hLab = cmsCreateLab4Profile(NULL);
+
+    cmsSetLogErrorHandler(NULL);
+    cmsWriteRawTag(hsrgb, cmsSigBlueColorantTag, &garbage, sizeof(garbage));
+
+    xform0 = cmsCreateTransform(hsrgb, TYPE_RGB_16, hLab, TYPE_Lab_16, INTENT_RELATIVE_COLORIMETRIC, 0);
+
+    if (xform0) cmsDeleteTransform(xform0);
+
+    cmsCloseProfile(hsrgb);
+    cmsCloseProfile(hLab);
+
+    ResetFatalError();
+    return 1;
+}
+
+#if 0
+
+// You need to download following profiles to execute this test: sRGB-elle-V4-srgbtrc.icc, sRGB-elle-V4-g10.icc
+// The include this line in the checks list:  Check("KInear spaces detection", CheckLinearSpacesOptimization);
+static
+void uint16toFloat(cmsUInt16Number* src, cmsFloat32Number* dst)
+{
+    for (int i = 0; i < 3; i++) {
+        dst[i] = src[i] / 65535.f;
+    }
+}
+
+static
+int CheckLinearSpacesOptimization(void)
+{
+    cmsHPROFILE lcms_sRGB = cmsCreate_sRGBProfile();
+    cmsHPROFILE elle_sRGB = cmsOpenProfileFromFile("sRGB-elle-V4-srgbtrc.icc", "r");
+    cmsHPROFILE elle_linear = cmsOpenProfileFromFile("sRGB-elle-V4-g10.icc", "r");
+    cmsHTRANSFORM transform1 = cmsCreateTransform(elle_sRGB, TYPE_RGB_16, elle_linear, TYPE_RGB_16, INTENT_RELATIVE_COLORIMETRIC, 0);
+    cmsHTRANSFORM transform2 = cmsCreateTransform(elle_linear, TYPE_RGB_16, lcms_sRGB, TYPE_RGB_16, INTENT_RELATIVE_COLORIMETRIC, 0);
+    cmsHTRANSFORM transform2a = cmsCreateTransform(elle_linear, TYPE_RGB_FLT, lcms_sRGB, TYPE_RGB_16, INTENT_RELATIVE_COLORIMETRIC, 0);
+
+    cmsUInt16Number sourceCol[3] = { 43 * 257, 27 * 257, 6 * 257 };
+    cmsUInt16Number linearCol[3] = { 0 };
+    float linearColF[3] = { 0 };
+    cmsUInt16Number finalCol[3] = { 0 };
+    int difR, difG, difB;
+    int difR2, difG2, difB2;
+
+    cmsDoTransform(transform1, sourceCol, linearCol, 1);
+    cmsDoTransform(transform2, linearCol, finalCol, 1);
+
+    cmsCloseProfile(lcms_sRGB); cmsCloseProfile(elle_sRGB); cmsCloseProfile(elle_linear);
+
+
+    difR = (int)sourceCol[0] - finalCol[0];
+    difG = (int)sourceCol[1] - finalCol[1];
+    difB = (int)sourceCol[2] - finalCol[2];
+
+
+    uint16toFloat(linearCol, linearColF);
+    cmsDoTransform(transform2a, linearColF, finalCol, 1);
+
+    difR2 = (int)sourceCol[0] - finalCol[0];
+    difG2 = (int)sourceCol[1] - finalCol[1];
+    difB2 = (int)sourceCol[2] - finalCol[2];
+
+    cmsDeleteTransform(transform1);
+    cmsDeleteTransform(transform2);
+    cmsDeleteTransform(transform2a);
+
+    if (abs(difR2 - difR) > 5 || abs(difG2 - difG) > 5 || abs(difB2 - difB) > 5)
+    {
+        Fail("Linear detection failed");
+        return 0;
+    }
+
+    return 1;
+}
+#endif
+
+
+
+static
+int CheckBadCGATS(void)
+{
+    const char* bad_it8 =
+        " \"\"\n"
+        "NUMBER_OF_FIELDS 4\n"
+        "BEGIN_DATA_FORMAT\n"
+        "I R G G\n"
+        "END_DATA_FORMAT\n"
+        "NUMBER_OF_FIELDS 9\n"
+        "NUMBER_OF_SETS 2\n"
+        "BEGIN_DATA\n"
+        "d\n"
+        "0 0Bd\n"
+        "0Ba	$ $ t .";
+
+    cmsHANDLE hIT8;
+    
+    cmsSetLogErrorHandler(NULL);
+
+    hIT8 = cmsIT8LoadFromMem(0, bad_it8, (cmsUInt32Number) strlen(bad_it8));
+    
+    ResetFatalError();
+
+    if (hIT8 != NULL)
+    {
+        Fail("Wrong IT8 accepted as ok");
+        cmsIT8Free(hIT8);
+    }
+
+    return 1;
+}
+
+static
+int CheckIntToFloatTransform(void)
+{
+    cmsHPROFILE hAbove = Create_AboveRGB();
+    cmsHPROFILE hsRGB = cmsCreate_sRGBProfile();
+
+    cmsHTRANSFORM xform = cmsCreateTransform(hAbove, TYPE_RGB_8, hsRGB, TYPE_RGB_DBL, INTENT_PERCEPTUAL, 0);
+
+    cmsUInt8Number rgb8[3] = { 12, 253, 21 };
+    cmsFloat64Number rgbDBL[3] = { 0 };
+
+    cmsCloseProfile(hAbove); cmsCloseProfile(hsRGB);
+
+    cmsDoTransform(xform, rgb8, rgbDBL, 1);
+
+    
+    cmsDeleteTransform(xform);
+
+    if (rgbDBL[0] < 0 && rgbDBL[2] < 0) return 1;
+
+    Fail("Unbounded transforms with integer input failed");
+
+    return 0;
+}
+
+static
+int CheckSaveLinearizationDevicelink(void)
+{
+    const cmsFloat32Number table[] = { 0, 0.5f, 1.0f };
+
+    cmsToneCurve* tone = cmsBuildTabulatedToneCurveFloat(NULL, 3, table);
+
+    cmsToneCurve* rgb_curves[3] = { tone, tone, tone };
+
+    cmsHPROFILE hDeviceLink = cmsCreateLinearizationDeviceLink(cmsSigRgbData, rgb_curves);
+
+    cmsBool result;
+    cmsHTRANSFORM xform;
+    int i;
+    
+    cmsFreeToneCurve(tone);
+
+    result = cmsSaveProfileToFile(hDeviceLink, "lin_rgb.icc");
+
+    cmsCloseProfile(hDeviceLink);
+
+    if (!result)
+    {
+        remove("lin_rgb.icc");
+        Fail("Couldn't save linearization devicelink");        
+    }
+
+
+    hDeviceLink = cmsOpenProfileFromFile("lin_rgb.icc", "r");
+
+    if (hDeviceLink == NULL)
+    {
+        remove("lin_rgb.icc");
+        Fail("Couldn't open devicelink");
+    }
+
+    xform = cmsCreateTransform(hDeviceLink, TYPE_RGB_8, NULL, TYPE_RGB_8, INTENT_PERCEPTUAL, 0);
+    cmsCloseProfile(hDeviceLink);
+
+    for (i = 0; i < 256; i++)
+    {
+        cmsUInt8Number rgb_in[3] = { i, i, i };
+        cmsUInt8Number rgb_out[3];
+
+        cmsDoTransform(xform, rgb_in, rgb_out, 1);
+
+        if (rgb_in[0] != rgb_out[0] ||
+            rgb_in[1] != rgb_out[1] ||
+            rgb_in[2] != rgb_out[2])
+        {
+            remove("lin_rgb.icc");
+            Fail("Saved devicelink was not working");
+        }
+    }
+
+
+    cmsDeleteTransform(xform);
+    remove("lin_rgb.icc");
+
+    return 1;
+}
+
+static
+int CheckGamutCheckFloats(void)
+{
+
+    cmsUInt16Number alarms[16] = { 0x0f0f,3,4,5,6,7,8,9,10 };
+    
+
+    cmsHPROFILE hLab = cmsCreateLab4Profile(NULL);
+    cmsHPROFILE hNull = cmsCreateNULLProfile();
+    cmsHPROFILE hsRGB = cmsCreate_sRGBProfile();
+
+    cmsHTRANSFORM xfrm = cmsCreateProofingTransform(hLab,
+        TYPE_Lab_DBL, hNull, TYPE_GRAY_8, hsRGB,
+        INTENT_RELATIVE_COLORIMETRIC, INTENT_ABSOLUTE_COLORIMETRIC,
+        cmsFLAGS_GAMUTCHECK);
+
+    cmsCloseProfile(hLab);
+    cmsCloseProfile(hNull);
+    cmsCloseProfile(hsRGB);
+
+    cmsCIELab Lab = { 50, -125, 125 };
+    cmsCIELab Lab2 = { 50, -10, 12 };
+
+    cmsUInt8Number gamut;
+
+    cmsSetAlarmCodes(alarms);
+
+    cmsDoTransform(xfrm, &Lab, &gamut, 1);  // Gives the alarm != 0
+    if (gamut != 0x0f)
+        Fail("Gamut check not good");
+
+    cmsDoTransform(xfrm, &Lab2, &gamut, 1);
+    if (gamut != 0)
+        Fail("Gamut check zero");
+
+    cmsDeleteTransform(xfrm);
+    return 1;
+}
+
+static
+int CheckMixedRawAndCooked(void)
+{
+    const cmsUInt32Number data = cmsSigFilmScanner;
+    const cmsUInt32Number* pdata;
+    cmsBool is_ok = FALSE;
+
+    // This is the internal representation of cmsSigTechnologyTag tag type
+    struct _cooked_st
+    {
+        _cmsTagBase base;
+        cmsUInt32Number data;
+
+    } buffer = { { (cmsTagTypeSignature) cmsSigTechnologyTag, {0} }, cmsSigFilmScanner };
 
+    cmsHPROFILE hProfile = cmsCreateProfilePlaceholder(0);   
+    cmsWriteRawTag(hProfile, cmsSigTechnologyTag, &buffer, sizeof buffer);
+    cmsWriteTag(hProfile, cmsSigTechnologyTag, &data);
+    cmsWriteRawTag(hProfile, cmsSigTechnologyTag, &buffer, sizeof buffer);
+    cmsWriteRawTag(hProfile, cmsSigTechnologyTag, &buffer, sizeof buffer);
+    cmsWriteTag(hProfile, cmsSigTechnologyTag, &data);
+    cmsWriteTag(hProfile, cmsSigTechnologyTag, &data);
+    memset(&buffer, 0, sizeof(buffer));
 
+    cmsReadRawTag(hProfile, cmsSigTechnologyTag, &buffer, sizeof buffer );
+    pdata = cmsReadTag(hProfile, cmsSigTechnologyTag);
 
+    is_ok = (*pdata == cmsSigFilmScanner) && (_cmsAdjustEndianess32(buffer.data) == cmsSigFilmScanner);
 
-/**
-* Bug reported & fixed. Thanks to Kornel Lesinski for spotting this.
-*/
+    cmsCloseProfile(hProfile);
+    return is_ok;
+}
+
+// The hashed cache should give exactly the same results as the uncached path
 static
-int CheckSE(void)
+int CheckMultiCache(void)
 {
-    cmsHPROFILE input_profile = Create_AboveRGB();
-    cmsHPROFILE output_profile = cmsCreate_sRGBProfile();
+    cmsHPROFILE hsRGB = cmsCreate_sRGBProfileTHR(DbgThread());
+    cmsHPROFILE hLab  = cmsCreateLab4ProfileTHR(DbgThread(), NULL);
+    cmsHTRANSFORM xformRef, xformMulti;
+    cmsUInt8Number  In[4096][3];
+    cmsUInt16Number OutRef[4096][3], OutMulti[4096][3];
+    cmsUInt32Number i, Hits, Misses, FirstMisses, Count;
+    cmsUInt32Number seed = 1;
+    int rc = 1;
 
-    cmsHTRANSFORM tr = cmsCreateTransform(input_profile, TYPE_RGBA_8, output_profile, TYPE_RGBA_16_SE, INTENT_RELATIVE_COLORIMETRIC, cmsFLAGS_COPY_ALPHA);
-   
-    cmsUInt8Number rgba[4] = { 40, 41, 41, 0xfa };
-    cmsUInt16Number out[4];
+    xformRef   = cmsCreateTransformTHR(DbgThread(), hsRGB, TYPE_RGB_8, hLab, TYPE_Lab_16, INTENT_PERCEPTUAL, cmsFLAGS_NOCACHE);
+    xformMulti = cmsCreateTransformTHR(DbgThread(), hsRGB, TYPE_RGB_8, hLab, TYPE_Lab_16, INTENT_PERCEPTUAL, cmsFLAGS_MULTICACHE);
+    cmsCloseProfile(hsRGB); cmsCloseProfile(hLab);
 
-    cmsDoTransform(tr, rgba, out, 1);
-    cmsCloseProfile(input_profile);
-    cmsCloseProfile(output_profile);
-    cmsDeleteTransform(tr);
+    if (xformRef == NULL || xformMulti == NULL) {
+        Fail("Unable to create transforms");
+        return 0;
+    }
 
-    if (out[0] != 0xf622 || out[1] != 0x7f24 || out[2] != 0x7f24)
+    // A palette of 32 colors visited in no particular order
+    for (i = 0; i < 4096; i++) {
+
+        cmsUInt32Number c;
+
+        seed = seed * 1103515245U + 12345U;
+        c = (seed >> 16) & 31;
+
+        In[i][0] = (cmsUInt8Number) (c * 8);
+        In[i][1] = (cmsUInt8Number) (255 - c * 5);
+        In[i][2] = (cmsUInt8Number) ((c * 37) & 0xFF);
+    }
+
+    cmsDoTransform(xformRef, In, OutRef, 4096);
+    cmsDoTransform(xformMulti, In, OutMulti, 4096);
+
+    if (memcmp(OutRef, OutMulti, sizeof(OutRef)) != 0) {
+        Fail("Multi-entry cache gives different results");
+        rc = 0;
+    }
+
+    if (cmsGetTransformCacheStats(xformRef, &Hits, &Misses)) {
+        Fail("Cache stats on a transform without multi-entry cache");
+        rc = 0;
+    }
+
+    if (!cmsGetTransformCacheStats(xformMulti, &Hits, &Misses) ||
+        Hits + Misses != 4096 || Hits < Misses) {
+        Fail("Wrong cache stats: %u hits, %u misses", Hits, Misses);
+        rc = 0;
+    }
+
+    FirstMisses = Misses;
+
+    cmsResetTransformCacheStats(xformMulti);
+    cmsGetTransformCacheStats(xformMulti, &Hits, &Misses);
+    if (Hits != 0 || Misses != 0) {
+        Fail("Cache stats not reset");
+        rc = 0;
+    }
+
+    // The cache of the transform is kept between calls, and taking it does not allocate
+    Count = AllocCount;
+    cmsDoTransform(xformMulti, In, OutMulti, 4096);
+
+    if (AllocCount != Count) {
+        Fail("%u allocations on a cached transform", AllocCount - Count);
+        rc = 0;
+    }
+
+    cmsGetTransformCacheStats(xformMulti, &Hits, &Misses);
+    if (Misses >= FirstMisses) {
+        Fail("Cache not kept between calls: %u misses", Misses);
+        rc = 0;
+    }
+
+    // A call finding the cache taken by another one goes with the 1-pixel cache, and does not allocate either
+    ((_cmsTRANSFORM*) xformMulti) ->MultiCacheBusy = TRUE;
+    memset(OutMulti, 0, sizeof(OutMulti));
+    Count = AllocCount;
+    cmsDoTransform(xformMulti, In, OutMulti, 4096);
+    ((_cmsTRANSFORM*) xformMulti) ->MultiCacheBusy = FALSE;
+
+    if (AllocCount != Count) {
+        Fail("%u allocations on a contended cached transform", AllocCount - Count);
+        rc = 0;
+    }
+
+    if (memcmp(OutRef, OutMulti, sizeof(OutRef)) != 0) {
+        Fail("Contended cache gives different results");
+        rc = 0;
+    }
+
+    cmsDeleteTransform(xformRef);
+    cmsDeleteTransform(xformMulti);
+    return rc;
+}
+
+// With scratch memory attached, the multi-entry cache survives between calls and steady-state
+// transforms should not allocate at all. Allocations are counted by the debug memory handler.
+static
+int CheckScratchTransform(void)
+{
+    cmsHPROFILE hsRGB = cmsCreate_sRGBProfileTHR(DbgThread());
+    cmsHPROFILE hLab  = cmsCreateLab4ProfileTHR(DbgThread(), NULL);
+    cmsHTRANSFORM xformRef, xformMulti, xformFloat, xformBusy;
+    cmsUInt8Number  In[1024][3];
+    cmsUInt16Number OutRef[1024][3], OutMulti[1024][3], OutBusy[1024][3];
+    cmsFloat32Number InFloat[1024][3], OutFloat[1024][3];
+    cmsUInt32Number i, Size, Count, Hits, Misses;
+    void* Scratch;
+    int rc = 1;
+
+    xformRef   = cmsCreateTransformTHR(DbgThread(), hsRGB, TYPE_RGB_8, hLab, TYPE_Lab_16, INTENT_PERCEPTUAL, cmsFLAGS_NOCACHE);
+    xformMulti = cmsCreateTransformTHR(DbgThread(), hsRGB, TYPE_RGB_8, hLab, TYPE_Lab_16, INTENT_PERCEPTUAL, cmsFLAGS_MULTICACHE);
+    xformFloat = cmsCreateTransformTHR(DbgThread(), hsRGB, TYPE_RGB_FLT, hLab, TYPE_Lab_FLT, INTENT_PERCEPTUAL, 0);
+    xformBusy  = cmsCreateTransformTHR(DbgThread(), hsRGB, TYPE_RGB_8, hLab, TYPE_Lab_16, INTENT_PERCEPTUAL, cmsFLAGS_MULTICACHE);
+    cmsCloseProfile(hsRGB); cmsCloseProfile(hLab);
+
+    if (xformRef == NULL || xformMulti == NULL || xformFloat == NULL || xformBusy == NULL) {
+        Fail("Unable to create transforms");
         return 0;
+    }
 
-    return 1;
+    // As if another call held the cache all the time
+    ((_cmsTRANSFORM*) xformBusy)->MultiCacheBusy = TRUE;
+
+    if (cmsGetTransformScratchSize(xformRef) != 0) {
+        Fail("Scratch memory requested by a transform without cache");
+        rc = 0;
+    }
+
+    Size = cmsGetTransformScratchSize(xformMulti);
+    Scratch = chknull(malloc(Size));
+    cmsSetTransformScratch(xformMulti, Scratch, Size);
+
+    // A palette of 16 colors, the cache can hold all of them
+    for (i = 0; i < 1024; i++) {
+
+        In[i][0] = (cmsUInt8Number) ((i & 15) * 16);
+        In[i][1] = (cmsUInt8Number) (255 - (i & 15) * 9);
+        In[i][2] = (cmsUInt8Number) 128;
+
+        InFloat[i][0] = In[i][0] / 255.0F;
+        InFloat[i][1] = In[i][1] / 255.0F;
+        InFloat[i][2] = In[i][2] / 255.0F;
+    }
+
+    cmsDoTransform(xformRef, In, OutRef, 1024);
+    cmsDoTransform(xformMulti, In, OutMulti, 1024);
+    cmsDoTransform(xformFloat, InFloat, OutFloat, 1024);
+
+    if (memcmp(OutRef, OutMulti, sizeof(OutRef)) != 0) {
+        Fail("Cache on scratch memory gives different results");
+        rc = 0;
+    }
+
+    // From now on, all colors should be found in the cache
+    cmsResetTransformCacheStats(xformMulti);
+    Count = AllocCount;
+
+    for (i = 0; i < 100; i++) {
+
+        cmsDoTransform(xformRef, In, OutRef, 1024);
+        cmsDoTransform(xformMulti, In, OutMulti, 1024);
+        cmsDoTransform(xformFloat, InFloat, OutFloat, 1024);
+        cmsDoTransform(xformBusy, In, OutBusy, 1024);
+    }
+
+    if (AllocCount != Count) {
+        Fail("%u allocations on steady-state transforms", AllocCount - Count);
+        rc = 0;
+    }
+
+    cmsGetTransformCacheStats(xformMulti, &Hits, &Misses);
+    if (Misses != 0) {
+        Fail("Cache not kept between calls, %u misses", Misses);
+        rc = 0;
+    }
+
+    if (memcmp(OutRef, OutBusy, sizeof(OutRef)) != 0) {
+        Fail("Transform with the cache taken gives different results");
+        rc = 0;
+    }
+
+    cmsSetTransformScratch(xformMulti, NULL, 0);
+    free(Scratch);
+
+    cmsDeleteTransform(xformRef);
+    cmsDeleteTransform(xformMulti);
+    cmsDeleteTransform(xformFloat);
+    cmsDeleteTransform(xformBusy);
+    return rc;
 }
 
-/**
-* Bug reported.
-*/
+// Transforms built twice from the same profiles come from the cache, as long as the profiles have an ID
 static
-int CheckForgedMPE(void) 
+int CheckTransformCache(void)
 {
+    cmsContext ctx = WatchDogContext(NULL);
+    cmsHPROFILE hsRGB, hLab, hNoID;
+    cmsHTRANSFORM x1, x2, x3, x4, xRef;
+    cmsUInt8Number  In[256][3];
+    cmsUInt16Number Out[256][3], OutRef[256][3];
     cmsUInt32Number i;
-    cmsHPROFILE srcProfile;
-    cmsHPROFILE dstProfile;
-    cmsColorSpaceSignature srcCS;
-    cmsUInt32Number nSrcComponents;
-    cmsUInt32Number srcFormat;
-    cmsUInt32Number intent = 0;
-    cmsUInt32Number flags = 0;
-    cmsHTRANSFORM hTransform;
-    cmsUInt8Number output[4];
+    int rc = 1;
 
-    srcProfile = cmsOpenProfileFromFile("bad_mpe.icc", "r");
-    if (!srcProfile)
+    cmsSetLogErrorHandlerTHR(ctx, ErrorReportingFunction);
+    cmsSetTransformCacheSize(ctx, 2);
+
+    hsRGB = cmsCreate_sRGBProfileTHR(ctx);
+    hLab  = cmsCreateLab4ProfileTHR(ctx, NULL);
+    hNoID = cmsCreateLab2ProfileTHR(ctx, NULL);
+
+    cmsMD5computeID(hsRGB);
+    cmsMD5computeID(hLab);
+
+    x1 = cmsCreateTransformTHR(ctx, hsRGB, TYPE_RGB_8, hLab, TYPE_Lab_16, INTENT_PERCEPTUAL, 0);
+    x2 = cmsCreateTransformTHR(ctx, hsRGB, TYPE_RGB_8, hLab, TYPE_Lab_16, INTENT_PERCEPTUAL, 0);
+    x3 = cmsCreateTransformTHR(ctx, hsRGB, TYPE_RGB_8, hLab, TYPE_Lab_16, INTENT_RELATIVE_COLORIMETRIC, 0);
+
+    if (x1 == NULL || x1 != x2 || x3 == x1) {
+        Fail("Transform not shared");
+        rc = 0;
+    }
+
+    // Same results as a transform built on its own
+    xRef = cmsCreateTransformTHR(ctx, hsRGB, TYPE_RGB_8, hLab, TYPE_Lab_16, INTENT_PERCEPTUAL, cmsFLAGS_NOCACHE);
+
+    for (i = 0; i < 256; i++) {
+        In[i][0] = (cmsUInt8Number) i; In[i][1] = (cmsUInt8Number) (255 - i); In[i][2] = (cmsUInt8Number) (i * 7);
+    }
+
+    cmsDoTransform(x1, In, Out, 256);
+    cmsDoTransform(xRef, In, OutRef, 256);
+
+    if (memcmp(Out, OutRef, sizeof(Out)) != 0) {
+        Fail("Cached transform gives different results");
+        rc = 0;
+    }
+
+    // Shared transforms cannot be changed
+    TrappedError = FALSE;
+    if (cmsChangeBuffersFormat(x1, TYPE_RGB_16, TYPE_Lab_16) || !TrappedError) {
+        Fail("Shared transform changed");
+        rc = 0;
+    }
+    TrappedError = FALSE;
+
+    // Profiles without ID are not cached
+    x2 = cmsCreateTransformTHR(ctx, hsRGB, TYPE_RGB_8, hNoID, TYPE_Lab_16, INTENT_PERCEPTUAL, 0);
+    x4 = cmsCreateTransformTHR(ctx, hsRGB, TYPE_RGB_8, hNoID, TYPE_Lab_16, INTENT_PERCEPTUAL, 0);
+    if (x2 == x4) {
+        Fail("Transform on profile without ID was cached");
+        rc = 0;
+    }
+    cmsDeleteTransform(x2);
+    cmsDeleteTransform(x4);
+
+    // A third transform evicts the least recently used one, still valid for its holders
+    x4 = cmsCreateTransformTHR(ctx, hsRGB, TYPE_RGB_16, hLab, TYPE_Lab_16, INTENT_PERCEPTUAL, 0);
+    x2 = cmsCreateTransformTHR(ctx, hsRGB, TYPE_RGB_8, hLab, TYPE_Lab_16, INTENT_PERCEPTUAL, 0);
+
+    if (x2 == x1) {
+        Fail("Transform not evicted");
+        rc = 0;
+    }
+
+    cmsDoTransform(x1, In, Out, 256);
+    if (memcmp(Out, OutRef, sizeof(Out)) != 0) {
+        Fail("Evicted transform no longer valid");
+        rc = 0;
+    }
+
+    cmsDeleteTransform(x1);
+    cmsDeleteTransform(x1);     // Was handed out twice
+    cmsDeleteTransform(x2);
+    cmsDeleteTransform(x3);
+    cmsDeleteTransform(x4);
+    cmsDeleteTransform(xRef);
+
+    cmsCloseProfile(hsRGB);
+    cmsCloseProfile(hLab);
+    cmsCloseProfile(hNoID);
+
+    // Whatever remains in the cache goes with the context
+    cmsDeleteContext(ctx);
+    return rc;
+}
+
+// CLUTs filled on demand should end exactly as the ones sampled up front
+static
+int CheckOneLazyTransform(cmsHPROFILE hIn, cmsUInt32Number InputFormat, cmsHPROFILE hOut, cmsUInt32Number OutputFormat, cmsUInt32Number dwFlags)
+{
+    cmsHTRANSFORM xform, xformLazy;
+    cmsHPROFILE hLink, hLinkLazy;
+    cmsUInt8Number In[4096 * 8], Out[4096 * 8], OutLazy[4096 * 8];
+    cmsUInt32Number i, seed = 7;
+    int rc = 1;
+
+    xform     = cmsCreateTransformTHR(DbgThread(), hIn, InputFormat, hOut, OutputFormat, INTENT_PERCEPTUAL, dwFlags | cmsFLAGS_NOCACHE);
+    xformLazy = cmsCreateTransformTHR(DbgThread(), hIn, InputFormat, hOut, OutputFormat, INTENT_PERCEPTUAL, dwFlags | cmsFLAGS_NOCACHE | cmsFLAGS_LAZYPRECALC);
+
+    if (xform == NULL || xformLazy == NULL) return 0;
+
+    for (i = 0; i < sizeof(In); i++) {
+
+        seed = seed * 1103515245U + 12345U;
+        In[i] = (cmsUInt8Number) (seed >> 16);
+    }
+
+    // Includes white, which may be patched
+    memset(In, 0xFF, 16);
+    memset(Out, 0, sizeof(Out));
+    memset(OutLazy, 0, sizeof(OutLazy));
+
+    // Twice, the second time on cells already filled
+    cmsDoTransform(xform, In, Out, 4096);
+    cmsDoTransform(xformLazy, In, OutLazy, 4096);
+    if (memcmp(Out, OutLazy, sizeof(Out)) != 0) rc = 0;
+
+    cmsDoTransform(xformLazy, In, OutLazy, 4096);
+    if (memcmp(Out, OutLazy, sizeof(Out)) != 0) rc = 0;
+
+    // Devicelinks need the whole table
+    hLink     = cmsTransform2DeviceLink(xform, 4.3, 0);
+    hLinkLazy = cmsTransform2DeviceLink(xformLazy, 4.3, 0);
+
+    cmsDeleteTransform(xform);
+    cmsDeleteTransform(xformLazy);
+
+    if (hLink == NULL || hLinkLazy == NULL) return 0;
+
+    xform     = cmsCreateTransformTHR(DbgThread(), hLink, InputFormat, NULL, OutputFormat, INTENT_PERCEPTUAL, cmsFLAGS_NOOPTIMIZE);
+    xformLazy = cmsCreateTransformTHR(DbgThread(), hLinkLazy, InputFormat, NULL, OutputFormat, INTENT_PERCEPTUAL, cmsFLAGS_NOOPTIMIZE);
+
+    cmsCloseProfile(hLink);
+    cmsCloseProfile(hLinkLazy);
+
+    if (xform == NULL || xformLazy == NULL) return 0;
+
+    for (i = 0; i < sizeof(In); i++)
+        In[i] = (cmsUInt8Number) (i * 97);
+
+    cmsDoTransform(xform, In, Out, 4096);
+    cmsDoTransform(xformLazy, In, OutLazy, 4096);
+    if (memcmp(Out, OutLazy, sizeof(Out)) != 0) rc = 0;
+
+    cmsDeleteTransform(xform);
+    cmsDeleteTransform(xformLazy);
+    return rc;
+}
+
+static
+int CheckLazyPrecalc(void)
+{
+    cmsHPROFILE hsRGB  = cmsCreate_sRGBProfileTHR(DbgThread());
+    cmsHPROFILE hRGB3  = cmsOpenProfileFromFileTHR(DbgThread(), "test3.icc", "r");
+    cmsHPROFILE hSWOP  = cmsOpenProfileFromFileTHR(DbgThread(), "test1.icc", "r");
+    cmsHPROFILE hFOGRA = cmsOpenProfileFromFileTHR(DbgThread(), "test2.icc", "r");
+    int rc = 1;
+
+    // RGB to RGB on 8 bits is not compared, as lazy mode skips the linearization optimization
+    if (!CheckOneLazyTransform(hRGB3, TYPE_RGB_8, hSWOP, TYPE_CMYK_8, 0)) { Fail("Lazy RGB CLUT"); rc = 0; }
+    if (!CheckOneLazyTransform(hsRGB, TYPE_RGB_16, hSWOP, TYPE_CMYK_16,
+                               cmsFLAGS_CLUT_PRE_LINEARIZATION|cmsFLAGS_CLUT_POST_LINEARIZATION)) { Fail("Lazy CLUT with prelinearization"); rc = 0; }
+    if (!CheckOneLazyTransform(hSWOP, TYPE_CMYK_16, hFOGRA, TYPE_CMYK_16, cmsFLAGS_HIGHRESPRECALC)) { Fail("Lazy CMYK CLUT"); rc = 0; }
+
+    cmsCloseProfile(hsRGB);
+    cmsCloseProfile(hRGB3);
+    cmsCloseProfile(hSWOP);
+    cmsCloseProfile(hFOGRA);
+    return rc;
+}
+
+// Round trip of a transform through a blob, results should be bit-exact
+static
+int CheckOneTransformBlob(cmsHPROFILE hIn, cmsUInt32Number InputFormat, cmsHPROFILE hOut, cmsUInt32Number OutputFormat, cmsUInt32Number dwFlags)
+{
+    cmsHTRANSFORM xform, xformBlob;
+    cmsUInt8Number In[4096 * 8], Out[4096 * 8], OutBlob[4096 * 8];
+    cmsUInt32Number i, seed = 1, BytesNeeded = 0;
+    void* Blob;
+    int rc = 1;
+
+    xform = cmsCreateTransformTHR(DbgThread(), hIn, InputFormat, hOut, OutputFormat, INTENT_PERCEPTUAL, dwFlags);
+    if (xform == NULL) return 0;
+
+    if (!cmsSaveTransformToMem(xform, NULL, &BytesNeeded)) {
+        cmsDeleteTransform(xform);
         return 0;
+    }
 
-    dstProfile = cmsCreate_sRGBProfile();
-    if (!dstProfile) {
-        cmsCloseProfile(srcProfile);
+    Blob = malloc(BytesNeeded);
+    if (!cmsSaveTransformToMem(xform, Blob, &BytesNeeded)) {
+        free(Blob);
+        cmsDeleteTransform(xform);
         return 0;
     }
 
-    srcCS = cmsGetColorSpace(srcProfile);
-    nSrcComponents = cmsChannelsOfColorSpace(srcCS);
-    
-    if (srcCS == cmsSigLabData) {
-        srcFormat =
-            COLORSPACE_SH(PT_Lab) | CHANNELS_SH(nSrcComponents) | BYTES_SH(0);
+    xformBlob = cmsLoadTransformFromMemTHR(DbgThread(), Blob, BytesNeeded);
+    free(Blob);
+
+    if (xformBlob == NULL) {
+        cmsDeleteTransform(xform);
+        return 0;
+    }
+
+    for (i = 0; i < sizeof(In); i++) {
+
+        seed = seed * 1103515245U + 12345U;
+        In[i] = (cmsUInt8Number) (seed >> 16);
+    }
+
+    // Include the zero, which may come from the cache seed
+    memset(In, 0, 16);
+    memset(Out, 0, sizeof(Out));
+    memset(OutBlob, 0, sizeof(OutBlob));
+
+    cmsDoTransform(xform, In, Out, 4096);
+    cmsDoTransform(xformBlob, In, OutBlob, 4096);
+
+    if (memcmp(Out, OutBlob, sizeof(Out)) != 0) rc = 0;
+
+    if (cmsGetTransformInputFormat(xformBlob) != cmsGetTransformInputFormat(xform) ||
+        cmsGetTransformOutputFormat(xformBlob) != cmsGetTransformOutputFormat(xform)) rc = 0;
+
+    cmsDeleteTransform(xform);
+    cmsDeleteTransform(xformBlob);
+    return rc;
+}
+
+// Blobs are big endian
+static
+cmsUInt32Number BlobWord(const cmsUInt8Number* Ptr)
+{
+    return ((cmsUInt32Number) Ptr[0] << 24) | ((cmsUInt32Number) Ptr[1] << 16) | ((cmsUInt32Number) Ptr[2] << 8) | Ptr[3];
+}
+
+static
+void SetBlobWord(cmsUInt8Number* Ptr, cmsUInt32Number v)
+{
+    Ptr[0] = (cmsUInt8Number) (v >> 24); Ptr[1] = (cmsUInt8Number) (v >> 16);
+    Ptr[2] = (cmsUInt8Number) (v >> 8);  Ptr[3] = (cmsUInt8Number) v;
+}
+
+// Offset of the interpolation flags of the first CLUT in a blob, or zero. Only curves may come before.
+// The stages start after the header (96 bytes) and the pipeline kind, channels and number of stages.
+static
+cmsUInt32Number BlobCLUTFlagsOffset(const cmsUInt8Number* Blob, cmsUInt32Number Size)
+{
+    cmsUInt32Number Offset = 112, i, nIn;
+
+    while (Offset + 12 < Size) {
+
+        nIn = BlobWord(Blob + Offset + 4);
+
+        if (BlobWord(Blob + Offset) == cmsSigCLutElemType) return Offset + 12;
+        if (BlobWord(Blob + Offset) != cmsSigCurveSetElemType) return 0;
+
+        Offset += 12;
+        for (i = 0; i < nIn; i++)
+            Offset += 4 + 2 * BlobWord(Blob + Offset);
     }
+
+    return 0;
+}
+
+static
+int CheckTransformBlob(void)
+{
+    cmsHPROFILE hAbove = Create_AboveRGB();
+    cmsHPROFILE hsRGB  = cmsCreate_sRGBProfileTHR(DbgThread());
+    cmsHPROFILE hLab   = cmsCreateLab4ProfileTHR(DbgThread(), NULL);
+    cmsHPROFILE hLinear;
+    cmsHPROFILE hRGB3  = cmsOpenProfileFromFileTHR(DbgThread(), "test3.icc", "r");
+    cmsHPROFILE hSWOP  = cmsOpenProfileFromFileTHR(DbgThread(), "test1.icc", "r");
+    cmsHPROFILE hFOGRA = cmsOpenProfileFromFileTHR(DbgThread(), "test2.icc", "r");
+    cmsHTRANSFORM xform, xformBlob;
+    cmsUInt8Number* Blob;
+    cmsUInt32Number BytesNeeded = 0, Offset, Word;
+    cmsToneCurve* Curves[3];
+    int rc = 1;
+
+    Curves[0] = Curves[1] = Curves[2] = cmsBuildGamma(DbgThread(), 1.8);
+    hLinear = cmsCreateLinearizationDeviceLinkTHR(DbgThread(), cmsSigRgbData, Curves);
+    cmsFreeToneCurve(Curves[0]);
+
+    // One of each built-in optimization
+    if (!CheckOneTransformBlob(hAbove, TYPE_RGB_8, hsRGB, TYPE_RGB_8, 0)) { Fail("Matrix-shaper blob"); rc = 0; }
+    if (!CheckOneTransformBlob(hAbove, TYPE_RGB_16, hsRGB, TYPE_RGB_16, cmsFLAGS_MATSHAPER16)) { Fail("16 bits matrix-shaper blob"); rc = 0; }
+    if (!CheckOneTransformBlob(hLinear, TYPE_RGB_8, NULL, TYPE_RGB_8, 0)) { Fail("8 bits curves blob"); rc = 0; }
+    if (!CheckOneTransformBlob(hLinear, TYPE_RGB_16, NULL, TYPE_RGB_16, 0)) { Fail("16 bits curves blob"); rc = 0; }
+    if (!CheckOneTransformBlob(hsRGB, TYPE_RGB_16, hsRGB, TYPE_RGB_16, 0)) { Fail("Identity blob"); rc = 0; }
+    if (!CheckOneTransformBlob(hRGB3, TYPE_RGB_8, hsRGB, TYPE_RGB_8, 0)) { Fail("8 bits prelinearization blob"); rc = 0; }
+    if (!CheckOneTransformBlob(hsRGB, TYPE_RGB_16, hSWOP, TYPE_CMYK_16,
+                               cmsFLAGS_CLUT_PRE_LINEARIZATION|cmsFLAGS_CLUT_POST_LINEARIZATION)) { Fail("16 bits prelinearization blob"); rc = 0; }
+    if (!CheckOneTransformBlob(hsRGB, TYPE_RGB_8, hSWOP, TYPE_CMYK_8, 0)) { Fail("CLUT blob"); rc = 0; }
+    if (!CheckOneTransformBlob(hSWOP, TYPE_CMYK_16, hFOGRA, TYPE_CMYK_16, cmsFLAGS_MULTICACHE)) { Fail("CMYK CLUT blob"); rc = 0; }
+    if (!CheckOneTransformBlob(hsRGB, TYPE_RGB_16, hLab, TYPE_Lab_16, 0)) { Fail("Lab CLUT blob"); rc = 0; }
+    if (!CheckOneTransformBlob(hSWOP, TYPE_CMYK_16, hFOGRA, TYPE_CMYK_16, cmsFLAGS_LAZYPRECALC)) { Fail("Lazy CLUT blob"); rc = 0; }
+
+    // Tampered blobs are refused
+    cmsSetLogErrorHandler(ErrorReportingFunction);
+
+    xform = cmsCreateTransformTHR(DbgThread(), hsRGB, TYPE_RGB_8, hSWOP, TYPE_CMYK_8, INTENT_PERCEPTUAL, 0);
+    cmsSaveTransformToMem(xform, NULL, &BytesNeeded);
+    Blob = (cmsUInt8Number*) malloc(BytesNeeded);
+    cmsSaveTransformToMem(xform, Blob, &BytesNeeded);
+
+    // The blob version, big endian on offset 4
+    Blob[7] ^= 0xFF;
+    xformBlob = cmsLoadTransformFromMemTHR(DbgThread(), Blob, BytesNeeded);
+    if (xformBlob != NULL || !TrappedError) { Fail("Blob with wrong version accepted"); rc = 0; }
+    TrappedError = FALSE;
+    Blob[7] ^= 0xFF;
+
+    // A CPU feature no host has, on offset 12
+    Blob[12] ^= 0x80;
+    xformBlob = cmsLoadTransformFromMemTHR(DbgThread(), Blob, BytesNeeded);
+    if (xformBlob != NULL || !TrappedError) { Fail("Blob with unsupported CPU features accepted"); rc = 0; }
+    TrappedError = FALSE;
+    Blob[12] ^= 0x80;
+
+    // Truncated
+    xformBlob = cmsLoadTransformFromMemTHR(DbgThread(), Blob, BytesNeeded / 2);
+    if (xformBlob != NULL || !TrappedError) { Fail("Truncated blob accepted"); rc = 0; }
+    TrappedError = FALSE;
+
+    // Float interpolation on a 16 bits table
+    Offset = BlobCLUTFlagsOffset(Blob, BytesNeeded);
+    if (Offset == 0) { Fail("No CLUT found on the blob"); rc = 0; }
     else {
-        srcFormat =
-            COLORSPACE_SH(PT_ANY) | CHANNELS_SH(nSrcComponents) | BYTES_SH(1);
+
+        Blob[Offset + 3] ^= CMS_LERP_FLAGS_FLOAT;
+        xformBlob = cmsLoadTransformFromMemTHR(DbgThread(), Blob, BytesNeeded);
+        if (xformBlob != NULL || !TrappedError) { Fail("Blob with float interpolation on 16 bits accepted"); rc = 0; }
+        TrappedError = FALSE;
+        Blob[Offset + 3] ^= CMS_LERP_FLAGS_FLOAT;
     }
 
-    cmsSetLogErrorHandler(ErrorReportingFunction);
+    // Input format with more channels than the pipeline, on offset 16
+    Word = BlobWord(Blob + 16);
+    SetBlobWord(Blob + 16, (Word & ~(cmsUInt32Number) CHANNELS_SH(15)) | CHANNELS_SH(4));
+    xformBlob = cmsLoadTransformFromMemTHR(DbgThread(), Blob, BytesNeeded);
+    if (xformBlob != NULL || !TrappedError) { Fail("Blob with wrong number of channels accepted"); rc = 0; }
+    TrappedError = FALSE;
+    SetBlobWord(Blob + 16, Word);
 
-    hTransform = cmsCreateTransform(srcProfile, srcFormat, dstProfile,
-        TYPE_BGR_8, intent, flags);
-    cmsCloseProfile(srcProfile);
-    cmsCloseProfile(dstProfile);
+    xformBlob = cmsLoadTransformFromMemTHR(DbgThread(), Blob, BytesNeeded);
+    if (xformBlob == NULL) { Fail("Blob not restored"); rc = 0; }
 
-    cmsSetLogErrorHandler(FatalErrorQuit);    
+    // A buffer too small is reported as such
+    BytesNeeded--;
+    if (cmsSaveTransformToMem(xform, Blob, &BytesNeeded) || !TrappedError ||
+        strncmp(ReasonToFailBuffer, "Buffer too small", 16) != 0) { Fail("Blob saved on a buffer too small"); rc = 0; }
+    TrappedError = FALSE;
 
-    // Should report error
-    if (!TrappedError) return 0;
+    cmsDeleteTransform(xformBlob);
+    cmsDeleteTransform(xform);
+    free(Blob);
+
+    // The second shaper of the 16 bits matrix-shaper goes to the output as is. Its three tables end the blob
+    xform = cmsCreateTransformTHR(DbgThread(), hAbove, TYPE_RGB_16, hsRGB, TYPE_RGB_16, INTENT_PERCEPTUAL, cmsFLAGS_MATSHAPER16);
+    cmsSaveTransformToMem(xform, NULL, &BytesNeeded);
+    Blob = (cmsUInt8Number*) malloc(BytesNeeded);
+    cmsSaveTransformToMem(xform, Blob, &BytesNeeded);
+
+    Offset = BytesNeeded - 3 * 16385 * 4 + 100 * 4;
+    Word = BlobWord(Blob + Offset);
 
+    SetBlobWord(Blob + Offset, 0x7FC00000);     // NaN
+    xformBlob = cmsLoadTransformFromMemTHR(DbgThread(), Blob, BytesNeeded);
+    if (xformBlob != NULL || !TrappedError) { Fail("Blob with NaN on the shaper accepted"); rc = 0; }
     TrappedError = FALSE;
 
-    // Transform should NOT be created
-    if (!hTransform) return 1;
-    
-    // Never should reach here
-    if (T_BYTES(srcFormat) == 0) {  // 0 means double
-        double input[128];
-        for (i = 0; i < nSrcComponents; i++)
-            input[i] = 0.5f;
-        cmsDoTransform(hTransform, input, output, 1);
-    }
-    else {
-        cmsUInt8Number input[128];
-        for (i = 0; i < nSrcComponents; i++)
-            input[i] = 128;
-        cmsDoTransform(hTransform, input, output, 1);
-    }
-    cmsDeleteTransform(hTransform);
+    SetBlobWord(Blob + Offset, 0x40000000);     // 2.0
+    xformBlob = cmsLoadTransformFromMemTHR(DbgThread(), Blob, BytesNeeded);
+    if (xformBlob != NULL || !TrappedError) { Fail("Blob with shaper out of range accepted"); rc = 0; }
+    TrappedError = FALSE;
 
-    return 0;
+    SetBlobWord(Blob + Offset, Word);
+    xformBlob = cmsLoadTransformFromMemTHR(DbgThread(), Blob, BytesNeeded);
+    if (xformBlob == NULL) { Fail("16 bits matrix-shaper blob not restored"); rc = 0; }
+
+    cmsDeleteTransform(xformBlob);
+    cmsDeleteTransform(xform);
+    free(Blob);
+
+    // Float and unoptimized transforms cannot be saved
+    xform = cmsCreateTransformTHR(DbgThread(), hsRGB, TYPE_RGB_FLT, hSWOP, TYPE_CMYK_FLT, INTENT_PERCEPTUAL, 0);
+    if (cmsSaveTransformToMem(xform, NULL, &BytesNeeded) || !TrappedError) { Fail("Float transform saved"); rc = 0; }
+    TrappedError = FALSE;
+    cmsDeleteTransform(xform);
+
+    xform = cmsCreateTransformTHR(DbgThread(), hsRGB, TYPE_RGB_16, hSWOP, TYPE_CMYK_16, INTENT_PERCEPTUAL, cmsFLAGS_NOOPTIMIZE);
+    if (cmsSaveTransformToMem(xform, NULL, &BytesNeeded) || !TrappedError) { Fail("Unoptimized transform saved"); rc = 0; }
+    TrappedError = FALSE;
+    cmsDeleteTransform(xform);
+
+    cmsSetLogErrorHandler(FatalErrorQuit);
+
+    cmsCloseProfile(hAbove); cmsCloseProfile(hsRGB); cmsCloseProfile(hLab);
+    cmsCloseProfile(hLinear); cmsCloseProfile(hRGB3);
+    cmsCloseProfile(hSWOP); cmsCloseProfile(hFOGRA);
+    return rc;
 }
 
-/**
-* What the self test is trying to do is creating a proofing transform
-* with gamut check, so we can getting the coverage of one profile of
-* another, i.e. to approximate the gamut intersection. e.g.
-* Thanks to Richard Hughes for providing the test
-*/
+// Batched evaluation should give exactly the same results as evaluating pixel by pixel
 static
-int CheckProofingIntersection(void)
+int CheckBatchOnPipeline(const cmsPipeline* lut)
 {
-    cmsHPROFILE profile_null, hnd1, hnd2;
-    cmsHTRANSFORM transform;
+    cmsUInt16Number In16[1000 * cmsMAXCHANNELS], Out16[1000 * cmsMAXCHANNELS], Ref16[cmsMAXCHANNELS];
+    cmsFloat32Number InF[1000 * cmsMAXCHANNELS], OutF[1000 * cmsMAXCHANNELS], RefF[cmsMAXCHANNELS];
+    cmsUInt32Number nIn  = cmsPipelineInputChannels(lut);
+    cmsUInt32Number nOut = cmsPipelineOutputChannels(lut);
+    cmsUInt32Number i, j, seed = 1;
 
-    hnd1 = cmsCreate_sRGBProfile();
-    hnd2 = Create_AboveRGB();
+    for (i = 0; i < 1000 * nIn; i++) {
 
-    profile_null = cmsCreateNULLProfileTHR(DbgThread());
-    transform = cmsCreateProofingTransformTHR(DbgThread(),
-        hnd1,
-        TYPE_RGB_FLT,
-        profile_null,
-        TYPE_GRAY_FLT,
-        hnd2,
-        INTENT_ABSOLUTE_COLORIMETRIC,
-        INTENT_ABSOLUTE_COLORIMETRIC,
-        cmsFLAGS_GAMUTCHECK |
-        cmsFLAGS_SOFTPROOFING);
+        seed = seed * 1103515245U + 12345U;
+        In16[i] = (cmsUInt16Number) (seed >> 16);
+        InF[i]  = (cmsFloat32Number) In16[i] / 65535.0F;
+    }
 
-    cmsCloseProfile(hnd1);
-    cmsCloseProfile(hnd2);
-    cmsCloseProfile(profile_null);
+    cmsPipelineEval16Batch(In16, Out16, 1000, lut);
+    cmsPipelineEvalFloatBatch(InF, OutF, 1000, lut);
 
-    // Failed?
-    if (transform == NULL) return 0;
+    for (i = 0; i < 1000; i++) {
+
+        cmsPipelineEval16(In16 + i * nIn, Ref16, lut);
+        cmsPipelineEvalFloat(InF + i * nIn, RefF, lut);
+
+        for (j = 0; j < nOut; j++) {
+
+            if (Ref16[j] != Out16[i * nOut + j] || RefF[j] != OutF[i * nOut + j]) {
+
+                Fail("Batched evaluation differs on pixel %u, channel %u", i, j);
+                return 0;
+            }
+        }
+    }
 
-    cmsDeleteTransform(transform);
     return 1;
 }
 
-/**
-* In 2.11: When I create a RGB profile, set the copyright data with an empty string, 
-* then call cmsMD5computeID on said profile, the program crashes.
-*/
 static
-int CheckEmptyMLUC(void)
+int CheckBatchTransform(cmsHPROFILE hIn, cmsUInt32Number InputFormat, cmsHPROFILE hOut, cmsUInt32Number OutputFormat, cmsUInt32Number dwFlags)
 {
-    cmsContext context = cmsCreateContext(NULL, NULL);    
-    cmsCIExyY white = { 0.31271, 0.32902, 1.0 };
-    cmsCIExyYTRIPLE primaries =
-    {
-    .Red = { 0.640, 0.330, 1.0 },
-    .Green = { 0.300, 0.600, 1.0 },
-    .Blue = { 0.150, 0.060, 1.0 }
-    };
+    cmsHTRANSFORM xform;
+    int rc;
 
-    cmsFloat64Number parameters[10] = { 2.6, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
-    cmsToneCurve* toneCurve = cmsBuildParametricToneCurve(context, 1, parameters);
-    cmsToneCurve* toneCurves[3] = { toneCurve, toneCurve, toneCurve };
+    xform = cmsCreateTransformTHR(DbgThread(), hIn, InputFormat, hOut, OutputFormat, INTENT_PERCEPTUAL, dwFlags);
+    cmsCloseProfile(hIn); cmsCloseProfile(hOut);
 
-    cmsHPROFILE profile = cmsCreateRGBProfileTHR(context, &white, &primaries, toneCurves);
-    
-    cmsSetLogErrorHandlerTHR(context, FatalErrorQuit);
+    if (xform == NULL) {
+        Fail("Unable to create transform");
+        return 0;
+    }
 
-    cmsFreeToneCurve(toneCurve);
+    rc = CheckBatchOnPipeline(cmsGetTransformPipeline(xform));
+    cmsDeleteTransform(xform);
+    return rc;
+}
 
-    // Set an empty copyright tag. This should log an error.
-    cmsMLU* mlu = cmsMLUalloc(context, 1);
-    
-    cmsMLUsetASCII(mlu, "en", "AU", "");
-    cmsMLUsetWide(mlu,  "en", "EN", L"");
-    cmsWriteTag(profile, cmsSigCopyrightTag, mlu);
-    cmsMLUfree(mlu);
+static
+int CheckPipelineBatch(void)
+{
+    // Curves and matrices
+    if (!CheckBatchTransform(cmsCreate_sRGBProfileTHR(DbgThread()), TYPE_RGB_16,
+                             cmsCreateLab4ProfileTHR(DbgThread(), NULL), TYPE_Lab_16, cmsFLAGS_NOOPTIMIZE)) return 0;
 
-    // This will cause a crash after setting an empty copyright tag.
-    cmsMD5computeID(profile);
+    // CLUT in 16 bits
+    if (!CheckBatchTransform(cmsOpenProfileFromFileTHR(DbgThread(), "test1.icc", "r"), TYPE_CMYK_16,
+                             cmsCreateLab4ProfileTHR(DbgThread(), NULL), TYPE_Lab_16, cmsFLAGS_NOOPTIMIZE)) return 0;
 
-    // Cleanup
-    cmsCloseProfile(profile);
-    DebugMemDontCheckThis(context);
-    cmsDeleteContext(context);
+    // Optimized pipeline, with its own evaluator
+    if (!CheckBatchTransform(cmsOpenProfileFromFileTHR(DbgThread(), "test1.icc", "r"), TYPE_CMYK_16,
+                             cmsCreate_sRGBProfileTHR(DbgThread()), TYPE_RGB_16, 0)) return 0;
 
     return 1;
 }
 
+// Batch interpolators should match the one-pixel interpolators bit for bit. CLUTs are sampled from
+// the testbed profiles, then compared on every cell, around its edges and in its middle.
+#define BATCH_INTERP_NODES   33
+#define BATCH_INTERP_VALUES  (BATCH_INTERP_NODES * 5)
+
 static
-double distance(const cmsUInt16Number* a, const cmsUInt16Number* b)
+cmsInt32Number SampleByTransform(CMSREGISTER const cmsUInt16Number In[], CMSREGISTER cmsUInt16Number Out[], CMSREGISTER void* Cargo)
 {
-    double d1 = a[0] - b[0];
-    double d2 = a[1] - b[1];
-    double d3 = a[2] - b[2];
+    cmsDoTransform((cmsHTRANSFORM) Cargo, In, Out, 1);
+    return 1;
+}
 
-    return sqrt(d1 * d1 + d2 * d2 + d3 * d3);
+static
+cmsInt32Number SampleByTransformFloat(CMSREGISTER const cmsFloat32Number In[], CMSREGISTER cmsFloat32Number Out[], CMSREGISTER void* Cargo)
+{
+    cmsDoTransform((cmsHTRANSFORM) Cargo, In, Out, 1);
+    return 1;
 }
 
-/**
-* In 2.12, a report suggest that the built-in sRGB has roundtrip errors that makes color to move
-* when roundtripping again and again
-*/
 static
-int Check_sRGB_Rountrips(void)
+int CheckBatchInterpOnProfile(const char* Profile, cmsUInt32Number nOut)
 {
-    cmsUInt16Number rgb[3], seed[3];
-    cmsCIELab Lab;
-    int i, r, g, b;
-    double err, maxErr;
-    cmsHPROFILE hsRGB = cmsCreate_sRGBProfile();
-    cmsHPROFILE hLab = cmsCreateLab4Profile(NULL);
+    cmsHPROFILE hsRGB = cmsCreate_sRGBProfileTHR(DbgThread());
+    cmsHPROFILE hOut  = cmsOpenProfileFromFileTHR(DbgThread(), Profile, "r");
+    cmsHTRANSFORM xform16, xformFloat;
+    cmsStage *clut16, *clutFloat;
+    const cmsInterpParams *p16, *pFloat;
+    cmsUInt16Number Values[BATCH_INTERP_VALUES];
+    cmsUInt16Number In16[BATCH_INTERP_VALUES * 3], Out16[BATCH_INTERP_VALUES * cmsMAXCHANNELS], Ref16[cmsMAXCHANNELS];
+    cmsFloat32Number InFloat[BATCH_INTERP_VALUES * 3], OutFloat[BATCH_INTERP_VALUES * cmsMAXCHANNELS], RefFloat[cmsMAXCHANNELS];
+    cmsUInt32Number r, g, b, j, n, Node, Edge;
+    int rc = 1;
 
-    cmsHTRANSFORM hBack = cmsCreateTransform(hLab, TYPE_Lab_DBL, hsRGB, TYPE_RGB_16, INTENT_RELATIVE_COLORIMETRIC, 0);
-    cmsHTRANSFORM hForth = cmsCreateTransform(hsRGB, TYPE_RGB_16, hLab, TYPE_Lab_DBL, INTENT_RELATIVE_COLORIMETRIC, 0);
+    xform16    = cmsCreateTransformTHR(DbgThread(), hsRGB, TYPE_RGB_16, hOut, CHANNELS_SH(nOut)|BYTES_SH(2), INTENT_PERCEPTUAL, cmsFLAGS_NOCACHE);
+    xformFloat = cmsCreateTransformTHR(DbgThread(), hsRGB, TYPE_RGB_FLT, hOut, FLOAT_SH(1)|CHANNELS_SH(nOut)|BYTES_SH(4), INTENT_PERCEPTUAL, 0);
+    cmsCloseProfile(hsRGB); cmsCloseProfile(hOut);
 
-    cmsCloseProfile(hLab);
-    cmsCloseProfile(hsRGB);
+    clut16    = cmsStageAllocCLut16bit(DbgThread(), BATCH_INTERP_NODES, 3, nOut, NULL);
+    clutFloat = cmsStageAllocCLutFloat(DbgThread(), BATCH_INTERP_NODES, 3, nOut, NULL);
 
-    maxErr = 0.0;
-    for (r = 0; r <= 255; r += 16)
-        for (g = 0; g <= 255; g += 16)
-            for (b = 0; b <= 255; b += 16)
-            {
-                seed[0] = rgb[0] = (cmsUInt16Number) ((r << 8) | r);
-                seed[1] = rgb[1] = (cmsUInt16Number) ((g << 8) | g);
-                seed[2] = rgb[2] = (cmsUInt16Number) ((b << 8) | b);
+    cmsStageSampleCLut16bit(clut16, SampleByTransform, xform16, 0);
+    cmsStageSampleCLutFloat(clutFloat, SampleByTransformFloat, xformFloat, 0);
+    cmsDeleteTransform(xform16);
+    cmsDeleteTransform(xformFloat);
 
-                for (i = 0; i < 50; i++)
-                {
-                    cmsDoTransform(hForth, rgb, &Lab, 1);
-                    cmsDoTransform(hBack, &Lab, rgb, 1);
-                }
+    p16    = ((_cmsStageCLutData*) cmsStageData(clut16)) ->Params;
+    pFloat = ((_cmsStageCLutData*) cmsStageData(clutFloat)) ->Params;
 
-                err = distance(seed, rgb);
+    // On each axis, the values on both sides of every node, where the cell changes and the rest is about
+    // zero or one, and the middle of every cell. So all cells are visited with their edges, and in every
+    // combination across axes
+    n = 0;
+    for (Node=0; Node < BATCH_INTERP_NODES; Node++) {
 
-                if (err > maxErr)
-                    maxErr = err;
-            }
+        Edge = (Node * 0xFFFFU) / (BATCH_INTERP_NODES - 1);
 
+        for (j=0; j < 4; j++) {
 
-    cmsDeleteTransform(hBack);
-    cmsDeleteTransform(hForth);
+            if (Edge + j >= 1 && Edge + j <= 0x10000U)
+                Values[n++] = (cmsUInt16Number) (Edge + j - 1);
+        }
 
-    if (maxErr > 20.0)
-    {
-        printf("Maximum sRGB roundtrip error %f!\n", maxErr);
-        return 0;
+        if (Node < BATCH_INTERP_NODES - 1)
+            Values[n++] = (cmsUInt16Number) (Edge + 0xFFFFU / (2 * (BATCH_INTERP_NODES - 1)));
     }
-    
-    return 1;
-}
 
+    for (r=0; rc && r < n; r++) {
+        for (g=0; rc && g < n; g++) {
 
-static
-int CheckCenteringOfLab(void)
-{
-    cmsHPROFILE hProPhoto = cmsOpenProfileFromFile("test4.icc", "r");
-    cmsHPROFILE hLab = cmsCreateLab4Profile(NULL);
+            for (b=0; b < n; b++) {
 
-    cmsHTRANSFORM xform1 = cmsCreateTransform(hProPhoto, TYPE_BGR_16, hLab, TYPE_Lab_16, INTENT_RELATIVE_COLORIMETRIC, cmsFLAGS_HIGHRESPRECALC);
-    cmsHTRANSFORM xform2 = cmsCreateTransform(hLab, TYPE_Lab_16, hProPhoto, TYPE_BGR_16, INTENT_RELATIVE_COLORIMETRIC, cmsFLAGS_HIGHRESPRECALC);
+                In16[b*3+0] = Values[r];
+                In16[b*3+1] = Values[g];
+                In16[b*3+2] = Values[b];
 
-    cmsUInt16Number bgr[3] = { 0xffff, 0xffff, 0xffff };
-    cmsUInt16Number bgr2[3];
-    cmsUInt16Number lab[3];
+                for (j=0; j < 3; j++)
+                    InFloat[b*3+j] = In16[b*3+j] / 65535.0F;
+            }
 
-    cmsDoTransform(xform1, bgr, lab, 1);
-    cmsDoTransform(xform2, lab, bgr2, 1);
+            p16 ->BatchInterpolation.Lerp16Batch(In16, Out16, n, p16);
+            pFloat ->BatchInterpolation.LerpFloatBatch(InFloat, OutFloat, n, pFloat);
 
-    if ((0xffff - bgr2[0]) > 5 ||
-        (0xffff - bgr2[1]) > 5 ||
-        (0xffff - bgr2[2]) > 5)
-    {
-        printf("Centering of Lab16 failed. Got %x %x %x\n", bgr2[0], bgr2[1], bgr2[2]);
-        return 0;
-    }
+            for (b=0; rc && b < n; b++) {
 
+                p16 ->Interpolation.Lerp16(In16 + b*3, Ref16, p16);
+                pFloat ->Interpolation.LerpFloat(InFloat + b*3, RefFloat, pFloat);
 
-    cmsCloseProfile(hLab);
-    cmsCloseProfile(hProPhoto);
-    cmsDeleteTransform(xform1);
-    cmsDeleteTransform(xform2);
+                for (j=0; j < nOut; j++) {
 
-    return 1;
+                    if (Ref16[j] != Out16[b * nOut + j] || RefFloat[j] != OutFloat[b * nOut + j]) {
+
+                        Fail("%s: batch interpolation differs at (%u, %u, %u)", Profile, In16[b*3], In16[b*3+1], In16[b*3+2]);
+                        rc = 0;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    cmsStageFree(clut16);
+    cmsStageFree(clutFloat);
+    return rc;
 }
 
+static
+int CheckBatchInterpolation(void)
+{
+    return CheckBatchInterpOnProfile("test1.icc", 4) &&
+           CheckBatchInterpOnProfile("test2.icc", 4) &&
+           CheckBatchInterpOnProfile("test3.icc", 3) &&
+           CheckBatchInterpOnProfile("test4.icc", 3) &&
+           CheckBatchInterpOnProfile("test5.icc", 3) &&
+           CheckBatchInterpOnProfile("crayons.icc", 3) &&
+           CheckBatchInterpOnProfile("ibm-t61.icc", 3);
+}
 
-/**
-* Check OKLab colorspace
-*/
+// Same on four inputs, CMYK to CMYK. The lattice is coarser, there is one more dimension
 static
-int Check_OkLab(void)
+int CheckBatchInterpCMYK(void)
 {
-    cmsHPROFILE hOkLab = cmsCreate_OkLabProfile(NULL);
-    cmsHPROFILE hXYZ = cmsCreateXYZProfile();
-    cmsCIEXYZ xyz, xyz2;
-    cmsCIELab okLab;
+    cmsHPROFILE hIn  = cmsOpenProfileFromFileTHR(DbgThread(), "test1.icc", "r");
+    cmsHPROFILE hOut = cmsOpenProfileFromFileTHR(DbgThread(), "test2.icc", "r");
+    cmsHTRANSFORM xform16, xformFloat;
+    cmsStage *clut16, *clutFloat;
+    const cmsInterpParams *p16, *pFloat;
+    cmsUInt16Number Values[24];
+    cmsUInt16Number In16[24 * 4], Out16[24 * 4], Ref16[cmsMAXCHANNELS];
+    cmsFloat32Number InFloat[24 * 4], OutFloat[24 * 4], RefFloat[cmsMAXCHANNELS];
+    cmsUInt32Number c, m, y, k, j;
+    int rc = 1;
 
-#define TYPE_OKLAB_DBL          (FLOAT_SH(1)|COLORSPACE_SH(PT_MCH3)|CHANNELS_SH(3)|BYTES_SH(0))
+    xform16    = cmsCreateTransformTHR(DbgThread(), hIn, TYPE_CMYK_16, hOut, TYPE_CMYK_16, INTENT_PERCEPTUAL, cmsFLAGS_NOCACHE);
+    xformFloat = cmsCreateTransformTHR(DbgThread(), hIn, TYPE_CMYK_FLT, hOut, TYPE_CMYK_FLT, INTENT_PERCEPTUAL, 0);
+    cmsCloseProfile(hIn); cmsCloseProfile(hOut);
 
-    cmsHTRANSFORM xform  = cmsCreateTransform(hXYZ, TYPE_XYZ_DBL,  hOkLab, TYPE_OKLAB_DBL, INTENT_RELATIVE_COLORIMETRIC, 0);
-    cmsHTRANSFORM xform2 = cmsCreateTransform(hOkLab, TYPE_OKLAB_DBL, hXYZ, TYPE_XYZ_DBL,  INTENT_RELATIVE_COLORIMETRIC, 0);
+    clut16    = cmsStageAllocCLut16bit(DbgThread(), 9, 4, 4, NULL);
+    clutFloat = cmsStageAllocCLutFloat(DbgThread(), 9, 4, 4, NULL);
 
-    /**
-    * D50 should be converted to white by PCS definition
-    */
-    xyz.X = 0.9642; xyz.Y = 1.0000; xyz.Z = 0.8249;
-    cmsDoTransform(xform, &xyz, &okLab, 1);
-    cmsDoTransform(xform2, &okLab, &xyz2, 1);
+    cmsStageSampleCLut16bit(clut16, SampleByTransform, xform16, 0);
+    cmsStageSampleCLutFloat(clutFloat, SampleByTransformFloat, xformFloat, 0);
+    cmsDeleteTransform(xform16);
+    cmsDeleteTransform(xformFloat);
 
+    p16    = ((_cmsStageCLutData*) cmsStageData(clut16)) ->Params;
+    pFloat = ((_cmsStageCLutData*) cmsStageData(clutFloat)) ->Params;
 
-    xyz.X = 1.0; xyz.Y = 0.0; xyz.Z = 0.0;
-    cmsDoTransform(xform, &xyz, &okLab, 1);
-    cmsDoTransform(xform2, &okLab, &xyz2, 1);
+    // Every 11th 8-bit value, plus the values next to the extremes
+    for (c=0; c < 22; c++)
+        Values[c] = (cmsUInt16Number) (c * 11 * 257);
+    Values[22] = 1;
+    Values[23] = 0xFFFF;
 
+    for (c=0; rc && c < 24; c++) {
+        for (m=0; rc && m < 24; m++) {
+            for (y=0; rc && y < 24; y++) {
 
-    xyz.X = 0.0; xyz.Y = 1.0; xyz.Z = 0.0;
-    cmsDoTransform(xform, &xyz, &okLab, 1);
-    cmsDoTransform(xform2, &okLab, &xyz2, 1);
+                for (k=0; k < 24; k++) {
 
-    xyz.X = 0.0; xyz.Y = 0.0; xyz.Z = 1.0;
-    cmsDoTransform(xform, &xyz, &okLab, 1);
-    cmsDoTransform(xform2, &okLab, &xyz2, 1);
+                    In16[k*4+0] = Values[c];
+                    In16[k*4+1] = Values[m];
+                    In16[k*4+2] = Values[y];
+                    In16[k*4+3] = Values[k];
 
-    xyz.X = 0.143046; xyz.Y = 0.060610; xyz.Z = 0.713913;
-    cmsDoTransform(xform, &xyz, &okLab, 1);
-    cmsDoTransform(xform2, &okLab, &xyz2, 1);
-    
-    cmsDeleteTransform(xform);
-    cmsDeleteTransform(xform2);
-    cmsCloseProfile(hOkLab);
-    cmsCloseProfile(hXYZ);
+                    for (j=0; j < 4; j++)
+                        InFloat[k*4+j] = In16[k*4+j] / 65535.0F;
+                }
+
+                p16 ->BatchInterpolation.Lerp16Batch(In16, Out16, 24, p16);
+                pFloat ->BatchInterpolation.LerpFloatBatch(InFloat, OutFloat, 24, pFloat);
+
+                for (k=0; rc && k < 24; k++) {
+
+                    p16 ->Interpolation.Lerp16(In16 + k*4, Ref16, p16);
+                    pFloat ->Interpolation.LerpFloat(InFloat + k*4, RefFloat, pFloat);
+
+                    for (j=0; j < 4; j++) {
+
+                        if (Ref16[j] != Out16[k*4+j] || RefFloat[j] != OutFloat[k*4+j]) {
 
-    return 1;
-}
+                            Fail("CMYK batch interpolation differs at (%u, %u, %u, %u)", In16[k*4], In16[k*4+1], In16[k*4+2], In16[k*4+3]);
+                            rc = 0;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+    }
 
+    cmsStageFree(clut16);
+    cmsStageFree(clutFloat);
+    return rc;
+}
 
+// Restricting CPU features should select other kernels, all giving the same results
 static
-int Check_OkLab2(void)
+int CheckCPUFeatures(void)
 {
-#define TYPE_LABA_F32 (FLOAT_SH(1)|COLORSPACE_SH(PT_MCH3)|EXTRA_SH(1)|CHANNELS_SH(3)|BYTES_SH(4))
+    cmsUInt32Number Levels[] = { 0, cmsCPU_SSE2, cmsCPU_SSE2|cmsCPU_SSE41, 0xFFFFFFFFU };
+    cmsUInt32Number i, Prev;
+    int rc = 1;
 
-    cmsUInt16Number rgb[3];
-    cmsFloat32Number lab[4];
+    Prev = cmsSetCPUFeaturesMask(DbgThread(), 0xFFFFFFFFU);
 
-    cmsHPROFILE labProfile = cmsCreate_OkLabProfile(NULL);
-    cmsHPROFILE rgbProfile = cmsCreate_sRGBProfile();
+    for (i=0; rc && i < sizeof(Levels) / sizeof(Levels[0]); i++) {
 
-    cmsHTRANSFORM hBack = cmsCreateTransform(labProfile, TYPE_LABA_F32, rgbProfile, TYPE_RGB_16, INTENT_RELATIVE_COLORIMETRIC, 0);
-    cmsHTRANSFORM hForth = cmsCreateTransform(rgbProfile, TYPE_RGB_16, labProfile, TYPE_LABA_F32, INTENT_RELATIVE_COLORIMETRIC, 0);
+        cmsSetCPUFeaturesMask(DbgThread(), Levels[i]);
 
-    cmsCloseProfile(labProfile);
-    cmsCloseProfile(rgbProfile);
+        if ((cmsGetCPUFeatures(DbgThread()) & ~Levels[i]) != 0) {
+            Fail("CPU features not masked");
+            rc = 0;
+        }
 
-    rgb[0] = 0;
-    rgb[1] = 0;
-    rgb[2] = 65535;
+        if (!CheckBatchInterpOnProfile("test1.icc", 4) || !CheckBatchInterpCMYK()) rc = 0;
+    }
 
-    cmsDoTransform(hForth, rgb, &lab, 1);
-    cmsDoTransform(hBack, lab, &rgb, 1);
+    cmsSetCPUFeaturesMask(DbgThread(), Prev);
+    return rc;
+}
 
-    cmsDeleteTransform(hBack);
-    cmsDeleteTransform(hForth);
+// Matrix-shaper scanline routines read and write chunky RGB straight from the buffers. They should give
+// the same results as the formatters, which are the only way for planar layouts.
+typedef struct {
 
-    if (rgb[0] != 0 || rgb[1] != 0 || rgb[2] != 65535) return 0;
+    cmsUInt32Number Format;
+    cmsUInt32Number nSamples;
+    cmsUInt32Number Offset[4];      // R, G, B and the extra channel, if any
 
-    return 1;
-}
+} ChunkyRGB;
 
+#define SCANLINE_PIXELS 1027
 
 static
-cmsHPROFILE createRgbGamma(cmsFloat64Number g)
+int CheckOneMatShaperScanline(cmsHPROFILE hIn, cmsHPROFILE hOut, cmsUInt32Number Planar, const ChunkyRGB* Chunky, cmsUInt32Number dwFlags)
 {
-    cmsCIExyY       D65 = { 0.3127, 0.3290, 1.0 };
-    cmsCIExyYTRIPLE Rec709Primaries = {
-                                {0.6400, 0.3300, 1.0},
-                                {0.3000, 0.6000, 1.0},
-                                {0.1500, 0.0600, 1.0}
-    };
-    cmsToneCurve* Gamma[3];
-    cmsHPROFILE  hRGB;
-    
-    Gamma[0] = Gamma[1] = Gamma[2] = cmsBuildGamma(0, g);
-    if (Gamma[0] == NULL) return NULL;
+    cmsUInt32Number nBytes = T_BYTES(Planar);
+    cmsUInt32Number PlaneSize = SCANLINE_PIXELS * nBytes;
+    cmsUInt8Number* InP  = (cmsUInt8Number*) chknull(malloc(3 * PlaneSize));
+    cmsUInt8Number* OutP = (cmsUInt8Number*) chknull(malloc(3 * PlaneSize));
+    cmsUInt8Number* InC  = (cmsUInt8Number*) chknull(malloc(Chunky ->nSamples * PlaneSize));
+    cmsUInt8Number* OutC = (cmsUInt8Number*) chknull(malloc(Chunky ->nSamples * PlaneSize));
+    cmsHTRANSFORM xPlanar, xChunky;
+    cmsUInt32Number i, c, seed = 1;
+    int rc = 1;
 
-    hRGB = cmsCreateRGBProfile(&D65, &Rec709Primaries, Gamma);
-    cmsFreeToneCurve(Gamma[0]);    
-    return hRGB;
-}
+    xPlanar = cmsCreateTransformTHR(DbgThread(), hIn, Planar, hOut, Planar, INTENT_RELATIVE_COLORIMETRIC, dwFlags & ~cmsFLAGS_COPY_ALPHA);
+    xChunky = cmsCreateTransformTHR(DbgThread(), hIn, Chunky ->Format, hOut, Chunky ->Format, INTENT_RELATIVE_COLORIMETRIC, dwFlags);
 
+    // Same routine on both means the scanline routine was not taken
+    if (((_cmsTRANSFORM*) xPlanar) ->xform == ((_cmsTRANSFORM*) xChunky) ->xform) {
+        Fail("Matrix-shaper scanline routine not selected");
+        rc = 0;
+    }
 
-static
-int CheckGammaSpaceDetection(void)
-{
-    cmsFloat64Number i;
+    for (i=0; i < SCANLINE_PIXELS * 3; i++) {
 
-    for (i = 0.5; i < 3; i += 0.1)
-    {                
-        cmsHPROFILE hProfile = createRgbGamma(i);
+        seed = seed * 1103515245U + 12345U;
 
-        cmsFloat64Number gamma = cmsDetectRGBProfileGamma(hProfile, 0.01);
+        if (nBytes == 4)
+            ((cmsFloat32Number*) InP)[i] = (cmsFloat32Number) (seed >> 8) / 16777216.0F * 1.2F - 0.1F;
+        else
+        if (nBytes == 2)
+            ((cmsUInt16Number*) InP)[i] = (cmsUInt16Number) (seed >> 16);
+        else
+            InP[i] = (cmsUInt8Number) (seed >> 16);
+    }
 
-        cmsCloseProfile(hProfile);
+    // The extremes
+    memset(InP, 0, nBytes);
+    memset(InP + PlaneSize - nBytes, 0xFF, nBytes);
+    if (nBytes == 4) ((cmsFloat32Number*) InP)[SCANLINE_PIXELS - 1] = 1.0F;
 
-        if (fabs(gamma - i) > 0.1)
-        {
-            Fail("Failed profile gamma detection of %f (got %f)", i, gamma);
-            return 0;
+    memset(InC, 0x55, Chunky ->nSamples * PlaneSize);
+    memset(OutC, 0, Chunky ->nSamples * PlaneSize);
+    memset(OutP, 0, 3 * PlaneSize);
+
+    for (i=0; i < SCANLINE_PIXELS; i++) {
+        for (c=0; c < 3; c++)
+            memcpy(InC + (i * Chunky ->nSamples + Chunky ->Offset[c]) * nBytes, InP + c * PlaneSize + i * nBytes, nBytes);
+    }
+
+    cmsDoTransform(xPlanar, InP, OutP, SCANLINE_PIXELS);
+    cmsDoTransform(xChunky, InC, OutC, SCANLINE_PIXELS);
+
+    for (i=0; rc && i < SCANLINE_PIXELS; i++) {
+
+        for (c=0; c < 3; c++) {
+
+            if (memcmp(OutC + (i * Chunky ->nSamples + Chunky ->Offset[c]) * nBytes, OutP + c * PlaneSize + i * nBytes, nBytes) != 0) {
+
+                Fail("Matrix-shaper scanline differs from formatters on pixel %u", i);
+                rc = 0;
+                break;
+            }
+        }
+
+        if (Chunky ->nSamples == 4 && (dwFlags & cmsFLAGS_COPY_ALPHA) &&
+            memcmp(OutC + (i * 4 + Chunky ->Offset[3]) * nBytes, InC + (i * 4 + Chunky ->Offset[3]) * nBytes, nBytes) != 0) {
+
+            Fail("Alpha not copied on pixel %u", i);
+            rc = 0;
         }
     }
 
-    return 1;
+    cmsDeleteTransform(xPlanar);
+    cmsDeleteTransform(xChunky);
+    free(InP); free(OutP); free(InC); free(OutC);
+    return rc;
 }
 
-// Per issue #308. A built-in is corrupted by using write raw tag was causing a segfault
+// A scanline routine is bound to the sample size, so changing the formats should pick the routine again
 static
-int CheckInducedCorruption(void)
+int CheckMatShaperChangeFormat(cmsHPROFILE hIn, cmsHPROFILE hOut)
 {
-    cmsHTRANSFORM xform0;
-    char garbage[] = "\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0a\x0b";
-    cmsHPROFILE hsrgb = cmsCreate_sRGBProfile();
-    cmsHPROFILE hLab = cmsCreateLab4Profile(NULL);
+    cmsUInt8Number  In[SCANLINE_PIXELS][3], Out[SCANLINE_PIXELS][3];
+    cmsUInt16Number In16[SCANLINE_PIXELS][3], Ref16[SCANLINE_PIXELS][3];
+    cmsHTRANSFORM xform, xformRef;
+    cmsUInt32Number i, c, seed = 1;
+    int rc = 1;
 
-    cmsSetLogErrorHandler(NULL);
-    cmsWriteRawTag(hsrgb, cmsSigBlueColorantTag, &garbage, sizeof(garbage));
+    xform    = cmsCreateTransformTHR(DbgThread(), hIn, TYPE_RGB_16, hOut, TYPE_RGB_16, INTENT_RELATIVE_COLORIMETRIC, cmsFLAGS_MATSHAPER16);
+    xformRef = cmsCreateTransformTHR(DbgThread(), hIn, TYPE_RGB_16, hOut, TYPE_RGB_16, INTENT_RELATIVE_COLORIMETRIC, cmsFLAGS_MATSHAPER16);
 
-    xform0 = cmsCreateTransform(hsrgb, TYPE_RGB_16, hLab, TYPE_Lab_16, INTENT_RELATIVE_COLORIMETRIC, 0);
+    if (xform == NULL || xformRef == NULL || !cmsChangeBuffersFormat(xform, TYPE_RGB_8, TYPE_RGB_8)) {
 
-    if (xform0) cmsDeleteTransform(xform0);
+        Fail("Cannot change formats of a matrix-shaper transform");
+        rc = 0;
+    }
+    else {
 
-    cmsCloseProfile(hsrgb);
-    cmsCloseProfile(hLab);
+        for (i=0; i < SCANLINE_PIXELS; i++) {
+            for (c=0; c < 3; c++) {
 
-    ResetFatalError();
-    return 1;
-}
+                seed = seed * 1103515245U + 12345U;
+                In[i][c] = (cmsUInt8Number) (seed >> 16);
+                In16[i][c] = FROM_8_TO_16(In[i][c]);
+            }
+        }
 
-#if 0
+        cmsDoTransform(xform, In, Out, SCANLINE_PIXELS);
+        cmsDoTransform(xformRef, In16, Ref16, SCANLINE_PIXELS);
 
-// You need to download following profiles to execute this test: sRGB-elle-V4-srgbtrc.icc, sRGB-elle-V4-g10.icc
-// The include this line in the checks list:  Check("KInear spaces detection", CheckLinearSpacesOptimization);
-static
-void uint16toFloat(cmsUInt16Number* src, cmsFloat32Number* dst)
-{
-    for (int i = 0; i < 3; i++) {
-        dst[i] = src[i] / 65535.f;
+        for (i=0; rc && i < SCANLINE_PIXELS; i++) {
+            for (c=0; c < 3; c++) {
+
+                if (Out[i][c] != FROM_16_TO_8(Ref16[i][c])) {
+
+                    Fail("Matrix-shaper scanline routine kept after changing formats");
+                    rc = 0;
+                    break;
+                }
+            }
+        }
     }
+
+    if (xform != NULL) cmsDeleteTransform(xform);
+    if (xformRef != NULL) cmsDeleteTransform(xformRef);
+    return rc;
 }
 
 static
-int CheckLinearSpacesOptimization(void)
+int CheckMatShaperScanline(void)
 {
-    cmsHPROFILE lcms_sRGB = cmsCreate_sRGBProfile();
-    cmsHPROFILE elle_sRGB = cmsOpenProfileFromFile("sRGB-elle-V4-srgbtrc.icc", "r");
-    cmsHPROFILE elle_linear = cmsOpenProfileFromFile("sRGB-elle-V4-g10.icc", "r");
-    cmsHTRANSFORM transform1 = cmsCreateTransform(elle_sRGB, TYPE_RGB_16, elle_linear, TYPE_RGB_16, INTENT_RELATIVE_COLORIMETRIC, 0);
-    cmsHTRANSFORM transform2 = cmsCreateTransform(elle_linear, TYPE_RGB_16, lcms_sRGB, TYPE_RGB_16, INTENT_RELATIVE_COLORIMETRIC, 0);
-    cmsHTRANSFORM transform2a = cmsCreateTransform(elle_linear, TYPE_RGB_FLT, lcms_sRGB, TYPE_RGB_16, INTENT_RELATIVE_COLORIMETRIC, 0);
+    static const ChunkyRGB Chunky8[] = {
 
-    cmsUInt16Number sourceCol[3] = { 43 * 257, 27 * 257, 6 * 257 };
-    cmsUInt16Number linearCol[3] = { 0 };
-    float linearColF[3] = { 0 };
-    cmsUInt16Number finalCol[3] = { 0 };
-    int difR, difG, difB;
-    int difR2, difG2, difB2;
+        { TYPE_RGB_8,  3, { 0, 1, 2, 0 } },
+        { TYPE_BGR_8,  3, { 2, 1, 0, 0 } },
+        { TYPE_RGBA_8, 4, { 0, 1, 2, 3 } },
+        { TYPE_ARGB_8, 4, { 1, 2, 3, 0 } },
+        { TYPE_BGRA_8, 4, { 2, 1, 0, 3 } },
+        { TYPE_ABGR_8, 4, { 3, 2, 1, 0 } }
+    };
 
-    cmsDoTransform(transform1, sourceCol, linearCol, 1);
-    cmsDoTransform(transform2, linearCol, finalCol, 1);
+    static const ChunkyRGB Chunky16[] = {
 
-    cmsCloseProfile(lcms_sRGB); cmsCloseProfile(elle_sRGB); cmsCloseProfile(elle_linear);
+        { TYPE_RGB_16,  3, { 0, 1, 2, 0 } },
+        { TYPE_BGR_16,  3, { 2, 1, 0, 0 } },
+        { TYPE_RGBA_16, 4, { 0, 1, 2, 3 } }
+    };
 
+    static const ChunkyRGB ChunkyFloat[] = {
 
-    difR = (int)sourceCol[0] - finalCol[0];
-    difG = (int)sourceCol[1] - finalCol[1];
-    difB = (int)sourceCol[2] - finalCol[2];
+        { TYPE_RGB_FLT,  3, { 0, 1, 2, 0 } },
+        { TYPE_RGBA_FLT, 4, { 0, 1, 2, 3 } },
+        { TYPE_BGRA_FLT, 4, { 2, 1, 0, 3 } }
+    };
 
+    cmsUInt32Number PlanarFloat = FLOAT_SH(1)|COLORSPACE_SH(PT_RGB)|CHANNELS_SH(3)|BYTES_SH(4)|PLANAR_SH(1);
+    cmsUInt32Number Levels[] = { 0, 0xFFFFFFFFU };
+    cmsHPROFILE hAbove = Create_AboveRGB();
+    cmsHPROFILE hsRGB  = cmsCreate_sRGBProfileTHR(DbgThread());
+    cmsUInt32Number i, j, Prev;
+    int rc = 1;
 
-    uint16toFloat(linearCol, linearColF);
-    cmsDoTransform(transform2a, linearColF, finalCol, 1);
+    Prev = cmsSetCPUFeaturesMask(DbgThread(), 0xFFFFFFFFU);
 
-    difR2 = (int)sourceCol[0] - finalCol[0];
-    difG2 = (int)sourceCol[1] - finalCol[1];
-    difB2 = (int)sourceCol[2] - finalCol[2];
+    // Plain C and vectorized routines
+    for (i=0; rc && i < sizeof(Levels) / sizeof(Levels[0]); i++) {
 
-    cmsDeleteTransform(transform1);
-    cmsDeleteTransform(transform2);
-    cmsDeleteTransform(transform2a);
+        cmsSetCPUFeaturesMask(DbgThread(), Levels[i]);
 
-    if (abs(difR2 - difR) > 5 || abs(difG2 - difG) > 5 || abs(difB2 - difB) > 5)
-    {
-        Fail("Linear detection failed");
-        return 0;
+        for (j=0; j < sizeof(Chunky8) / sizeof(Chunky8[0]); j++)
+            if (!CheckOneMatShaperScanline(hAbove, hsRGB, TYPE_RGB_8_PLANAR, &Chunky8[j], 0)) rc = 0;
+
+        for (j=0; j < sizeof(Chunky16) / sizeof(Chunky16[0]); j++)
+            if (!CheckOneMatShaperScanline(hAbove, hsRGB, TYPE_RGB_16_PLANAR, &Chunky16[j], cmsFLAGS_MATSHAPER16)) rc = 0;
+
+        for (j=0; j < sizeof(ChunkyFloat) / sizeof(ChunkyFloat[0]); j++)
+            if (!CheckOneMatShaperScanline(hAbove, hsRGB, PlanarFloat, &ChunkyFloat[j], 0)) rc = 0;
+
+        if (!CheckOneMatShaperScanline(hAbove, hsRGB, TYPE_RGB_8_PLANAR, &Chunky8[4], cmsFLAGS_COPY_ALPHA)) rc = 0;
+        if (!CheckOneMatShaperScanline(hAbove, hsRGB, TYPE_RGB_16_PLANAR, &Chunky16[2], cmsFLAGS_COPY_ALPHA|cmsFLAGS_MATSHAPER16)) rc = 0;
     }
 
-    return 1;
-}
-#endif
+    cmsSetCPUFeaturesMask(DbgThread(), Prev);
 
+    if (rc && !CheckMatShaperChangeFormat(hAbove, hsRGB)) rc = 0;
 
+    cmsCloseProfile(hAbove);
+    cmsCloseProfile(hsRGB);
+    return rc;
+}
 
+// The 16 bits matrix-shaper against the unoptimized pipeline
 static
-int CheckBadCGATS(void)
+int CheckMatShaper16Accuracy(void)
 {
-    const char* bad_it8 =
-        " \"\"\n"
-        "NUMBER_OF_FIELDS 4\n"
-        "BEGIN_DATA_FORMAT\n"
-        "I R G G\n"
-        "END_DATA_FORMAT\n"
-        "NUMBER_OF_FIELDS 9\n"
-        "NUMBER_OF_SETS 2\n"
-        "BEGIN_DATA\n"
-        "d\n"
-        "0 0Bd\n"
-        "0Ba	$ $ t .";
+    cmsHPROFILE hAbove = Create_AboveRGB();
+    cmsHPROFILE hsRGB  = cmsCreate_sRGBProfileTHR(DbgThread());
+    cmsHTRANSFORM xform, xformRef;
+    cmsUInt16Number In[3], Out[3], Ref[3];
+    cmsUInt32Number r, g, b, c;
+    int Max = 0;
+
+    xform    = cmsCreateTransformTHR(DbgThread(), hAbove, TYPE_RGB_16, hsRGB, TYPE_RGB_16, INTENT_RELATIVE_COLORIMETRIC, cmsFLAGS_MATSHAPER16);
+    xformRef = cmsCreateTransformTHR(DbgThread(), hAbove, TYPE_RGB_16, hsRGB, TYPE_RGB_16, INTENT_RELATIVE_COLORIMETRIC, cmsFLAGS_NOOPTIMIZE);
+    cmsCloseProfile(hAbove);
+    cmsCloseProfile(hsRGB);
 
-    cmsHANDLE hIT8;
-    
-    cmsSetLogErrorHandler(NULL);
+    for (r=0; r < 65536; r += 1031) {
+        for (g=0; g < 65536; g += 1031) {
+            for (b=0; b < 65536; b += 1031) {
 
-    hIT8 = cmsIT8LoadFromMem(0, bad_it8, (cmsUInt32Number) strlen(bad_it8));
-    
-    ResetFatalError();
+                In[0] = (cmsUInt16Number) r; In[1] = (cmsUInt16Number) g; In[2] = (cmsUInt16Number) b;
 
-    if (hIT8 != NULL)
-    {
-        Fail("Wrong IT8 accepted as ok");
-        cmsIT8Free(hIT8);
+                cmsDoTransform(xform, In, Out, 1);
+                cmsDoTransform(xformRef, In, Ref, 1);
+
+                for (c=0; c < 3; c++) {
+                    int d = abs((int) Out[c] - (int) Ref[c]);
+                    if (d > Max) Max = d;
+                }
+            }
+        }
+    }
+
+    cmsDeleteTransform(xform);
+    cmsDeleteTransform(xformRef);
+
+    if (Max > 2) {
+        Fail("16 bits matrix-shaper off by %d", Max);
+        return 0;
     }
 
     return 1;
 }
 
+// Fused routines of the commonest layouts should give the same results as the formatters, checked
+// here on the planar layouts, which have no fused routines
+typedef struct {
+
+    cmsUInt32Number Format;
+    cmsUInt32Number Planar;
+    cmsUInt32Number nChannels;
+    cmsUInt32Number nSamples;
+    cmsUInt32Number Offset[4];      // Where each channel is in the pixel
+
+} FusedLayout;
+
+#define FUSED_PIXELS 1031
+
 static
-int CheckIntToFloatTransform(void)
+int CheckOneFusedXform(cmsHPROFILE hProfiles[], cmsUInt32Number nProfiles, const FusedLayout* In, const FusedLayout* Out, cmsUInt32Number dwFlags)
 {
-    cmsHPROFILE hAbove = Create_AboveRGB();
-    cmsHPROFILE hsRGB = cmsCreate_sRGBProfile();
+    cmsUInt32Number nBytesIn  = T_BYTES(In ->Format);
+    cmsUInt32Number nBytesOut = T_BYTES(Out ->Format);
+    cmsUInt8Number* InP  = (cmsUInt8Number*) chknull(malloc(In ->nChannels * FUSED_PIXELS * nBytesIn));
+    cmsUInt8Number* InC  = (cmsUInt8Number*) chknull(malloc(In ->nSamples * FUSED_PIXELS * nBytesIn));
+    cmsUInt8Number* OutP = (cmsUInt8Number*) chknull(malloc(Out ->nChannels * FUSED_PIXELS * nBytesOut));
+    cmsUInt8Number* OutC = (cmsUInt8Number*) chknull(malloc(Out ->nSamples * FUSED_PIXELS * nBytesOut));
+    cmsHTRANSFORM xPlanar, xFused;
+    cmsUInt32Number i, c, seed = 3;
+    int rc = 1;
 
-    cmsHTRANSFORM xform = cmsCreateTransform(hAbove, TYPE_RGB_8, hsRGB, TYPE_RGB_DBL, INTENT_PERCEPTUAL, 0);
+    xPlanar = cmsCreateMultiprofileTransformTHR(DbgThread(), hProfiles, nProfiles, In ->Planar, Out ->Planar, INTENT_PERCEPTUAL, dwFlags);
+    xFused  = cmsCreateMultiprofileTransformTHR(DbgThread(), hProfiles, nProfiles, In ->Format, Out ->Format, INTENT_PERCEPTUAL, dwFlags);
 
-    cmsUInt8Number rgb8[3] = { 12, 253, 21 };
-    cmsFloat64Number rgbDBL[3] = { 0 };
+    if (xPlanar == NULL || xFused == NULL) return 0;
 
-    cmsCloseProfile(hAbove); cmsCloseProfile(hsRGB);
+    if (((_cmsTRANSFORM*) xPlanar) ->xform == ((_cmsTRANSFORM*) xFused) ->xform) {
+        Fail("Fused routine not selected");
+        rc = 0;
+    }
 
-    cmsDoTransform(xform, rgb8, rgbDBL, 1);
+    // Pairs of equal pixels, for the cache to hit
+    for (i=0; i < FUSED_PIXELS; i++) {
+        for (c=0; c < In ->nChannels; c++) {
 
-    
-    cmsDeleteTransform(xform);
+            cmsUInt8Number* Ptr = InP + (c * FUSED_PIXELS + i) * nBytesIn;
 
-    if (rgbDBL[0] < 0 && rgbDBL[2] < 0) return 1;
+            if (i & 1) {
+                memcpy(Ptr, Ptr - nBytesIn, nBytesIn);
+                continue;
+            }
 
-    Fail("Unbounded transforms with integer input failed");
+            seed = seed * 1103515245U + 12345U;
 
-    return 0;
+            if (nBytesIn == 4)
+                *(cmsFloat32Number*) Ptr = (cmsFloat32Number) (seed >> 8) / 16777216.0F;
+            else
+            if (nBytesIn == 2)
+                *(cmsUInt16Number*) Ptr = (cmsUInt16Number) (seed >> 16);
+            else
+                *Ptr = (cmsUInt8Number) (seed >> 16);
+        }
+    }
+
+    // Zero goes through the cache seed
+    for (c=0; c < In ->nChannels; c++)
+        memset(InP + c * FUSED_PIXELS * nBytesIn, 0, nBytesIn);
+
+    memset(InC, 0x55, In ->nSamples * FUSED_PIXELS * nBytesIn);
+    memset(OutC, 0, Out ->nSamples * FUSED_PIXELS * nBytesOut);
+    memset(OutP, 0, Out ->nChannels * FUSED_PIXELS * nBytesOut);
+
+    for (i=0; i < FUSED_PIXELS; i++)
+        for (c=0; c < In ->nChannels; c++)
+            memcpy(InC + (i * In ->nSamples + In ->Offset[c]) * nBytesIn, InP + (c * FUSED_PIXELS + i) * nBytesIn, nBytesIn);
+
+    cmsDoTransform(xPlanar, InP, OutP, FUSED_PIXELS);
+    cmsDoTransform(xFused, InC, OutC, FUSED_PIXELS);
+
+    for (i=0; rc && i < FUSED_PIXELS; i++) {
+        for (c=0; c < Out ->nChannels; c++) {
+
+            if (memcmp(OutC + (i * Out ->nSamples + Out ->Offset[c]) * nBytesOut, OutP + (c * FUSED_PIXELS + i) * nBytesOut, nBytesOut) != 0) {
+
+                Fail("Fused routine differs from formatters on pixel %u", i);
+                rc = 0;
+                break;
+            }
+        }
+    }
+
+    cmsDeleteTransform(xPlanar);
+    cmsDeleteTransform(xFused);
+    free(InP); free(InC); free(OutP); free(OutC);
+    return rc;
 }
 
 static
-int CheckSaveLinearizationDevicelink(void)
+int CheckFusedXforms(void)
 {
-    const cmsFloat32Number table[] = { 0, 0.5f, 1.0f };
-
-    cmsToneCurve* tone = cmsBuildTabulatedToneCurveFloat(NULL, 3, table);
-
-    cmsToneCurve* rgb_curves[3] = { tone, tone, tone };
+    static const FusedLayout Layouts[] = {
 
-    cmsHPROFILE hDeviceLink = cmsCreateLinearizationDeviceLink(cmsSigRgbData, rgb_curves);
+        { TYPE_RGB_8,  TYPE_RGB_8_PLANAR,  3, 3, { 0, 1, 2, 0 } },
+        { TYPE_RGBA_8, TYPE_RGB_8_PLANAR,  3, 4, { 0, 1, 2, 0 } },
+        { TYPE_BGRA_8, TYPE_RGB_8_PLANAR,  3, 4, { 2, 1, 0, 0 } },
+        { TYPE_CMYK_8, TYPE_CMYK_8_PLANAR, 4, 4, { 0, 1, 2, 3 } },
+        { TYPE_RGB_16, TYPE_RGB_16_PLANAR, 3, 3, { 0, 1, 2, 0 } }
+    };
 
-    cmsBool result;
-    cmsHTRANSFORM xform;
-    int i;
-    
-    cmsFreeToneCurve(tone);
+    static const FusedLayout RGBAFloat = { TYPE_RGBA_FLT, FLOAT_SH(1)|COLORSPACE_SH(PT_RGB)|CHANNELS_SH(3)|BYTES_SH(4)|PLANAR_SH(1), 3, 4, { 0, 1, 2, 0 } };
 
-    result = cmsSaveProfileToFile(hDeviceLink, "lin_rgb.icc");
+    cmsHPROFILE hsRGB  = cmsCreate_sRGBProfileTHR(DbgThread());
+    cmsHPROFILE hBCHSW = cmsCreateBCHSWabstractProfileTHR(DbgThread(), 17, 0, 1.2, 0, 3, 5000, 5000);
+    cmsHPROFILE hSWOP  = cmsOpenProfileFromFileTHR(DbgThread(), "test1.icc", "r");
+    cmsHPROFILE hFOGRA = cmsOpenProfileFromFileTHR(DbgThread(), "test2.icc", "r");
+    cmsHPROFILE hProfiles[3];
+    cmsHTRANSFORM xform, xformRef;
+    cmsUInt8Number In[3] = { 10, 120, 250 }, Out[3];
+    cmsUInt16Number In16[3], Out16[3];
+    cmsUInt32Number i, j, nProfiles;
+    int rc = 1;
 
-    cmsCloseProfile(hDeviceLink);
+    for (i=0; rc && i < sizeof(Layouts) / sizeof(Layouts[0]); i++) {
+        for (j=0; rc && j < sizeof(Layouts) / sizeof(Layouts[0]); j++) {
 
-    if (!result)
-    {
-        remove("lin_rgb.icc");
-        Fail("Couldn't save linearization devicelink");        
-    }
+            // Some abstract in between, or RGB to RGB would be a matrix-shaper
+            if (Layouts[i].nChannels == 3 && Layouts[j].nChannels == 3) {
 
+                hProfiles[0] = hsRGB; hProfiles[1] = hBCHSW; hProfiles[2] = hsRGB;
+                nProfiles = 3;
+            }
+            else {
 
-    hDeviceLink = cmsOpenProfileFromFile("lin_rgb.icc", "r");
+                hProfiles[0] = Layouts[i].nChannels == 3 ? hsRGB : hSWOP;
+                hProfiles[1] = Layouts[j].nChannels == 3 ? hsRGB : hFOGRA;
+                nProfiles = 2;
+            }
 
-    if (hDeviceLink == NULL)
-    {
-        remove("lin_rgb.icc");
-        Fail("Couldn't open devicelink");
+            if (!CheckOneFusedXform(hProfiles, nProfiles, Layouts + i, Layouts + j, 0) ||
+                !CheckOneFusedXform(hProfiles, nProfiles, Layouts + i, Layouts + j, cmsFLAGS_NOCACHE)) rc = 0;
+        }
     }
 
-    xform = cmsCreateTransform(hDeviceLink, TYPE_RGB_8, NULL, TYPE_RGB_8, INTENT_PERCEPTUAL, 0);
-    cmsCloseProfile(hDeviceLink);
+    hProfiles[0] = hsRGB; hProfiles[1] = hBCHSW; hProfiles[2] = hsRGB;
+    if (rc && !CheckOneFusedXform(hProfiles, 3, &RGBAFloat, &RGBAFloat, 0)) rc = 0;
 
-    for (i = 0; i < 256; i++)
-    {
-        cmsUInt8Number rgb_in[3] = { i, i, i };
-        cmsUInt8Number rgb_out[3];
+    // Changing the formats should not keep the routine of the old ones
+    xform    = cmsCreateMultiprofileTransformTHR(DbgThread(), hProfiles, 3, TYPE_RGB_16, TYPE_RGB_16, INTENT_PERCEPTUAL, 0);
+    xformRef = cmsCreateMultiprofileTransformTHR(DbgThread(), hProfiles, 3, TYPE_RGB_16, TYPE_RGB_16, INTENT_PERCEPTUAL, 0);
 
-        cmsDoTransform(xform, rgb_in, rgb_out, 1);
+    if (xform == NULL || xformRef == NULL || !cmsChangeBuffersFormat(xform, TYPE_RGB_8, TYPE_RGB_8)) rc = 0;
+    else {
 
-        if (rgb_in[0] != rgb_out[0] ||
-            rgb_in[1] != rgb_out[1] ||
-            rgb_in[2] != rgb_out[2])
-        {
-            remove("lin_rgb.icc");
-            Fail("Saved devicelink was not working");
+        for (i=0; i < 3; i++)
+            In16[i] = FROM_8_TO_16(In[i]);
+
+        cmsDoTransform(xform, In, Out, 1);
+        cmsDoTransform(xformRef, In16, Out16, 1);
+
+        for (i=0; i < 3; i++) {
+
+            if (Out[i] != FROM_16_TO_8(Out16[i])) {
+                Fail("Fused routine kept after changing formats");
+                rc = 0;
+                break;
+            }
         }
     }
 
+    if (xform != NULL) cmsDeleteTransform(xform);
+    if (xformRef != NULL) cmsDeleteTransform(xformRef);
 
-    cmsDeleteTransform(xform);
-    remove("lin_rgb.icc");
-
-    return 1;
+    cmsCloseProfile(hsRGB);
+    cmsCloseProfile(hBCHSW);
+    cmsCloseProfile(hSWOP);
+    cmsCloseProfile(hFOGRA);
+    return rc;
 }
 
+// Row routines against the generic routine of the same transform
 static
-int CheckGamutCheckFloats(void)
+int CheckOneRowXform(cmsHPROFILE hIn, cmsHPROFILE hOut, cmsUInt32Number InputFormat, cmsUInt32Number OutputFormat, cmsUInt32Number dwFlags)
 {
+    cmsUInt32Number InSize  = T_BYTES(InputFormat) * (T_CHANNELS(InputFormat) + T_EXTRA(InputFormat)) * FUSED_PIXELS;
+    cmsUInt32Number OutSize = T_BYTES(OutputFormat) * (T_CHANNELS(OutputFormat) + T_EXTRA(OutputFormat)) * FUSED_PIXELS;
+    cmsUInt8Number* In   = (cmsUInt8Number*) chknull(malloc(InSize));
+    cmsUInt8Number* Out  = (cmsUInt8Number*) chknull(malloc(OutSize));
+    cmsUInt8Number* Ref  = (cmsUInt8Number*) chknull(malloc(OutSize));
+    cmsHTRANSFORM xform;
+    _cmsTRANSFORM* p;
+    _cmsTransform2Fn Row;
+    cmsUInt32Number i, Seed = 7;
+    int rc = 1;
 
-    cmsUInt16Number alarms[16] = { 0x0f0f,3,4,5,6,7,8,9,10 };
-    
+    xform = cmsCreateTransformTHR(DbgThread(), hIn, InputFormat, hOut, OutputFormat, INTENT_PERCEPTUAL, dwFlags);
+    if (xform == NULL) return 0;
 
-    cmsHPROFILE hLab = cmsCreateLab4Profile(NULL);
-    cmsHPROFILE hNull = cmsCreateNULLProfile();
-    cmsHPROFILE hsRGB = cmsCreate_sRGBProfile();
+    p = (_cmsTRANSFORM*) xform;
+    Row = p ->xform;
 
-    cmsHTRANSFORM xfrm = cmsCreateProofingTransform(hLab,
-        TYPE_Lab_DBL, hNull, TYPE_GRAY_8, hsRGB,
-        INTENT_RELATIVE_COLORIMETRIC, INTENT_ABSOLUTE_COLORIMETRIC,
-        cmsFLAGS_GAMUTCHECK);
+    if (Row == p ->GenericXform) {
+        Fail("Row routine not selected");
+        rc = 0;
+    }
 
-    cmsCloseProfile(hLab);
-    cmsCloseProfile(hNull);
-    cmsCloseProfile(hsRGB);
+    for (i=0; i < InSize; i++) {
 
-    cmsCIELab Lab = { 50, -125, 125 };
-    cmsCIELab Lab2 = { 50, -10, 12 };
+        Seed = Seed * 1103515245U + 12345U;
+        In[i] = (cmsUInt8Number) (Seed >> 16);
+    }
 
-    cmsUInt8Number gamut;
+    // Floats should be in range, and pairs of equal pixels make the cache to hit
+    if (T_FLOAT(InputFormat)) {
 
-    cmsSetAlarmCodes(alarms);
+        for (i=0; i < InSize / 4; i++)
+            ((cmsFloat32Number*) In)[i] = (cmsFloat32Number) In[i * 4] / 255.0F;
+    }
+    else
+        memcpy(In + InSize / 2, In, InSize / 2);
 
-    cmsDoTransform(xfrm, &Lab, &gamut, 1);  // Gives the alarm != 0
-    if (gamut != 0x0f)
-        Fail("Gamut check not good");
+    memset(Out, 0x33, OutSize);
+    memset(Ref, 0x33, OutSize);
 
-    cmsDoTransform(xfrm, &Lab2, &gamut, 1);
-    if (gamut != 0)
-        Fail("Gamut check zero");
+    cmsDoTransform(xform, In, Out, FUSED_PIXELS);
 
-    cmsDeleteTransform(xfrm);
-    return 1;
+    p ->xform = p ->GenericXform;
+    cmsDoTransform(xform, In, Ref, FUSED_PIXELS);
+    p ->xform = Row;
+
+    if (rc && memcmp(Out, Ref, OutSize) != 0) {
+        Fail("Row routine differs from the generic one");
+        rc = 0;
+    }
+
+    cmsDeleteTransform(xform);
+    free(In); free(Out); free(Ref);
+    return rc;
 }
 
 static
-int CheckMixedRawAndCooked(void)
+int CheckRowXforms(void)
 {
-    const cmsUInt32Number data = cmsSigFilmScanner;
-    const cmsUInt32Number* pdata;
-    cmsBool is_ok = FALSE;
-
-    // This is the internal representation of cmsSigTechnologyTag tag type
-    struct _cooked_st
-    {
-        _cmsTagBase base;
-        cmsUInt32Number data;
-
-    } buffer = { { (cmsTagTypeSignature) cmsSigTechnologyTag, {0} }, cmsSigFilmScanner };
-
-    cmsHPROFILE hProfile = cmsCreateProfilePlaceholder(0);   
-    cmsWriteRawTag(hProfile, cmsSigTechnologyTag, &buffer, sizeof buffer);
-    cmsWriteTag(hProfile, cmsSigTechnologyTag, &data);
-    cmsWriteRawTag(hProfile, cmsSigTechnologyTag, &buffer, sizeof buffer);
-    cmsWriteRawTag(hProfile, cmsSigTechnologyTag, &buffer, sizeof buffer);
-    cmsWriteTag(hProfile, cmsSigTechnologyTag, &data);
-    cmsWriteTag(hProfile, cmsSigTechnologyTag, &data);
-    memset(&buffer, 0, sizeof(buffer));
-
-    cmsReadRawTag(hProfile, cmsSigTechnologyTag, &buffer, sizeof buffer );
-    pdata = cmsReadTag(hProfile, cmsSigTechnologyTag);
+    cmsHPROFILE hsRGB  = cmsCreate_sRGBProfileTHR(DbgThread());
+    cmsHPROFILE hSWOP  = cmsOpenProfileFromFileTHR(DbgThread(), "test1.icc", "r");
+    cmsHPROFILE hFOGRA = cmsOpenProfileFromFileTHR(DbgThread(), "test2.icc", "r");
+    int rc = 1;
 
-    is_ok = (*pdata == cmsSigFilmScanner) && (_cmsAdjustEndianess32(buffer.data) == cmsSigFilmScanner);
+    if (!CheckOneRowXform(hSWOP, hFOGRA, TYPE_CMYK_8_PLANAR, TYPE_KYMC_8, 0)) rc = 0;
+    if (!CheckOneRowXform(hsRGB, hSWOP, TYPE_ARGB_8, TYPE_CMYK_16_PLANAR, cmsFLAGS_NOCACHE)) rc = 0;
+    if (!CheckOneRowXform(hSWOP, hsRGB, TYPE_CMYK_16_SE, TYPE_BGR_8, 0)) rc = 0;
+    if (!CheckOneRowXform(hsRGB, hFOGRA, TYPE_RGB_FLT, TYPE_CMYK_FLT, 0)) rc = 0;
+    if (!CheckOneRowXform(hSWOP, hsRGB, TYPE_CMYK_FLT, TYPE_BGRA_8, cmsFLAGS_NOOPTIMIZE)) rc = 0;
 
-    cmsCloseProfile(hProfile);
-    return is_ok;
+    cmsCloseProfile(hsRGB);
+    cmsCloseProfile(hSWOP);
+    cmsCloseProfile(hFOGRA);
+    return rc;
 }
 
 // --------------------------------------------------------------------------------------------------
@@ -9179,6 +11255,149 @@ void SpeedTest16bitsCMYK(const char * Title, cmsHPROFILE hlcmsProfileIn, cmsHPRO
 }
 
 
+// Interpolation alone on a CMYK to CMYK CLUT, one pixel at time against the batch interpolator
+static
+void SpeedTestCMYKInterpolation(const char * Title, cmsHPROFILE hlcmsProfileIn, cmsHPROFILE hlcmsProfileOut)
+{
+    cmsInt32Number r, g, b, j;
+    clock_t atime;
+    cmsFloat64Number diff;
+    cmsHTRANSFORM hlcmsxform;
+    cmsStage* clut;
+    const cmsInterpParams* p;
+    Scanline_rgba16 *In, *Out;
+    cmsUInt32Number Mb;
+    char Txt[256];
+
+    if (hlcmsProfileIn == NULL || hlcmsProfileOut == NULL)
+        Die("Unable to open profiles");
+
+    hlcmsxform  = cmsCreateTransformTHR(DbgThread(), hlcmsProfileIn, TYPE_CMYK_16,
+        hlcmsProfileOut, TYPE_CMYK_16, INTENT_PERCEPTUAL,  cmsFLAGS_NOCACHE);
+    cmsCloseProfile(hlcmsProfileIn);
+    cmsCloseProfile(hlcmsProfileOut);
+
+    clut = cmsStageAllocCLut16bit(DbgThread(), 17, 4, 4, NULL);
+    cmsStageSampleCLut16bit(clut, SampleByTransform, hlcmsxform, 0);
+    cmsDeleteTransform(hlcmsxform);
+
+    p = ((_cmsStageCLutData*) cmsStageData(clut)) ->Params;
+
+    Mb = 256*256*256*sizeof(Scanline_rgba16);
+
+    In  = (Scanline_rgba16*) chknull(malloc(Mb));
+    Out = (Scanline_rgba16*) chknull(malloc(Mb));
+
+    j = 0;
+    for (r=0; r < 256; r++)
+        for (g=0; g < 256; g++)
+            for (b=0; b < 256; b++) {
+
+                In[j].r = (cmsUInt16Number) ((r << 8) | r);
+                In[j].g = (cmsUInt16Number) ((g << 8) | g);
+                In[j].b = (cmsUInt16Number) ((b << 8) | b);
+                In[j].a = (cmsUInt16Number) ((r ^ b) * 257);
+
+                j++;
+            }
+
+    sprintf(Txt, "%s, one pixel", Title);
+    TitlePerformance(Txt);
+
+    atime = clock();
+
+    for (j=0; j < 256*256*256; j++)
+        p ->Interpolation.Lerp16(&In[j].r, &Out[j].r, p);
+
+    diff = clock() - atime;
+    PrintPerformance(Mb, sizeof(Scanline_rgba16), diff);
+
+    sprintf(Txt, "%s, batch", Title);
+    TitlePerformance(Txt);
+
+    atime = clock();
+
+    p ->BatchInterpolation.Lerp16Batch(&In[0].r, &Out[0].r, 256*256*256, p);
+
+    diff = clock() - atime;
+    PrintPerformance(Mb, sizeof(Scanline_rgba16), diff);
+
+    free(In);
+    free(Out);
+    cmsStageFree(clut);
+}
+
+
+// Recursive against simplex interpolation on a 7-input CLUT, as found on hexachrome and 7-color proofing
+static
+cmsInt32Number SampleSeven(CMSREGISTER const cmsUInt16Number In[], CMSREGISTER cmsUInt16Number Out[], CMSREGISTER void* Cargo)
+{
+    cmsUInt32Number i;
+
+    for (i=0; i < 4; i++)
+        Out[i] = (cmsUInt16Number) ((In[i] + In[i+1] + In[i+2] + In[i+3]) / 4);
+
+    cmsUNUSED_PARAMETER(Cargo);
+    return 1;
+}
+
+static
+void SpeedTestSimplexInterpolation(const char * Title)
+{
+    cmsUInt32Number j, Seed = 1;
+    clock_t atime;
+    cmsFloat64Number diff;
+    cmsStage* clut;
+    const cmsInterpParams* p;
+    cmsInterpFunction Simplex;
+    cmsUInt16Number *In, Out[4];
+    cmsUInt32Number nPixels = 1024*1024;
+    char Txt[256];
+
+    clut = cmsStageAllocCLut16bit(DbgThread(), 7, 7, 4, NULL);
+    if (clut == NULL)
+        Die("Unable to allocate CLUT");
+
+    cmsStageSampleCLut16bit(clut, SampleSeven, NULL, 0);
+
+    p = ((_cmsStageCLutData*) cmsStageData(clut)) ->Params;
+    Simplex = _cmsSimplexInterpolatorsFactory(7, 4, 0);
+
+    In = (cmsUInt16Number*) chknull(malloc(nPixels * 7 * sizeof(cmsUInt16Number)));
+
+    for (j=0; j < nPixels * 7; j++) {
+
+        Seed = Seed * 1103515245U + 12345U;
+        In[j] = (cmsUInt16Number) (Seed >> 8);
+    }
+
+    sprintf(Txt, "%s, recursive", Title);
+    TitlePerformance(Txt);
+
+    atime = clock();
+
+    for (j=0; j < nPixels; j++)
+        p ->Interpolation.Lerp16(In + j*7, Out, p);
+
+    diff = clock() - atime;
+    PrintPerformance(nPixels * 7 * sizeof(cmsUInt16Number), 7 * sizeof(cmsUInt16Number), diff);
+
+    sprintf(Txt, "%s, simplex", Title);
+    TitlePerformance(Txt);
+
+    atime = clock();
+
+    for (j=0; j < nPixels; j++)
+        Simplex.Lerp16(In + j*7, Out, p);
+
+    diff = clock() - atime;
+    PrintPerformance(nPixels * 7 * sizeof(cmsUInt16Number), 7 * sizeof(cmsUInt16Number), diff);
+
+    free(In);
+    cmsStageFree(clut);
+}
+
+
 static
 void SpeedTest8bits(const char * Title, cmsHPROFILE hlcmsProfileIn, cmsHPROFILE hlcmsProfileOut, cmsInt32Number Intent)
 {
@@ -9230,6 +11449,80 @@ void SpeedTest8bits(const char * Title, cmsHPROFILE hlcmsProfileIn, cmsHPROFILE
 }
 
 
+// Specialized routines, fused or scanline, against the generic one the flags would pick, on the same buffers
+static
+void SpeedTestSpecialized(const char * Title, const char* Routine, cmsHPROFILE hlcmsProfileIn, cmsHPROFILE hlcmsProfileOut,
+                          cmsUInt32Number InputFormat, cmsUInt32Number OutputFormat, cmsUInt32Number dwFlags)
+{
+    cmsUInt32Number nPixels = 256*256*256;
+    cmsUInt32Number InSize  = T_BYTES(InputFormat) * (T_CHANNELS(InputFormat) + T_EXTRA(InputFormat));
+    cmsUInt32Number OutSize = T_BYTES(OutputFormat) * (T_CHANNELS(OutputFormat) + T_EXTRA(OutputFormat));
+    cmsUInt32Number j, Seed = 1;
+    clock_t atime;
+    cmsFloat64Number diff;
+    cmsHTRANSFORM hlcmsxform;
+    _cmsTRANSFORM* p;
+    _cmsTransform2Fn Specialized;
+    cmsUInt8Number* In;
+    cmsUInt8Number* Out;
+    char Txt[256];
+
+    if (hlcmsProfileIn == NULL || hlcmsProfileOut == NULL)
+        Die("Unable to open profiles");
+
+    hlcmsxform = cmsCreateTransformTHR(DbgThread(), hlcmsProfileIn, InputFormat, hlcmsProfileOut, OutputFormat, INTENT_PERCEPTUAL, dwFlags);
+    cmsCloseProfile(hlcmsProfileIn);
+    cmsCloseProfile(hlcmsProfileOut);
+
+    p = (_cmsTRANSFORM*) hlcmsxform;
+    Specialized = p ->xform;
+
+    In  = (cmsUInt8Number*) chknull(malloc(nPixels * InSize));
+    Out = (cmsUInt8Number*) chknull(malloc(nPixels * OutSize));
+
+    for (j=0; j < nPixels * InSize; j++) {
+
+        Seed = Seed * 1103515245U + 12345U;
+        In[j] = (cmsUInt8Number) (Seed >> 16);
+    }
+
+    // Floats should be in range
+    if (T_FLOAT(InputFormat)) {
+
+        for (j=0; j < nPixels * InSize / 4; j++)
+            ((cmsFloat32Number*) In)[j] = (cmsFloat32Number) In[j * 4] / 255.0F;
+    }
+
+    // Touch the output, so page faults don't go into the first timing
+    memset(Out, 0, nPixels * OutSize);
+
+    sprintf(Txt, "%s, %s", Title, Routine);
+    TitlePerformance(Txt);
+
+    atime = clock();
+    cmsDoTransform(hlcmsxform, In, Out, nPixels);
+    diff = clock() - atime;
+
+    PrintPerformance(nPixels * InSize, InSize, diff);
+
+    sprintf(Txt, "%s, generic", Title);
+    TitlePerformance(Txt);
+
+    p ->xform = p ->GenericXform;
+
+    atime = clock();
+    cmsDoTransform(hlcmsxform, In, Out, nPixels);
+    diff = clock() - atime;
+
+    PrintPerformance(nPixels * InSize, InSize, diff);
+
+    p ->xform = Specialized;
+
+    free(In);
+    free(Out);
+    cmsDeleteTransform(hlcmsxform);
+}
+
 static
 void SpeedTest8bitsCMYK(const char * Title, cmsHPROFILE hlcmsProfileIn, cmsHPROFILE hlcmsProfileOut)
 {
@@ -9520,6 +11813,49 @@ void SpeedTest(void)
 
     // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
+    SpeedTestSpecialized("8 bits on Matrix-Shaper profiles", "scanline",
+        cmsOpenProfileFromFile("test5.icc", "r"),
+        cmsOpenProfileFromFile("aRGBlcms2.icc", "r"),
+        TYPE_RGBA_8, TYPE_RGBA_8, cmsFLAGS_NOCACHE|cmsFLAGS_MATSHAPER16);
+
+    SpeedTestSpecialized("16 bits on Matrix-Shaper profiles", "scanline",
+        cmsOpenProfileFromFile("test5.icc", "r"),
+        cmsOpenProfileFromFile("aRGBlcms2.icc", "r"),
+        TYPE_RGBA_16, TYPE_RGBA_16, cmsFLAGS_NOCACHE|cmsFLAGS_MATSHAPER16);
+
+    printf("\n");
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+    SpeedTestSpecialized("8 bits RGBA to CMYK", "fused",
+        cmsOpenProfileFromFile("test5.icc", "r"),
+        cmsOpenProfileFromFile("test1.icc", "r"),
+        TYPE_RGBA_8, TYPE_CMYK_8, 0);
+
+    SpeedTestSpecialized("8 bits CMYK to BGRA", "fused",
+        cmsOpenProfileFromFile("test1.icc", "r"),
+        cmsOpenProfileFromFile("test5.icc", "r"),
+        TYPE_CMYK_8, TYPE_BGRA_8, cmsFLAGS_NOCACHE);
+
+    SpeedTestSpecialized("8 bits CMYK to CMYK", "fused",
+        cmsOpenProfileFromFile("test1.icc", "r"),
+        cmsOpenProfileFromFile("test2.icc", "r"),
+        TYPE_CMYK_8, TYPE_CMYK_8, 0);
+
+    SpeedTestSpecialized("16 bits RGB to CMYK", "fused",
+        cmsOpenProfileFromFile("test5.icc", "r"),
+        cmsOpenProfileFromFile("test1.icc", "r"),
+        TYPE_RGB_16, TYPE_CMYK_8, cmsFLAGS_NOCACHE);
+
+    SpeedTestSpecialized("32 bits RGBA, not optimized", "fused",
+        cmsOpenProfileFromFile("test5.icc", "r"),
+        cmsOpenProfileFromFile("test5.icc", "r"),
+        TYPE_RGBA_FLT, TYPE_RGBA_FLT, cmsFLAGS_NOOPTIMIZE);
+
+    printf("\n");
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
     SpeedTest8bits("8 bits on curves",
         CreateCurves(),
         CreateCurves(),
@@ -9551,6 +11887,12 @@ void SpeedTest(void)
         cmsOpenProfileFromFile("test1.icc", "r"),
         cmsOpenProfileFromFile("test2.icc", "r"));
 
+    SpeedTestCMYKInterpolation("16 bits CMYK interpolation",
+        cmsOpenProfileFromFile("test1.icc", "r"),
+        cmsOpenProfileFromFile("test2.icc", "r"));
+
+    SpeedTestSimplexInterpolation("16 bits 7 channels interpolation");
+
     printf("\n");
 
     // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -9788,6 +12130,7 @@ int main(int argc, char* argv[])
 #ifndef CMS_NO_HALF_SUPPORT 
     Check("HALF formatters", CheckFormattersHalf);
 #endif
+    Check("Row formatters", CheckRowFormatters);
     // ChangeBuffersFormat
     Check("ChangeBuffersFormat", CheckChangeBufferFormat);
 
@@ -9863,6 +12206,13 @@ int main(int argc, char* argv[])
     Check("Check MetaTag", CheckMeta);
     Check("Null transform on floats", CheckFloatNULLxform);
     Check("Set free a tag", CheckRemoveTag);
+    Check("Tag directory", CheckTagDirectory);
+    Check("Mapped and borrowed profiles", CheckMappedProfiles);
+    Check("Cooked tag cache", CheckCookedTags);
+    Check("Read all tags", CheckReadAllTags);
+    Check("Shared profiles", CheckSharedProfiles);
+    Check("Arena transforms", CheckArenaTransforms);
+    Check("Memory accounting", CheckMemoryStats);
     Check("Matrix simplification", CheckMatrixSimplify);
     Check("Planar 8 optimization", CheckPlanar8opt);
     Check("Planar float to int16", CheckPlanarFloat2int);
@@ -9882,6 +12232,19 @@ int main(int argc, char* argv[])
     Check("Saving linearization devicelink", CheckSaveLinearizationDevicelink);
     Check("Gamut check on floats", CheckGamutCheckFloats);
     Check("Mixing RAW and Cooked tags", CheckMixedRawAndCooked);
+    Check("Multi-entry transform cache", CheckMultiCache);
+    Check("Transforms on scratch memory", CheckScratchTransform);
+    Check("Transform cache", CheckTransformCache);
+    Check("Lazy CLUT population", CheckLazyPrecalc);
+    Check("Transform blobs", CheckTransformBlob);
+    Check("Batched pipeline evaluation", CheckPipelineBatch);
+    Check("Batch interpolation", CheckBatchInterpolation);
+    Check("Batch interpolation on CMYK", CheckBatchInterpCMYK);
+    Check("CPU features dispatch", CheckCPUFeatures);
+    Check("Matrix-shaper scanline routines", CheckMatShaperScanline);
+    Check("Matrix-shaper 16 bits accuracy", CheckMatShaper16Accuracy);
+    Check("Fused transform routines", CheckFusedXforms);
+    Check("Row transform routines", CheckRowXforms);
     }
 
     if (DoPluginTests)
@@ -9893,14 +12256,17 @@ int main(int argc, char* argv[])
         Check("Adaptation state context", CheckAdaptationStateContext);
         Check("1D interpolation plugin", CheckInterp1DPlugin); 
         Check("3D interpolation plugin", CheckInterp3DPlugin); 
+        Check("Simplex interpolation plugin", CheckSimplexInterpPlugin);
         Check("Parametric curve plugin", CheckParametricCurvePlugin);        
         Check("Formatters plugin",       CheckFormattersPlugin);        
+        Check("Row formatters plugin",   CheckFormattersRowPlugin);
         Check("Tag type plugin",         CheckTagTypePlugin);
         Check("MPE type plugin",         CheckMPEPlugin);       
         Check("Optimization plugin",     CheckOptimizationPlugin); 
         Check("Rendering intent plugin", CheckIntentPlugin);
         Check("Full transform plugin",   CheckTransformPlugin);
         Check("Mutex plugin",            CheckMutexPlugin);
+        Check("Parallel sampling plugin", CheckParallelSamplingPlugin);
         Check("Double from float",       CheckMethodPackDoublesFromFloat);       
     }
 
@@ -73,14 +73,17 @@ cmsInt32Number CheckAlarmColorsContext(void);
 cmsInt32Number CheckAdaptationStateContext(void);
 cmsInt32Number CheckInterp1DPlugin(void);
 cmsInt32Number CheckInterp3DPlugin(void);
+cmsInt32Number CheckSimplexInterpPlugin(void);
 cmsInt32Number CheckParametricCurvePlugin(void);
 cmsInt32Number CheckFormattersPlugin(void);
+cmsInt32Number CheckFormattersRowPlugin(void);
 cmsInt32Number CheckTagTypePlugin(void);
 cmsInt32Number CheckMPEPlugin(void);
 cmsInt32Number CheckOptimizationPlugin(void);
 cmsInt32Number CheckIntentPlugin(void);
 cmsInt32Number CheckTransformPlugin(void);
 cmsInt32Number CheckMutexPlugin(void);
+cmsInt32Number CheckParallelSamplingPlugin(void);
 cmsInt32Number CheckMethodPackDoublesFromFloat(void);
 
 
@@ -430,6 +430,154 @@ Error:
 
 }
 
+// Simplex interpolation, installed through the interpolation plug-in. Tables are sampled from a linear
+// function, which any of the interpolators should reproduce up to rounding.
+static
+cmsInterpFunction my_Simplex_Factory(cmsUInt32Number nInputChannels,
+                                     cmsUInt32Number nOutputChannels,
+                                     cmsUInt32Number dwFlags)
+{
+    return _cmsSimplexInterpolatorsFactory(nInputChannels, nOutputChannels, dwFlags);
+}
+
+static
+cmsPluginInterpolation SimplexPluginSample = {
+
+    { cmsPluginMagicNumber, 2060, cmsPluginInterpolationSig, NULL },
+    my_Simplex_Factory
+};
+
+static
+cmsFloat64Number LinearCombination(const cmsFloat64Number In[], cmsUInt32Number nIn, cmsUInt32Number Chan)
+{
+    cmsFloat64Number Sum = 0, Total = 0;
+    cmsUInt32Number i;
+
+    for (i=0; i < nIn; i++) {
+
+        cmsFloat64Number w = (cmsFloat64Number) ((i + Chan) % nIn + 1);
+
+        Sum   += In[i] * w;
+        Total += w;
+    }
+
+    return Sum / Total;
+}
+
+static
+cmsInt32Number SampleLinear16(CMSREGISTER const cmsUInt16Number In[], CMSREGISTER cmsUInt16Number Out[], CMSREGISTER void* Cargo)
+{
+    cmsUInt32Number nIn = *(cmsUInt32Number*) Cargo;
+    cmsFloat64Number v[MAX_INPUT_DIMENSIONS];
+    cmsUInt32Number i;
+
+    for (i=0; i < nIn; i++) v[i] = In[i];
+    for (i=0; i < 3; i++)
+        Out[i] = _cmsQuickSaturateWord(LinearCombination(v, nIn, i));
+
+    return 1;
+}
+
+static
+cmsInt32Number SampleLinearFloat(CMSREGISTER const cmsFloat32Number In[], CMSREGISTER cmsFloat32Number Out[], CMSREGISTER void* Cargo)
+{
+    cmsUInt32Number nIn = *(cmsUInt32Number*) Cargo;
+    cmsFloat64Number v[MAX_INPUT_DIMENSIONS];
+    cmsUInt32Number i;
+
+    for (i=0; i < nIn; i++) v[i] = In[i];
+    for (i=0; i < 3; i++)
+        Out[i] = (cmsFloat32Number) LinearCombination(v, nIn, i);
+
+    return 1;
+}
+
+static
+cmsInt32Number CheckSimplexOnInputs(cmsContext ctx, cmsUInt32Number nIn, cmsUInt32Number nGridPoints)
+{
+    cmsStage *clut16, *clutFloat, *clutDefault;
+    const cmsInterpParams *p16, *pFloat, *pDefault;
+    cmsUInt16Number In16[MAX_INPUT_DIMENSIONS], Out16[3];
+    cmsFloat32Number InFloat[MAX_INPUT_DIMENSIONS], OutFloat[3];
+    cmsFloat64Number v[MAX_INPUT_DIMENSIONS];
+    cmsUInt32Number i, j, Seed = 1;
+    cmsInt32Number rc = 0;
+
+    clut16      = cmsStageAllocCLut16bit(ctx, nGridPoints, nIn, 3, NULL);
+    clutFloat   = cmsStageAllocCLutFloat(ctx, nGridPoints, nIn, 3, NULL);
+    clutDefault = cmsStageAllocCLut16bit(NULL, nGridPoints, nIn, 3, NULL);
+
+    if (clut16 == NULL || clutFloat == NULL || clutDefault == NULL) {
+        Fail("Cannot allocate %u-input CLUT", nIn);
+        goto Error;
+    }
+
+    cmsStageSampleCLut16bit(clut16, SampleLinear16, &nIn, 0);
+    cmsStageSampleCLutFloat(clutFloat, SampleLinearFloat, &nIn, 0);
+
+    p16      = ((_cmsStageCLutData*) cmsStageData(clut16)) ->Params;
+    pFloat   = ((_cmsStageCLutData*) cmsStageData(clutFloat)) ->Params;
+    pDefault = ((_cmsStageCLutData*) cmsStageData(clutDefault)) ->Params;
+
+    // The plug-in should have taken over
+    if (p16 ->Interpolation.Lerp16 == pDefault ->Interpolation.Lerp16) {
+        Fail("Simplex interpolator not selected on %u inputs", nIn);
+        goto Error;
+    }
+
+    for (j=0; j < 2000; j++) {
+
+        for (i=0; i < nIn; i++) {
+
+            // Some samples on the nodes and on the upper edge, the rest anywhere
+            Seed = Seed * 1103515245U + 12345U;
+            In16[i] = (j & 3) == 0 ? (cmsUInt16Number) (((Seed >> 16) % nGridPoints) * 0xFFFF / (nGridPoints - 1)) :
+                                     (cmsUInt16Number) (Seed >> 8);
+
+            InFloat[i] = In16[i] / 65535.0F;
+            v[i] = In16[i];
+        }
+
+        p16 ->Interpolation.Lerp16(In16, Out16, p16);
+        pFloat ->Interpolation.LerpFloat(InFloat, OutFloat, pFloat);
+
+        for (i=0; i < 3; i++) {
+
+            if (!IsGoodWordPrec("Simplex 16 bits", _cmsQuickSaturateWord(LinearCombination(v, nIn, i)), Out16[i], 2)) goto Error;
+            if (!IsGoodVal("Simplex float", LinearCombination(v, nIn, i) / 65535.0, OutFloat[i], 1E-5)) goto Error;
+        }
+    }
+
+    rc = 1;
+
+Error:
+    if (clut16 != NULL) cmsStageFree(clut16);
+    if (clutFloat != NULL) cmsStageFree(clutFloat);
+    if (clutDefault != NULL) cmsStageFree(clutDefault);
+    return rc;
+}
+
+cmsInt32Number CheckSimplexInterpPlugin(void)
+{
+    cmsContext ctx = WatchDogContext(NULL);
+    cmsInt32Number rc;
+
+    if (ctx == NULL) {
+        Fail("Cannot create context");
+        return 0;
+    }
+
+    cmsPluginTHR(ctx, &SimplexPluginSample);
+
+    rc = CheckSimplexOnInputs(ctx, 5, 5) &&
+         CheckSimplexOnInputs(ctx, 6, 4) &&
+         CheckSimplexOnInputs(ctx, 8, 3) &&
+         CheckSimplexOnInputs(ctx, 15, 2);
+
+    cmsDeleteContext(ctx);
+    return rc;
+}
+
 // --------------------------------------------------------------------------------------------------
 // Parametric curve plugin check: sin(x)/cos(x) function will be used to test the functionality. 
 // --------------------------------------------------------------------------------------------------
@@ -755,6 +903,195 @@ cmsInt32Number CheckFormattersPlugin(void)
     return 1;
 }
 
+// --------------------------------------------------------------------------------------------------
+// Row formatters plugin check: 5-6-5 RGB by runs of pixels, and a replacement for RGB 8 bits
+// --------------------------------------------------------------------------------------------------
+
+static cmsUInt32Number RowPixels;
+
+static
+cmsUInt8Number* my_UnrollRow565(struct _cmstransform_struct* CMMcargo,
+                                 cmsUInt16Number Planes[],
+                                 cmsUInt32Number PlaneStride,
+                                 cmsUInt8Number* Buffer,
+                                 cmsUInt32Number nPixels,
+                                 cmsUInt32Number Stride)
+{
+    cmsUInt16Number wIn[cmsMAXCHANNELS];
+    cmsUInt32Number i, c;
+
+    for (i=0; i < nPixels; i++) {
+
+        Buffer = my_Unroll565(CMMcargo, wIn, Buffer, Stride);
+        for (c=0; c < 3; c++)
+            Planes[c * PlaneStride + i] = wIn[c];
+    }
+
+    RowPixels += nPixels;
+    return Buffer;
+}
+
+static
+cmsUInt8Number* my_PackRow565(struct _cmstransform_struct* CMMcargo,
+                              cmsUInt16Number Planes[],
+                              cmsUInt32Number PlaneStride,
+                              cmsUInt8Number* Buffer,
+                              cmsUInt32Number nPixels,
+                              cmsUInt32Number Stride)
+{
+    cmsUInt16Number wOut[cmsMAXCHANNELS];
+    cmsUInt32Number i, c;
+
+    for (i=0; i < nPixels; i++) {
+
+        for (c=0; c < 3; c++)
+            wOut[c] = Planes[c * PlaneStride + i];
+        Buffer = my_Pack565(CMMcargo, wOut, Buffer, Stride);
+    }
+
+    RowPixels += nPixels;
+    return Buffer;
+}
+
+static
+cmsUInt8Number* my_UnrollRowRGB8(struct _cmstransform_struct* CMMcargo,
+                                 cmsUInt16Number Planes[],
+                                 cmsUInt32Number PlaneStride,
+                                 cmsUInt8Number* Buffer,
+                                 cmsUInt32Number nPixels,
+                                 cmsUInt32Number Stride)
+{
+    cmsUInt32Number i;
+
+    for (i=0; i < nPixels; i++) {
+
+        Planes[i]                   = FROM_8_TO_16(Buffer[0]);
+        Planes[PlaneStride + i]     = FROM_8_TO_16(Buffer[1]);
+        Planes[2 * PlaneStride + i] = FROM_8_TO_16(Buffer[2]);
+        Buffer += 3;
+    }
+
+    RowPixels += nPixels;
+    return Buffer;
+
+    cmsUNUSED_PARAMETER(CMMcargo);
+    cmsUNUSED_PARAMETER(Stride);
+}
+
+static
+cmsFormatterRow my_FormatterRowFactory(cmsUInt32Number Type,
+                                       cmsFormatterDirection Dir,
+                                       cmsUInt32Number dwFlags)
+{
+    cmsFormatterRow Result = { NULL };
+
+    if (dwFlags & CMS_PACK_FLAGS_FLOAT) return Result;
+
+    if (Type == TYPE_RGB_565)
+        Result.Row16 = (Dir == cmsFormatterInput) ? my_UnrollRow565 : my_PackRow565;
+    else
+    if (Type == TYPE_RGB_8 && Dir == cmsFormatterInput)
+        Result.Row16 = my_UnrollRowRGB8;
+
+    return Result;
+}
+
+static
+cmsPluginFormattersRow FormattersRowPluginSample = { {cmsPluginMagicNumber,
+                                2060,
+                                cmsPluginFormattersRowSig,
+                                NULL},
+                                my_FormatterRowFactory };
+
+static
+cmsHTRANSFORM CreateRowPluginXform(cmsContext ContextID, cmsUInt32Number InputFormat, cmsUInt32Number OutputFormat)
+{
+    cmsCIExyYTRIPLE Primaries = { {0.64, 0.33, 1.0}, {0.30, 0.60, 1.0}, {0.15, 0.06, 1.0} };
+    cmsToneCurve* Gamma22 = cmsBuildGamma(ContextID, 2.2);
+    cmsToneCurve* Curves[3];
+    cmsHPROFILE hIn, hOut;
+    cmsHTRANSFORM xform;
+
+    Curves[0] = Curves[1] = Curves[2] = Gamma22;
+
+    hIn  = cmsCreate_sRGBProfileTHR(ContextID);
+    hOut = cmsCreateRGBProfileTHR(ContextID, cmsD50_xyY(), &Primaries, Curves);
+
+    xform = cmsCreateTransformTHR(ContextID, hIn, InputFormat, hOut, OutputFormat, INTENT_PERCEPTUAL, 0);
+
+    cmsCloseProfile(hIn);
+    cmsCloseProfile(hOut);
+    cmsFreeToneCurve(Gamma22);
+    return xform;
+}
+
+// Same transform on a context with the row formatters and on another without
+static
+cmsInt32Number CheckOneRowPluginXform(cmsContext WithRows, cmsContext NoRows, cmsUInt32Number InputFormat, cmsUInt32Number OutputFormat,
+                                      const void* In, cmsUInt32Number nPixels, int Tolerance)
+{
+    cmsUInt16Number Out[256 * 3], Ref[256 * 3];
+    cmsHTRANSFORM xform;
+    cmsUInt32Number i, nWords = nPixels * (OutputFormat == TYPE_RGB_565 ? 1 : 3);
+
+    memset(Out, 0, sizeof(Out));
+    memset(Ref, 0, sizeof(Ref));
+
+    xform = CreateRowPluginXform(NoRows, InputFormat, OutputFormat);
+    if (xform == NULL) return 0;
+    cmsDoTransform(xform, In, Ref, nPixels);
+    cmsDeleteTransform(xform);
+
+    xform = CreateRowPluginXform(WithRows, InputFormat, OutputFormat);
+    if (xform == NULL) return 0;
+
+    RowPixels = 0;
+    cmsDoTransform(xform, In, Out, nPixels);
+    cmsDeleteTransform(xform);
+
+    // The row formatters have to be used, even when a built-in routine could handle the formats
+    if (RowPixels < nPixels) return 0;
+
+    for (i=0; i < nWords; i++)
+        if (abs((int) Out[i] - (int) Ref[i]) > Tolerance) return 0;
+
+    return 1;
+}
+
+cmsInt32Number CheckFormattersRowPlugin(void)
+{
+    cmsContext ctx = WatchDogContext(NULL);
+    cmsContext cpy;
+    cmsUInt16Number stream565[256];
+    cmsUInt8Number  streamRGB[256 * 3];
+    cmsUInt32Number i;
+    cmsInt32Number rc = 1;
+
+    for (i=0; i < 256; i++)
+        stream565[i] = (cmsUInt16Number) (i * 257);
+
+    for (i=0; i < 256 * 3; i++)
+        streamRGB[i] = (cmsUInt8Number) ((i * 7) & 0xFF);
+
+    cmsPluginTHR(ctx, &FormattersPluginSample);
+    cmsPluginTHR(ctx, &FormattersPluginSample2);
+
+    cpy = DupContext(ctx, NULL);
+    cmsPluginTHR(cpy, &FormattersRowPluginSample);
+
+    if (!CheckOneRowPluginXform(cpy, ctx, TYPE_RGB_565, TYPE_RGB_565, stream565, 256, 0)) rc = 0;
+    if (!CheckOneRowPluginXform(cpy, ctx, TYPE_RGB_8, TYPE_RGB_16, streamRGB, 256, 0x200)) rc = 0;
+
+    // Once unregistered, the 5-6-5 format has no row formatter anymore
+    cmsUnregisterPluginsTHR(cpy);
+    if (_cmsGetRowFormatter(cpy, TYPE_RGB_565, cmsFormatterInput, CMS_PACK_FLAGS_16BITS).Row16 != NULL) rc = 0;
+
+    cmsDeleteContext(ctx);
+    cmsDeleteContext(cpy);
+
+    return rc;
+}
+
 // --------------------------------------------------------------------------------------------------
 // TagTypePlugin plugin check
 // --------------------------------------------------------------------------------------------------
@@ -1508,6 +1845,87 @@ cmsInt32Number CheckMutexPlugin(void)
 }
 
 
+// A parallelization plug-in that runs tasks backwards, to check results do not depend on the order
+static cmsUInt32Number TasksRun;
+
+static
+void MySerialScheduler(struct _cmstransform_struct* CMMcargo,
+                       const void* InputBuffer,
+                       void* OutputBuffer,
+                       cmsUInt32Number PixelsPerLine,
+                       cmsUInt32Number LineCount,
+                       const cmsStride* Stride)
+{
+    _cmsGetTransformWorker(CMMcargo)(CMMcargo, InputBuffer, OutputBuffer, PixelsPerLine, LineCount, Stride);
+}
+
+static
+void MyBackwardsTasks(cmsContext ContextID, cmsInt32Number MaxWorkers, _cmsTaskFn Fn, void* Cargo, cmsUInt32Number nTasks)
+{
+    while (nTasks > 0) {
+
+        Fn(Cargo, --nTasks);
+        TasksRun++;
+    }
+
+    cmsUNUSED_PARAMETER(ContextID);
+    cmsUNUSED_PARAMETER(MaxWorkers);
+}
+
+static cmsPluginParalellization ParallelPluginSample = {
+
+     { cmsPluginMagicNumber, 2190, cmsPluginParalellizationSig, NULL },
+
+     2, 0, MySerialScheduler, NULL, MyBackwardsTasks
+};
+
+
+cmsInt32Number CheckParallelSamplingPlugin(void)
+{
+    cmsContext ctx = WatchDogContext(NULL);
+    cmsContext cpy;
+    cmsHPROFILE hIn, hOut;
+    cmsHTRANSFORM xform, xformRef;
+    cmsUInt16Number In[1000 * 4], Out[1000 * 4], OutRef[1000 * 4];
+    cmsUInt32Number i, seed = 1;
+    int rc;
+
+    cpy = DupContext(ctx, NULL);
+    cmsPluginTHR(cpy, &ParallelPluginSample);
+
+    for (i = 0; i < 1000 * 4; i++) {
+
+        seed = seed * 1103515245U + 12345U;
+        In[i] = (cmsUInt16Number) (seed >> 16);
+    }
+
+    hIn  = cmsOpenProfileFromFileTHR(ctx, "test1.icc", "r");
+    hOut = cmsOpenProfileFromFileTHR(ctx, "test2.icc", "r");
+    xformRef = cmsCreateTransformTHR(ctx, hIn, TYPE_CMYK_16, hOut, TYPE_CMYK_16, INTENT_PERCEPTUAL, cmsFLAGS_HIGHRESPRECALC);
+    cmsCloseProfile(hIn); cmsCloseProfile(hOut);
+
+    TasksRun = 0;
+
+    hIn  = cmsOpenProfileFromFileTHR(cpy, "test1.icc", "r");
+    hOut = cmsOpenProfileFromFileTHR(cpy, "test2.icc", "r");
+    xform = cmsCreateTransformTHR(cpy, hIn, TYPE_CMYK_16, hOut, TYPE_CMYK_16, INTENT_PERCEPTUAL, cmsFLAGS_HIGHRESPRECALC);
+    cmsCloseProfile(hIn); cmsCloseProfile(hOut);
+
+    cmsDoTransform(xformRef, In, OutRef, 1000);
+    cmsDoTransform(xform, In, Out, 1000);
+
+    // Sampling out of order should give the very same CLUT
+    rc = (TasksRun > 1) && memcmp(Out, OutRef, sizeof(Out)) == 0;
+
+    cmsDeleteTransform(xform);
+    cmsDeleteTransform(xformRef);
+    cmsDeleteContext(cpy);
+    cmsDeleteContext(ctx);
+
+    return rc;
+}
+
+
 cmsInt32Number CheckMethodPackDoublesFromFloat(void)
 {
 